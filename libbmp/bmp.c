@@ -0,0 +1,145 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Transport-independent layer: request splitting and the pipeline.
+ *
+ * A queued operation goes on the wire at once and its reply is read
+ * back later, in issue order, by bmp_drain().  The backends only
+ * issue and collect single bounded requests; everything about depth,
+ * splitting and error accumulation lives here.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bmp_priv.h"
+
+bmp *bmp_new(const struct bmp_ops *ops)
+{
+	bmp *b = calloc(1, sizeof(*b));
+
+	if (!b)
+		return NULL;
+	b->ops = ops;
+	b->fd = -1;
+	b->max_inflight = 1;
+	return b;
+}
+
+void bmp_close(bmp *b)
+{
+	if (!b)
+		return;
+	bmp_drain(b);
+	b->ops->close(b);
+	free(b->pktbuf);
+	free(b->txbuf);
+	free(b);
+}
+
+int bmp_drain(bmp *b)
+{
+	int err = b->pend_error;
+
+	for (unsigned i = 0; i < b->pend_count; i++)
+		if (b->ops->collect(b, &b->pend[i]) < 0)
+			err = -1;
+	b->pend_count = 0;
+	b->pend_error = 0;
+	return err;
+}
+
+static int bmp_queue(bmp *b, enum bmp_op op, uint32_t addr,
+		     void *dest, const void *src, size_t len)
+{
+	while (len) {
+		size_t chunk = len > b->max_data ? b->max_data : len;
+		struct bmp_pending *p;
+
+		if (b->pend_count >= b->max_inflight)
+			if (bmp_drain(b) < 0)
+				b->pend_error = -1;
+
+		p = &b->pend[b->pend_count];
+		p->op = op;
+		p->dest = dest;
+		p->len = chunk;
+		if (b->ops->issue(b, p, addr, src) < 0) {
+			b->pend_error = -1;
+			return -1;
+		}
+		b->pend_count++;
+
+		addr += chunk;
+		if (dest)
+			dest = (char *)dest + chunk;
+		if (src)
+			src = (const char *)src + chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+int bmp_mem_read_queue(bmp *b, uint32_t addr, void *dest, size_t len)
+{
+	return bmp_queue(b, BMP_OP_READ, addr, dest, NULL, len);
+}
+
+int bmp_mem_write_queue(bmp *b, uint32_t addr, const void *src, size_t len)
+{
+	return bmp_queue(b, BMP_OP_WRITE, addr, NULL, src, len);
+}
+
+int bmp_mem_read(bmp *b, uint32_t addr, void *dest, size_t len)
+{
+	if (bmp_mem_read_queue(b, addr, dest, len) < 0) {
+		bmp_drain(b);
+		return -1;
+	}
+	return bmp_drain(b);
+}
+
+int bmp_mem_write(bmp *b, uint32_t addr, const void *src, size_t len)
+{
+	if (bmp_mem_write_queue(b, addr, src, len) < 0) {
+		bmp_drain(b);
+		return -1;
+	}
+	return bmp_drain(b);
+}
+
+/* Control operations order against outstanding transfers */
+int bmp_scan(bmp *b)
+{
+	if (bmp_drain(b) < 0)
+		return -1;
+	return b->ops->scan(b);
+}
+
+int bmp_attach(bmp *b, int n)
+{
+	if (bmp_drain(b) < 0)
+		return -1;
+	return b->ops->attach(b, n);
+}
+
+int bmp_detach(bmp *b)
+{
+	if (bmp_drain(b) < 0)
+		return -1;
+	return b->ops->detach(b);
+}
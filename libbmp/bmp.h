@@ -0,0 +1,74 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host-side client library for scripted probe access.
+ *
+ * Wraps the two channels the probe exposes in one flat-C API so bulk
+ * tooling doesn't pay per-word string handling:
+ *
+ *  - the GDB remote serial protocol, over TCP (hosted builds) or the
+ *    CDC-ACM device node (real hardware);
+ *  - the binary batch interface (src/platforms/common/batch.h), over
+ *    USB, which skips RSP framing entirely.
+ *
+ * All functions return 0 (or a non-negative count) on success and -1
+ * on failure.  The _queue/drain pairs pipeline requests: queued
+ * operations go on the wire immediately and their replies are
+ * collected in order by bmp_drain(), so back-to-back transfers
+ * overlap probe execution with transport latency.  Queued reads land
+ * in their destination buffers only once bmp_drain() returns.  The
+ * plain calls are queue-plus-drain and may be mixed freely with
+ * queued ones.
+ *
+ * The API is deliberately bindable: one opaque handle, no callbacks,
+ * no varargs, so ctypes/cffi/FFI wrappers are one-liners.
+ */
+
+#ifndef __BMP_H
+#define __BMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct bmp bmp;
+
+/* RSP over TCP, as served by hosted builds (default port 2001) */
+bmp *bmp_open_tcp(const char *host, int port);
+/* RSP over the probe's GDB CDC-ACM device node, e.g. /dev/ttyACM0 */
+bmp *bmp_open_serial(const char *device);
+/* Binary batch interface over USB; finds the first probe by VID/PID */
+bmp *bmp_open_batch(void);
+void bmp_close(bmp *b);
+
+/* Scan for targets.  On the batch transport this runs a bus scan and
+ * returns the number of devices found; the RSP path in current
+ * firmware has no scan request, so there it only verifies the link
+ * and returns 0. */
+int bmp_scan(bmp *b);
+int bmp_attach(bmp *b, int n);
+int bmp_detach(bmp *b);
+
+int bmp_mem_read(bmp *b, uint32_t addr, void *dest, size_t len);
+int bmp_mem_write(bmp *b, uint32_t addr, const void *src, size_t len);
+
+/* Pipelined variants; bmp_drain() returns 0 only if every queued
+ * operation since the last drain succeeded */
+int bmp_mem_read_queue(bmp *b, uint32_t addr, void *dest, size_t len);
+int bmp_mem_write_queue(bmp *b, uint32_t addr, const void *src, size_t len);
+int bmp_drain(bmp *b);
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Batch transport: the probe's binary bulk interface (wire format in
+ * src/platforms/common/batch.h), which carries raw records with no
+ * RSP framing or hex encoding.
+ *
+ * Records stream out back-to-back and replies are collected in issue
+ * order.  The depth is capped at two in flight: the probe buffers
+ * queued records in a ring a little over one maximal record deep, so
+ * two is what overlaps transfer with execution without risking both
+ * ends blocked mid-transfer on a full ring.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libusb.h>
+
+#include "bmp_priv.h"
+
+#define BATCH_VID	0x1d50
+#define BATCH_PID	0x6018
+#define BATCH_INTERFACE	6
+#define BATCH_EP_OUT	0x06
+#define BATCH_EP_IN	0x86
+
+#define BATCH_MAGIC	0xB5
+#define BATCH_OP_SCAN	0x01
+#define BATCH_OP_READ	0x02
+#define BATCH_OP_WRITE	0x03
+#define BATCH_OP_DETACH	0x04
+
+#define BATCH_MAX_DATA	1024
+#define BATCH_TIMEOUT	5000
+
+#define batch_handle(b)	((libusb_device_handle *)(b)->usb)
+
+static int batch_xfer(bmp *b, uint8_t ep, uint8_t *buf, int len)
+{
+	int done = 0;
+
+	while (done < len) {
+		int size;
+
+		if (libusb_bulk_transfer(batch_handle(b), ep, buf + done,
+					 len - done, &size,
+					 BATCH_TIMEOUT) < 0)
+			return -1;
+		done += size;
+	}
+	return 0;
+}
+
+/* Send one record; replies are collected separately so records can
+ * stream back-to-back */
+static int batch_put(bmp *b, uint8_t op, uint32_t addr, unsigned len,
+		     const void *data)
+{
+	uint8_t buf[8 + BATCH_MAX_DATA];
+	unsigned n = 2;
+
+	buf[0] = BATCH_MAGIC;
+	buf[1] = op;
+	if ((op == BATCH_OP_READ) || (op == BATCH_OP_WRITE)) {
+		buf[2] = addr & 0xFF;
+		buf[3] = (addr >> 8) & 0xFF;
+		buf[4] = (addr >> 16) & 0xFF;
+		buf[5] = (addr >> 24) & 0xFF;
+		buf[6] = len & 0xFF;
+		buf[7] = (len >> 8) & 0xFF;
+		n = 8;
+	}
+	if (op == BATCH_OP_WRITE) {
+		memcpy(buf + n, data, len);
+		n += len;
+	}
+	return batch_xfer(b, BATCH_EP_OUT, buf, n);
+}
+
+/* Collect one status reply (4 bytes for scan, else 3); returns the
+ * status byte or -1 */
+static int batch_status(bmp *b, uint8_t op, uint8_t *extra)
+{
+	uint8_t rep[4];
+
+	if (batch_xfer(b, BATCH_EP_IN, rep,
+		       (op == BATCH_OP_SCAN) ? 4 : 3) < 0)
+		return -1;
+	if ((rep[0] != BATCH_MAGIC) || (rep[1] != op))
+		return -1;
+	if (extra)
+		*extra = rep[3];
+	return rep[2];
+}
+
+static int batch_scan(bmp *b)
+{
+	uint8_t ndev;
+
+	if (batch_put(b, BATCH_OP_SCAN, 0, 0, NULL) < 0)
+		return -1;
+	if (batch_status(b, BATCH_OP_SCAN, &ndev) != 0)
+		return -1;
+	return ndev;
+}
+
+static int batch_attach(bmp *b, int n)
+{
+	/* The scan record attaches to the first device; the interface
+	 * has no separate attach request */
+	if (n != 1)
+		return -1;
+	return (batch_scan(b) >= 0) ? 0 : -1;
+}
+
+static int batch_detach(bmp *b)
+{
+	if (batch_put(b, BATCH_OP_DETACH, 0, 0, NULL) < 0)
+		return -1;
+	return (batch_status(b, BATCH_OP_DETACH, NULL) == 0) ? 0 : -1;
+}
+
+static int batch_issue(bmp *b, const struct bmp_pending *p,
+		       uint32_t addr, const void *src)
+{
+	if (p->op == BMP_OP_READ)
+		return batch_put(b, BATCH_OP_READ, addr, p->len, NULL);
+	return batch_put(b, BATCH_OP_WRITE, addr, p->len, src);
+}
+
+static int batch_collect(bmp *b, const struct bmp_pending *p)
+{
+	if (p->op == BMP_OP_WRITE)
+		return (batch_status(b, BATCH_OP_WRITE, NULL) == 0) ? 0 : -1;
+
+	if (batch_status(b, BATCH_OP_READ, NULL) != 0)
+		return -1;
+	return batch_xfer(b, BATCH_EP_IN, p->dest, p->len);
+}
+
+static void batch_close(bmp *b)
+{
+	if (b->usb) {
+		libusb_release_interface(batch_handle(b), BATCH_INTERFACE);
+		libusb_close(batch_handle(b));
+	}
+	libusb_exit(NULL);
+}
+
+static const struct bmp_ops batch_ops = {
+	.scan = batch_scan,
+	.attach = batch_attach,
+	.detach = batch_detach,
+	.issue = batch_issue,
+	.collect = batch_collect,
+	.close = batch_close,
+};
+
+bmp *bmp_open_batch(void)
+{
+	bmp *b;
+
+	if (libusb_init(NULL) < 0)
+		return NULL;
+
+	b = bmp_new(&batch_ops);
+	if (!b) {
+		libusb_exit(NULL);
+		return NULL;
+	}
+	b->max_data = BATCH_MAX_DATA;
+	b->max_inflight = 2;
+
+	b->usb = libusb_open_device_with_vid_pid(NULL, BATCH_VID, BATCH_PID);
+	if (!b->usb ||
+	    (libusb_claim_interface(batch_handle(b), BATCH_INTERFACE) < 0)) {
+		if (b->usb)
+			libusb_close(batch_handle(b));
+		libusb_exit(NULL);
+		free(b);
+		return NULL;
+	}
+	return b;
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Internal handle layout and backend interface shared between the
+ * transport implementations. */
+
+#ifndef __BMP_PRIV_H
+#define __BMP_PRIV_H
+
+#include <stdbool.h>
+
+#include "bmp.h"
+
+/* Maximum operations in flight between drains.  Queue calls past this
+ * depth drain implicitly, so callers may queue without counting. */
+#define BMP_PIPELINE	64
+
+enum bmp_op {
+	BMP_OP_READ,
+	BMP_OP_WRITE,
+};
+
+struct bmp_pending {
+	enum bmp_op op;
+	void *dest;		/* reads only */
+	size_t len;
+};
+
+struct bmp_ops {
+	int (*scan)(bmp *b);
+	int (*attach)(bmp *b, int n);
+	int (*detach)(bmp *b);
+	/* Put one operation on the wire; the reply is collected by
+	 * drain in issue order.  len is already within the transport's
+	 * per-request limit. */
+	int (*issue)(bmp *b, const struct bmp_pending *p,
+		     uint32_t addr, const void *src);
+	/* Collect the reply for the oldest outstanding operation */
+	int (*collect)(bmp *b, const struct bmp_pending *p);
+	void (*close)(bmp *b);
+};
+
+struct bmp {
+	const struct bmp_ops *ops;
+	/* Largest single read/write the transport takes; the generic
+	 * layer splits bigger requests */
+	size_t max_data;
+	/* Requests the transport can overlap safely: 1 for RSP in ack
+	 * mode (interleaved acks), bounded by the probe's record ring
+	 * for the batch interface, BMP_PIPELINE otherwise */
+	unsigned max_inflight;
+
+	struct bmp_pending pend[BMP_PIPELINE];
+	unsigned pend_count;
+	int pend_error;
+
+	/* RSP state */
+	int fd;
+	bool noack;
+	size_t packet_size;
+	char *pktbuf;		/* decoded reply */
+	char *txbuf;		/* framed request under construction */
+	uint8_t rxbuf[4096];	/* raw byte stream, buffered */
+	size_t rxlen, rxpos;
+
+	/* Batch state (libusb handle, kept untyped so only the batch
+	 * backend needs the libusb headers) */
+	void *usb;
+};
+
+bmp *bmp_new(const struct bmp_ops *ops);
+
+#endif
@@ -0,0 +1,398 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* RSP transport: the GDB remote serial protocol over a TCP socket
+ * (hosted builds) or the probe's CDC-ACM device node.
+ *
+ * The session is switched to no-ack mode when the probe offers it,
+ * which is what makes pipelining possible: requests stream out
+ * back-to-back and the replies are collected in order.  If no-ack
+ * mode is refused the generic layer falls back to one request in
+ * flight, since the interleaved acks would need a full stream parser
+ * for no gain on a reliable transport.
+ *
+ * Reads use the m packet and writes the binary X packet, each sized
+ * to the probe's advertised PacketSize, so hosted probes negotiating
+ * large buffers get large transfers automatically.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "bmp_priv.h"
+
+#define RSP_DEFAULT_PACKET	1024
+
+static int rsp_getc(bmp *b)
+{
+	if (b->rxpos == b->rxlen) {
+		ssize_t n = read(b->fd, b->rxbuf, sizeof(b->rxbuf));
+
+		if (n <= 0)
+			return -1;
+		b->rxlen = n;
+		b->rxpos = 0;
+	}
+	return b->rxbuf[b->rxpos++];
+}
+
+static int rsp_send(bmp *b, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t n = write(b->fd, p, len);
+
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Frame and send one packet; in ack mode, wait for the '+' and honour
+ * '-' retransmission requests */
+static int rsp_putpacket(bmp *b, const char *payload, size_t len)
+{
+	char *frame = b->txbuf;
+	uint8_t csum = 0;
+	size_t flen = 0;
+
+	frame[flen++] = '$';
+	for (size_t i = 0; i < len; i++) {
+		csum += (uint8_t)payload[i];
+		frame[flen++] = payload[i];
+	}
+	flen += sprintf(frame + flen, "#%02x", csum);
+
+	for (int tries = 0; tries < 4; tries++) {
+		int c;
+
+		if (rsp_send(b, frame, flen) < 0)
+			return -1;
+		if (b->noack)
+			return 0;
+		do {
+			c = rsp_getc(b);
+			if (c < 0)
+				return -1;
+		} while ((c != '+') && (c != '-'));
+		if (c == '+')
+			return 0;
+	}
+	return -1;
+}
+
+/* Receive one packet into pktbuf, decoding escapes and run-length
+ * encoding; returns the decoded length */
+static int rsp_getpacket(bmp *b)
+{
+	size_t len = 0;
+	uint8_t csum = 0;
+	int c;
+
+	do {
+		c = rsp_getc(b);
+		if (c < 0)
+			return -1;
+	} while (c != '$');
+
+	while (((c = rsp_getc(b)) >= 0) && (c != '#')) {
+		csum += c;
+		if (c == '}') {
+			c = rsp_getc(b);
+			if (c < 0)
+				return -1;
+			csum += c;
+			c ^= 0x20;
+		} else if (c == '*') {
+			/* Run-length: repeat the previous character */
+			int n = rsp_getc(b);
+
+			if ((n < 29) || !len)
+				return -1;
+			csum += n;
+			for (n -= 29; n && (len < b->packet_size); n--)
+				b->pktbuf[len] = b->pktbuf[len - 1], len++;
+			continue;
+		}
+		if (len < b->packet_size)
+			b->pktbuf[len++] = c;
+	}
+	if (c < 0)
+		return -1;
+
+	char recv_csum[3] = {0};
+
+	if (((c = rsp_getc(b)) < 0))
+		return -1;
+	recv_csum[0] = c;
+	if (((c = rsp_getc(b)) < 0))
+		return -1;
+	recv_csum[1] = c;
+	if (csum != strtol(recv_csum, NULL, 16)) {
+		if (!b->noack)
+			rsp_send(b, "-", 1);
+		return -1;
+	}
+	if (!b->noack && (rsp_send(b, "+", 1) < 0))
+		return -1;
+	b->pktbuf[len] = 0;
+	return len;
+}
+
+/* Receive the next real reply, skipping console output packets ('O'
+ * plus hex, including keep-alives; "OK" is a reply, not output) */
+static int rsp_getreply(bmp *b)
+{
+	for (;;) {
+		int len = rsp_getpacket(b);
+
+		if (len < 0)
+			return -1;
+		if ((b->pktbuf[0] == 'O') && strcmp(b->pktbuf, "OK"))
+			continue;
+		return len;
+	}
+}
+
+static int rsp_transact(bmp *b, const char *payload)
+{
+	if (rsp_putpacket(b, payload, strlen(payload)) < 0)
+		return -1;
+	return rsp_getreply(b);
+}
+
+static int hex_digit(int c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+	return -1;
+}
+
+static int rsp_scan(bmp *b)
+{
+	/* No scan request exists over RSP; run a harmless monitor
+	 * command to verify the link end to end */
+	if (rsp_transact(b, "qRcmd,76657273696f6e") < 0)	/* "version" */
+		return -1;
+	if (strcmp(b->pktbuf, "OK"))
+		return -1;
+	return 0;
+}
+
+static int rsp_attach(bmp *b, int n)
+{
+	char pkt[32];
+
+	snprintf(pkt, sizeof(pkt), "vAttach;%08x", n);
+	if (rsp_transact(b, pkt) < 0)
+		return -1;
+	return (b->pktbuf[0] == 'T') ? 0 : -1;
+}
+
+static int rsp_detach(bmp *b)
+{
+	if (rsp_transact(b, "D") < 0)
+		return -1;
+	return strcmp(b->pktbuf, "OK") ? -1 : 0;
+}
+
+static int rsp_issue(bmp *b, const struct bmp_pending *p,
+		     uint32_t addr, const void *src)
+{
+	if (p->op == BMP_OP_READ) {
+		char pkt[32];
+
+		snprintf(pkt, sizeof(pkt), "m%08x,%zx", addr, p->len);
+		return rsp_putpacket(b, pkt, strlen(pkt));
+	}
+
+	/* Binary write: X addr,len:data with $, #, } and * escaped */
+	char *pkt = malloc(32 + 2 * p->len);
+	const uint8_t *data = src;
+	size_t plen;
+	int ret;
+
+	if (!pkt)
+		return -1;
+	plen = sprintf(pkt, "X%08x,%zx:", addr, p->len);
+	for (size_t i = 0; i < p->len; i++) {
+		uint8_t c = data[i];
+
+		if ((c == '$') || (c == '#') || (c == '}') || (c == '*')) {
+			pkt[plen++] = '}';
+			c ^= 0x20;
+		}
+		pkt[plen++] = c;
+	}
+	ret = rsp_putpacket(b, pkt, plen);
+	free(pkt);
+	return ret;
+}
+
+static int rsp_collect(bmp *b, const struct bmp_pending *p)
+{
+	if (rsp_getreply(b) < 0)
+		return -1;
+
+	if (p->op == BMP_OP_WRITE)
+		return strcmp(b->pktbuf, "OK") ? -1 : 0;
+
+	if (strlen(b->pktbuf) != 2 * p->len)
+		return -1;
+	for (size_t i = 0; i < p->len; i++) {
+		int hi = hex_digit(b->pktbuf[2 * i]);
+		int lo = hex_digit(b->pktbuf[2 * i + 1]);
+
+		if ((hi < 0) || (lo < 0))
+			return -1;
+		((uint8_t *)p->dest)[i] = (hi << 4) | lo;
+	}
+	return 0;
+}
+
+static void rsp_close(bmp *b)
+{
+	if (b->fd >= 0)
+		close(b->fd);
+}
+
+static const struct bmp_ops rsp_ops = {
+	.scan = rsp_scan,
+	.attach = rsp_attach,
+	.detach = rsp_detach,
+	.issue = rsp_issue,
+	.collect = rsp_collect,
+	.close = rsp_close,
+};
+
+/* Negotiate packet size and no-ack mode on a fresh connection */
+static bmp *rsp_init(bmp *b)
+{
+	b->packet_size = RSP_DEFAULT_PACKET;
+	b->pktbuf = malloc(b->packet_size + 1);
+	b->txbuf = malloc(b->packet_size + 16);
+	if (!b->pktbuf || !b->txbuf)
+		goto fail;
+
+	if (rsp_transact(b, "qSupported:multiprocess+") < 0)
+		goto fail;
+	for (char *f = strtok(b->pktbuf, ";"); f; f = strtok(NULL, ";"))
+		if (!strncmp(f, "PacketSize=", 11)) {
+			size_t size = strtoul(f + 11, NULL, 16);
+			char *pkt = realloc(b->pktbuf, size + 1);
+			char *tx = realloc(b->txbuf, size + 16);
+
+			if (pkt)
+				b->pktbuf = pkt;
+			if (tx)
+				b->txbuf = tx;
+			if (!pkt || !tx)
+				goto fail;
+			b->packet_size = size;
+		}
+
+	if ((rsp_transact(b, "QStartNoAckMode") >= 0) &&
+	    !strcmp(b->pktbuf, "OK")) {
+		b->noack = true;
+		b->max_inflight = BMP_PIPELINE;
+	}
+
+	/* m reply is two hex digits per byte; X takes up to two bytes
+	 * per byte once escaped.  Keep one limit for both. */
+	b->max_data = (b->packet_size - 32) / 2;
+	return b;
+
+fail:
+	bmp_close(b);
+	return NULL;
+}
+
+bmp *bmp_open_tcp(const char *host, int port)
+{
+	bmp *b = bmp_new(&rsp_ops);
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res, *ai;
+	char service[8];
+
+	if (!b)
+		return NULL;
+
+	snprintf(service, sizeof(service), "%d", port);
+	if (getaddrinfo(host, service, &hints, &res)) {
+		free(b);
+		return NULL;
+	}
+	for (ai = res; ai; ai = ai->ai_next) {
+		b->fd = socket(ai->ai_family, ai->ai_socktype,
+			       ai->ai_protocol);
+		if (b->fd < 0)
+			continue;
+		if (connect(b->fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(b->fd);
+		b->fd = -1;
+	}
+	freeaddrinfo(res);
+	if (b->fd < 0) {
+		free(b);
+		return NULL;
+	}
+
+	int nodelay = 1;
+
+	setsockopt(b->fd, IPPROTO_TCP, TCP_NODELAY,
+		   &nodelay, sizeof(nodelay));
+	return rsp_init(b);
+}
+
+bmp *bmp_open_serial(const char *device)
+{
+	bmp *b = bmp_new(&rsp_ops);
+	struct termios tio;
+
+	if (!b)
+		return NULL;
+
+	b->fd = open(device, O_RDWR | O_NOCTTY);
+	if (b->fd < 0) {
+		free(b);
+		return NULL;
+	}
+	if (tcgetattr(b->fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(b->fd, TCSANOW, &tio);
+	}
+	return rsp_init(b);
+}
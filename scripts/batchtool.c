@@ -0,0 +1,212 @@
+/*
+ * Batch access client for Blackmagic Probe.
+ * =========================================
+ *
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Drives the probe's binary batch interface (see src/platforms/common/
+ * batch.h for the wire format), bypassing the GDB channel entirely:
+ *
+ *   ./batchtool scan
+ *   ./batchtool read 0x08000000 0x1000 flash.bin
+ *   ./batchtool write 0x20000000 image.bin
+ *   ./batchtool detach
+ *
+ * Reads and writes larger than one record are split into 1KiB chunks
+ * issued back to back, so the probe overlaps execution with transfer.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <libusb.h>
+
+#define VID       (0x1d50)
+#define PID       (0x6018)
+#define INTERFACE (6)
+#define EP_OUT    (0x06)
+#define EP_IN     (0x86)
+
+#define MAGIC     (0xB5)
+#define OP_SCAN   (0x01)
+#define OP_READ   (0x02)
+#define OP_WRITE  (0x03)
+#define OP_DETACH (0x04)
+
+#define MAX_DATA   (1024)
+#define TIMEOUT_MS (5000)
+
+static libusb_device_handle *handle;
+
+static int xfer(uint8_t ep, uint8_t *buf, int len)
+{
+  int done = 0, size, ret;
+
+  while (done < len)
+    {
+      ret = libusb_bulk_transfer(handle, ep, buf + done, len - done,
+                                 &size, TIMEOUT_MS);
+      if (ret < 0)
+        {
+          fprintf(stderr, "USB transfer failed (%d)\n", ret);
+          return -1;
+        }
+      done += size;
+    }
+  return 0;
+}
+
+/* Issue one record and collect the 3-byte (or, for scan, 4-byte)
+ * status reply.  Returns the status byte, or -1 on transport error. */
+static int command(uint8_t op, uint32_t addr, unsigned len,
+                   const uint8_t *data, uint8_t *extra)
+{
+  uint8_t buf[8 + MAX_DATA];
+  unsigned n = 2;
+
+  buf[0] = MAGIC;
+  buf[1] = op;
+  if ((op == OP_READ) || (op == OP_WRITE))
+    {
+      buf[2] = addr & 0xFF;
+      buf[3] = (addr >> 8) & 0xFF;
+      buf[4] = (addr >> 16) & 0xFF;
+      buf[5] = (addr >> 24) & 0xFF;
+      buf[6] = len & 0xFF;
+      buf[7] = (len >> 8) & 0xFF;
+      n = 8;
+    }
+  if (op == OP_WRITE)
+    {
+      memcpy(buf + n, data, len);
+      n += len;
+    }
+  if (xfer(EP_OUT, buf, n) < 0)
+    return -1;
+
+  n = (op == OP_SCAN) ? 4 : 3;
+  if (xfer(EP_IN, buf, n) < 0)
+    return -1;
+  if ((buf[0] != MAGIC) || (buf[1] != op))
+    {
+      fprintf(stderr, "Reply desynchronised (%02x %02x)\n", buf[0], buf[1]);
+      return -1;
+    }
+  if (extra)
+    *extra = buf[3];
+  return buf[2];
+}
+
+int main(int argc, char **argv)
+{
+  uint8_t data[MAX_DATA], ndev;
+  unsigned long addr, len, chunk;
+  FILE *f;
+  int status = -1;
+
+  if (argc < 2)
+    {
+      fprintf(stderr, "Usage: %s scan | read <addr> <len> [file] | "
+                      "write <addr> <file> | detach\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (libusb_init(NULL) < 0)
+    {
+      fprintf(stderr, "Failed to initialise libusb\n");
+      return EXIT_FAILURE;
+    }
+  handle = libusb_open_device_with_vid_pid(NULL, VID, PID);
+  if (!handle)
+    {
+      fprintf(stderr, "Could not open probe (%04x:%04x)\n", VID, PID);
+      return EXIT_FAILURE;
+    }
+  if (libusb_claim_interface(handle, INTERFACE) < 0)
+    {
+      fprintf(stderr, "Failed to claim interface %d\n", INTERFACE);
+      return EXIT_FAILURE;
+    }
+
+  if (!strcmp(argv[1], "scan"))
+    {
+      status = command(OP_SCAN, 0, 0, NULL, &ndev);
+      if (status == 0)
+        fprintf(stderr, "Attached (%d device%s)\n", ndev, (ndev == 1) ? "" : "s");
+    }
+  else if (!strcmp(argv[1], "detach"))
+    {
+      status = command(OP_DETACH, 0, 0, NULL, NULL);
+    }
+  else if (!strcmp(argv[1], "read") && (argc > 3))
+    {
+      addr = strtoul(argv[2], NULL, 0);
+      len = strtoul(argv[3], NULL, 0);
+      f = (argc > 4) ? fopen(argv[4], "wb") : stdout;
+      if (!f)
+        {
+          perror(argv[4]);
+          return EXIT_FAILURE;
+        }
+      while (len)
+        {
+          chunk = (len > MAX_DATA) ? MAX_DATA : len;
+          status = command(OP_READ, addr, chunk, NULL, NULL);
+          if (status != 0)
+            break;
+          if (xfer(EP_IN, data, chunk) < 0)
+            return EXIT_FAILURE;
+          fwrite(data, 1, chunk, f);
+          addr += chunk;
+          len -= chunk;
+        }
+      if (f != stdout)
+        fclose(f);
+    }
+  else if (!strcmp(argv[1], "write") && (argc > 3))
+    {
+      addr = strtoul(argv[2], NULL, 0);
+      f = fopen(argv[3], "rb");
+      if (!f)
+        {
+          perror(argv[3]);
+          return EXIT_FAILURE;
+        }
+      while ((chunk = fread(data, 1, MAX_DATA, f)))
+        {
+          status = command(OP_WRITE, addr, chunk, data, NULL);
+          if (status != 0)
+            break;
+          addr += chunk;
+        }
+      fclose(f);
+    }
+  else
+    {
+      fprintf(stderr, "Bad arguments\n");
+      return EXIT_FAILURE;
+    }
+
+  if (status != 0)
+    fprintf(stderr, "Operation failed (status %d)\n", status);
+
+  libusb_release_interface(handle, INTERFACE);
+  libusb_close(handle);
+  libusb_exit(NULL);
+
+  return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+/*
+ * Raw memory dump receiver for Blackmagic Probe.
+ * ==============================================
+ *
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Receives the binary stream produced by the probe's `monitor dump
+ * <addr> <len>' command on the trace endpoint and writes it to a file
+ * (or stdout).  Start this first, then issue the monitor command:
+ *
+ *   ./dumplisten 0x30000 ram.bin &
+ *   (gdb) monitor dump 0x20000000 0x30000
+ *
+ * Reception ends when the expected byte count arrives, or after a
+ * read timeout when no count was given.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <libusb.h>
+
+#define VID       (0x1d50)
+#define PID       (0x6018)
+#define INTERFACE (5)
+#define ENDPOINT  (0x85)
+
+#define TRANSFER_SIZE (4096)
+#define TIMEOUT_MS    (2000)
+
+int main(int argc, char **argv)
+{
+  libusb_device_handle *handle;
+  uint8_t buf[TRANSFER_SIZE];
+  unsigned long expected = 0, received = 0;
+  FILE *out = stdout;
+  int size, ret;
+
+  if (argc > 1)
+    expected = strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    {
+      out = fopen(argv[2], "wb");
+      if (!out)
+        {
+          perror(argv[2]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (libusb_init(NULL) < 0)
+    {
+      fprintf(stderr, "Failed to initialise libusb\n");
+      return EXIT_FAILURE;
+    }
+
+  handle = libusb_open_device_with_vid_pid(NULL, VID, PID);
+  if (!handle)
+    {
+      fprintf(stderr, "Could not open probe (%04x:%04x)\n", VID, PID);
+      return EXIT_FAILURE;
+    }
+
+  if (libusb_claim_interface(handle, INTERFACE) < 0)
+    {
+      fprintf(stderr, "Failed to claim interface %d\n", INTERFACE);
+      return EXIT_FAILURE;
+    }
+
+  while (!expected || (received < expected))
+    {
+      ret = libusb_bulk_transfer(handle, ENDPOINT, buf, TRANSFER_SIZE,
+                                 &size, TIMEOUT_MS);
+      if ((ret < 0) && (ret != LIBUSB_ERROR_TIMEOUT))
+        {
+          fprintf(stderr, "USB transfer failed (%d)\n", ret);
+          break;
+        }
+      if (ret == LIBUSB_ERROR_TIMEOUT)
+        {
+          /* Without an expected length the stream end is a timeout;
+           * with one, keep waiting until the dump starts flowing */
+          if (!expected || received)
+            break;
+          continue;
+        }
+      fwrite(buf, 1, size, out);
+      received += size;
+    }
+
+  if (out != stdout)
+    fclose(out);
+  fprintf(stderr, "Received %lu bytes\n", received);
+
+  libusb_release_interface(handle, INTERFACE);
+  libusb_close(handle);
+  libusb_exit(NULL);
+
+  return (expected && (received != expected)) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
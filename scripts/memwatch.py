@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+
+# memwatch.py: Decode a memory-watch capture from the probe's sampler
+# Copyright (C) 2011  Black Sphere Technologies
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# The probe's `monitor watch add <addr> <len> <hz>' streams samples
+# over the trace endpoint framed as
+#   0xA7, entry index, payload length, 32-bit LE microsecond
+#   timestamp, payload
+# Capture them with dumplisten, then print one line per sample:
+#
+#   ./dumplisten 0 samples.bin &
+#   (gdb) monitor watch add 0x20000400 4 100
+#   (gdb) continue
+#   ... let the target run ...
+#   ./memwatch.py samples.bin
+#
+# Payloads of 1, 2, 4 or 8 bytes are shown as little-endian integers
+# as well as hex.
+
+import struct
+import sys
+
+MAGIC = 0xA7
+HDR = 7
+
+if len(sys.argv) != 2:
+    sys.stderr.write("Usage: %s <samples.bin>\n" % sys.argv[0])
+    sys.exit(1)
+
+data = open(sys.argv[1], "rb").read()
+
+pos = 0
+last_us = {}
+while pos + HDR <= len(data):
+    if data[pos] != MAGIC:
+        # Lost framing (dropped bytes): hunt for the next header
+        pos += 1
+        continue
+    index, length, us = struct.unpack_from("<xBBI", data, pos)
+    if pos + HDR + length > len(data):
+        break
+    payload = data[pos + HDR:pos + HDR + length]
+    pos += HDR + length
+
+    delta = us - last_us[index] if index in last_us else 0
+    last_us[index] = us
+
+    value = ""
+    if length in (1, 2, 4, 8):
+        value = " = %d" % int.from_bytes(payload, "little")
+    print("%10u us (+%6u) watch%d: %s%s"
+          % (us, delta, index, payload.hex(), value))
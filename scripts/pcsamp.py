@@ -0,0 +1,76 @@
+#!/usr/bin/env python
+
+# pcsamp.py: Decode a PC-sample capture from the probe's profiler
+# Copyright (C) 2011  Black Sphere Technologies
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# The probe's `monitor profile start <hz>' streams raw little-endian
+# 32-bit DWT PCSR samples over the trace endpoint.  Capture them with
+# dumplisten, then fold the capture into a hot-spot histogram:
+#
+#   ./dumplisten 0 samples.bin &
+#   (gdb) monitor profile start 100
+#   ... let the target run ...
+#   (gdb) monitor profile stop
+#   ./pcsamp.py samples.bin [firmware.elf]
+#
+# With an ELF given, samples are attributed to symbols via nm.
+
+import struct
+import subprocess
+import sys
+
+TOP = 25
+
+def load_symbols(elf):
+    syms = []
+    out = subprocess.check_output(["arm-none-eabi-nm", "-nS", elf])
+    for line in out.decode("ascii", "replace").splitlines():
+        parts = line.split()
+        if (len(parts) >= 4) and (parts[2].lower() in "tw"):
+            syms.append((int(parts[0], 16), int(parts[1], 16), parts[3]))
+    return syms
+
+def resolve(syms, addr):
+    for base, size, name in syms:
+        if base <= addr < base + size:
+            return name
+    return "?"
+
+if len(sys.argv) < 2:
+    sys.stderr.write("Usage: %s <samples.bin> [firmware.elf]\n" % sys.argv[0])
+    sys.exit(1)
+
+data = open(sys.argv[1], "rb").read()
+syms = load_symbols(sys.argv[2]) if len(sys.argv) > 2 else None
+
+hist = {}
+total = 0
+for i in range(0, len(data) - 3, 4):
+    pc = struct.unpack_from("<I", data, i)[0]
+    if pc == 0xFFFFFFFF:        # core halted/sleeping, no sample
+        continue
+    key = resolve(syms, pc) if syms else pc
+    hist[key] = hist.get(key, 0) + 1
+    total += 1
+
+if not total:
+    sys.stderr.write("No samples\n")
+    sys.exit(1)
+
+print("%d samples" % total)
+for key, count in sorted(hist.items(), key=lambda kv: -kv[1])[:TOP]:
+    name = key if syms else ("0x%08x" % key)
+    print("%6.2f%% %8d  %s" % (100.0 * count / total, count, name))
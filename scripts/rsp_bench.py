@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+#
+# RSP protocol throughput benchmark for the hosted-sim build.
+# ===========================================================
+#
+# This file is part of the Black Magic Debug project.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Launches a hosted-sim blackmagic binary and replays canned GDB Remote
+# Serial Protocol sessions against its in-memory loopback target, so
+# every second measured belongs to the protocol stack rather than a
+# wire.  Reports wall time per phase:
+#
+#   attach   connect, qSupported, vAttach and a register fetch
+#   load     flash load through vFlashErase/vFlashWrite/vFlashDone
+#   step     single-step/stop-reply round trips
+#
+# With --baseline the times are compared against a saved run and the
+# exit status reflects a regression, for use from `make benchmark` in
+# CI.  A missing baseline file is created from the current run.
+
+import argparse
+import json
+import socket
+import subprocess
+import sys
+import time
+
+ESCAPED = b'#$}*'
+
+
+def checksum(data):
+    return sum(data) & 0xff
+
+
+class RSPClient:
+    def __init__(self, port):
+        self.sock = socket.create_connection(('localhost', port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.rxbuf = b''
+
+    def _read(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise EOFError('probe closed the connection')
+        return data
+
+    def _getc(self):
+        while not self.rxbuf:
+            self.rxbuf = self._read()
+        c, self.rxbuf = self.rxbuf[:1], self.rxbuf[1:]
+        return c
+
+    def send(self, payload):
+        """Frame and send one packet, waiting for the ack."""
+        frame = b'$' + payload + b'#' + b'%02x' % checksum(payload)
+        self.sock.sendall(frame)
+        while True:
+            c = self._getc()
+            if c == b'+':
+                return
+            if c == b'-':
+                self.sock.sendall(frame)
+
+    def recv(self):
+        """Receive one packet, unescaping, and ack it."""
+        while self._getc() != b'$':
+            pass
+        payload = b''
+        while True:
+            c = self._getc()
+            if c == b'#':
+                break
+            if c == b'}':
+                c = bytes([self._getc()[0] ^ 0x20])
+            elif c == b'*':
+                # Run-length encoding: repeat the previous character
+                payload += payload[-1:] * (self._getc()[0] - 29)
+                continue
+            payload += c
+        self._getc()
+        self._getc()
+        self.sock.sendall(b'+')
+        return payload
+
+    def transact(self, payload):
+        self.send(payload)
+        while True:
+            reply = self.recv()
+            # Console output packets ('O' plus hex, including the bare
+            # keep-alives sent during long operations) arrive while a
+            # command is in flight; like gdb, skip them and keep
+            # waiting for the real reply.  'OK' is a reply, not output.
+            if reply.startswith(b'O') and reply != b'OK':
+                continue
+            return reply
+
+
+def escape(data):
+    out = bytearray()
+    for b in data:
+        if b in ESCAPED:
+            out.append(0x7d)
+            out.append(b ^ 0x20)
+        else:
+            out.append(b)
+    return bytes(out)
+
+
+def connect(port, timeout=5.0):
+    deadline = time.monotonic() + timeout
+    while True:
+        try:
+            return RSPClient(port)
+        except OSError:
+            if time.monotonic() > deadline:
+                raise
+            time.sleep(0.05)
+
+
+def phase_attach(rsp):
+    reply = rsp.transact(b'qSupported:multiprocess+')
+    packet_size = 0x4000
+    for feature in reply.split(b';'):
+        if feature.startswith(b'PacketSize='):
+            packet_size = int(feature[11:], 16)
+    if rsp.transact(b'vAttach;1') != b'T05':
+        sys.exit('vAttach failed')
+    rsp.transact(b'g')
+    return packet_size
+
+
+def phase_load(rsp, packet_size, load_bytes):
+    # Leave generous headroom for the command, escaping and framing
+    chunk = min(packet_size // 2, 16384)
+    if rsp.transact(b'vFlashErase:08000000,%08x' % load_bytes) != b'OK':
+        sys.exit('vFlashErase failed')
+    payload = bytes(range(256)) * (chunk // 256)
+    for offset in range(0, load_bytes, chunk):
+        cmd = b'vFlashWrite:%08x:' % (0x08000000 + offset)
+        if rsp.transact(cmd + escape(payload)) != b'OK':
+            sys.exit('vFlashWrite failed at offset %#x' % offset)
+    if rsp.transact(b'vFlashDone') != b'OK':
+        sys.exit('vFlashDone failed')
+
+
+def phase_step(rsp, steps):
+    for _ in range(steps):
+        if not rsp.transact(b's').startswith(b'T05'):
+            sys.exit('step did not stop')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Replay RSP sessions against a hosted-sim probe')
+    parser.add_argument('probe', help='hosted-sim blackmagic binary')
+    parser.add_argument('--port', type=int, default=2001)
+    parser.add_argument('--load-bytes', type=int, default=1024 * 1024)
+    parser.add_argument('--steps', type=int, default=10000)
+    parser.add_argument('--runs', type=int, default=3,
+                        help='sessions to run, keeping the best time per '
+                             'phase (default 3)')
+    parser.add_argument('--baseline', metavar='FILE',
+                        help='compare against (or create) saved phase times')
+    parser.add_argument('--threshold', type=float, default=5.0,
+                        help='allowed regression, percent (default 5)')
+    args = parser.parse_args()
+
+    # Scheduling noise easily tops a few percent for a single run, so
+    # replay the whole session several times and score the best of each
+    # phase, which converges on the code's actual cost.
+    times = {}
+    for _ in range(args.runs):
+        probe = subprocess.Popen([args.probe], stdout=subprocess.DEVNULL)
+        run = {}
+        try:
+            rsp = connect(args.port)
+
+            start = time.monotonic()
+            packet_size = phase_attach(rsp)
+            run['attach'] = time.monotonic() - start
+
+            start = time.monotonic()
+            phase_load(rsp, packet_size, args.load_bytes)
+            run['load'] = time.monotonic() - start
+
+            start = time.monotonic()
+            phase_step(rsp, args.steps)
+            run['step'] = time.monotonic() - start
+
+            rsp.transact(b'D')
+        finally:
+            probe.kill()
+            probe.wait()
+        for phase, t in run.items():
+            times[phase] = min(times.get(phase, t), t)
+
+    print('attach: %8.3f s' % times['attach'])
+    print('load:   %8.3f s  (%d bytes)' % (times['load'], args.load_bytes))
+    print('step:   %8.3f s  (%d steps)' % (times['step'], args.steps))
+
+    if not args.baseline:
+        return 0
+    try:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    except FileNotFoundError:
+        with open(args.baseline, 'w') as f:
+            json.dump(times, f, indent=1)
+        print('Baseline written to %s' % args.baseline)
+        return 0
+
+    failed = False
+    for phase, t in sorted(times.items()):
+        if phase not in baseline:
+            continue
+        delta = (t / baseline[phase] - 1.0) * 100.0
+        print('%s: %+6.1f%% vs baseline' % (phase, delta))
+        if delta > args.threshold:
+            failed = True
+    if failed:
+        print('FAIL: regression beyond %.1f%%' % args.threshold)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -47,8 +47,18 @@
 #define NUM_FIFOS     32
 #define MAX_FIFOS     128
 
+/* Queue of USB bulk transfers kept in flight so capture continues
+ * while completed buffers are being pumped */
+#define NUM_TRANSFERS     (8)
+#define USB_TRANSFER_SIZE (4096)
+
 #define CHANNELNAME   "chan"
 
+/* Optional probe-side timestamp framing (`monitor trace_ts enable'):
+ * magic, payload length, 32 bit LE probe cycle counter, payload */
+#define TRACE_TS_MAGIC (0xA6)
+#define TRACE_TS_HDR   (6)
+
 #define BOOL       char
 #define FALSE      (0)
 #define TRUE       (!FALSE)
@@ -58,6 +68,7 @@ struct
 {
   BOOL verbose;
   BOOL dump;
+  BOOL tstamp;
   int nChannels;
   char *chanPath;
   char *port;
@@ -337,6 +348,63 @@ void _protocolPump(uint8_t *c)
 #endif
 }
 // ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+// Pump for unwrapping probe timestamp frames (-t)
+// ====================================================================================================
+// ====================================================================================================
+// ====================================================================================================
+enum _tsState {TS_MAGIC, TS_LEN, TS_TIME, TS_PAYLOAD};
+
+void _tsPump(uint8_t *c)
+
+{
+  static enum _tsState s;
+  static uint32_t stamp, lastStamp;
+  static int count, payloadLen;
+  static BOOL synced;
+
+  switch (s)
+    {
+    case TS_MAGIC:
+      if (*c!=TRACE_TS_MAGIC)
+	{
+	  /* Hunt for the next frame header after stream loss */
+	  if (synced && options.verbose)
+	    fprintf(stderr,"Lost timestamp framing, resyncing\n");
+	  synced=FALSE;
+	  break;
+	}
+      s=TS_LEN;
+      break;
+    case TS_LEN:
+      payloadLen=*c;
+      stamp=0;
+      count=0;
+      s=TS_TIME;
+      break;
+    case TS_TIME:
+      stamp|=((uint32_t)*c)<<(8*count++);
+      if (count<4)
+	break;
+      if (options.verbose)
+	fprintf(stderr,"TS %10u (+%u cycles) %d bytes\n",
+		stamp,synced?stamp-lastStamp:0,payloadLen);
+      lastStamp=stamp;
+      synced=TRUE;
+      s=payloadLen?TS_PAYLOAD:TS_MAGIC;
+      break;
+    case TS_PAYLOAD:
+      if (options.dump)
+	fwrite(c,1,1,stdout);
+      else
+	_protocolPump(c);
+      if (!--payloadLen)
+	s=TS_MAGIC;
+      break;
+    }
+}
+// ====================================================================================================
 void intHandler(int dummy)
 
 {
@@ -346,13 +414,14 @@ void intHandler(int dummy)
 void _printHelp(char *progName)
 
 {
-  printf("Useage: %s <dhnv> <b basedir> <p port> <s speed>\n",progName);
+  printf("Useage: %s <dhntv> <b basedir> <p port> <s speed>\n",progName);
   printf("        b: <basedir> for channels\n");
   printf("        h: This help\n");
   printf("        d: Dump received data without further processing\n");
   printf("        n: <Number> of channels to populate\n");
   printf("        p: <serialPort> to use\n");
   printf("        s: <serialSpeed> to use\n");
+  printf("        t: Unwrap probe timestamp frames (monitor trace_ts enable)\n");
   printf("        v: Verbose mode\n");
 }
 // ====================================================================================================
@@ -360,7 +429,7 @@ int _processOptions(int argc, char *argv[])
 
 {
   int c;
-  while ((c = getopt (argc, argv, "vdn:b:hp:s:")) != -1)
+  while ((c = getopt (argc, argv, "vdn:b:hp:s:t")) != -1)
     switch (c)
       {
       case 'v':
@@ -369,6 +438,9 @@ int _processOptions(int argc, char *argv[])
       case 'd':
         options.dump = 1;
         break;
+      case 't':
+        options.tstamp = 1;
+        break;
       case 'p':
 	options.port=optarg;
 	break;
@@ -410,14 +482,43 @@ int _processOptions(int argc, char *argv[])
   return TRUE;
 }
 // ====================================================================================================
-int usbFeeder(void)
+static BOOL usbTerminated;
+
+static void _usbCallback(struct libusb_transfer *t)
 
 {
+  if ((t->status==LIBUSB_TRANSFER_COMPLETED) ||
+      (t->status==LIBUSB_TRANSFER_TIMED_OUT))
+    {
+      unsigned char *c=t->buffer;
+      int size=t->actual_length;
+
+      if (options.tstamp)
+	  while (size--)
+	      _tsPump(c++);
+      else if (options.dump)
+	  fwrite(c,1,size,stdout);
+      else
+	  while (size--)
+	      _protocolPump(c++);
 
-  unsigned char cbw[TRANSFER_SIZE];
+      /* Put this buffer straight back on the wire */
+      if (libusb_submit_transfer(t)<0)
+	  usbTerminated=TRUE;
+    }
+  else
+    {
+      usbTerminated=TRUE;
+    }
+}
+// ====================================================================================================
+int usbFeeder(void)
+
+{
+  static unsigned char buffer[NUM_TRANSFERS][USB_TRANSFER_SIZE];
+  struct libusb_transfer *transfer[NUM_TRANSFERS];
   libusb_device_handle *handle;
   libusb_device *dev;
-  int size;
 
   while (1)
     {
@@ -438,16 +539,26 @@ int usbFeeder(void)
       if (libusb_claim_interface (handle, INTERFACE)<0)
 	continue;
 
-      while (0==libusb_bulk_transfer(handle, ENDPOINT, cbw, TRANSFER_SIZE, &size, 10))
+      /* Asynchronous reception: keep a queue of bulk transfers in
+       * flight and pump each buffer from the completion callback, so
+       * nothing is lost while a buffer is being processed */
+      usbTerminated=FALSE;
+      for (int t=0; t<NUM_TRANSFERS; t++)
 	{
-	  unsigned char *c=cbw;
-          if (options.dump)
-              printf(cbw);
-          else
-              while (size--)
-                  _protocolPump(c++);
+	  transfer[t]=libusb_alloc_transfer(0);
+	  libusb_fill_bulk_transfer(transfer[t], handle, ENDPOINT,
+				    buffer[t], USB_TRANSFER_SIZE,
+				    _usbCallback, NULL, 100);
+	  if (libusb_submit_transfer(transfer[t])<0)
+	      usbTerminated=TRUE;
 	}
 
+      while (!usbTerminated)
+	  libusb_handle_events(NULL);
+
+      for (int t=0; t<NUM_TRANSFERS; t++)
+	  libusb_free_transfer(transfer[t]);
+
       libusb_close(handle);
     }
 }
@@ -506,7 +617,12 @@ int serialFeeder(void)
 	{
 	  unsigned char *c=cbw;
 	  while (t--)
-	    _protocolPump(c++);
+	    {
+	      if (options.tstamp)
+		_tsPump(c++);
+	      else
+		_protocolPump(c++);
+	    }
 	}
       if (options.verbose)
 	{
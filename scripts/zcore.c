@@ -0,0 +1,107 @@
+/*
+ * zcore unpacker
+ * ==============
+ *
+ * Reconstructs an ELF core file from the "zcore" compressed container
+ * written by the zynq_amp crash dump path (set BMP_CORE_COMPRESS in the
+ * probe's environment to enable it).  The container is a magic/version
+ * header followed by records of the raw ELF byte stream; each record
+ * starts with a 32-bit little-endian word carrying the type in the top
+ * two bits and the length in the rest:
+ *
+ *   type 0: a run of that many zero bytes (no payload)
+ *   type 1: literal data, the payload follows
+ *   type 2: a patch - a 32-bit file offset follows, then the payload,
+ *           which overwrites earlier output (used for the ELF header)
+ *
+ * Build with:  gcc -o zcore zcore.c
+ * Usage:       zcore <dump.zcore> <core.elf>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ZCORE_MAGIC   0x524F435A  /* "ZCOR" */
+#define ZCORE_VERSION 1
+
+static uint32_t read_word(FILE *f)
+{
+	uint8_t b[4];
+	if (fread(b, sizeof(b), 1, f) != 1)
+		return 0;
+	return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t buf[4096];
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <dump.zcore> <core.elf>\n", argv[0]);
+		return 1;
+	}
+
+	FILE *in = fopen(argv[1], "rb");
+	if (in == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	if ((read_word(in) != ZCORE_MAGIC) || (read_word(in) != ZCORE_VERSION)) {
+		fprintf(stderr, "%s: not a zcore v%d file\n", argv[1], ZCORE_VERSION);
+		return 1;
+	}
+
+	FILE *out = fopen(argv[2], "wb");
+	if (out == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	long pos = 0, end = 0;
+	while (1) {
+		uint32_t rec = read_word(in);
+		if (feof(in))
+			break;
+		uint32_t len = rec & 0x3FFFFFFF;
+		switch (rec >> 30) {
+		case 0:
+			/* Zero run: seek forward, the OS fills the hole */
+			fseek(out, len, SEEK_CUR);
+			pos += len;
+			break;
+		case 2:
+			pos = read_word(in);
+			fseek(out, pos, SEEK_SET);
+			/* fall through */
+		case 1:
+			while (len) {
+				size_t chunk = (len > sizeof(buf)) ? sizeof(buf) : len;
+				if (fread(buf, chunk, 1, in) != 1) {
+					fprintf(stderr, "%s: truncated record\n", argv[1]);
+					return 1;
+				}
+				fwrite(buf, chunk, 1, out);
+				pos += chunk;
+				len -= chunk;
+			}
+			break;
+		default:
+			fprintf(stderr, "%s: bad record type\n", argv[1]);
+			return 1;
+		}
+		if (pos > end)
+			end = pos;
+	}
+
+	/* A trailing zero run only seeks; make sure the file reaches it */
+	fseek(out, 0, SEEK_END);
+	if (ftell(out) < end) {
+		fseek(out, end - 1, SEEK_SET);
+		fputc(0, out);
+	}
+
+	fclose(out);
+	fclose(in);
+	return 0;
+}
@@ -33,6 +33,12 @@
 
 #ifdef PLATFORM_HAS_TRACESWO
 #	include "traceswo.h"
+#	include "profile.h"
+#	include "memwatch.h"
+#endif
+
+#ifdef SWD_SPI
+#	include "swdptap.h"
 #endif
 
 typedef bool (*cmd_handler)(target *t, int argc, const char **argv);
@@ -55,6 +61,12 @@ static bool cmd_help(target *t);
 
 static bool cmd_targets(void);
 static bool cmd_morse(void);
+static bool cmd_stats(void);
+static bool cmd_timing(void);
+static bool cmd_bench(target *t, int argc, const char **argv);
+static bool cmd_flash_diff(target *t, int argc, const char **argv);
+static bool cmd_attach_fast(target *t, int argc, const char **argv);
+static bool cmd_keep_powered(target *t, int argc, const char **argv);
 static bool cmd_assert_srst(target *t, int argc, const char **argv);
 static bool cmd_halt_timeout(target *t, int argc, const char **argv);
 static bool cmd_hard_srst(void);
@@ -64,9 +76,14 @@ static bool cmd_target_power(target *t, int argc, const char **argv);
 #endif
 #ifdef PLATFORM_HAS_TRACESWO
 static bool cmd_traceswo(target *t, int argc, const char **argv);
+static bool cmd_trace_ts(target *t, int argc, const char **argv);
+static bool cmd_dump(target *t, int argc, const char **argv);
+static bool cmd_profile(target *t, int argc, const char **argv);
+static bool cmd_watch(target *t, int argc, const char **argv);
 #endif
 #ifdef PLATFORM_HAS_DEBUG
 static bool cmd_debug_bmp(target *t, int argc, const char **argv);
+static bool cmd_debug_dump(target *t, int argc, const char **argv);
 #endif
 
 const struct command_s cmd_list[] = {
@@ -74,6 +91,12 @@ const struct command_s cmd_list[] = {
 	{"help", (cmd_handler)cmd_help, "Display help for monitor commands"},
 	{"targets", (cmd_handler)cmd_targets, "Display list of available targets" },
 	{"morse", (cmd_handler)cmd_morse, "Display morse error message" },
+	{"stats", (cmd_handler)cmd_stats, "Display and reset GDB link statistics" },
+	{"timing", (cmd_handler)cmd_timing, "Display and reset flash phase timing" },
+	{"bench", (cmd_handler)cmd_bench, "Measure probe primitive rates: (swclk|read <addr>|write <addr>|flash <addr> <len>)" },
+	{"flash_diff", (cmd_handler)cmd_flash_diff, "Only reprogram flash sectors that changed: (enable|disable)"},
+	{"attach_fast", (cmd_handler)cmd_attach_fast, "Scan with minimum-length reset sequences: (enable|disable)"},
+	{"keep_powered", (cmd_handler)cmd_keep_powered, "Keep debug port powered across detach: (enable|disable)"},
 	{"assert_srst", (cmd_handler)cmd_assert_srst, "Assert SRST until:(never(default)| scan | attach)" },
 	{"halt_timeout", (cmd_handler)cmd_halt_timeout, "Timeout (ms) to wait until Cortex-M is halted: (Default 2000)" },
 	{"hard_srst", (cmd_handler)cmd_hard_srst, "Force a pulse on the hard SRST line - disconnects target" },
@@ -83,13 +106,34 @@ const struct command_s cmd_list[] = {
 #endif
 #ifdef PLATFORM_HAS_TRACESWO
 	{"traceswo", (cmd_handler)cmd_traceswo, "Start trace capture [(baudrate) for async swo]" },
+	{"trace_ts", (cmd_handler)cmd_trace_ts, "Timestamp trace frames with the probe cycle counter: (enable|disable)"},
+	{"dump", (cmd_handler)cmd_dump, "Stream raw memory over the trace endpoint: <addr> <len>" },
+	{"profile", (cmd_handler)cmd_profile, "Sample the running PC to the trace endpoint: (start <hz>|stop)" },
+	{"watch", (cmd_handler)cmd_watch, "Sample memory to the trace endpoint while running: (add <addr> <len> <hz>|clear)" },
 #endif
 #ifdef PLATFORM_HAS_DEBUG
 	{"debug_bmp", (cmd_handler)cmd_debug_bmp, "Output BMP \"debug\" strings to the second vcom: (enable|disable)"},
+	{"debug_dump", (cmd_handler)cmd_debug_dump, "Replay the in-memory DEBUG trace ring"},
 #endif
 	{NULL, NULL, NULL}
 };
 
+/* Hash-based dispatch for exact command names.  The table is built
+ * over cmd_list on first use; an entry holds index+1, 0 means empty.
+ * Abbreviated commands fall back to the prefix scan. */
+#define CMD_HASH_SIZE 32
+
+static uint8_t cmd_hash_tab[CMD_HASH_SIZE];
+static bool cmd_hash_built;
+
+static uint32_t cmd_hash(const char *s)
+{
+	uint32_t h = 5381;
+	while (*s)
+		h = (h * 33) + *s++;
+	return h & (CMD_HASH_SIZE - 1);
+}
+
 static enum assert_srst_t assert_srst;
 #ifdef PLATFORM_HAS_DEBUG
 bool debug_bmp;
@@ -112,12 +156,37 @@ int command_process(target *t, char *cmd)
 	for(argc = 0, argv[argc] = strtok(cmd, " \t");
 		argv[argc]; argv[++argc] = strtok(NULL, " \t"));
 
+	if (!cmd_hash_built) {
+		unsigned n = 0;
+		for (c = cmd_list; c->cmd; c++, n++) {
+			uint32_t h = cmd_hash(c->cmd);
+			while (cmd_hash_tab[h])
+				h = (h + 1) & (CMD_HASH_SIZE - 1);
+			cmd_hash_tab[h] = n + 1;
+		}
+		cmd_hash_built = true;
+	}
+
+	/* Exact names (what scripted monitor traffic sends) dispatch
+	 * through the hash table in constant time */
+	if (argc) {
+		for (uint32_t h = cmd_hash(argv[0]); cmd_hash_tab[h];
+		     h = (h + 1) & (CMD_HASH_SIZE - 1)) {
+			c = &cmd_list[cmd_hash_tab[h] - 1];
+			if (!strcmp(argv[0], c->cmd))
+				return !c->handler(t, argc, argv);
+		}
+	}
+
 	/* Look for match and call handler */
+	size_t cmdlen = argc ? strlen(argv[0]) : 0;
 	for(c = cmd_list; c->cmd; c++) {
 		/* Accept a partial match as GDB does.
 		 * So 'mon ver' will match 'monitor version'
-		 */
-		if ((argc == 0) || !strncmp(argv[0], c->cmd, strlen(argv[0])))
+		 * The first character rejects most entries without a full
+		 * compare. */
+		if ((argc == 0) || ((argv[0][0] == c->cmd[0]) &&
+		                    !strncmp(argv[0], c->cmd, cmdlen)))
 			return !c->handler(t, argc, argv);
 	}
 
@@ -178,6 +247,172 @@ bool cmd_morse(void)
 	return true;
 }
 
+bool cmd_stats(void)
+{
+	struct gdb_packet_stats *s = &gdb_packet_stats;
+
+	gdb_outf("Link: %u packets rx (%u bytes), %u packets tx (%u bytes), "
+	         "%u resends\n", s->rx_packets, s->rx_bytes,
+	         s->tx_packets, s->tx_bytes, s->tx_resends);
+	memset(s, 0, sizeof(*s));
+	return true;
+}
+
+bool cmd_timing(void)
+{
+	struct flash_timing *ft = &flash_timing;
+
+	gdb_outf("Flash: erase %uus, program %uus, verify %uus\n",
+	         ft->erase_us, ft->program_us, ft->verify_us);
+	memset(ft, 0, sizeof(*ft));
+	return true;
+}
+
+/* In-situ microbenchmarks of the probe's primitive rates, so a slow
+ * unit or a firmware regression shows up without a scope.  Each run
+ * hammers one primitive for about a second and reports the rate. */
+#define BENCH_RUN_MS 1000
+
+static bool cmd_bench(target *t, int argc, const char **argv)
+{
+	uint32_t start, elapsed, ops = 0;
+
+	if (argc < 2) {
+		gdb_out("Usage: bench (swclk|read <addr>|write <addr>"
+		        "|flash <addr> <len>)\n");
+		return false;
+	}
+
+	if (!strcmp(argv[1], "swclk")) {
+#ifdef SWD_SPI
+		/* Raw wire rate: clock out idle cycles as fast as the
+		 * tap allows.  Run after a scan so the tap is set up. */
+		start = platform_time_ms();
+		do {
+			swdptap_seq_out(0, 32);
+			ops++;
+		} while ((elapsed = platform_time_ms() - start) < BENCH_RUN_MS);
+		gdb_outf("SWCLK: %u kHz (%u 32-bit sequences)\n",
+		         ops * 32 / elapsed, ops);
+#else
+		gdb_out("swclk bench needs the SWD_SPI build\n");
+#endif
+		return true;
+	}
+
+	if (!strcmp(argv[1], "read") || !strcmp(argv[1], "write")) {
+		bool wr = (argv[1][0] == 'w');
+		uint32_t word = 0xDEADBEEF;
+		uint32_t addr;
+
+		if (t == NULL) {
+			gdb_out("Bench requires an attached target\n");
+			return false;
+		}
+		if (argc < 3) {
+			gdb_outf("Usage: bench %s <ram addr>\n", argv[1]);
+			return false;
+		}
+		addr = strtoul(argv[2], NULL, 0);
+		start = platform_time_ms();
+		do {
+			int err = wr ? target_mem_write(t, addr, &word, 4) :
+			               target_mem_read(t, &word, addr, 4);
+			if (err) {
+				gdb_outf("Memory %s failed at 0x%08"PRIx32"\n",
+				         argv[1], addr);
+				return false;
+			}
+			ops++;
+		} while ((elapsed = platform_time_ms() - start) < BENCH_RUN_MS);
+		gdb_outf("Word %s: %u ops/s\n", argv[1],
+		         (uint32_t)((uint64_t)ops * 1000 / elapsed));
+		return true;
+	}
+
+	if (!strcmp(argv[1], "flash")) {
+		uint8_t pattern[256];
+		uint32_t addr, len, offset;
+
+		if (t == NULL) {
+			gdb_out("Bench requires an attached target\n");
+			return false;
+		}
+		if (argc < 4) {
+			gdb_out("Usage: bench flash <addr> <len>\n");
+			return false;
+		}
+		addr = strtoul(argv[2], NULL, 0);
+		len = strtoul(argv[3], NULL, 0);
+		if (len == 0) {
+			gdb_out("Usage: bench flash <addr> <len>\n");
+			return false;
+		}
+		for (offset = 0; offset < sizeof(pattern); offset++)
+			pattern[offset] = offset;
+		/* Destructive: erases and programs the region given */
+		start = platform_time_us();
+		for (offset = 0; offset < len; offset += sizeof(pattern)) {
+			uint32_t chunk = len - offset;
+			if (chunk > sizeof(pattern))
+				chunk = sizeof(pattern);
+			if (target_flash_write(t, addr + offset, pattern,
+			                       chunk)) {
+				gdb_outf("Flash write failed at 0x%08"PRIx32"\n",
+				         addr + offset);
+				return false;
+			}
+		}
+		if (target_flash_done(t)) {
+			gdb_out("Flash write failed to complete\n");
+			return false;
+		}
+		elapsed = platform_time_us() - start;
+		if (elapsed == 0)
+			elapsed = 1;
+		gdb_outf("Flash: %"PRIu32" bytes in %uus, %u KiB/s\n", len,
+		         elapsed,
+		         (uint32_t)((uint64_t)len * 1000000 / elapsed / 1024));
+		return true;
+	}
+
+	gdb_outf("Unrecognised bench '%s'\n", argv[1]);
+	return false;
+}
+
+static bool cmd_flash_diff(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1) {
+		flash_diff = !strcmp(argv[1], "enable");
+	}
+	gdb_outf("Flash diff mode is %s\n",
+		 flash_diff ? "enabled" : "disabled");
+	return true;
+}
+
+static bool cmd_attach_fast(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1) {
+		attach_fast = !strcmp(argv[1], "enable");
+	}
+	gdb_outf("Fast attach mode is %s\n",
+		 attach_fast ? "enabled" : "disabled");
+	return true;
+}
+
+static bool cmd_keep_powered(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1) {
+		keep_powered = !strcmp(argv[1], "enable");
+	}
+	gdb_outf("Keep powered mode is %s\n",
+		 keep_powered ? "enabled" : "disabled");
+	return true;
+}
+
 static bool cmd_assert_srst(target *t, int argc, const char **argv)
 {
 	(void)t;
@@ -249,10 +484,133 @@ static bool cmd_traceswo(target *t, int argc, const char **argv)
 	if (argc > 1)
 		baudrate = atoi(argv[1]);
 
+#if defined(TRACESWO_PROTOCOL) && (TRACESWO_PROTOCOL == 2)
+	/* Optional stimulus port mask: only those ITM channels reach USB */
+	if (argc > 2)
+		traceswo_setmask(strtol(argv[2], NULL, 0));
+	else
+		traceswo_setmask(0xFFFFFFFF);
+#endif
 	traceswo_init(baudrate);
 	gdb_outf("%s:%02X:%02X\n", serial_no, 5, 0x85);
 	return true;
 }
+
+static bool trace_ts;
+
+static bool cmd_trace_ts(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if (argc > 1) {
+		trace_ts = !strcmp(argv[1], "enable");
+		traceswo_timestamp(trace_ts);
+	}
+	gdb_outf("Trace timestamping is %s\n",
+		 trace_ts ? "enabled" : "disabled");
+	return true;
+}
+
+/* Stream raw target memory out of the trace endpoint.  Hex encoding,
+ * packet framing and acks cap RSP memory reads well below link
+ * bandwidth; large crash dumps go out here as straight binary instead,
+ * received with scripts/dumplisten.c.  Shares the endpoint with SWO
+ * capture, so don't mix the two. */
+static bool cmd_dump(target *t, int argc, const char **argv)
+{
+	uint8_t buf[256];
+	uint32_t addr, len;
+
+	if (t == NULL) {
+		gdb_out("Dump requires an attached target\n");
+		return false;
+	}
+	if (argc < 3) {
+		gdb_out("Usage: dump <addr> <len>\n");
+		return false;
+	}
+	addr = strtoul(argv[1], NULL, 0);
+	len = strtoul(argv[2], NULL, 0);
+
+	while (len) {
+		uint32_t chunk = MIN(sizeof(buf), len);
+		if (target_mem_read(t, buf, addr, chunk)) {
+			gdb_outf("Memory read failed at 0x%08" PRIx32 "\n", addr);
+			return false;
+		}
+		if (!trace_dump_write(buf, chunk)) {
+			gdb_out("Trace endpoint stalled - is the receiver running?\n");
+			return false;
+		}
+		addr += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+static bool cmd_profile(target *t, int argc, const char **argv)
+{
+	if ((argc > 1) && !strcmp(argv[1], "start")) {
+		if (t == NULL) {
+			gdb_out("Profiling requires an attached target\n");
+			return false;
+		}
+		uint32_t hz = (argc > 2) ? strtoul(argv[2], NULL, 0) : 100;
+		if (!profile_start(hz)) {
+			gdb_out("Usage: profile start <hz> (1..1000)\n");
+			return false;
+		}
+		gdb_outf("Profiling at %" PRIu32 " Hz while the target runs; "
+			 "samples stream to the trace endpoint\n", hz);
+	} else if ((argc > 1) && !strcmp(argv[1], "stop")) {
+		profile_stop();
+		gdb_outf("Profiling stopped: %" PRIu32 " samples\n",
+			 profile_sample_count());
+	} else {
+		gdb_outf("Profiling is %s (%" PRIu32 " samples)\n",
+			 profile_active() ? "running" : "stopped",
+			 profile_sample_count());
+	}
+	return true;
+}
+
+static bool cmd_watch(target *t, int argc, const char **argv)
+{
+	(void)t;
+	if ((argc > 1) && !strcmp(argv[1], "add")) {
+		if (argc < 5) {
+			gdb_out("Usage: watch add <addr> <len> <hz>\n");
+			return false;
+		}
+		uint32_t addr = strtoul(argv[2], NULL, 0);
+		uint32_t len = strtoul(argv[3], NULL, 0);
+		uint32_t hz = strtoul(argv[4], NULL, 0);
+		if (!memwatch_add(addr, len, hz)) {
+			gdb_outf("Can't add watch: %u entries max, "
+				 "len 1..%d, hz 1..1000\n",
+				 MEMWATCH_MAX, MEMWATCH_MAX_LEN);
+			return false;
+		}
+		gdb_outf("Watch %u: 0x%08" PRIx32 " len %" PRIu32
+			 " at %" PRIu32 " Hz; samples stream to the "
+			 "trace endpoint while the target runs\n",
+			 memwatch_count() - 1, addr, len, hz);
+	} else if ((argc > 1) && !strcmp(argv[1], "clear")) {
+		memwatch_clear();
+		gdb_out("Watches cleared\n");
+	} else {
+		for (unsigned i = 0; i < memwatch_count(); i++) {
+			const struct memwatch_entry *e = memwatch_entry_get(i);
+			gdb_outf("Watch %u: 0x%08" PRIx32 " len %" PRIu32
+				 " every %" PRIu32 " ms\n",
+				 i, e->addr, e->len, e->interval_ms);
+		}
+		if (!memwatch_count())
+			gdb_out("No watches\n");
+		else if (memwatch_stalled())
+			gdb_out("Sampling stalled - is the receiver running?\n");
+	}
+	return true;
+}
 #endif
 
 #ifdef PLATFORM_HAS_DEBUG
@@ -266,4 +624,13 @@ static bool cmd_debug_bmp(target *t, int argc, const char **argv)
 		 debug_bmp ? "enabled" : "disabled");
 	return true;
 }
+
+static bool cmd_debug_dump(target *t, int argc, const char **argv)
+{
+	(void)t;
+	(void)argc;
+	(void)argv;
+	debug_trace_dump();
+	return true;
+}
 #endif
@@ -21,6 +21,12 @@
 #include "general.h"
 #include "target.h"
 
+/* Platforms with plenty of RAM override this to read packet-buffer
+ * sized chunks per bulk transfer; the default suits small probes. */
+#ifndef CRC32_BUFFER_SIZE
+#define CRC32_BUFFER_SIZE 128
+#endif
+
 #if !defined(STM32F1) && !defined(STM32F4)
 static const uint32_t crc32_table[] = {
 	0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9,
@@ -94,28 +100,85 @@ static uint32_t crc32_calc(uint32_t crc, uint8_t data)
 	return (crc << 8) ^ crc32_table[((crc >> 24) ^ data) & 255];
 }
 
+/* Slicing tables, derived from crc32_table on first use.  With reads
+ * arriving in packet-buffer sized chunks the byte-at-a-time loop was
+ * the next limit; slicing folds four bytes per step. */
+static uint32_t crc32_slice_table[3][256];
+static bool crc32_slice_ready;
+
+static void crc32_slice_setup(void)
+{
+	for (unsigned i = 0; i < 256; i++) {
+		uint32_t x = crc32_table[i];
+		for (unsigned k = 0; k < 3; k++) {
+			x = (x << 8) ^ crc32_table[x >> 24];
+			crc32_slice_table[k][i] = x;
+		}
+	}
+	crc32_slice_ready = true;
+}
+
 uint32_t generic_crc32(target *t, uint32_t base, size_t len)
 {
 	uint32_t crc = -1;
-	uint8_t bytes[128];
+	static uint8_t bytes[CRC32_BUFFER_SIZE];
+
+	if (!crc32_slice_ready)
+		crc32_slice_setup();
 
 	while (len) {
 		size_t read_len = MIN(sizeof(bytes), len);
 		target_mem_read(t, bytes, base, read_len);
 
-		for (unsigned i = 0; i < read_len; i++)
+		size_t i = 0;
+		for (; i + 4 <= read_len; i += 4) {
+			crc ^= ((uint32_t)bytes[i] << 24) |
+			       ((uint32_t)bytes[i+1] << 16) |
+			       ((uint32_t)bytes[i+2] << 8) |
+			        (uint32_t)bytes[i+3];
+			crc = crc32_slice_table[2][crc >> 24] ^
+			      crc32_slice_table[1][(crc >> 16) & 0xff] ^
+			      crc32_slice_table[0][(crc >> 8) & 0xff] ^
+			      crc32_table[crc & 0xff];
+		}
+		for (; i < read_len; i++)
 			crc = crc32_calc(crc, bytes[i]);
 
 		base += read_len;
 		len -= read_len;
+		target_op_progress();
 	}
 	return crc;
 }
+
+uint32_t crc32_buf(const void *buf, size_t len)
+{
+	const uint8_t *bytes = buf;
+	uint32_t crc = -1;
+	size_t i = 0;
+
+	if (!crc32_slice_ready)
+		crc32_slice_setup();
+
+	for (; i + 4 <= len; i += 4) {
+		crc ^= ((uint32_t)bytes[i] << 24) |
+		       ((uint32_t)bytes[i+1] << 16) |
+		       ((uint32_t)bytes[i+2] << 8) |
+		        (uint32_t)bytes[i+3];
+		crc = crc32_slice_table[2][crc >> 24] ^
+		      crc32_slice_table[1][(crc >> 16) & 0xff] ^
+		      crc32_slice_table[0][(crc >> 8) & 0xff] ^
+		      crc32_table[crc & 0xff];
+	}
+	for (; i < len; i++)
+		crc = crc32_calc(crc, bytes[i]);
+	return crc;
+}
 #else
 #include <libopencm3/stm32/crc.h>
 uint32_t generic_crc32(target *t, uint32_t base, size_t len)
 {
-	uint8_t bytes[128];
+	static uint8_t bytes[CRC32_BUFFER_SIZE];
 	uint32_t crc;
 
 	CRC_CR |= CRC_CR_RESET;
@@ -129,6 +192,7 @@ uint32_t generic_crc32(target *t, uint32_t base, size_t len)
 
 		base += read_len;
 		len -= read_len;
+		target_op_progress();
 	}
 
 	crc = CRC_DR;
@@ -146,5 +210,32 @@ uint32_t generic_crc32(target *t, uint32_t base, size_t len)
 	}
 	return crc;
 }
+
+uint32_t crc32_buf(const void *buf, size_t len)
+{
+	const uint8_t *data = buf;
+	uint32_t crc;
+
+	CRC_CR |= CRC_CR_RESET;
+
+	while (len > 3) {
+		CRC_DR = __builtin_bswap32(*(uint32_t*)data);
+		data += 4;
+		len -= 4;
+	}
+
+	crc = CRC_DR;
+
+	while (len--) {
+		crc ^= *data++ << 24;
+		for (int i = 0; i < 8; i++) {
+			if (crc & 0x80000000)
+				crc = (crc << 1) ^ 0x4C11DB7;
+			else
+				crc <<= 1;
+		}
+	}
+	return crc;
+}
 #endif
 
@@ -0,0 +1,80 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* In-memory sink for DEBUG() instrumentation.  Each call formats one
+ * timestamped record into a RAM ring and nothing is emitted on the
+ * spot, so tracing stays enabled in production probes without the
+ * synchronous output perturbing the timings under measurement.  The
+ * ring is drained on demand by the `debug_dump' monitor command.
+ */
+
+#include "general.h"
+#include "gdb_packet.h"
+#include "debug_trace.h"
+
+#include <stdarg.h>
+
+#ifdef PLATFORM_HAS_DEBUG
+
+/* Power of two so index wrapping is a mask; once full, new records
+ * overwrite the oldest. */
+#define TRACE_ENTRIES	64
+#define TRACE_MSG_SIZE	60
+
+struct trace_entry {
+	uint32_t time_ms;
+	char msg[TRACE_MSG_SIZE];
+};
+
+static struct trace_entry trace_ring[TRACE_ENTRIES];
+/* Total records ever written; assumed written only from thread context.
+ * The dump command is the only reader and runs in the same context. */
+static volatile uint32_t trace_in;
+
+void debug_trace(const char *fmt, ...)
+{
+	struct trace_entry *e = &trace_ring[trace_in % TRACE_ENTRIES];
+	va_list ap;
+
+	e->time_ms = platform_time_ms();
+	va_start(ap, fmt);
+	vsnprintf(e->msg, sizeof(e->msg), fmt, ap);
+	va_end(ap);
+	/* Publish only once the record is complete */
+	trace_in++;
+}
+
+void debug_trace_dump(void)
+{
+	uint32_t in = trace_in;
+	uint32_t out = (in > TRACE_ENTRIES) ? (in - TRACE_ENTRIES) : 0;
+
+	if (in == 0) {
+		gdb_out("Trace empty\n");
+		return;
+	}
+	if (out)
+		gdb_outf("(%" PRIu32 " older records overwritten)\n", out);
+	for (; out < in; out++) {
+		struct trace_entry *e = &trace_ring[out % TRACE_ENTRIES];
+		gdb_outf("%7" PRIu32 " %s", e->time_ms, e->msg);
+	}
+}
+
+#endif
@@ -25,6 +25,96 @@
 #include "gdb_packet.h"
 
 int gdb_main_loop(struct target_controller *, bool in_syscall);
+extern target *cur_target;
+
+/* Probe-side block cache for semihosted file I/O.  Small sequential
+ * SYS_READs are served from a read-ahead block fetched with one Fread,
+ * and small sequential SYS_WRITEs are coalesced into one Fwrite, so
+ * file-driven targets aren't limited to one F exchange per call.
+ *
+ * gdb transfers cache blocks at a reserved address that the memory
+ * packet handlers redirect into probe memory (see gdb_main.c), so the
+ * target's own buffers are never overrun by the read-ahead. */
+#define FIO_BLOCK_SIZE	512
+#define FIO_XFER_ADDR	0xFE000000
+
+static struct {
+	int fd;
+	unsigned len;		/* valid bytes */
+	unsigned consumed;	/* already delivered to the target */
+	bool valid;
+	uint8_t data[FIO_BLOCK_SIZE];
+} fio_rdbuf;
+
+static struct {
+	int fd;
+	unsigned len;
+	bool valid;
+	uint8_t data[FIO_BLOCK_SIZE];
+} fio_wrbuf;
+
+static bool fio_redirect;
+
+bool hostio_fio_redirect_read(uint32_t addr, void *data, size_t len)
+{
+	if (!fio_redirect || (addr < FIO_XFER_ADDR) ||
+	    (addr - FIO_XFER_ADDR + len > FIO_BLOCK_SIZE))
+		return false;
+	memcpy(data, fio_wrbuf.data + (addr - FIO_XFER_ADDR), len);
+	return true;
+}
+
+bool hostio_fio_redirect_write(uint32_t addr, const void *data, size_t len)
+{
+	if (!fio_redirect || (addr < FIO_XFER_ADDR) ||
+	    (addr - FIO_XFER_ADDR + len > FIO_BLOCK_SIZE))
+		return false;
+	memcpy(fio_rdbuf.data + (addr - FIO_XFER_ADDR), data, len);
+	return true;
+}
+
+static int fio_write_flush(struct target_controller *tc)
+{
+	if (!fio_wrbuf.valid)
+		return 0;
+	unsigned len = fio_wrbuf.len;
+	int fd = fio_wrbuf.fd;
+	fio_wrbuf.valid = false;
+	gdb_putpacket_f("Fwrite,%08X,%08X,%08X", fd, FIO_XFER_ADDR, len);
+	fio_redirect = true;
+	int ret = gdb_main_loop(tc, true);
+	fio_redirect = false;
+	return (ret == (int)len) ? 0 : -1;
+}
+
+/* Give back read-ahead the target never consumed, so the host file
+ * position matches what the target believes */
+static void fio_read_sync(struct target_controller *tc)
+{
+	if (!fio_rdbuf.valid)
+		return;
+	unsigned excess = fio_rdbuf.len - fio_rdbuf.consumed;
+	int fd = fio_rdbuf.fd;
+	fio_rdbuf.valid = false;
+	if (!excess)
+		return;
+	gdb_putpacket_f("Flseek,%08X,-%X,%08X", fd, excess, TARGET_SEEK_CUR);
+	gdb_main_loop(tc, true);
+}
+
+static int fio_sync(struct target_controller *tc)
+{
+	int ret = fio_write_flush(tc);
+	fio_read_sync(tc);
+	return ret;
+}
+
+/* Flush pending coalesced writes and reposition the host file once the
+ * target stops: called before a stop reply goes out */
+void hostio_fio_drain(struct target_controller *tc)
+{
+	fio_sync(tc);
+}
 
 int hostio_reply(struct target_controller *tc, char *pbuf, int len)
 {
@@ -57,6 +147,7 @@ int hostio_open(struct target_controller *tc,
 
 int hostio_close(struct target_controller *tc, int fd)
 {
+	fio_sync(tc);
 	gdb_putpacket_f("Fclose,%08X", fd);
 	return gdb_main_loop(tc, true);
 }
@@ -64,20 +155,84 @@ int hostio_close(struct target_controller *tc, int fd)
 int hostio_read(struct target_controller *tc,
 	         int fd, target_addr buf, unsigned int count)
 {
-	gdb_putpacket_f("Fread,%08X,%08X,%08X", fd, buf, count);
-	return gdb_main_loop(tc, true);
+	/* Ordering: writes out first, and drop read-ahead for other fds */
+	if (fio_write_flush(tc) < 0)
+		return -1;
+	if (fio_rdbuf.valid && (fio_rdbuf.fd != fd))
+		fio_read_sync(tc);
+
+	/* Large reads go to the host directly */
+	if (!cur_target || (count > FIO_BLOCK_SIZE / 2)) {
+		fio_read_sync(tc);
+		gdb_putpacket_f("Fread,%08X,%08X,%08X", fd, buf, count);
+		return gdb_main_loop(tc, true);
+	}
+
+	if (!fio_rdbuf.valid || (fio_rdbuf.consumed == fio_rdbuf.len)) {
+		/* Refill: read a whole block ahead into probe memory */
+		fio_rdbuf.valid = false;
+		gdb_putpacket_f("Fread,%08X,%08X,%08X",
+		                fd, FIO_XFER_ADDR, FIO_BLOCK_SIZE);
+		fio_redirect = true;
+		int ret = gdb_main_loop(tc, true);
+		fio_redirect = false;
+		if (ret <= 0)
+			return ret;
+		fio_rdbuf.valid = true;
+		fio_rdbuf.fd = fd;
+		fio_rdbuf.len = ret;
+		fio_rdbuf.consumed = 0;
+	}
+
+	/* Serve from the cache; a short count here just means the target
+	 * comes back for the rest */
+	unsigned n = MIN(count, fio_rdbuf.len - fio_rdbuf.consumed);
+	if (target_mem_write(cur_target, buf,
+	                     fio_rdbuf.data + fio_rdbuf.consumed, n))
+		return -1;
+	fio_rdbuf.consumed += n;
+	tc->errno_ = 0;
+	return n;
 }
 
 int hostio_write(struct target_controller *tc,
 	          int fd, target_addr buf, unsigned int count)
 {
-	gdb_putpacket_f("Fwrite,%08X,%08X,%08X", fd, buf, count);
-	return gdb_main_loop(tc, true);
+	/* A write invalidates read-ahead on the same file */
+	if (fio_rdbuf.valid && (fio_rdbuf.fd == fd))
+		fio_read_sync(tc);
+	if (fio_wrbuf.valid && ((fio_wrbuf.fd != fd) ||
+	                        (fio_wrbuf.len + count > FIO_BLOCK_SIZE)))
+		if (fio_write_flush(tc) < 0)
+			return -1;
+
+	/* Large writes go to the host directly */
+	if (!cur_target || (count > FIO_BLOCK_SIZE)) {
+		if (fio_write_flush(tc) < 0)
+			return -1;
+		gdb_putpacket_f("Fwrite,%08X,%08X,%08X", fd, buf, count);
+		return gdb_main_loop(tc, true);
+	}
+
+	/* Coalesce: stage the data probe-side and report success now;
+	 * a host-side write failure surfaces on the flushing call */
+	if (!fio_wrbuf.valid) {
+		fio_wrbuf.valid = true;
+		fio_wrbuf.fd = fd;
+		fio_wrbuf.len = 0;
+	}
+	if (target_mem_read(cur_target, fio_wrbuf.data + fio_wrbuf.len,
+	                    buf, count))
+		return -1;
+	fio_wrbuf.len += count;
+	tc->errno_ = 0;
+	return count;
 }
 
 long hostio_lseek(struct target_controller *tc,
 	           int fd, long offset, enum target_seek_flag flag)
 {
+	fio_sync(tc);
 	gdb_putpacket_f("Flseek,%08X,%08X,%08X", fd, offset, flag);
 	return gdb_main_loop(tc, true);
 }
@@ -86,6 +241,7 @@ int hostio_rename(struct target_controller *tc,
 	           target_addr oldpath, size_t old_len,
 	           target_addr newpath, size_t new_len)
 {
+	fio_sync(tc);
 	gdb_putpacket_f("Frename,%08X/%X,%08X/%X",
 	                oldpath, old_len, newpath, new_len);
 	return gdb_main_loop(tc, true);
@@ -94,6 +250,7 @@ int hostio_rename(struct target_controller *tc,
 int hostio_unlink(struct target_controller *tc,
 	           target_addr path, size_t path_len)
 {
+	fio_sync(tc);
 	gdb_putpacket_f("Funlink,%08X/%X", path, path_len);
 	return gdb_main_loop(tc, true);
 }
@@ -101,12 +258,14 @@ int hostio_unlink(struct target_controller *tc,
 int hostio_stat(struct target_controller *tc,
 	         target_addr path, size_t path_len, target_addr buf)
 {
+	fio_sync(tc);
 	gdb_putpacket_f("Fstat,%08X/%X,%08X", path, path_len, buf);
 	return gdb_main_loop(tc, true);
 }
 
 int hostio_fstat(struct target_controller *tc, int fd, target_addr buf)
 {
+	fio_sync(tc);
 	gdb_putpacket_f("Ffstat,%X,%08X", fd, buf);
 	return gdb_main_loop(tc, true);
 }
@@ -127,6 +286,7 @@ int hostio_isatty(struct target_controller *tc, int fd)
 int hostio_system(struct target_controller *tc,
 	          target_addr cmd, size_t cmd_len)
 {
+	fio_sync(tc);
 	gdb_putpacket_f("Fsystem,%08X/%X", cmd, cmd_len);
 	return gdb_main_loop(tc, true);
 }
@@ -24,6 +24,12 @@
 
 int hostio_reply(struct target_controller *tc, char *packet, int len);
 
+/* File I/O block cache: redirection of gdb memory transfers aimed at
+ * the reserved cache window, and the flush hook run at target stop */
+bool hostio_fio_redirect_read(uint32_t addr, void *data, size_t len);
+bool hostio_fio_redirect_write(uint32_t addr, const void *data, size_t len);
+void hostio_fio_drain(struct target_controller *tc);
+
 /* Interface to host system calls */
 int hostio_open(struct target_controller *,
 	        target_addr path, size_t path_len,
@@ -34,6 +34,9 @@
 #include "command.h"
 #include "crc32.h"
 #include "morse.h"
+#include "rtos.h"
+#include "profile.h"
+#include "memwatch.h"
 
 #include "coredump.h"
 #include <signal.h>
@@ -45,16 +48,37 @@ enum gdb_signal {
 	GDB_SIGLOST = 29,
 };
 
-#define BUF_SIZE	1024
+/* The packet buffer size is negotiated with the host via the PacketSize
+ * attribute in the qSupported reply.  Platforms with RAM to spare
+ * (hosted builds) override this in platform.h to cut the packet count
+ * of large flash loads; the embedded probes keep the 1K default. */
+#ifndef GDB_PACKET_BUFFER_SIZE
+#define GDB_PACKET_BUFFER_SIZE	1024
+#endif
+#define BUF_SIZE	GDB_PACKET_BUFFER_SIZE
 
 #define ERROR_IF_NO_TARGET()	\
 	if(!cur_target) { gdb_putpacketz("EFF"); break; }
 
 static char pbuf[BUF_SIZE+1];
 
-static target *cur_target;
+target *cur_target;
 static target *last_target;
 
+/* Non-stop protocol state, negotiated with QNonStop.  In non-stop mode
+ * a resume is acknowledged immediately and the later stop is delivered
+ * as an asynchronous %Stop notification from the poll loop at the top
+ * of gdb_main_loop(), so the host keeps the command channel while the
+ * target runs. */
+static bool non_stop;
+static bool target_running;
+
+/* Thread selected with 'Hg': register operations against a task other
+ * than the one on the CPU are served from its saved context frame.
+ * Thread ids are TCB addresses (as rendered in the qXfer:threads
+ * annex); 0 keeps the running task. */
+static uint32_t thread_g_select;
+
 static void handle_q_packet(char *packet, int len);
 static void handle_v_packet(char *packet, int len);
 static void handle_z_packet(char *packet, int len);
@@ -94,6 +118,138 @@ static struct target_controller gdb_controller = {
 	.system = hostio_system,
 };
 
+/* Long driver loops report progress between units of work; route it to
+ * the packet layer's keep-alive so a slow mass erase or CRC does not
+ * trip gdb's retransmission timer and get issued twice. */
+void target_op_progress(void)
+{
+	gdb_keepalive();
+}
+
+/* While the target is halted its memory is immutable, but a backtrace
+ * arrives as many small overlapping 'm' reads around the stack pointer,
+ * each a full transaction chain through target_mem_read().  A few cache
+ * lines over recently read memory serve the overlap from the probe.
+ * The cache only ever holds halted-state data: it is flushed on every
+ * path that resumes, resets or writes the target. */
+#define MEM_CACHE_LINE_SIZE	64
+#define MEM_CACHE_LINES		4
+
+static struct mem_cache_line {
+	target_addr addr;
+	bool valid;
+	uint8_t data[MEM_CACHE_LINE_SIZE];
+} mem_cache[MEM_CACHE_LINES];
+static unsigned mem_cache_evict;
+
+static void gdb_mem_cache_flush(void)
+{
+	for (unsigned i = 0; i < MEM_CACHE_LINES; i++)
+		mem_cache[i].valid = false;
+}
+
+/* Serve an 'm' read from the cache, filling one line on a miss.  Reads
+ * that span a line boundary go straight to the target: they are rare
+ * in the stack-walk pattern and not worth a two-line fill. */
+static int gdb_mem_cache_read(target *t, void *dest, target_addr src,
+                              size_t len)
+{
+	target_addr base = src & ~(MEM_CACHE_LINE_SIZE - 1);
+
+	/* In non-stop mode reads are permitted while the core runs; that
+	 * data is in flight and must neither be served from nor fill a
+	 * line, or it would still be served after the next stop. */
+	if (non_stop && target_running)
+		return target_mem_read(t, dest, src, len);
+	if ((len == 0) || (len > MEM_CACHE_LINE_SIZE) ||
+	    (((src + len - 1) & ~(MEM_CACHE_LINE_SIZE - 1)) != base))
+		return target_mem_read(t, dest, src, len);
+
+	struct mem_cache_line *line = NULL;
+	for (unsigned i = 0; i < MEM_CACHE_LINES; i++)
+		if (mem_cache[i].valid && (mem_cache[i].addr == base))
+			line = &mem_cache[i];
+
+	if (!line) {
+		line = &mem_cache[mem_cache_evict];
+		mem_cache_evict = (mem_cache_evict + 1) % MEM_CACHE_LINES;
+		line->valid = false;
+		/* The full line may cross into an unmapped region the
+		 * requested bytes don't touch; serve such a read direct */
+		if (target_mem_read(t, line->data, base, MEM_CACHE_LINE_SIZE))
+			return target_mem_read(t, dest, src, len);
+		line->addr = base;
+		line->valid = true;
+	}
+	memcpy(dest, line->data + (src - base), len);
+	return 0;
+}
+
+/* A task other than the running one is selected for register access */
+static bool thread_reg_redirect(target *t)
+{
+	return thread_g_select &&
+	       (thread_g_select != rtos_current_thread(t));
+}
+
+/* Translate a halt reason into the RSP stop-reply text.  Shared by the
+ * all-stop '?' path and the non-stop %Stop notification. */
+static void gdb_stop_reply(char *buf, size_t size,
+                           enum target_halt_reason reason, target_addr watch)
+{
+	switch (reason) {
+	case TARGET_HALT_ERROR:
+		snprintf(buf, size, "X%02X", GDB_SIGLOST);
+		break;
+	case TARGET_HALT_REQUEST:
+		snprintf(buf, size, "T%02X", GDB_SIGINT);
+		break;
+	case TARGET_HALT_WATCHPOINT:
+		snprintf(buf, size, "T%02Xwatch:%08X;", GDB_SIGTRAP, watch);
+		break;
+	case TARGET_HALT_FAULT:
+		snprintf(buf, size, "T%02X", GDB_SIGSEGV);
+		break;
+	default:
+		snprintf(buf, size, "T%02X", GDB_SIGTRAP);
+	}
+}
+
+/* Block until the target halts (or the host interrupts it), then send
+ * the stop reply: the tail of every all-stop resume. */
+static void gdb_wait_for_halt(void)
+{
+	target_addr watch;
+	enum target_halt_reason reason;
+	char reply[64];
+
+	while(!(reason = target_halt_poll(cur_target, &watch))) {
+		profile_poll(cur_target);
+		memwatch_poll(cur_target);
+		platform_event_pump();
+		unsigned char c = gdb_if_getchar_to(10);
+		if((c == '\x03') || (c == '\x04')) {
+			target_halt_request(cur_target);
+		}
+	}
+	SET_RUN_STATE(0);
+
+	/* The halt poll resumes the target internally to service
+	 * semihosting requests, and the F-packet exchange takes real 'm'
+	 * reads that fill cache lines; the target then ran over them.
+	 * Drop anything cached before the halted state is reported. */
+	gdb_mem_cache_flush();
+
+	/* Flush coalesced semihosting file writes while still in the
+	 * continue context, before the stop reply goes out */
+	hostio_fio_drain(&gdb_controller);
+
+	gdb_stop_reply(reply, sizeof(reply), reason, watch);
+	gdb_putpacketz(reply);
+	if (reason == TARGET_HALT_ERROR)
+		morse("TARGET LOST.", true);
+}
+
 volatile bool coredump_requested;
 void sigusr1_handler(int x)
 {
@@ -114,6 +270,35 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 	/* GDB protocol main loop */
 	while(1) {
 		SET_IDLE_STATE(1);
+		/* In non-stop mode the target runs while we keep serving
+		 * packets: watch it between arrivals and report a halt as a
+		 * notification rather than a reply. */
+		while (non_stop && target_running && !gdb_rx_available(10)) {
+			target_addr watch;
+			enum target_halt_reason reason;
+
+			if (!cur_target) {
+				target_running = false;
+				break;
+			}
+			reason = target_halt_poll(cur_target, &watch);
+			if (!reason) {
+				profile_poll(cur_target);
+				memwatch_poll(cur_target);
+				platform_event_pump();
+				continue;
+			}
+			SET_RUN_STATE(0);
+			target_running = false;
+			/* Same rule as gdb_wait_for_halt: nothing cached
+			 * while the target could run survives the stop */
+			gdb_mem_cache_flush();
+			hostio_fio_drain(tc);
+			char notif[64] = "Stop:";
+			gdb_stop_reply(notif + 5, sizeof(notif) - 5,
+			               reason, watch);
+			gdb_putnotifz(notif);
+		}
 		size = gdb_getpacket(pbuf, BUF_SIZE);
 		if (coredump_requested && (cur_target == NULL)) {
 			printf("Core dump requested\n");
@@ -128,8 +313,16 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 		/* Implementation of these is mandatory! */
 		case 'g': { /* 'g': Read general registers */
 			ERROR_IF_NO_TARGET();
-			uint8_t arm_regs[target_regs_size(cur_target)];
-			target_regs_read(cur_target, arm_regs);
+			uint32_t arm_regs[target_regs_size(cur_target) / 4];
+			if (thread_reg_redirect(cur_target)) {
+				if (!rtos_thread_regs(cur_target,
+				                      thread_g_select, arm_regs,
+				                      sizeof(arm_regs) / 4)) {
+					gdb_putpacketz("E01");
+					break;
+				}
+			} else
+				target_regs_read(cur_target, arm_regs);
 			gdb_putpacket(hexify(pbuf, arm_regs, sizeof(arm_regs)),
 			              sizeof(arm_regs) * 2);
 			break;
@@ -143,15 +336,78 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 			DEBUG("m packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			uint8_t mem[len];
-			if (target_mem_read(cur_target, mem, addr, len))
+			/* Read into the back half of the packet buffer and hexify
+			 * in place into the front: no bounce buffer, and the data
+			 * is traversed once.  Safe because byte i's hex pair ends
+			 * at pbuf[2*i+1] <= pbuf[len+i], its stash cell, and
+			 * hexify loads each byte before writing its pair. */
+			uint8_t *mem = (uint8_t *)pbuf + len;
+			if (hostio_fio_redirect_read(addr, mem, len))
+				gdb_putpacket(hexify(pbuf, mem, len), len*2);
+			else if (gdb_mem_cache_read(cur_target, mem, addr, len))
 				gdb_putpacketz("E01");
 			else
 				gdb_putpacket(hexify(pbuf, mem, len), len*2);
 			break;
 			}
+		case 'p': {	/* 'p reg': Read single register */
+			uint32_t reg;
+			uint8_t val[8];
+			ERROR_IF_NO_TARGET();
+			sscanf(pbuf, "p%" SCNx32, &reg);
+			ssize_t s;
+			if (thread_reg_redirect(cur_target)) {
+				/* Saved-frame view: word registers only; gdb
+				 * falls back to 'g' for anything else */
+				uint32_t regs[19];
+				if ((reg < 19) &&
+				    rtos_thread_regs(cur_target,
+				                     thread_g_select, regs, 19)) {
+					memcpy(val, &regs[reg], 4);
+					s = 4;
+				} else
+					s = -1;
+			} else
+				s = target_reg_read(cur_target, reg,
+				                    val, sizeof(val));
+			if (s > 0)
+				gdb_putpacket(hexify(pbuf, val, s), s * 2);
+			else
+				/* No single-register support; an empty reply
+				 * makes gdb fall back to 'g' */
+				gdb_putpacketz("");
+			break;
+			}
+		case 'P': {	/* 'P reg=XX': Write single register */
+			uint32_t reg;
+			int hex;
+			uint8_t val[8];
+			ERROR_IF_NO_TARGET();
+			sscanf(pbuf, "P%" SCNx32 "=%n", &reg, &hex);
+			size_t s = (size - hex) / 2;
+			if (s > sizeof(val)) {
+				gdb_putpacketz("E02");
+				break;
+			}
+			if (thread_reg_redirect(cur_target)) {
+				gdb_putpacketz("E01");
+				break;
+			}
+			unhexify(val, pbuf + hex, s);
+			if (target_reg_write(cur_target, reg, val, s) > 0)
+				gdb_putpacketz("OK");
+			else
+				gdb_putpacketz("");
+			break;
+			}
 		case 'G': {	/* 'G XX': Write general registers */
 			ERROR_IF_NO_TARGET();
+			/* Writing a switched-out task's saved context is not
+			 * supported */
+			if (thread_reg_redirect(cur_target)) {
+				gdb_putpacketz("E01");
+				break;
+			}
 			uint8_t arm_regs[target_regs_size(cur_target)];
 			unhexify(arm_regs, &pbuf[1], sizeof(arm_regs));
 			target_regs_write(cur_target, arm_regs);
@@ -168,9 +424,28 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 			DEBUG("M packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			uint8_t mem[len];
-			unhexify(mem, pbuf + hex, len);
-			if (target_mem_write(cur_target, addr, mem, len))
+			/* Decode in place: byte i lands at pbuf[i], always below
+			 * its own hex pair at pbuf[hex + 2*i].  Large payloads
+			 * (hosted builds negotiate 64K packets) are decoded and
+			 * written in 1K runs, so each run reaches the bulk
+			 * write engine while still cache-hot instead of the
+			 * whole payload being traversed twice. */
+			gdb_mem_cache_flush();
+			uint32_t done = 0;
+			bool err = false;
+			while (done < len) {
+				uint32_t chunk = MIN(len - done, 1024);
+				unhexify(pbuf + done, pbuf + hex + 2 * done, chunk);
+				if (hostio_fio_redirect_write(addr + done,
+				                              pbuf + done, chunk)) {
+				} else if (target_mem_write(cur_target, addr + done,
+				                            pbuf + done, chunk)) {
+					err = true;
+					break;
+				}
+				done += chunk;
+			}
+			if (err)
 				gdb_putpacketz("E01");
 			else
 				gdb_putpacketz("OK");
@@ -185,49 +460,32 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 
+			gdb_mem_cache_flush();
 			target_halt_resume(cur_target, single_step);
 			SET_RUN_STATE(1);
 			single_step = false;
+			if (non_stop) {
+				/* The resume reply is immediate; the stop
+				 * arrives later as a %Stop notification. */
+				target_running = true;
+				gdb_putpacketz("OK");
+				break;
+			}
 			/* fall through */
 		case '?': {	/* '?': Request reason for target halt */
 			/* This packet isn't documented as being mandatory,
 			 * but GDB doesn't work without it. */
-			target_addr watch;
-			enum target_halt_reason reason;
-
 			if(!cur_target) {
 				/* Report "target exited" if no target */
 				gdb_putpacketz("W00");
 				break;
 			}
-
-			/* Wait for target halt */
-			while(!(reason = target_halt_poll(cur_target, &watch))) {
-				unsigned char c = gdb_if_getchar_to(10);
-				if((c == '\x03') || (c == '\x04')) {
-					target_halt_request(cur_target);
-				}
-			}
-			SET_RUN_STATE(0);
-
-			/* Translate reason to GDB signal */
-			switch (reason) {
-			case TARGET_HALT_ERROR:
-				gdb_putpacket_f("X%02X", GDB_SIGLOST);
-				morse("TARGET LOST.", true);
-				break;
-			case TARGET_HALT_REQUEST:
-				gdb_putpacket_f("T%02X", GDB_SIGINT);
-				break;
-			case TARGET_HALT_WATCHPOINT:
-				gdb_putpacket_f("T%02Xwatch:%08X;", GDB_SIGTRAP, watch);
-				break;
-			case TARGET_HALT_FAULT:
-				gdb_putpacket_f("T%02X", GDB_SIGSEGV);
+			if (non_stop && target_running) {
+				/* Nothing has stopped */
+				gdb_putpacketz("OK");
 				break;
-			default:
-				gdb_putpacket_f("T%02X", GDB_SIGTRAP);
 			}
+			gdb_wait_for_halt();
 			break;
 			}
 		case 'F':	/* Semihosting call finished */
@@ -250,14 +508,24 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 
 		case 0x04:
 		case 'D':	/* GDB 'detach' command. */
+			/* The next session negotiates ACK and stop modes
+			 * afresh */
+			gdb_set_noackmode(false);
+			non_stop = false;
+			target_running = false;
 			if(cur_target)
 				target_detach(cur_target);
 			last_target = cur_target;
 			cur_target = NULL;
-			gdb_putpacketz("OK");
+			/* 0x04 is the transport's EOF marker, not a host
+			 * packet; replying to it can race a fresh
+			 * connection.  Only a real detach gets an OK. */
+			if (pbuf[0] == 'D')
+				gdb_putpacketz("OK");
 			break;
 
 		case 'k':	/* Kill the target */
+			gdb_mem_cache_flush();
 			if(cur_target) {
 				target_reset(cur_target);
 				target_detach(cur_target);
@@ -268,6 +536,7 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 
 		case 'r':	/* Reset the target system */
 		case 'R':	/* Restart the target program */
+			gdb_mem_cache_flush();
 			if(cur_target)
 				target_reset(cur_target);
 			else if(last_target) {
@@ -287,18 +556,77 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 				break;
 			}
 			DEBUG("X packet: addr = %" PRIx32 ", len = %" PRIx32 "\n", addr, len);
-			if (target_mem_write(cur_target, addr, pbuf+bin, len))
+			/* gdb_getpacket() has already unescaped the binary
+			 * payload in place, so the packet buffer is handed to
+			 * target_mem_write() directly -- no staging copy. */
+			gdb_mem_cache_flush();
+			if (hostio_fio_redirect_write(addr, pbuf+bin, len))
+				gdb_putpacketz("OK");
+			else if (target_mem_write(cur_target, addr, pbuf+bin, len))
 				gdb_putpacketz("E01");
 			else
 				gdb_putpacketz("OK");
 			break;
 			}
 
+		case 'H': {	/* 'Hg/Hc id': Set thread for later operations */
+			/* Execution always resumes the whole core, so 'Hc' is
+			 * only acknowledged; 'g' selections are honoured.  ids
+			 * 0 and -1 mean "any"/"all": the running task. */
+			long id = strtol(pbuf + 2, NULL, 16);
+			if (pbuf[1] == 'g')
+				thread_g_select = (id > 0) ? (uint32_t)id : 0;
+			gdb_putpacketz("OK");
+			break;
+			}
+
+		case 'T':	/* 'T id': Thread alive query */
+			gdb_putpacketz("OK");
+			break;
+
 		case 'q':	/* General query packet */
+		case 'Q':	/* General set packet */
 			handle_q_packet(pbuf, size);
 			break;
 
 		case 'v':	/* General query packet */
+			if (!strcmp(pbuf, "vCont?")) {
+				/* Resume actions; 'r' keeps the range-step
+				 * loop on the probe instead of one RSP round
+				 * trip per instruction */
+				gdb_putpacketz("vCont;c;C;s;S;r");
+				break;
+			}
+			if (!strncmp(pbuf, "vCont;", 6)) {
+				if(!cur_target) {
+					gdb_putpacketz("X1D");
+					break;
+				}
+				gdb_mem_cache_flush();
+				if (pbuf[6] == 'r') {
+					uint32_t start, end;
+					sscanf(pbuf + 7, "%" SCNx32 ",%" SCNx32,
+					       &start, &end);
+					/* Plain step if the driver has no
+					 * range support */
+					if (!target_halt_range_resume(
+					            cur_target, start, end))
+						target_halt_resume(cur_target,
+						                   true);
+				} else {
+					target_halt_resume(cur_target,
+					        (pbuf[6] == 's') ||
+					        (pbuf[6] == 'S'));
+				}
+				SET_RUN_STATE(1);
+				if (non_stop) {
+					target_running = true;
+					gdb_putpacketz("OK");
+					break;
+				}
+				gdb_wait_for_halt();
+				break;
+			}
 			handle_v_packet(pbuf, size);
 			break;
 
@@ -316,6 +644,13 @@ int gdb_main_loop(struct target_controller *tc, bool in_syscall)
 	}
 }
 
+/* qXfer annexes (features, memory-map, ...) are read in offset
+ * windows.  The source length is computed when a transfer starts and
+ * remembered across windows, so serving a large annex doesn't rescan
+ * the whole string once per window. */
+static const char *q_string_source;
+static size_t q_string_len;
+
 static void
 handle_q_string_reply(const char *str, const char *param)
 {
@@ -325,14 +660,18 @@ handle_q_string_reply(const char *str, const char *param)
 		gdb_putpacketz("E01");
 		return;
 	}
-	if (addr < strlen (str)) {
+	if ((str != q_string_source) || (addr == 0)) {
+		q_string_source = str;
+		q_string_len = strlen(str);
+	}
+	if (addr < q_string_len) {
+		if (len > q_string_len - addr)
+			len = q_string_len - addr;
 		char reply[len+2];
 		reply[0] = 'm';
-		strncpy (reply + 1, &str[addr], len);
-		if(len > strlen(&str[addr]))
-			len = strlen(&str[addr]);
+		memcpy(reply + 1, &str[addr], len);
 		gdb_putpacket(reply, len + 1);
-	} else if (addr == strlen (str)) {
+	} else if (addr == q_string_len) {
 		gdb_putpacketz("l");
 	} else
 		gdb_putpacketz("E01");
@@ -354,6 +693,8 @@ handle_q_packet(char *packet, int len)
 		unhexify(data, packet+6, datalen);
 		data[datalen] = 0;	/* add terminating null */
 
+		/* Monitor commands may write or reset the target */
+		gdb_mem_cache_flush();
 		int c = command_process(cur_target, data);
 		if(c < 0)
 			gdb_putpacketz("");
@@ -363,8 +704,56 @@ handle_q_packet(char *packet, int len)
 			gdb_putpacketz("E");
 
 	} else if (!strncmp (packet, "qSupported", 10)) {
-		/* Query supported protocol features */
-		gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+", BUF_SIZE);
+		/* Query supported protocol features.  A new session starts
+		 * here, so forget RTOS symbols from the previous one. */
+		rtos_reset();
+		thread_g_select = 0;
+		gdb_putpacket_f("PacketSize=%X;qXfer:memory-map:read+;qXfer:features:read+;qXfer:threads:read+;QStartNoAckMode+;QNonStop+", BUF_SIZE);
+
+	} else if (!strncmp (packet, "qSymbol:", 8)) {
+		/* gdb's symbol lookup service, which feeds the RTOS thread
+		 * awareness.  "qSymbol::" opens the exchange; answers carry
+		 * the value (empty if undefined) and the hex-encoded name. */
+		char *rest = packet + 8;
+		char *colon = strchr(rest, ':');
+		if ((colon == rest) && !colon[1]) {
+			/* A new symbol table is on offer: re-request all */
+			rtos_reset();
+		} else if (colon) {
+			size_t namelen = strlen(colon + 1) / 2;
+			char name[namelen + 1];
+			unhexify(name, colon + 1, namelen);
+			name[namelen] = 0;
+			if (namelen)
+				rtos_symbol_set(name, strtoul(rest, NULL, 16));
+		}
+		const char *want = rtos_symbol_wanted();
+		if (want) {
+			char hexname[strlen(want) * 2 + 1];
+			gdb_putpacket_f("qSymbol:%s",
+			                hexify(hexname, want, strlen(want)));
+		} else {
+			gdb_putpacketz("OK");
+		}
+
+	} else if (!strcmp (packet, "qC")) {
+		/* Current thread id: the running task's TCB address */
+		uint32_t tid = cur_target ? rtos_current_thread(cur_target) : 0;
+		gdb_putpacket_f("QC%" PRIx32, tid);
+
+	} else if (!strncmp (packet, "QNonStop:", 9)) {
+		/* Select between all-stop and non-stop operation */
+		non_stop = (packet[9] == '1');
+		if (!non_stop)
+			target_running = false;
+		gdb_putpacketz("OK");
+
+	} else if (!strcmp (packet, "QStartNoAckMode")) {
+		/* Host considers the link reliable: stop exchanging ACKs.
+		 * The reply itself is still acknowledged; the stray '+' is
+		 * discarded while waiting for the next packet start. */
+		gdb_putpacketz("OK");
+		gdb_set_noackmode(true);
 
 	} else if (strncmp (packet, "qXfer:memory-map:read::", 23) == 0) {
 		/* Read target XML memory map */
@@ -377,9 +766,7 @@ handle_q_packet(char *packet, int len)
 			gdb_putpacketz("E01");
 			return;
 		}
-		char buf[1024];
-		target_mem_map(cur_target, buf, sizeof(buf)); /* Fixme: Check size!*/
-		handle_q_string_reply(buf, packet + 23);
+		handle_q_string_reply(target_mem_map(cur_target), packet + 23);
 
 	} else if (strncmp (packet, "qXfer:features:read:target.xml:", 31) == 0) {
 		/* Read target description */
@@ -393,12 +780,24 @@ handle_q_packet(char *packet, int len)
 			return;
 		}
 		handle_q_string_reply(target_tdesc(cur_target), packet + 31);
+
+	} else if (strncmp (packet, "qXfer:threads:read::", 20) == 0) {
+		/* Thread list, walked on the probe by the RTOS support.
+		 * Re-walk when a transfer starts; later windows serve the
+		 * same render. */
+		if (!cur_target) {
+			gdb_putpacketz("E01");
+			return;
+		}
+		handle_q_string_reply(rtos_threads_xml(cur_target,
+		                      strtoul(packet + 20, NULL, 16) == 0),
+		                      packet + 20);
 	} else if (sscanf(packet, "qCRC:%" PRIx32 ",%" PRIx32, &addr, &alen) == 2) {
 		if(!cur_target) {
 			gdb_putpacketz("E01");
 			return;
 		}
-		gdb_putpacket_f("C%lx", generic_crc32(cur_target, addr, alen));
+		gdb_putpacket_f("C%lx", target_crc32(cur_target, addr, alen));
 
 	} else {
 		DEBUG("*** Unsupported packet: %s\n", packet);
@@ -412,17 +811,34 @@ handle_v_packet(char *packet, int plen)
 	unsigned long addr, len;
 	int bin;
 	static uint8_t flash_mode = 0;
+	static bool flash_error = false;
 
 	if (sscanf(packet, "vAttach;%08lx", &addr) == 1) {
 		/* Attach to remote target processor */
+		gdb_mem_cache_flush();
 		cur_target = target_attach_n(addr, &gdb_controller);
 		if(cur_target)
 			gdb_putpacketz("T05");
 		else
 			gdb_putpacketz("E01");
 
+	} else if (!strcmp(packet, "vCtrlC")) {
+		/* Non-stop replacement for the raw ^C interrupt byte: in
+		 * non-stop mode the break character would be lost in the
+		 * packet stream, so the interrupt arrives as a packet. */
+		if (cur_target)
+			target_halt_request(cur_target);
+		gdb_putpacketz("OK");
+
+	} else if (!strcmp(packet, "vStopped")) {
+		/* One target, so at most one stop event per resume; the
+		 * notification already delivered it and the queue is
+		 * empty. */
+		gdb_putpacketz("OK");
+
 	} else if (!strcmp(packet, "vRun;")) {
 		/* Run target program. For us (embedded) this means reset. */
+		gdb_mem_cache_flush();
 		if(cur_target) {
 			target_reset(cur_target);
 			gdb_putpacketz("T05");
@@ -441,6 +857,7 @@ handle_v_packet(char *packet, int plen)
 	} else if (sscanf(packet, "vFlashErase:%08lx,%08lx", &addr, &len) == 2) {
 		/* Erase Flash Memory */
 		DEBUG("Flash Erase %08lX %08lX\n", addr, len);
+		gdb_mem_cache_flush();
 		if(!cur_target) { gdb_putpacketz("EFF"); return; }
 
 		if(!flash_mode) {
@@ -448,25 +865,41 @@ handle_v_packet(char *packet, int plen)
 			/* This saves us if we're interrupted in IRQ context */
 			target_reset(cur_target);
 			flash_mode = 1;
+			flash_error = false;
 		}
-		if(target_flash_erase(cur_target, addr, len) == 0)
-			gdb_putpacketz("OK");
-		else
+		if(flash_error || target_flash_erase(cur_target, addr, len))
 			gdb_putpacketz("EFF");
+		else
+			gdb_putpacketz("OK");
 
 	} else if (sscanf(packet, "vFlashWrite:%08lx:%n", &addr, &bin) == 1) {
 		/* Write Flash Memory */
 		len = plen - bin;
 		DEBUG("Flash Write %08lX %08lX\n", addr, len);
-		if(cur_target && target_flash_write(cur_target, addr, (void*)packet + bin, len) == 0)
-			gdb_putpacketz("OK");
-		else
+		gdb_mem_cache_flush();
+		if(!cur_target || flash_error) {
 			gdb_putpacketz("EFF");
+		} else {
+			/* Acknowledge as soon as the data is in our hands so
+			 * GDB transmits the next chunk while this one is
+			 * programmed; a failure is reported on the following
+			 * packet, or at vFlashDone at the latest. */
+			gdb_putpacketz("OK");
+			if(target_flash_write(cur_target, addr,
+					      (void*)packet + bin, len))
+				flash_error = true;
+		}
 
 	} else if (!strcmp(packet, "vFlashDone")) {
-		/* Commit flash operations. */
-		gdb_putpacketz(target_flash_done(cur_target) ? "EFF" : "OK");
+		/* Commit flash operations.  The final sector's programming
+		 * is only started here; the reply leaves while it finishes
+		 * and any late error surfaces on the next target operation. */
+		if(flash_error || target_flash_done_async(cur_target))
+			gdb_putpacketz("EFF");
+		else
+			gdb_putpacketz("OK");
 		flash_mode = 0;
+		flash_error = false;
 
 	} else {
 		DEBUG("*** Unsupported packet: %s\n", packet);
@@ -29,6 +29,93 @@
 
 #include <stdarg.h>
 
+/* Characters are received from the interface a block at a time and
+ * scanned out of this stash, so reception cost scales with the number
+ * of link-level transfers rather than the number of bytes. */
+static unsigned char rx_block[256];
+static int rx_block_len;
+static int rx_block_ptr;
+
+/* One character of lookahead: gdb_rx_available() may have to read a
+ * character to learn one is there, and stashes it here for the next
+ * consumer.  -1 when empty. */
+static int rx_ungot = -1;
+
+/* GDB protocol ACKs are suppressed once the host has negotiated
+ * QStartNoAckMode; the transport below us is reliable. */
+static bool noackmode;
+
+struct gdb_packet_stats gdb_packet_stats;
+
+/* Retransmission handling: when gdb times out waiting for a reply it
+ * resends its packet verbatim, and replaying a slow request (a mass
+ * erase, a big qCRC) doubles its cost.  The last packet accepted is
+ * remembered as a signature (length, checksum, leading bytes) together
+ * with the reply sent for it and whether that reply was acked.  A
+ * verbatim repeat while the reply stands unacked is answered from the
+ * cache instead of being executed again.  Only short replies are
+ * cached; requests with long replies (memory reads) are idempotent
+ * anyway.  In no-ack mode the link is reliable and gdb never resends,
+ * so none of this applies. */
+#define RX_SIG_PREFIX	32
+#define REPLY_CACHE_SIZE	128
+
+static int rx_last_len = -1;
+static unsigned char rx_last_csum;
+static char rx_last_prefix[RX_SIG_PREFIX];
+
+static char reply_cache[REPLY_CACHE_SIZE];
+static int reply_cache_len;
+static bool reply_cache_valid;
+static bool reply_acked = true;
+/* Console 'O' packets interleave with a request's real reply and must
+ * not displace it in the cache */
+static bool tx_console;
+
+void gdb_set_noackmode(bool enable)
+{
+	noackmode = enable;
+}
+
+static unsigned char gdb_rx_char(void)
+{
+	if (rx_ungot >= 0) {
+		unsigned char c = rx_ungot;
+		rx_ungot = -1;
+		return c;
+	}
+	if (rx_block_ptr == rx_block_len) {
+		rx_block_len = gdb_if_getbuf(rx_block, sizeof(rx_block));
+		rx_block_ptr = 0;
+	}
+	return rx_block[rx_block_ptr++];
+}
+
+static unsigned char gdb_rx_char_to(int timeout)
+{
+	if (rx_ungot >= 0) {
+		unsigned char c = rx_ungot;
+		rx_ungot = -1;
+		return c;
+	}
+	if (rx_block_ptr < rx_block_len)
+		return rx_block[rx_block_ptr++];
+	return gdb_if_getchar_to(timeout);
+}
+
+bool gdb_rx_available(int timeout)
+{
+	unsigned char c;
+
+	if ((rx_ungot >= 0) || (rx_block_ptr < rx_block_len))
+		return true;
+	c = gdb_if_getchar_to(timeout);
+	if (c == 0xFF)	/* the transport's timeout sentinel */
+		return false;
+	rx_ungot = c;
+	return true;
+}
+
 int gdb_getpacket(char *packet, int size)
 {
 	unsigned char c;
@@ -38,12 +125,12 @@ int gdb_getpacket(char *packet, int size)
 
 	while(1) {
 		/* Wait for packet start */
-		while((packet[0] = gdb_if_getchar()) != '$')
+		while((packet[0] = gdb_rx_char()) != '$')
 			if(packet[0] == 0x04) return 1;
 
 		i = 0; csum = 0;
 		/* Capture packet data into buffer */
-		while((c = gdb_if_getchar()) != '#') {
+		while((c = gdb_rx_char()) != '#') {
 
 			if(i == size) break; /* Oh shit */
 
@@ -53,7 +140,7 @@ int gdb_getpacket(char *packet, int size)
 				continue;
 			}
 			if(c == '}') { /* escaped char */
-				c = gdb_if_getchar();
+				c = gdb_rx_char();
 				csum += c + '}';
 				packet[i++] = c ^ 0x20;
 				continue;
@@ -61,18 +148,40 @@ int gdb_getpacket(char *packet, int size)
 			csum += c;
 			packet[i++] = c;
 		}
-		recv_csum[0] = gdb_if_getchar();
-		recv_csum[1] = gdb_if_getchar();
+		recv_csum[0] = gdb_rx_char();
+		recv_csum[1] = gdb_rx_char();
 		recv_csum[2] = 0;
 
 		/* return packet if checksum matches */
-		if(csum == strtol(recv_csum, NULL, 16)) break;
+		if(csum != strtol(recv_csum, NULL, 16)) {
+			/* get here if checksum fails */
+			if(!noackmode)
+				gdb_if_putchar('-', 1); /* send nack */
+			continue;
+		}
+		if(!noackmode)
+			gdb_if_putchar('+', 1); /* send ack */
 
-		/* get here if checksum fails */
-		gdb_if_putchar('-', 1); /* send nack */
+		/* An unacked reply plus a verbatim repeat of the previous
+		 * packet means gdb never saw that reply and retransmitted:
+		 * resend the cached reply rather than execute the request
+		 * a second time. */
+		if (!noackmode && reply_cache_valid && !reply_acked &&
+		    (i == rx_last_len) && (csum == rx_last_csum) &&
+		    !memcmp(packet, rx_last_prefix,
+		            MIN(i, RX_SIG_PREFIX))) {
+			gdb_putpacket(reply_cache, reply_cache_len);
+			continue;
+		}
+		rx_last_len = i;
+		rx_last_csum = csum;
+		memcpy(rx_last_prefix, packet, MIN(i, RX_SIG_PREFIX));
+		reply_cache_valid = false;
+		break;
 	}
-	gdb_if_putchar('+', 1); /* send ack */
 	packet[i] = 0;
+	gdb_packet_stats.rx_packets++;
+	gdb_packet_stats.rx_bytes += i;
 
 #ifdef DEBUG_GDBPACKET
 	DEBUG("%s : ", __func__);
@@ -88,6 +197,22 @@ int gdb_getpacket(char *packet, int size)
 	return i;
 }
 
+/* Length of the run of identical characters at the start of the buffer,
+ * capped to what one RSP 'X*N' repeat can carry.  The repeat count is
+ * encoded as count + 29 in a printable character, which must not be
+ * '#', '$' or '}'; runs that would need those counts are shortened. */
+static int gdb_run_length(const char *packet, int size)
+{
+	int run = 1;
+	while ((run < size) && (packet[run] == packet[0]) && (run < 98))
+		run++;
+	while ((run == 7) || (run == 8) || (run == 97))
+		run--;
+	return run;
+}
+
+static void gdb_out_flush(void);
+
 void gdb_putpacket(const char *packet, int size)
 {
 	int i;
@@ -95,30 +220,70 @@ void gdb_putpacket(const char *packet, int size)
 	unsigned char c;
 	char xmit_csum[3];
 	int tries = 0;
+	bool acked = true;
 
+	/* Any pending console output must leave before this packet so the
+	 * host prints it ahead of the reply it belongs to */
+	gdb_out_flush();
+
+	gdb_packet_stats.tx_packets++;
+	gdb_packet_stats.tx_bytes += size;
 	do {
 #ifdef DEBUG_GDBPACKET
 		DEBUG("%s : ", __func__);
 #endif
 		csum = 0;
 		gdb_if_putchar('$', 0);
-		for(i = 0; i < size; i++) {
+		i = 0;
+		while (i < size) {
 			c = packet[i];
-#ifdef DEBUG_GDBPACKET
-			if ((c >= 32) && (c < 127))
-				DEBUG("%c", c);
-			else
-				DEBUG("\\x%02X", c);
-#endif
 			if((c == '$') || (c == '#') || (c == '}')) {
 				gdb_if_putchar('}', 0);
 				gdb_if_putchar(c ^ 0x20, 0);
 				csum += '}' + (c ^ 0x20);
-			} else {
+				i++;
+				continue;
+			}
+			/* Run-length encode repeats past break-even:
+			 * 'X*N' spends 3 characters however long the run */
+			int run = gdb_run_length(&packet[i], size - i);
+			if (run >= 4) {
+				unsigned char n = run - 1 + 29;
 				gdb_if_putchar(c, 0);
-				csum += c;
+				gdb_if_putchar('*', 0);
+				gdb_if_putchar(n, 0);
+				csum += c + '*' + n;
+				i += run;
+				continue;
 			}
+			/* Extend the span over everything that needs neither
+			 * escaping nor run-length encoding and emit it in one
+			 * block instead of a call per character */
+			int span = run;
+			while (i + span < size) {
+				c = packet[i + span];
+				if((c == '$') || (c == '#') || (c == '}'))
+					break;
+				run = gdb_run_length(&packet[i + span],
+				                     size - (i + span));
+				if (run >= 4)
+					break;
+				span += run;
+			}
+			for (int j = 0; j < span; j++)
+				csum += packet[i + j];
+			gdb_if_write(&packet[i], span);
+			i += span;
 		}
+#ifdef DEBUG_GDBPACKET
+		for (i = 0; i < size; i++) {
+			c = packet[i];
+			if ((c >= 32) && (c < 127))
+				DEBUG("%c", c);
+			else
+				DEBUG("\\x%02X", c);
+		}
+#endif
 		gdb_if_putchar('#', 0);
 		sprintf(xmit_csum, "%02X", csum);
 		gdb_if_putchar(xmit_csum[0], 0);
@@ -126,7 +291,86 @@ void gdb_putpacket(const char *packet, int size)
 #ifdef DEBUG_GDBPACKET
 		DEBUG("\n");
 #endif
-	} while((gdb_if_getchar_to(2000) != '+') && (tries++ < 3));
+		if (noackmode) {
+			acked = true;
+			break;
+		}
+		acked = (gdb_rx_char_to(2000) == '+');
+	} while(!acked && (tries++ < 3));
+	gdb_packet_stats.tx_resends += tries;
+
+	/* Remember the reply for the duplicate-request check, unless this
+	 * is interleaved console output rather than the real reply */
+	if (!tx_console) {
+		reply_acked = acked;
+		reply_cache_valid = (size <= REPLY_CACHE_SIZE);
+		if (reply_cache_valid) {
+			memcpy(reply_cache, packet, size);
+			reply_cache_len = size;
+		}
+	}
+}
+
+/* Rate-limited progress keep-alive: an empty console packet emitted
+ * from long operation loops.  The host prints nothing for it, but the
+ * traffic holds its retransmission timer off a mass erase or CRC that
+ * outlasts the remote timeout. */
+void gdb_keepalive(void)
+{
+	static uint32_t last_ms;
+	uint32_t now = platform_time_ms();
+
+	if (now - last_ms < 500)
+		return;
+	last_ms = now;
+	tx_console = true;
+	gdb_putpacket("O", 1);
+	tx_console = false;
+}
+
+/* Asynchronous notification, '%data#cs' framing.  Notifications are
+ * never acknowledged or resent; the host confirms delivery by polling
+ * with vStopped.  Stop-reply payloads contain no characters that need
+ * escaping, so none is done here. */
+void gdb_putnotifz(const char *notif)
+{
+	unsigned char csum = 0;
+	char xmit_csum[3];
+
+	gdb_out_flush();
+
+	gdb_if_putchar('%', 0);
+	while (*notif) {
+		gdb_if_putchar(*notif, 0);
+		csum += *notif++;
+	}
+	gdb_if_putchar('#', 0);
+	sprintf(xmit_csum, "%02X", csum);
+	gdb_if_putchar(xmit_csum[0], 0);
+	gdb_if_putchar(xmit_csum[1], 1);
+}
+
+/* Formatted replies render into a small ring of static buffers with a
+ * bounded vsnprintf instead of vasprintf, so the reply hot path (stop
+ * replies, monitor output lines) makes no heap allocations.  The ring
+ * lets a caller still hold one formatted buffer while another formats.
+ * Formatted replies are short protocol strings; anything longer than a
+ * buffer is truncated rather than grown. */
+#define GDB_FMT_BUF_COUNT 4
+#define GDB_FMT_BUF_SIZE  128
+
+static char gdb_fmt_buf[GDB_FMT_BUF_COUNT][GDB_FMT_BUF_SIZE];
+static unsigned gdb_fmt_buf_idx;
+
+static char *gdb_fmt(const char *fmt, va_list ap, int *size)
+{
+	char *buf = gdb_fmt_buf[gdb_fmt_buf_idx];
+	gdb_fmt_buf_idx = (gdb_fmt_buf_idx + 1) % GDB_FMT_BUF_COUNT;
+	int len = vsnprintf(buf, GDB_FMT_BUF_SIZE, fmt, ap);
+	if (len > GDB_FMT_BUF_SIZE - 1)
+		len = GDB_FMT_BUF_SIZE - 1;
+	*size = len;
+	return buf;
 }
 
 void gdb_putpacket_f(const char *fmt, ...)
@@ -136,31 +380,53 @@ void gdb_putpacket_f(const char *fmt, ...)
 	int size;
 
 	va_start(ap, fmt);
-	size = vasprintf(&buf, fmt, ap);
+	buf = gdb_fmt(fmt, ap, &size);
 	gdb_putpacket(buf, size);
-	free(buf);
 	va_end(ap);
 }
 
-void gdb_out(const char *buf)
+/* Console output is coalesced: tc_printf/gdb_outf calls append here and
+ * one 'O' packet carries the lot, flushed when the buffer fills or when
+ * the next real packet (the command's reply, a stop reply) goes out.
+ * Verbose monitor commands emit dozens of lines; batching spends the
+ * packet and ack overhead once per buffer instead of once per printf. */
+#define GDB_OUT_BUF_SIZE 256
+
+static char gdb_out_buf[GDB_OUT_BUF_SIZE];
+static unsigned gdb_out_buf_len;
+
+static void gdb_out_flush(void)
 {
-	char *hexdata;
-	int i;
+	char hexdata[GDB_OUT_BUF_SIZE * 2 + 1];
+	unsigned len = gdb_out_buf_len;
 
-	hexdata = alloca((i = strlen(buf)*2 + 1) + 1);
+	if (len == 0)
+		return;
+	/* Reset before sending: gdb_putpacket flushes pending output and
+	 * would recurse otherwise */
+	gdb_out_buf_len = 0;
 	hexdata[0] = 'O';
-	hexify(hexdata+1, buf, strlen(buf));
-	gdb_putpacket(hexdata, i);
+	hexify(hexdata + 1, gdb_out_buf, len);
+	bool was_console = tx_console;
+	tx_console = true;
+	gdb_putpacket(hexdata, len * 2 + 1);
+	tx_console = was_console;
+}
+
+void gdb_out(const char *buf)
+{
+	while (*buf) {
+		gdb_out_buf[gdb_out_buf_len++] = *buf++;
+		if (gdb_out_buf_len == sizeof(gdb_out_buf))
+			gdb_out_flush();
+	}
 }
 
 void gdb_voutf(const char *fmt, va_list ap)
 {
-	char *buf;
+	int size;
 
-	if (vasprintf(&buf, fmt, ap) < 0)
-		return;
-	gdb_out(buf);
-	free(buf);
+	gdb_out(gdb_fmt(fmt, ap, &size));
 }
 
 void gdb_outf(const char *fmt, ...)
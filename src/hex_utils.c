@@ -26,36 +26,76 @@
 
 static const char hexdigits[] = "0123456789abcdef";
 
+/* These sit on the hot path of every m/M/g/G packet, so both directions
+ * are table driven: one load per byte instead of shift/compare logic per
+ * nibble, with the loops unrolled four bytes at a time. */
+static uint16_t hex_pair[256];
+static uint8_t hex_nibble[256];
+static bool hex_tables_ready;
+
+static void hex_tables_init(void)
+{
+	for (int i = 0; i < 256; i++)
+		hex_pair[i] = hexdigits[i >> 4] | (hexdigits[i & 0xF] << 8);
+	for (int i = 0; i < 16; i++) {
+		hex_nibble[(uint8_t)hexdigits[i]] = i;
+		hex_nibble[(uint8_t)"0123456789ABCDEF"[i]] = i;
+	}
+	hex_tables_ready = true;
+}
+
+static inline void hexify_byte(char *hex, uint8_t b)
+{
+	hex[0] = hex_pair[b] & 0xFF;
+	hex[1] = hex_pair[b] >> 8;
+}
+
 char * hexify(char *hex, const void *buf, size_t size)
 {
 	char *tmp = hex;
 	const uint8_t *b = buf;
 
+	if (!hex_tables_ready)
+		hex_tables_init();
+
+	while (size >= 4) {
+		hexify_byte(tmp, b[0]);
+		hexify_byte(tmp + 2, b[1]);
+		hexify_byte(tmp + 4, b[2]);
+		hexify_byte(tmp + 6, b[3]);
+		tmp += 8;
+		b += 4;
+		size -= 4;
+	}
 	while (size--) {
-		*tmp++ = hexdigits[*b >> 4];
-		*tmp++ = hexdigits[*b++ & 0xF];
+		hexify_byte(tmp, *b++);
+		tmp += 2;
 	}
 	*tmp++ = 0;
 
 	return hex;
 }
 
-static uint8_t unhex_digit(char hex)
-{
-	uint8_t tmp = hex - '0';
-	if(tmp > 9)
-		tmp -= 'A' - '0' - 10;
-	if(tmp > 16)
-		tmp -= 'a' - 'A';
-	return tmp;
-}
-
 char * unhexify(void *buf, const char *hex, size_t size)
 {
 	uint8_t *b = buf;
+	const uint8_t *h = (const uint8_t *)hex;
+
+	if (!hex_tables_ready)
+		hex_tables_init();
+
+	while (size >= 4) {
+		b[0] = (hex_nibble[h[0]] << 4) | hex_nibble[h[1]];
+		b[1] = (hex_nibble[h[2]] << 4) | hex_nibble[h[3]];
+		b[2] = (hex_nibble[h[4]] << 4) | hex_nibble[h[5]];
+		b[3] = (hex_nibble[h[6]] << 4) | hex_nibble[h[7]];
+		b += 4;
+		h += 8;
+		size -= 4;
+	}
 	while (size--) {
-		*b = unhex_digit(*hex++) << 4;
-		*b++ |= unhex_digit(*hex++);
+		*b++ = (hex_nibble[h[0]] << 4) | hex_nibble[h[1]];
+		h += 2;
 	}
 	return buf;
 }
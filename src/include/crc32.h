@@ -21,6 +21,8 @@
 #ifndef __CRC32_H
 #define __CRC32_H
 
-uint32_t generic_crc32(target *t, uint32_t base, int len);
+uint32_t generic_crc32(target *t, uint32_t base, size_t len);
+/* Same polynomial over a probe-local buffer; no target access */
+uint32_t crc32_buf(const void *buf, size_t len);
 
 #endif
@@ -0,0 +1,29 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DEBUG_TRACE_H
+#define __DEBUG_TRACE_H
+
+/* Format one trace record into the in-memory ring.  Each call is one
+ * record, so multi-call partial lines come out as separate records. */
+void debug_trace(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+/* Replay the ring to the GDB console, oldest record first */
+void debug_trace_dump(void);
+
+#endif
@@ -24,7 +24,20 @@
 int gdb_if_init(void);
 unsigned char gdb_if_getchar(void);
 unsigned char gdb_if_getchar_to(int timeout);
+/* Block until at least one character is available, then return as many
+ * as the interface has ready, up to maxlen.  Returns the number of
+ * characters placed in buf.  Link-level conditions are reported in-band
+ * as with gdb_if_getchar() (e.g. 0x04 on disconnect). */
+int gdb_if_getbuf(unsigned char *buf, int maxlen);
 void gdb_if_putchar(unsigned char c, int flush);
+/* Queue a block of characters for transmission without flushing, so
+ * escape-free spans of a packet go out in one call instead of one call
+ * per byte.  The final character of a packet still goes through
+ * gdb_if_putchar() with flush set. */
+void gdb_if_write(const char *data, int size);
+/* Hosted platforms only: override the TCP listen port before
+ * gdb_if_init() is called. */
+void gdb_if_set_port(uint16_t port);
 
 #endif
 
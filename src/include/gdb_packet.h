@@ -23,15 +23,36 @@
 
 #include <stdarg.h>
 
+/* Link statistics, dumped and reset by the `stats' monitor command */
+struct gdb_packet_stats {
+	uint32_t rx_packets;
+	uint32_t rx_bytes;
+	uint32_t tx_packets;
+	uint32_t tx_bytes;
+	uint32_t tx_resends;
+};
+extern struct gdb_packet_stats gdb_packet_stats;
+
+void gdb_set_noackmode(bool enable);
 int gdb_getpacket(char *packet, int size);
+/* True if a character is waiting (or arrives within the timeout, in
+ * milliseconds); the character stays queued for gdb_getpacket().  Lets
+ * the non-stop poll loop watch the link without consuming from it. */
+bool gdb_rx_available(int timeout);
 void gdb_putpacket(const char *packet, int size);
 #define gdb_putpacketz(packet) gdb_putpacket((packet), strlen(packet))
 void gdb_putpacket_f(const char *packet, ...);
+void gdb_putnotifz(const char *notif);
 
 void gdb_out(const char *buf);
 void gdb_voutf(const char *fmt, va_list);
 void gdb_outf(const char *fmt, ...);
 
+/* Rate-limited empty console packet, called from long-running
+ * operation loops so gdb's retransmission timer sees link activity
+ * while a mass erase or CRC grinds on. */
+void gdb_keepalive(void);
+
 #endif
 
 
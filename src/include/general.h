@@ -33,11 +33,27 @@
 #include "platform.h"
 #include "platform_support.h"
 
+/* With PLATFORM_HAS_DEBUG, DEBUG() statements are captured into the
+ * in-memory trace ring and replayed by `monitor debug_dump' instead of
+ * being emitted synchronously, so instrumentation stays off the timing
+ * hot path.  A platform may still define DEBUG itself to override. */
+#if defined(PLATFORM_HAS_DEBUG) && !defined(DEBUG)
+#include "debug_trace.h"
+#define DEBUG	debug_trace
+#endif
+
 #ifndef DEBUG
 #include <stdio.h>
 #define DEBUG	printf
 #endif
 
+/* Marks timing-critical bit-bang code for execution from RAM on
+ * platforms that define it (flash wait-state and prefetch jitter limit
+ * the stable SWCLK rate otherwise).  Expands to nothing elsewhere. */
+#ifndef PLATFORM_RAMFUNC
+#define PLATFORM_RAMFUNC
+#endif
+
 #define ALIGN(x, n) (((x) + (n) - 1) & ~((n) - 1))
 #undef MIN
 #define MIN(x, y)  (((x) < (y)) ? (x) : (y))
@@ -45,6 +45,15 @@ void jtagtap_tdi_seq(const uint8_t final_tms, const uint8_t *DI, int ticks);
  * - DO may be point to the same address as DI.
  */
 
+void jtagtap_scan(uint8_t *DO, const uint8_t *DI,
+		  int prescan, int ticks, int postscan);
+/* Shift a whole DR/IR vector through the chain in one call: prescan
+ * don't-care ones for devices in BYPASS before the target, ticks data
+ * bits from DI (captured to DO unless NULL), postscan ones after it.
+ * TMS is raised on the last bit of the whole vector to leave the shift
+ * state.  The caller is responsible for the state moves either side.
+ */
+
 /* generic soft reset: 1, 1, 1, 1, 1, 0 */
 #define jtagtap_soft_reset()	\
 	jtagtap_tms_seq(0x1F, 6)
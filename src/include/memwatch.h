@@ -0,0 +1,59 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MEMWATCH_H
+#define __MEMWATCH_H
+
+#include "target.h"
+
+/* Each sample streams to the trace endpoint framed as
+ *   magic, entry index, payload length, 32-bit LE microsecond
+ *   timestamp, payload
+ * decoded on the host by scripts/memwatch.py */
+#define MEMWATCH_MAGIC	0xA7
+#define MEMWATCH_HDR	7
+
+#define MEMWATCH_MAX		8
+#define MEMWATCH_MAX_LEN	16
+
+struct memwatch_entry {
+	uint32_t addr;
+	uint32_t len;
+	uint32_t interval_ms;
+	uint32_t due_ms;
+};
+
+#ifdef PLATFORM_HAS_TRACESWO
+/* Register a watch sampled at the given rate while the target runs.
+ * Returns false for a full table or unusable length/rate. */
+bool memwatch_add(uint32_t addr, uint32_t len, uint32_t hz);
+void memwatch_clear(void);
+unsigned memwatch_count(void);
+/* NULL past the last registered entry */
+const struct memwatch_entry *memwatch_entry_get(unsigned i);
+/* True when sampling shut down because the trace endpoint stalled */
+bool memwatch_stalled(void);
+/* Sample any due entries; called from the halt-poll loops while the
+ * target runs */
+void memwatch_poll(target *t);
+#else
+#define memwatch_poll(t) ((void)(t))
+#endif
+
+#endif
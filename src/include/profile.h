@@ -0,0 +1,40 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include "target.h"
+
+#ifdef PLATFORM_HAS_TRACESWO
+/* Begin sampling the target PC at the given rate.  Returns false for
+ * an unusable rate. */
+bool profile_start(uint32_t hz);
+/* Stop sampling and flush any buffered samples to the trace endpoint */
+void profile_stop(void);
+bool profile_active(void);
+uint32_t profile_sample_count(void);
+/* Take a sample if one is due; called from the halt-poll loops while
+ * the target runs */
+void profile_poll(target *t);
+#else
+#define profile_poll(t) ((void)(t))
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2019  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTOS_H
+#define __RTOS_H
+
+#include "target.h"
+
+/* FreeRTOS thread awareness.  Symbol addresses arrive through the
+ * qSymbol exchange and are cached for the session; the task lists are
+ * then walked on the probe with bulk memory reads and served to gdb as
+ * one qXfer:threads annex instead of dozens of small `m' reads. */
+
+/* Forget cached symbols; called when a debug session (re)starts */
+void rtos_reset(void);
+
+/* Record one symbol answer from gdb.  addr is 0 when undefined. */
+void rtos_symbol_set(const char *name, uint32_t addr);
+
+/* Name of the next symbol to request from gdb, NULL when none remain */
+const char *rtos_symbol_wanted(void);
+
+/* All symbols needed for the task list walk are known */
+bool rtos_available(void);
+
+/* Thread list XML for qXfer:threads; re-walks the task lists when
+ * refresh is set, otherwise returns the render cached at the last
+ * stop.  Always returns a valid (possibly empty) document. */
+const char *rtos_threads_xml(target *t, bool refresh);
+
+/* TCB address of the running task, 0 when unknown */
+uint32_t rtos_current_thread(target *t);
+
+/* Register file of a switched-out task, rebuilt from the context frame
+ * at its pxTopOfStack.  regs is the g-packet word layout, count words
+ * long; words the frame doesn't hold read as zero.  Returns false when
+ * the frame cannot be read. */
+bool rtos_thread_regs(target *t, uint32_t tcb, uint32_t *regs, size_t count);
+
+#endif
@@ -23,6 +23,13 @@
 
 int swdptap_init(void);
 
+/* Extra delay-loop iterations per SWCLK phase; 0 runs the wire flat
+ * out.  Raised automatically when a target returns parity errors and
+ * settable through the `swd_divider' target command, so each board
+ * runs at its fastest reliable rate rather than a conservative fixed
+ * one. */
+extern unsigned swdptap_clk_divider;
+
 /* Primitive functions */
 bool swdptap_bit_in(void);
 void swdptap_bit_out(bool val);
@@ -33,5 +40,14 @@ bool swdptap_seq_in_parity(uint32_t *data, int ticks);
 void swdptap_seq_out(uint32_t MS, int ticks);
 void swdptap_seq_out_parity(uint32_t MS, int ticks);
 
+/* Whole-transaction functions: request, ack and data phase emitted from
+ * a single call, so turnaround state and call dispatch are resolved per
+ * transaction instead of per phase or per bit.  Both return the 3-bit
+ * ack; the data phase is only clocked when the ack is OK (0b001).
+ * Generic versions are provided as weak in swdptap_generic.c. */
+uint8_t swdptap_transaction_read(uint8_t request, uint32_t *data,
+                                 bool *parity_err);
+uint8_t swdptap_transaction_write(uint8_t request, uint32_t data);
+
 #endif
 
@@ -32,7 +32,11 @@ typedef uint32_t target_addr;
 struct target_controller;
 
 int adiv5_swdp_scan(void);
+int adiv5_swdp_scan_multidrop(const uint32_t *targetsel, size_t count);
 int jtag_scan(const uint8_t *lrlens);
+/* Autodetecting scan: tries SWD first and falls back to a JTAG chain
+ * scan on the same electrical session if no SW-DP answers. */
+int swj_scan(void);
 
 bool target_foreach(void (*cb)(int i, target *t, void *context), void *context);
 void target_list_free(void);
@@ -45,19 +49,58 @@ bool target_attached(target *t);
 const char *target_driver_name(target *t);
 
 /* Memory access functions */
-bool target_mem_map(target *t, char *buf, size_t len);
+const char *target_mem_map(target *t);
 int target_mem_read(target *t, void *dest, target_addr src, size_t len);
 int target_mem_write(target *t, target_addr dest, const void *src, size_t len);
 /* Flash memory access functions */
 int target_flash_erase(target *t, target_addr addr, size_t len);
 int target_flash_write(target *t, target_addr dest, const void *src, size_t len);
 int target_flash_done(target *t);
+/* Early-ack variant: starts any remaining programming and defers the
+ * final drain and driver done hooks to the next target operation,
+ * where any error surfaces */
+int target_flash_done_async(target *t);
+uint32_t target_crc32(target *t, target_addr addr, size_t len);
+
+/* Called from long-running operation loops (sector erases, mass-erase
+ * ready polls, CRC block reads).  The weak default does nothing; the
+ * GDB layer overrides it with a rate-limited keep-alive so the host's
+ * retransmission timer sees link activity during slow operations. */
+void target_op_progress(void);
+
+/* Flash diff mode (`flash_diff' monitor command): skip erase and
+ * program for sectors whose contents already match the incoming image */
+extern bool flash_diff;
+
+/* Fast attach mode (`attach_fast' monitor command): assume the wire is
+ * already in SWD mode and scan with the minimum-length line reset,
+ * falling back to the full JTAG-to-SWD switch if the DP stays silent */
+extern bool attach_fast;
+
+/* Keep-powered mode (`keep_powered' monitor command): debug power stays
+ * requested and the probed structures survive across sessions, so a
+ * re-scan of the same part is a DPIDR sanity read instead of a full
+ * AP discovery and ROM table walk */
+extern bool keep_powered;
+
+/* Accumulated time spent in each flash phase, microseconds.  Dumped
+ * and reset by the `timing' monitor command. */
+struct flash_timing {
+	uint32_t erase_us;
+	uint32_t program_us;
+	uint32_t verify_us;
+};
+extern struct flash_timing flash_timing;
 
 /* Register access functions */
 size_t target_regs_size(target *t);
 const char *target_tdesc(target *t);
 void target_regs_read(target *t, void *data);
 void target_regs_write(target *t, const void *data);
+/* Single-register access: returns the register size in bytes, 0 when
+ * the driver only supports whole-file transfers */
+ssize_t target_reg_read(target *t, int reg, void *data, size_t max);
+ssize_t target_reg_write(target *t, int reg, const void *data, size_t size);
 
 /* Halt/resume functions */
 enum target_halt_reason {
@@ -74,6 +117,9 @@ void target_reset(target *t);
 void target_halt_request(target *t);
 enum target_halt_reason target_halt_poll(target *t, target_addr *watch);
 void target_halt_resume(target *t, bool step);
+/* vCont range step: false if the driver has no range support and the
+ * caller should fall back to plain single stepping */
+bool target_halt_range_resume(target *t, target_addr start, target_addr end);
 
 /* Break-/watchpoint functions */
 enum target_breakwatch {
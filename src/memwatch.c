@@ -0,0 +1,116 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Probe-resident memory-watch sampler.  `monitor watch add' registers
+ * target locations the halt-poll loops sample via memwatch_poll() while
+ * the target runs, streaming each value over the trace endpoint as a
+ * timestamped frame.  Polling the same locations from the host costs a
+ * full RSP round trip per read and jitters with USB scheduling; sampled
+ * on the probe the period is set by the poll loop alone.
+ */
+
+#include "general.h"
+#include "memwatch.h"
+
+#ifdef PLATFORM_HAS_TRACESWO
+
+#include "traceswo.h"
+
+static struct memwatch_entry watch[MEMWATCH_MAX];
+static unsigned watch_count;
+static bool stalled;
+
+bool memwatch_add(uint32_t addr, uint32_t len, uint32_t hz)
+{
+	struct memwatch_entry *e;
+
+	if ((watch_count == MEMWATCH_MAX) ||
+	    (len == 0) || (len > MEMWATCH_MAX_LEN) ||
+	    (hz == 0) || (hz > 1000))
+		return false;
+
+	e = &watch[watch_count++];
+	e->addr = addr;
+	e->len = len;
+	e->interval_ms = 1000 / hz;
+	e->due_ms = platform_time_ms() + e->interval_ms;
+	stalled = false;
+	return true;
+}
+
+void memwatch_clear(void)
+{
+	watch_count = 0;
+	stalled = false;
+}
+
+unsigned memwatch_count(void)
+{
+	return watch_count;
+}
+
+const struct memwatch_entry *memwatch_entry_get(unsigned i)
+{
+	return (i < watch_count) ? &watch[i] : NULL;
+}
+
+bool memwatch_stalled(void)
+{
+	return stalled;
+}
+
+void memwatch_poll(target *t)
+{
+	uint8_t frame[MEMWATCH_HDR + MEMWATCH_MAX_LEN];
+
+	if (!watch_count || stalled || !t)
+		return;
+
+	for (unsigned i = 0; i < watch_count; i++) {
+		struct memwatch_entry *e = &watch[i];
+		uint32_t now_us;
+
+		if ((int32_t)(platform_time_ms() - e->due_ms) < 0)
+			continue;
+		e->due_ms += e->interval_ms;
+		/* If polling fell behind by more than a period, resync
+		 * rather than burst-sampling to catch up */
+		if ((int32_t)(platform_time_ms() - e->due_ms) > 0)
+			e->due_ms = platform_time_ms() + e->interval_ms;
+
+		if (target_mem_read(t, &frame[MEMWATCH_HDR], e->addr, e->len))
+			continue;
+		now_us = platform_time_us();
+		frame[0] = MEMWATCH_MAGIC;
+		frame[1] = i;
+		frame[2] = e->len;
+		frame[3] = now_us & 0xFF;
+		frame[4] = (now_us >> 8) & 0xFF;
+		frame[5] = (now_us >> 16) & 0xFF;
+		frame[6] = (now_us >> 24) & 0xFF;
+		/* Host stopped draining: shut the sampler down rather
+		 * than stall the poll loop */
+		if (!trace_dump_write(frame, MEMWATCH_HDR + e->len)) {
+			stalled = true;
+			return;
+		}
+	}
+}
+
+#endif
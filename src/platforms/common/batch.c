@@ -0,0 +1,204 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Engine for the binary batch access interface (see batch.h for the
+ * wire format).  The USB OUT callback only feeds a ring buffer; the
+ * records are parsed and executed by batch_process() from the event
+ * pump, so target access never happens in interrupt context and a
+ * half-received record simply waits for its remaining bytes.
+ */
+
+#include "general.h"
+#include "cdcacm.h"
+#include "batch.h"
+#include "target.h"
+
+#define BATCH_ENDPOINT_SIZE	64
+/* Room for the largest record (8-byte header plus data) and a packet */
+#define RX_RING_SIZE		(BATCH_MAX_DATA + 128)
+#define BATCH_HDR		8
+
+static uint8_t rx_ring[RX_RING_SIZE];
+static volatile unsigned rx_head;	/* Written in the USB interrupt */
+static volatile unsigned rx_tail;	/* Advanced by batch_process() */
+
+static uint8_t scratch[BATCH_MAX_DATA];
+static target *batch_target;
+
+static void batch_destroy_callback(struct target_controller *tc, target *t)
+{
+	(void)tc;
+	if (batch_target == t)
+		batch_target = NULL;
+}
+
+static void batch_target_printf(struct target_controller *tc,
+                                const char *fmt, va_list ap)
+{
+	(void)tc;
+	(void)fmt;
+	(void)ap;
+}
+
+static struct target_controller batch_controller = {
+	.destroy_callback = batch_destroy_callback,
+	.printf = batch_target_printf,
+};
+
+void batch_usb_out_cb(usbd_device *dev, uint8_t ep)
+{
+	uint8_t buf[BATCH_ENDPOINT_SIZE];
+	int len = usbd_ep_read_packet(dev, ep, buf, BATCH_ENDPOINT_SIZE);
+
+	for (int i = 0; i < len; i++) {
+		unsigned next = (rx_head + 1) % RX_RING_SIZE;
+		/* Drop on overflow; the resync rule lets the host recover */
+		if (next == rx_tail)
+			break;
+		rx_ring[rx_head] = buf[i];
+		rx_head = next;
+	}
+}
+
+static unsigned rx_avail(void)
+{
+	return (rx_head + RX_RING_SIZE - rx_tail) % RX_RING_SIZE;
+}
+
+static uint8_t rx_peek(unsigned off)
+{
+	return rx_ring[(rx_tail + off) % RX_RING_SIZE];
+}
+
+static void rx_drop(unsigned count)
+{
+	rx_tail = (rx_tail + count) % RX_RING_SIZE;
+}
+
+static uint32_t rx_peek32(unsigned off)
+{
+	return rx_peek(off) | ((uint32_t)rx_peek(off + 1) << 8) |
+	       ((uint32_t)rx_peek(off + 2) << 16) |
+	       ((uint32_t)rx_peek(off + 3) << 24);
+}
+
+/* Blocking reply writer; the endpoint NAKs while the previous packet
+ * is in flight.  A host that stops draining forfeits the reply. */
+static bool batch_reply(const uint8_t *buf, unsigned len)
+{
+	while (len) {
+		unsigned chunk = (len > BATCH_ENDPOINT_SIZE) ?
+		                 BATCH_ENDPOINT_SIZE : len;
+		uint32_t start = platform_time_ms();
+		while (usbd_ep_write_packet(usbdev, 0x86, buf, chunk) != chunk)
+			if (platform_time_ms() - start > 1000)
+				return false;
+		buf += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+void batch_process(void)
+{
+	if (cdcacm_get_config() != 1)
+		return;
+
+	while (rx_avail() >= 2) {
+		if (rx_peek(0) != BATCH_MAGIC) {
+			rx_drop(1);
+			continue;
+		}
+
+		uint8_t op = rx_peek(1);
+		uint8_t rep[4] = { BATCH_MAGIC, op, BATCH_STATUS_ERR, 0 };
+
+		switch (op) {
+		case BATCH_OP_SCAN: {
+			rx_drop(2);
+			int devs = adiv5_swdp_scan();
+			if (devs > 0) {
+				batch_target = target_attach_n(1, &batch_controller);
+				if (batch_target) {
+					rep[2] = BATCH_STATUS_OK;
+					rep[3] = devs;
+				}
+			}
+			batch_reply(rep, 4);
+			break;
+		}
+		case BATCH_OP_READ: {
+			if (rx_avail() < BATCH_HDR)
+				return;
+			uint32_t addr = rx_peek32(2);
+			unsigned len = rx_peek(6) | ((unsigned)rx_peek(7) << 8);
+			rx_drop(BATCH_HDR);
+			if (len > BATCH_MAX_DATA) {
+				rep[2] = BATCH_STATUS_TOOBIG;
+				batch_reply(rep, 3);
+				break;
+			}
+			if (batch_target &&
+			    !target_mem_read(batch_target, scratch, addr, len))
+				rep[2] = BATCH_STATUS_OK;
+			batch_reply(rep, 3);
+			if (rep[2] == BATCH_STATUS_OK)
+				batch_reply(scratch, len);
+			break;
+		}
+		case BATCH_OP_WRITE: {
+			if (rx_avail() < BATCH_HDR)
+				return;
+			uint32_t addr = rx_peek32(2);
+			unsigned len = rx_peek(6) | ((unsigned)rx_peek(7) << 8);
+			if (len > BATCH_MAX_DATA) {
+				/* Oversize data phase cannot follow: eat the
+				 * header and let the host resynchronise */
+				rx_drop(BATCH_HDR);
+				rep[2] = BATCH_STATUS_TOOBIG;
+				batch_reply(rep, 3);
+				break;
+			}
+			if (rx_avail() < BATCH_HDR + len)
+				return;
+			for (unsigned i = 0; i < len; i++)
+				scratch[i] = rx_peek(BATCH_HDR + i);
+			rx_drop(BATCH_HDR + len);
+			if (batch_target &&
+			    !target_mem_write(batch_target, addr, scratch, len))
+				rep[2] = BATCH_STATUS_OK;
+			batch_reply(rep, 3);
+			break;
+		}
+		case BATCH_OP_DETACH:
+			rx_drop(2);
+			if (batch_target) {
+				target_detach(batch_target);
+				batch_target = NULL;
+			}
+			rep[2] = BATCH_STATUS_OK;
+			batch_reply(rep, 3);
+			break;
+		default:
+			/* Not a record start after all; resynchronise */
+			rx_drop(1);
+			break;
+		}
+	}
+}
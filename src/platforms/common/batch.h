@@ -0,0 +1,60 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __BATCH_H
+#define __BATCH_H
+
+/* Binary batch access protocol, served on a dedicated vendor bulk
+ * interface (OUT 0x06 / IN 0x86) next to the trace interface.  Host
+ * tooling that only wants "read N bytes, write N bytes" packs a vector
+ * of records into the OUT pipe; the probe executes them back to back
+ * through the ADIv5 block-transfer path and streams the replies, with
+ * none of the per-word hex and ack overhead of the RSP channel.
+ *
+ * Records are little endian:
+ *   magic(1) op(1) [addr(4) len(2) [data(len)]]
+ * and every record is answered with
+ *   magic(1) op(1) status(1) [payload]
+ * SCAN replies carry one extra byte (device count), READ replies are
+ * followed by the data on success.  Bytes that do not start a valid
+ * record are skipped, so the host can resynchronise by flushing.
+ */
+#define BATCH_MAGIC	0xB5
+
+#define BATCH_OP_SCAN	0x01	/* SWD scan, attach first target */
+#define BATCH_OP_READ	0x02	/* addr(4) len(2) -> status, data */
+#define BATCH_OP_WRITE	0x03	/* addr(4) len(2) data(len) -> status */
+#define BATCH_OP_DETACH	0x04	/* release the target */
+
+#define BATCH_STATUS_OK		0x00
+#define BATCH_STATUS_ERR	0x01	/* no target / access faulted */
+#define BATCH_STATUS_TOOBIG	0x02	/* len exceeds BATCH_MAX_DATA */
+
+/* Largest data phase of a single record, either direction */
+#define BATCH_MAX_DATA	1024
+
+#if defined(PLATFORM_HAS_BATCH)
+#include <libopencm3/usb/usbd.h>
+
+void batch_usb_out_cb(usbd_device *dev, uint8_t ep);
+void batch_process(void);
+#else
+#define batch_process() do {} while (0)
+#endif
+
+#endif
@@ -32,6 +32,9 @@
 #if defined(PLATFORM_HAS_TRACESWO)
 #	include "traceswo.h"
 #endif
+#if defined(PLATFORM_HAS_BATCH)
+#	include "batch.h"
+#endif
 #include "usbuart.h"
 #include "serialno.h"
 
@@ -347,6 +350,49 @@ static const struct usb_iface_assoc_descriptor trace_assoc = {
 };
 #endif
 
+#if defined(PLATFORM_HAS_BATCH)
+static const struct usb_endpoint_descriptor batch_endp[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = 0x06,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+	.bInterval = 0,
+}, {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = 0x86,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+	.bInterval = 0,
+}};
+
+const struct usb_interface_descriptor batch_iface = {
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = 6,
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 2,
+	.bInterfaceClass = 0xFF,
+	.bInterfaceSubClass = 0xFF,
+	.bInterfaceProtocol = 0xFF,
+	.iInterface = 8,
+
+	.endpoint = batch_endp,
+};
+
+static const struct usb_iface_assoc_descriptor batch_assoc = {
+	.bLength = USB_DT_INTERFACE_ASSOCIATION_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE_ASSOCIATION,
+	.bFirstInterface = 6,
+	.bInterfaceCount = 1,
+	.bFunctionClass = 0xFF,
+	.bFunctionSubClass = 0xFF,
+	.bFunctionProtocol = 0xFF,
+	.iFunction = 8,
+};
+#endif
+
 static const struct usb_interface ifaces[] = {{
 	.num_altsetting = 1,
 	.iface_assoc = &gdb_assoc,
@@ -371,13 +417,21 @@ static const struct usb_interface ifaces[] = {{
 	.iface_assoc = &trace_assoc,
 	.altsetting = &trace_iface,
 #endif
+#if defined(PLATFORM_HAS_BATCH)
+}, {
+	.num_altsetting = 1,
+	.iface_assoc = &batch_assoc,
+	.altsetting = &batch_iface,
+#endif
 }};
 
 static const struct usb_config_descriptor config = {
 	.bLength = USB_DT_CONFIGURATION_SIZE,
 	.bDescriptorType = USB_DT_CONFIGURATION,
 	.wTotalLength = 0,
-#if defined(PLATFORM_HAS_TRACESWO)
+#if defined(PLATFORM_HAS_BATCH)
+	.bNumInterfaces = 7,
+#elif defined(PLATFORM_HAS_TRACESWO)
 	.bNumInterfaces = 6,
 #else
 	.bNumInterfaces = 5,
@@ -406,6 +460,9 @@ static const char *usb_strings[] = {
 #if defined(PLATFORM_HAS_TRACESWO)
 	"Black Magic Trace Capture",
 #endif
+#if defined(PLATFORM_HAS_BATCH)
+	"Black Magic Batch Access",
+#endif
 };
 
 static void dfu_detach_complete(usbd_device *dev, struct usb_setup_data *req)
@@ -515,8 +572,11 @@ static void cdcacm_set_config(usbd_device *dev, uint16_t wValue)
 	              CDCACM_PACKET_SIZE, NULL);
 	usbd_ep_setup(dev, 0x82, USB_ENDPOINT_ATTR_INTERRUPT, 16, NULL);
 
-	/* Serial interface */
+	/* Serial interface.  The half-size OUT throttle is a full-speed
+	 * trick; a high-speed bulk endpoint must take the full 512-byte
+	 * packets the descriptor advertises. */
 	usbd_ep_setup(dev, 0x03, USB_ENDPOINT_ATTR_BULK,
+	              (CDCACM_PACKET_SIZE > 64) ? CDCACM_PACKET_SIZE :
 	              CDCACM_PACKET_SIZE / 2, usbuart_usb_out_cb);
 	usbd_ep_setup(dev, 0x83, USB_ENDPOINT_ATTR_BULK,
 	              CDCACM_PACKET_SIZE, usbuart_usb_in_cb);
@@ -528,6 +588,14 @@ static void cdcacm_set_config(usbd_device *dev, uint16_t wValue)
 					64, trace_buf_drain);
 #endif
 
+#if defined(PLATFORM_HAS_BATCH)
+	/* Batch access interface; records execute from the event pump */
+	usbd_ep_setup(dev, 0x06, USB_ENDPOINT_ATTR_BULK,
+					64, batch_usb_out_cb);
+	usbd_ep_setup(dev, 0x86, USB_ENDPOINT_ATTR_BULK,
+					64, NULL);
+#endif
+
 	usbd_register_control_callback(dev,
 			USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
 			USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
@@ -30,7 +30,11 @@
 
 #include <libopencm3/usb/usbd.h>
 
+/* Bulk endpoint max packet: 64 at full speed.  High-speed platforms
+ * (OTG_HS through a ULPI PHY) override this to 512 in platform.h. */
+#ifndef CDCACM_PACKET_SIZE
 #define CDCACM_PACKET_SIZE 	64
+#endif
 
 #define CDCACM_GDB_ENDPOINT	1
 #define CDCACM_UART_ENDPOINT	3
@@ -28,12 +28,60 @@ enum {
 	SWDIO_STATUS_DRIVE
 };
 
+unsigned swdptap_clk_divider;
+
+/* Pace each SWCLK phase; a divider of 0 runs the bit-bang flat out */
+static void PLATFORM_RAMFUNC swd_delay(void)
+{
+	for (volatile unsigned i = swdptap_clk_divider; i; i--)
+		;
+}
+
 int swdptap_init(void)
 {
 	return 0;
 }
 
-static void swdptap_turnaround(int dir)
+/* The transaction phases all have architecturally fixed lengths (8-bit
+ * request, 3-bit ack, 32-bit data plus parity), so they are emitted as
+ * straight-line code: the REP macros expand their statement N times and
+ * the compiler constant-folds each bit's mask, leaving the platform
+ * GPIO inlines back to back with no loop bookkeeping between edges.
+ * On an F103 running the bit-bang flat out, that bookkeeping was a
+ * measurable slice of every bit period. */
+#define REP2(x)  x x
+#define REP3(x)  REP2(x) x
+#define REP4(x)  REP2(x) REP2(x)
+#define REP8(x)  REP4(x) REP4(x)
+#define REP32(x) REP8(x) REP8(x) REP8(x) REP8(x)
+
+/* One SWCLK cycle; the doubled set widens the high phase to even the
+ * duty cycle out against the work done while the clock is low */
+#define SWD_CLOCK() \
+	do { \
+		gpio_set(SWCLK_PORT, SWCLK_PIN); \
+		gpio_set(SWCLK_PORT, SWCLK_PIN); \
+		swd_delay(); \
+		gpio_clear(SWCLK_PORT, SWCLK_PIN); \
+		swd_delay(); \
+	} while (0)
+
+/* Drive one bit of val selected by the running mask, then clock */
+#define SWD_OUT_BIT(val, mask) \
+	do { \
+		gpio_set_val(SWDIO_PORT, SWDIO_PIN, (val) & (mask)); \
+		SWD_CLOCK(); \
+	} while (0)
+
+/* Sample one bit into acc under the running mask, then clock */
+#define SWD_IN_BIT(acc, mask) \
+	do { \
+		if (gpio_get(SWDIO_PORT, SWDIO_PIN)) \
+			(acc) |= (mask); \
+		SWD_CLOCK(); \
+	} while (0)
+
+static void PLATFORM_RAMFUNC swdptap_turnaround(int dir)
 {
 	static int olddir = SWDIO_STATUS_FLOAT;
 
@@ -49,12 +97,14 @@ static void swdptap_turnaround(int dir)
 		SWDIO_MODE_FLOAT();
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	if(dir == SWDIO_STATUS_DRIVE)
 		SWDIO_MODE_DRIVE();
 }
 
-bool swdptap_bit_in(void)
+bool PLATFORM_RAMFUNC swdptap_bit_in(void)
 {
 	uint16_t ret;
 
@@ -63,7 +113,9 @@ bool swdptap_bit_in(void)
 	ret = gpio_get(SWDIO_PORT, SWDIO_PIN);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 
 #ifdef DEBUG_SWD_BITS
 	DEBUG("%d", ret?1:0);
@@ -72,7 +124,7 @@ bool swdptap_bit_in(void)
 	return ret != 0;
 }
 
-uint32_t
+uint32_t PLATFORM_RAMFUNC
 swdptap_seq_in(int ticks)
 {
 	uint32_t index = 1;
@@ -84,10 +136,12 @@ swdptap_seq_in(int ticks)
 		int res;
 		res = gpio_get(SWDIO_PORT, SWDIO_PIN);
 		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 		if (res)
 			ret |= index;
 		index <<= 1;
 		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 	}
 
 #ifdef DEBUG_SWD_BITS
@@ -97,7 +151,7 @@ swdptap_seq_in(int ticks)
 	return ret;
 }
 
-bool
+bool PLATFORM_RAMFUNC
 swdptap_seq_in_parity(uint32_t *ret, int ticks)
 {
 	uint32_t index = 1;
@@ -110,18 +164,22 @@ swdptap_seq_in_parity(uint32_t *ret, int ticks)
 	while (len--) {
 		bit = gpio_get(SWDIO_PORT, SWDIO_PIN);
 		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 		if (bit) {
 			res |= index;
 			parity ^= 1;
 		}
 		index <<= 1;
 		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 	}
 	bit = gpio_get(SWDIO_PORT, SWDIO_PIN);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	if (bit)
 		parity ^= 1;
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 #ifdef DEBUG_SWD_BITS
 	for (int i = 0; i < len; i++)
 		DEBUG("%d", (res & (1 << i)) ? 1 : 0);
@@ -130,7 +188,7 @@ swdptap_seq_in_parity(uint32_t *ret, int ticks)
 	return parity;
 }
 
-void swdptap_bit_out(bool val)
+void PLATFORM_RAMFUNC swdptap_bit_out(bool val)
 {
 #ifdef DEBUG_SWD_BITS
 	DEBUG("%d", val);
@@ -140,11 +198,14 @@ void swdptap_bit_out(bool val)
 
 	gpio_set_val(SWDIO_PORT, SWDIO_PIN, val);
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 }
-void
+void PLATFORM_RAMFUNC
 swdptap_seq_out(uint32_t MS, int ticks)
 {
 	int data = MS & 1;
@@ -159,11 +220,75 @@ swdptap_seq_out(uint32_t MS, int ticks)
 		data = MS & 1;
 		gpio_set(SWCLK_PORT, SWCLK_PIN);
 		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 	}
 }
 
-void
+/* Whole request/ack/data transactions emitted from one call.  The
+ * turnaround state is resolved once per phase change and every phase
+ * runs as a tight loop over the GPIO registers, instead of paying a
+ * call plus turnaround check per sequence as the seq_* compositions
+ * do.  The data phase is only clocked when the ack is OK. */
+uint8_t PLATFORM_RAMFUNC
+swdptap_transaction_read(uint8_t request, uint32_t *data, bool *parity_err)
+{
+	uint32_t index = 1;
+	uint32_t res = 0;
+	uint8_t ack = 0;
+	bool bit;
+
+	swdptap_turnaround(SWDIO_STATUS_DRIVE);
+	REP8({ SWD_OUT_BIT(request, index); index <<= 1; })
+
+	swdptap_turnaround(SWDIO_STATUS_FLOAT);
+	index = 1;
+	REP3({ SWD_IN_BIT(ack, index); index <<= 1; })
+
+	if (ack != 1)
+		return ack;
+
+	index = 1;
+	REP32({ SWD_IN_BIT(res, index); index <<= 1; })
+	bit = gpio_get(SWDIO_PORT, SWDIO_PIN);
+	SWD_CLOCK();
+
+	*data = res;
+	*parity_err = __builtin_parity(res) ^ (bit ? 1 : 0);
+	return ack;
+}
+
+uint8_t PLATFORM_RAMFUNC
+swdptap_transaction_write(uint8_t request, uint32_t data)
+{
+	uint32_t index = 1;
+	uint8_t ack = 0;
+
+	swdptap_turnaround(SWDIO_STATUS_DRIVE);
+	REP8({ SWD_OUT_BIT(request, index); index <<= 1; })
+
+	swdptap_turnaround(SWDIO_STATUS_FLOAT);
+	index = 1;
+	REP3({ SWD_IN_BIT(ack, index); index <<= 1; })
+
+	if (ack != 1)
+		return ack;
+
+	swdptap_turnaround(SWDIO_STATUS_DRIVE);
+	index = 1;
+	REP32({ SWD_OUT_BIT(data, index); index <<= 1; })
+	gpio_set_val(SWDIO_PORT, SWDIO_PIN, __builtin_parity(data));
+	SWD_CLOCK();
+	/* Two idle cycles to make the write effective internally on parts
+	 * with asynchronous SWCLK/HCLK domains (STM32L0x1, RM0377 Rev. 8
+	 * Chapter 27.5.4). */
+	gpio_clear(SWDIO_PORT, SWDIO_PIN);
+	REP2(SWD_CLOCK();)
+	return ack;
+}
+
+void PLATFORM_RAMFUNC
 swdptap_seq_out_parity(uint32_t MS, int ticks)
 {
 	uint8_t parity = 0;
@@ -179,12 +304,17 @@ swdptap_seq_out_parity(uint32_t MS, int ticks)
 		parity ^= MS;
 		MS >>= 1;
 		gpio_set(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 		data = MS & 1;
 		gpio_clear(SWCLK_PORT, SWCLK_PIN);
+		swd_delay();
 	}
 	gpio_set_val(SWDIO_PORT, SWDIO_PIN, parity & 1);
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
 	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	swd_delay();
 }
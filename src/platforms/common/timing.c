@@ -29,3 +29,22 @@ bool platform_timeout_is_expired(platform_timeout *t)
 	return platform_time_ms() > t->time;
 }
 
+uint32_t __attribute__((weak)) platform_poll_interval(void)
+{
+	return 64;
+}
+
+uint32_t __attribute__((weak)) platform_time_us(void)
+{
+	return platform_time_ms() * 1000;
+}
+
+void __attribute__((weak)) platform_event_pump(void)
+{
+}
+
+size_t __attribute__((weak)) platform_flash_buf_limit(void)
+{
+	return 0x400;
+}
+
@@ -26,5 +26,28 @@ struct platform_timeout {
 
 uint32_t platform_time_ms(void);
 
+/* Microsecond-resolution timestamp for profiling.  Weakly defined as
+ * milliseconds scaled up; platforms with a cycle counter or a host
+ * clock override it with the real thing. */
+uint32_t platform_time_us(void);
+
+/* Upper bound in ms for the halt-poll back-off while a target runs.
+ * Weakly defined; platforms may override to trade halt latency for
+ * debug link bandwidth. */
+uint32_t platform_poll_interval(void);
+
+/* Bytes the target layer may spend buffering flash writes.  Weakly
+ * defined small enough for RAM-constrained probes; hosted platforms
+ * override it with a budget large enough to buffer whole images and
+ * coalesce flash driver calls into maximal runs. */
+size_t platform_flash_buf_limit(void);
+
+/* Service deferred channel work (trace spill-over, flow control) from
+ * the wait loops: called whenever the probe is otherwise idle, blocked
+ * on a GDB byte or watching a running target.  Weakly defined as a
+ * no-op; platforms whose channels are not fully interrupt-driven
+ * override it. */
+void platform_event_pump(void);
+
 #endif /* __TIMING_H */
 
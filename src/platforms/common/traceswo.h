@@ -25,4 +25,22 @@
 void traceswo_init(uint32_t baudrate);
 void trace_buf_drain(usbd_device *dev, uint8_t ep);
 
+/* Blocking raw write to the trace endpoint.  `monitor dump' streams
+ * binary target memory through here at bulk bandwidth instead of hex
+ * over the GDB channel.  Returns false if the host stops draining. */
+bool trace_dump_write(const uint8_t *buf, unsigned len);
+
+/* Forward only ITM packets from the stimulus ports set in mask
+ * (NRZ/UART capture only) */
+void traceswo_setmask(uint32_t mask);
+
+/* Optional probe-side timestamping (`monitor trace_ts on', unpacked by
+ * swolisten -t).  Each trace packet is framed as:
+ *   magic byte, payload length, capture time (32 bit little endian,
+ *   probe CPU cycles from DWT_CYCCNT), then the payload bytes.
+ * Off by default, leaving the wire format a raw byte stream. */
+#define TRACE_TS_MAGIC	0xA6
+#define TRACE_TS_HDR	6
+void traceswo_timestamp(bool enable);
+
 #endif
@@ -65,14 +65,45 @@ void platform_init(void)
 	rcc_clock_setup_hse_3v3(&rcc_hse_8mhz_3v3[RCC_CLOCK_3V3_48MHZ]);
 
 	/* Enable peripherals */
-	rcc_periph_clock_enable(RCC_OTGFS);
 	rcc_periph_clock_enable(RCC_GPIOC);
 	rcc_periph_clock_enable(RCC_GPIOD);
 	rcc_periph_clock_enable(RCC_CRC);
 
+#ifdef USB_HS
+	rcc_periph_clock_enable(RCC_OTGHS);
+	rcc_periph_clock_enable(RCC_OTGHSULPI);
+	rcc_periph_clock_enable(RCC_GPIOB);
+	rcc_periph_clock_enable(RCC_GPIOH);
+	rcc_periph_clock_enable(RCC_GPIOI);
+
+	/* ULPI interface to the external PHY, all AF10 at maximum slew:
+	 * CK PA5, D0 PA3, D1/D2 PB0/PB1, D3..D6 PB10..PB13, D7 PB5,
+	 * STP PC0, NXT PH4, DIR PI11 */
+	gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO3 | GPIO5);
+	gpio_set_output_options(GPIOA, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+	                        GPIO3 | GPIO5);
+	gpio_set_af(GPIOA, GPIO_AF10, GPIO3 | GPIO5);
+	gpio_mode_setup(GPIOB, GPIO_MODE_AF, GPIO_PUPD_NONE,
+	                GPIO0 | GPIO1 | GPIO5 | GPIO10 | GPIO11 | GPIO12 | GPIO13);
+	gpio_set_output_options(GPIOB, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+	                GPIO0 | GPIO1 | GPIO5 | GPIO10 | GPIO11 | GPIO12 | GPIO13);
+	gpio_set_af(GPIOB, GPIO_AF10,
+	                GPIO0 | GPIO1 | GPIO5 | GPIO10 | GPIO11 | GPIO12 | GPIO13);
+	gpio_mode_setup(GPIOC, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO0);
+	gpio_set_output_options(GPIOC, GPIO_OTYPE_PP, GPIO_OSPEED_100MHZ,
+	                        GPIO0);
+	gpio_set_af(GPIOC, GPIO_AF10, GPIO0);
+	gpio_mode_setup(GPIOH, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO4);
+	gpio_set_af(GPIOH, GPIO_AF10, GPIO4);
+	gpio_mode_setup(GPIOI, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO11);
+	gpio_set_af(GPIOI, GPIO_AF10, GPIO11);
+#else
+	rcc_periph_clock_enable(RCC_OTGFS);
+
 	/* Set up USB Pins and alternate function*/
 	gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO11 | GPIO12);
 	gpio_set_af(GPIOA, GPIO_AF10, GPIO11 | GPIO12);
+#endif
 
 	GPIOC_OSPEEDR &=~0xF30;
 	GPIOC_OSPEEDR |= 0xA20;
@@ -32,6 +32,13 @@
 #include <setjmp.h>
 
 #define PLATFORM_HAS_TRACESWO
+#define PLATFORM_HAS_BATCH
+/* Run the bit-bang hot loops from SRAM: single-cycle fetch, free of the
+ * flash wait-state/ART jitter that limits the stable SWCLK rate.  The
+ * functions ride in .data, so the libopencm3 startup copy relocates
+ * them with the initialized data.  (F4 CCM is D-bus only and cannot
+ * fetch instructions, so system SRAM it is.) */
+#define PLATFORM_RAMFUNC __attribute__((section(".data.ramfunc"), noinline))
 #define BOARD_IDENT "Black Magic Probe (F4Discovery), (Firmware " FIRMWARE_VERSION ")"
 #define DFU_IDENT   "Black Magic Firmware Upgrade (F4Discovery)"
 
@@ -95,9 +102,20 @@
 	                GPIO_PUPD_NONE, SWDIO_PIN);
 
 
+#ifdef USB_HS
+/* High-speed via the OTG_HS core and an external ULPI PHY (build with
+ * USB_HS=1).  Needs a carrier board routing the ULPI pins; note ULPI
+ * DIR/NXT live on ports H/I, and the discovery board itself carries no
+ * PHY.  Bulk endpoints run the full 512 bytes. */
+#define USB_DRIVER      stm32f207_usb_driver
+#define USB_IRQ         NVIC_OTG_HS_IRQ
+#define USB_ISR         otg_hs_isr
+#define CDCACM_PACKET_SIZE 512
+#else
 #define USB_DRIVER      stm32f107_usb_driver
 #define USB_IRQ         NVIC_OTG_FS_IRQ
 #define USB_ISR         otg_fs_isr
+#endif
 /* Interrupt priorities.  Low numbers are high priority.
  * For now USART1 preempts USB which may spin while buffer is drained.
  * TIM3 is used for traceswo capture and must be highest priority.
@@ -107,6 +125,9 @@
 #define IRQ_PRI_USBUSART_TIM	(3 << 4)
 #define IRQ_PRI_TRACE		(0 << 4)
 
+/* Plenty of RAM here: size the ring for multi-megabaud log streaming */
+#define USBUART_FIFO_SIZE 2048
+
 #define USBUSART USART3
 #define USBUSART_CR1 USART3_CR1
 #define USBUSART_IRQ NVIC_USART3_IRQ
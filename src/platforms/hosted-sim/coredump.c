@@ -0,0 +1 @@
+../zynq_amp/coredump.c
\ No newline at end of file
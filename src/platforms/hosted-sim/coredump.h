@@ -0,0 +1 @@
+../zynq_amp/coredump.h
\ No newline at end of file
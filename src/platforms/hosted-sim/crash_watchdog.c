@@ -0,0 +1 @@
+../zynq_amp/crash_watchdog.c
\ No newline at end of file
@@ -0,0 +1 @@
+../zynq_amp/elfcore.h
\ No newline at end of file
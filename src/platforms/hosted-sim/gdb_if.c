@@ -0,0 +1 @@
+../libftdi/gdb_if.c
\ No newline at end of file
@@ -0,0 +1,94 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Pure-software host platform: no probe hardware and no wire.  The GDB
+ * channel is the usual TCP server and the only target is the in-memory
+ * loopback core from sim_target.c, so a session against this build
+ * measures the protocol stack alone.  Build with
+ * "make PROBE_HOST=hosted-sim".
+ */
+#include "general.h"
+#include "gdb_if.h"
+#include "version.h"
+
+#include <assert.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <stdarg.h>
+
+void platform_init(void)
+{
+	printf("\nBlack Magic Probe (" FIRMWARE_VERSION ") simulator\n");
+	printf("Copyright (C) 2015  Black Sphere Technologies Ltd.\n");
+	printf("License GPLv3+: GNU GPL version 3 or later "
+	       "<http://gnu.org/licenses/gpl.html>\n\n");
+
+	extern bool sim_target_probe(void);
+	sim_target_probe();
+
+	assert(gdb_if_init() == 0);
+}
+
+void platform_srst_set_val(bool assert)
+{
+	(void)assert;
+}
+
+bool platform_srst_get_val(void) { return false; }
+
+const char *platform_target_voltage(void)
+{
+	return "simulated";
+}
+
+void platform_delay(uint32_t ms)
+{
+	usleep(ms * 1000);
+}
+
+uint32_t platform_time_ms(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+uint32_t platform_time_us(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/* Host RAM is plentiful: let the target layer buffer whole flash
+ * images and hand the driver maximal runs */
+size_t platform_flash_buf_limit(void)
+{
+	return 0x100000;
+}
+
+void piksi_log(char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
@@ -0,0 +1,235 @@
+/* In-memory loopback target for the hosted-sim platform.  Memory
+ * accesses hit static arrays and the "core" halts the moment it is
+ * asked to, so every cycle a GDB session spends against it belongs to
+ * the protocol stack: gdb_packet.c framing, gdb_main.c dispatch, the
+ * hex encode/decode and the target.c flash buffering.  Driving a
+ * firmware load or a register poll loop at this target gives a
+ * hardware-independent throughput baseline for spotting regressions.
+ */
+#include "general.h"
+#include "target.h"
+#include "target/target_internal.h"
+
+#define SIM_FLASH_BASE		0x08000000
+#define SIM_FLASH_SIZE		(1024*1024)
+#define SIM_FLASH_BLOCKSIZE	0x1000
+#define SIM_RAM_BASE		0x20000000
+#define SIM_RAM_SIZE		(1024*1024)
+
+/* r0-r15 + xpsr, the minimal m-profile set */
+#define SIM_NUM_REGS		17
+#define SIM_REG_PC		15
+
+static const char tdesc_sim[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target>"
+	"  <architecture>arm</architecture>"
+	"  <feature name=\"org.gnu.gdb.arm.m-profile\">"
+	"    <reg name=\"r0\" bitsize=\"32\"/>"
+	"    <reg name=\"r1\" bitsize=\"32\"/>"
+	"    <reg name=\"r2\" bitsize=\"32\"/>"
+	"    <reg name=\"r3\" bitsize=\"32\"/>"
+	"    <reg name=\"r4\" bitsize=\"32\"/>"
+	"    <reg name=\"r5\" bitsize=\"32\"/>"
+	"    <reg name=\"r6\" bitsize=\"32\"/>"
+	"    <reg name=\"r7\" bitsize=\"32\"/>"
+	"    <reg name=\"r8\" bitsize=\"32\"/>"
+	"    <reg name=\"r9\" bitsize=\"32\"/>"
+	"    <reg name=\"r10\" bitsize=\"32\"/>"
+	"    <reg name=\"r11\" bitsize=\"32\"/>"
+	"    <reg name=\"r12\" bitsize=\"32\"/>"
+	"    <reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+	"    <reg name=\"lr\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"xpsr\" bitsize=\"32\"/>"
+	"  </feature>"
+	"</target>";
+
+static struct {
+	uint8_t flash[SIM_FLASH_SIZE];
+	uint8_t ram[SIM_RAM_SIZE];
+	uint32_t regs[SIM_NUM_REGS];
+	bool halted;
+	enum target_halt_reason reason;
+} sim;
+
+static void *sim_mem(target_addr addr, size_t len)
+{
+	if ((addr >= SIM_FLASH_BASE) &&
+	    (addr + len <= SIM_FLASH_BASE + SIM_FLASH_SIZE))
+		return sim.flash + (addr - SIM_FLASH_BASE);
+	if ((addr >= SIM_RAM_BASE) &&
+	    (addr + len <= SIM_RAM_BASE + SIM_RAM_SIZE))
+		return sim.ram + (addr - SIM_RAM_BASE);
+	return NULL;
+}
+
+static void sim_mem_read(target *t, void *dest, target_addr src, size_t len)
+{
+	(void)t;
+	void *p = sim_mem(src, len);
+	if (p)
+		memcpy(dest, p, len);
+	else
+		memset(dest, 0, len);
+}
+
+static void sim_mem_write(target *t, target_addr dest, const void *src, size_t len)
+{
+	(void)t;
+	void *p = sim_mem(dest, len);
+	if (p)
+		memcpy(p, src, len);
+}
+
+static void sim_regs_read(target *t, void *data)
+{
+	(void)t;
+	memcpy(data, sim.regs, sizeof(sim.regs));
+}
+
+static void sim_regs_write(target *t, const void *data)
+{
+	(void)t;
+	memcpy(sim.regs, data, sizeof(sim.regs));
+}
+
+static ssize_t sim_reg_read(target *t, int reg, void *data, size_t max)
+{
+	(void)t;
+	if ((reg < 0) || (reg >= SIM_NUM_REGS) || (max < 4))
+		return -1;
+	memcpy(data, &sim.regs[reg], 4);
+	return 4;
+}
+
+static ssize_t sim_reg_write(target *t, int reg, const void *data, size_t size)
+{
+	(void)t;
+	if ((reg < 0) || (reg >= SIM_NUM_REGS) || (size < 4))
+		return -1;
+	memcpy(&sim.regs[reg], data, 4);
+	return 4;
+}
+
+static void sim_reset(target *t)
+{
+	(void)t;
+	memset(sim.regs, 0, sizeof(sim.regs));
+	sim.regs[SIM_REG_PC] = SIM_FLASH_BASE;
+	sim.halted = true;
+	sim.reason = TARGET_HALT_REQUEST;
+}
+
+static bool sim_attach(target *t)
+{
+	(void)t;
+	sim.halted = true;
+	sim.reason = TARGET_HALT_REQUEST;
+	return true;
+}
+
+static void sim_detach(target *t)
+{
+	(void)t;
+	sim.halted = false;
+}
+
+static bool sim_check_error(target *t)
+{
+	(void)t;
+	return false;
+}
+
+static void sim_halt_request(target *t)
+{
+	(void)t;
+	sim.halted = true;
+	sim.reason = TARGET_HALT_REQUEST;
+}
+
+static enum target_halt_reason sim_halt_poll(target *t, target_addr *watch)
+{
+	(void)t;
+	(void)watch;
+	return sim.halted ? sim.reason : TARGET_HALT_RUNNING;
+}
+
+static void sim_halt_resume(target *t, bool step)
+{
+	(void)t;
+	if (step) {
+		/* Nothing executes; pretend the instruction retired */
+		sim.regs[SIM_REG_PC] += 2;
+		sim.reason = TARGET_HALT_STEPPING;
+	} else {
+		sim.halted = false;
+	}
+}
+
+static void sim_halt_range_resume(target *t, target_addr start, target_addr end)
+{
+	(void)t;
+	/* Nothing executes, so the "core" marches straight out of the
+	 * range and reports the single final stop */
+	do {
+		sim.regs[SIM_REG_PC] += 2;
+	} while ((sim.regs[SIM_REG_PC] >= start) &&
+	         (sim.regs[SIM_REG_PC] < end));
+	sim.reason = TARGET_HALT_STEPPING;
+}
+
+static int sim_flash_erase(struct target_flash *f, target_addr addr, size_t len)
+{
+	(void)f;
+	memset(sim.flash + (addr - SIM_FLASH_BASE), 0xFF, len);
+	return 0;
+}
+
+static int sim_flash_write(struct target_flash *f, target_addr dest,
+                           const void *src, size_t len)
+{
+	(void)f;
+	memcpy(sim.flash + (dest - SIM_FLASH_BASE), src, len);
+	return 0;
+}
+
+bool sim_target_probe(void)
+{
+	target *t = target_new();
+
+	t->driver = "loopback simulator";
+	t->tdesc = tdesc_sim;
+	t->regs_size = sizeof(sim.regs);
+
+	t->attach = sim_attach;
+	t->detach = sim_detach;
+	t->check_error = sim_check_error;
+	t->mem_read = sim_mem_read;
+	t->mem_write = sim_mem_write;
+	t->regs_read = sim_regs_read;
+	t->regs_write = sim_regs_write;
+	t->reg_read = sim_reg_read;
+	t->reg_write = sim_reg_write;
+	t->reset = sim_reset;
+	t->halt_request = sim_halt_request;
+	t->halt_poll = sim_halt_poll;
+	t->halt_resume = sim_halt_resume;
+	t->halt_range_resume = sim_halt_range_resume;
+
+	target_add_ram(t, SIM_RAM_BASE, SIM_RAM_SIZE);
+
+	struct target_flash *f = target_mem_alloc(sizeof(*f));
+	f->start = SIM_FLASH_BASE;
+	f->length = SIM_FLASH_SIZE;
+	f->blocksize = SIM_FLASH_BLOCKSIZE;
+	f->buf_size = SIM_FLASH_BLOCKSIZE;
+	f->erased = 0xff;
+	f->erase = sim_flash_erase;
+	f->write = sim_flash_write;
+	target_add_flash(t, f);
+
+	sim_reset(t);
+	return true;
+}
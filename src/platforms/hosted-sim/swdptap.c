@@ -0,0 +1,25 @@
+/* Null SWD tap for the hosted-sim platform.  There is no wire here:
+ * the bit-in primitive always reads low, so an SWD scan sees an
+ * unresponsive bus and fails cleanly.  Providing the primitives lets
+ * the hosted build compile and link the full ADIv5/Cortex-M stack,
+ * which otherwise only ever sees a cross compiler.
+ */
+#include "general.h"
+#include "swdptap.h"
+
+unsigned swdptap_clk_divider;
+
+int swdptap_init(void)
+{
+	return 0;
+}
+
+bool swdptap_bit_in(void)
+{
+	return false;
+}
+
+void swdptap_bit_out(bool val)
+{
+	(void)val;
+}
@@ -33,6 +33,13 @@
 #include <setjmp.h>
 
 #define PLATFORM_HAS_TRACESWO
+#define PLATFORM_HAS_BATCH
+/* Run the bit-bang hot loops from SRAM: single-cycle fetch, free of the
+ * flash wait-state/ART jitter that limits the stable SWCLK rate.  The
+ * functions ride in .data, so the libopencm3 startup copy relocates
+ * them with the initialized data.  (F4 CCM is D-bus only and cannot
+ * fetch instructions, so system SRAM it is.) */
+#define PLATFORM_RAMFUNC __attribute__((section(".data.ramfunc"), noinline))
 #define BOARD_IDENT       "Black Magic Probe (HydraBus), (Firmware " FIRMWARE_VERSION ")"
 #define BOARD_IDENT_DFU   "Black Magic (Upgrade) for HydraBus, (Firmware " FIRMWARE_VERSION ")"
 #define DFU_IDENT         "Black Magic Firmware Upgrade (HydraBus)"
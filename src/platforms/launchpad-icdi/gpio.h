@@ -0,0 +1,56 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __GPIO_H
+#define __GPIO_H
+
+#include <libopencm3/lm4f/memorymap.h>
+#include <libopencm3/lm4f/gpio.h>
+
+#define INLINE_GPIO
+
+#define gpio_set_val(port, pin, val) do {	\
+	if(val)					\
+		gpio_set((port), (pin));	\
+	else					\
+		gpio_clear((port), (pin));	\
+} while(0)
+
+/* The LM4F GPIO data register decodes address bits [9:2] as a pin
+ * mask, so a single store to base + (pins << 2) touches exactly those
+ * pins.  That turns each bit-bang edge into one str instead of a call
+ * into the libopencm3 helpers. */
+#ifdef INLINE_GPIO
+static inline void _gpio_set(uint32_t gpioport, uint8_t gpios)
+{
+	*(volatile uint32_t *)(gpioport + ((uint32_t)gpios << 2)) = gpios;
+}
+#define gpio_set _gpio_set
+
+static inline void _gpio_clear(uint32_t gpioport, uint8_t gpios)
+{
+	*(volatile uint32_t *)(gpioport + ((uint32_t)gpios << 2)) = 0;
+}
+#define gpio_clear _gpio_clear
+
+static inline uint8_t _gpio_get(uint32_t gpioport, uint8_t gpios)
+{
+	return *(volatile uint32_t *)(gpioport + ((uint32_t)gpios << 2));
+}
+#define gpio_get _gpio_get
+#endif
+
+#endif
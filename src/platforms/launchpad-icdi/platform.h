@@ -17,9 +17,10 @@
 #ifndef __PLATFORM_H
 #define __PLATFORM_H
 
-#include <libopencm3/lm4f/gpio.h>
 #include <libopencm3/usb/usbd.h>
 
+#include "gpio.h"
+
 #include "timing.h"
 #include "version.h"
 
@@ -75,6 +76,9 @@ extern usbd_driver lm4f_usb_driver;
 
 #define IRQ_PRI_USB	(2 << 4)
 
+/* 80MHz part with uDMA moving the UART data: afford a big ring */
+#define USBUART_FIFO_SIZE	1024
+
 #define USBUART		UART0
 #define USBUART_CLK	RCC_UART0
 #define USBUART_IRQ	NVIC_UART0_IRQ
@@ -106,14 +110,6 @@ extern usbd_driver lm4f_usb_driver;
 
 #define PLATFORM_HAS_TRACESWO
 
-inline static void gpio_set_val(uint32_t port, uint8_t pin, uint8_t val) {
-	gpio_write(port, pin, val == 0 ? 0 : 0xff);
-}
-
-inline static uint8_t gpio_get(uint32_t port, uint8_t pin) {
-	return !(gpio_read(port, pin) == 0);
-}
-
 #define disconnect_usb() do { usbd_disconnect(usbdev,1); nvic_disable_irq(USB_IRQ);} while(0)
 
 static inline int platform_hwversion(void)
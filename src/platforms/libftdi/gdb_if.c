@@ -45,6 +45,47 @@
 #include "gdb_if.h"
 
 static int gdb_if_serv, gdb_if_conn;
+static uint16_t gdb_if_port = 2001;
+
+/* Must be called before gdb_if_init() to take effect */
+void gdb_if_set_port(uint16_t port)
+{
+	gdb_if_port = port;
+}
+
+/* Wait for a connection, sleeping in select() instead of a poll loop so
+ * we wake the moment the host connects; the timeout keeps the crash
+ * watchdog serviced.  Returns true once a connection is up. */
+static bool gdb_if_accept(void)
+{
+	extern void crash_watchdog_poll(void);
+	fd_set fds;
+	struct timeval tv;
+	int opt;
+
+	if (gdb_if_conn > 0)
+		return true;
+
+	crash_watchdog_poll();
+
+	FD_ZERO(&fds);
+	FD_SET(gdb_if_serv, &fds);
+	tv.tv_sec = 0;
+	tv.tv_usec = 10000;
+	if (select(gdb_if_serv + 1, &fds, NULL, NULL, &tv) <= 0)
+		return false;
+
+	gdb_if_conn = accept(gdb_if_serv, NULL, NULL);
+	if (gdb_if_conn <= 0)
+		return false;
+
+	/* Replies leave in a single send(); don't let Nagle hold them */
+	opt = 1;
+	setsockopt(gdb_if_conn, IPPROTO_TCP, TCP_NODELAY,
+	           (void*)&opt, sizeof(opt));
+	DEBUG("Got connection %d\n", gdb_if_conn);
+	return true;
+}
 
 int gdb_if_init(void)
 {
@@ -56,7 +97,7 @@ int gdb_if_init(void)
 	int opt;
 
 	addr.sin_family = AF_INET;
-	addr.sin_port = htons(2001);
+	addr.sin_port = htons(gdb_if_port);
 	addr.sin_addr.s_addr = htonl(INADDR_ANY);
 
 	assert((gdb_if_serv = socket(PF_INET, SOCK_STREAM, 0)) != -1);
@@ -69,37 +110,65 @@ int gdb_if_init(void)
 	assert(bind(gdb_if_serv, (void*)&addr, sizeof(addr)) != -1);
 	assert(listen(gdb_if_serv, 1) != -1);
 
-	DEBUG("Listening on TCP:2001\n");
+	DEBUG("Listening on TCP:%d\n", gdb_if_port);
 
 	return 0;
 }
 
 
+/* Receive buffer: one large recv() per socket read instead of a
+ * syscall per character.  Everything on the read side drains this
+ * before touching the socket again. */
+static uint8_t gdb_if_rxbuf[2048];
+static int gdb_if_rxpos, gdb_if_rxlen;
+
+static int gdb_if_fill(void)
+{
+	gdb_if_rxpos = 0;
+	gdb_if_rxlen = recv(gdb_if_conn, (void*)gdb_if_rxbuf,
+	                    sizeof(gdb_if_rxbuf), 0);
+	if (gdb_if_rxlen <= 0) {
+		gdb_if_rxlen = 0;
+		gdb_if_conn = -1;
+		DEBUG("Dropped broken connection\n");
+		return -1;
+	}
+	return 0;
+}
+
 unsigned char gdb_if_getchar(void)
 {
-	unsigned char ret;
-	int i = 0;
-
-	while(i <= 0) {
-		if(gdb_if_conn <= 0) {
-			gdb_if_conn = accept(gdb_if_serv, NULL, NULL);
-			if (gdb_if_conn <= 0) {
-				extern void crash_watchdog_poll(void);
-				crash_watchdog_poll();
-				usleep(1000);
-				return 0x04;
-			}
-			DEBUG("Got connection %d\n", gdb_if_conn);
-		}
-		i = recv(gdb_if_conn, (void*)&ret, 1, 0);
-		if(i <= 0) {
-			gdb_if_conn = -1;
-			DEBUG("Dropped broken connection\n");
+	while (gdb_if_rxpos == gdb_if_rxlen) {
+		if (!gdb_if_accept())
+			return 0x04;
+		if (gdb_if_fill() < 0)
 			/* Return '+' in case we were waiting for an ACK */
 			return '+';
+	}
+	return gdb_if_rxbuf[gdb_if_rxpos++];
+}
+
+int gdb_if_getbuf(unsigned char *buf, int maxlen)
+{
+	int avail;
+
+	if (gdb_if_rxpos == gdb_if_rxlen) {
+		if (!gdb_if_accept()) {
+			buf[0] = 0x04;
+			return 1;
+		}
+		if (gdb_if_fill() < 0) {
+			/* Return '+' in case we were waiting for an ACK */
+			buf[0] = '+';
+			return 1;
 		}
 	}
-	return ret;
+	avail = gdb_if_rxlen - gdb_if_rxpos;
+	if (avail > maxlen)
+		avail = maxlen;
+	memcpy(buf, gdb_if_rxbuf + gdb_if_rxpos, avail);
+	gdb_if_rxpos += avail;
+	return avail;
 }
 
 unsigned char gdb_if_getchar_to(int timeout)
@@ -107,6 +176,9 @@ unsigned char gdb_if_getchar_to(int timeout)
 	fd_set fds;
 	struct timeval tv;
 
+	if (gdb_if_rxpos < gdb_if_rxlen)
+		return gdb_if_rxbuf[gdb_if_rxpos++];
+
 	if(gdb_if_conn == -1) return -1;
 
 	tv.tv_sec = timeout / 1000;
@@ -121,15 +193,35 @@ unsigned char gdb_if_getchar_to(int timeout)
 	return -1;
 }
 
+static uint8_t gdb_if_txbuf[2048];
+static unsigned gdb_if_txlen;
+
+void gdb_if_write(const char *data, int size)
+{
+	if (gdb_if_conn <= 0)
+		return;
+	while (size) {
+		int n = sizeof(gdb_if_txbuf) - gdb_if_txlen;
+		if (n > size)
+			n = size;
+		memcpy(gdb_if_txbuf + gdb_if_txlen, data, n);
+		gdb_if_txlen += n;
+		data += n;
+		size -= n;
+		if (gdb_if_txlen == sizeof(gdb_if_txbuf)) {
+			send(gdb_if_conn, gdb_if_txbuf, gdb_if_txlen, 0);
+			gdb_if_txlen = 0;
+		}
+	}
+}
+
 void gdb_if_putchar(unsigned char c, int flush)
 {
-	static uint8_t buf[2048];
-	static int bufsize = 0;
 	if (gdb_if_conn > 0) {
-		buf[bufsize++] = c;
-		if (flush || (bufsize == sizeof(buf))) {
-			send(gdb_if_conn, buf, bufsize, 0);
-			bufsize = 0;
+		gdb_if_txbuf[gdb_if_txlen++] = c;
+		if (flush || (gdb_if_txlen == sizeof(gdb_if_txbuf))) {
+			send(gdb_if_conn, gdb_if_txbuf, gdb_if_txlen, 0);
+			gdb_if_txlen = 0;
 		}
 	}
 }
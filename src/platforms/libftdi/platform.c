@@ -24,7 +24,11 @@
 
 #include <assert.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/time.h>
+#ifndef WIN32
+#	include <sys/wait.h>
+#endif
 
 struct ftdi_context *ftdic;
 
@@ -178,6 +182,54 @@ cable_desc_t cable_desc[] = {
 	},
 };
 
+#ifndef WIN32
+/* Daemon mode: enumerate every attached cable of the selected type and
+ * fork one server per cable, listening on port_base + index.  Each
+ * child owns its own FTDI handle and target state; the parent only
+ * sticks around to reap them.  Returns the serial of the cable the
+ * calling (child) process should open; does not return in the parent. */
+static char *platform_daemon_fork(uint16_t port_base)
+{
+	struct ftdi_context *ctx;
+	struct ftdi_device_list *devlist, *dev;
+	char serial[64];
+	int found, i = 0;
+
+	if ((ctx = ftdi_new()) == NULL) {
+		fprintf(stderr, "ftdi_new: %s\n", ftdi_get_error_string(ctx));
+		exit(-1);
+	}
+	found = ftdi_usb_find_all(ctx, &devlist,
+			active_cable->vendor, active_cable->product);
+	if (found <= 0) {
+		fprintf(stderr, "daemon: no %s cables found\n",
+			active_cable->name);
+		exit(-1);
+	}
+	for (dev = devlist; dev; dev = dev->next, i++) {
+		if (ftdi_usb_get_strings(ctx, dev->dev, NULL, 0, NULL, 0,
+					 serial, sizeof(serial)) != 0) {
+			fprintf(stderr, "daemon: skipping cable %d: %s\n",
+				i, ftdi_get_error_string(ctx));
+			continue;
+		}
+		pid_t pid = fork();
+		if (pid == 0) {
+			ftdi_list_free(&devlist);
+			ftdi_free(ctx);
+			gdb_if_set_port(port_base + i);
+			return strdup(serial);
+		}
+		printf("daemon: cable %s on TCP:%d (pid %d)\n",
+		       serial, port_base + i, (int)pid);
+	}
+	ftdi_list_free(&devlist);
+	ftdi_free(ctx);
+	while (wait(NULL) > 0 || errno != ECHILD);
+	exit(0);
+}
+#endif
+
 void platform_init(int argc, char **argv)
 {
 	int err;
@@ -185,7 +237,8 @@ void platform_init(int argc, char **argv)
 	unsigned index = 0;
 	char *serial = NULL;
 	char * cablename =  "ftdi";
-	while((c = getopt(argc, argv, "c:s:")) != -1) {
+	uint16_t daemon_port_base = 0;
+	while((c = getopt(argc, argv, "c:s:d:")) != -1) {
 		switch(c) {
 		case 'c':
 			cablename =  optarg;
@@ -193,6 +246,9 @@ void platform_init(int argc, char **argv)
 		case 's':
 			serial = optarg;
 			break;
+		case 'd':
+			daemon_port_base = atoi(optarg);
+			break;
 		}
 	}
 
@@ -213,6 +269,16 @@ void platform_init(int argc, char **argv)
 	printf("License GPLv3+: GNU GPL version 3 or later "
 	       "<http://gnu.org/licenses/gpl.html>\n\n");
 
+#ifndef WIN32
+	if (daemon_port_base)
+		serial = platform_daemon_fork(daemon_port_base);
+#else
+	if (daemon_port_base) {
+		fprintf(stderr, "daemon mode not supported on Windows\n");
+		exit(-1);
+	}
+#endif
+
 	if(ftdic) {
 		ftdi_usb_close(ftdic);
 		ftdi_free(ftdic);
@@ -317,3 +383,17 @@ uint32_t platform_time_ms(void)
 	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
 }
 
+uint32_t platform_time_us(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/* Host RAM is plentiful: let the target layer buffer whole flash
+ * images and hand the driver maximal runs */
+size_t platform_flash_buf_limit(void)
+{
+	return 0x100000;
+}
+
@@ -38,6 +38,12 @@
 
 #define PLATFORM_HAS_DEBUG
 
+/* Hosted build: take large packets so a firmware load needs an order of
+ * magnitude fewer round trips than the 1K default allows. */
+#define GDB_PACKET_BUFFER_SIZE	(64*1024)
+/* CRC verification reads in packet-buffer sized chunks */
+#define CRC32_BUFFER_SIZE	(64*1024)
+
 #define SET_RUN_STATE(state)
 #define SET_IDLE_STATE(state)
 #define SET_ERROR_STATE(state)
@@ -130,6 +130,103 @@ void swdptap_bit_out(bool val)
 	platform_buffer_write(cmd, 3);
 }
 
+/* Whole transactions enqueued as a single MPSSE command stream and
+ * drained with one USB round trip, instead of paying one per phase.
+ * The data phase of a read is clocked speculatively before the ack has
+ * been seen; on WAIT/FAULT the collected bits are discarded and the
+ * sticky-overrun clearing in the DP error path covers the target side,
+ * as in overrun-detection operation. */
+uint8_t swdptap_transaction_read(uint8_t request, uint32_t *data,
+				 bool *parity_err)
+{
+	uint8_t cmd[8 + 36 * 4];
+	uint8_t resp[36];
+	int index = 0;
+	uint8_t ack = 0;
+	uint32_t ret = 0;
+	unsigned int parity = 0;
+
+	swdptap_turnaround(0);
+	/* Request phase: 7 + 1 bits via TMS shifts */
+	cmd[index++] = MPSSE_TMS_SHIFT;
+	cmd[index++] = 6;
+	cmd[index++] = request & 0x7f;
+	cmd[index++] = MPSSE_TMS_SHIFT;
+	cmd[index++] = 0;
+	cmd[index++] = (request >> 7) & 1;
+	platform_buffer_write(cmd, index);
+
+	swdptap_turnaround(1);
+	/* Ack (3) + data (32) + parity (1), one sampled bit per command */
+	index = 0;
+	for (int i = 0; i < 36; i++) {
+		cmd[index++] = active_cable->bitbang_tms_in_port_cmd;
+		cmd[index++] = MPSSE_TMS_SHIFT;
+		cmd[index++] = 0;
+		cmd[index++] = 0;
+	}
+	platform_buffer_write(cmd, index);
+	platform_buffer_read(resp, 36);
+
+	for (int i = 0; i < 3; i++)
+		if (resp[i] & active_cable->bitbang_tms_in_pin)
+			ack |= 1 << i;
+	for (int i = 0; i < 32; i++)
+		if (resp[3 + i] & active_cable->bitbang_tms_in_pin) {
+			ret |= 1 << i;
+			parity ^= 1;
+		}
+	if (resp[35] & active_cable->bitbang_tms_in_pin)
+		parity ^= 1;
+
+	if (ack != 1)
+		return ack;
+
+	*data = ret;
+	*parity_err = parity;
+	return ack;
+}
+
+uint8_t swdptap_transaction_write(uint8_t request, uint32_t data)
+{
+	uint8_t cmd[36];
+	uint8_t resp[3];
+	int index = 0;
+	uint8_t ack = 0;
+
+	swdptap_turnaround(0);
+	cmd[index++] = MPSSE_TMS_SHIFT;
+	cmd[index++] = 6;
+	cmd[index++] = request & 0x7f;
+	cmd[index++] = MPSSE_TMS_SHIFT;
+	cmd[index++] = 0;
+	cmd[index++] = (request >> 7) & 1;
+	platform_buffer_write(cmd, index);
+
+	swdptap_turnaround(1);
+	index = 0;
+	for (int i = 0; i < 3; i++) {
+		cmd[index++] = active_cable->bitbang_tms_in_port_cmd;
+		cmd[index++] = MPSSE_TMS_SHIFT;
+		cmd[index++] = 0;
+		cmd[index++] = 0;
+	}
+	platform_buffer_write(cmd, index);
+	platform_buffer_read(resp, 3);
+
+	for (int i = 0; i < 3; i++)
+		if (resp[i] & active_cable->bitbang_tms_in_pin)
+			ack |= 1 << i;
+
+	if (ack != 1)
+		return ack;
+
+	/* Data + parity + two idle cycles, queued without a read-back */
+	swdptap_seq_out_parity(data, 32);
+	swdptap_seq_out(0, 2);
+	return ack;
+}
+
 bool swdptap_seq_in_parity(uint32_t *res, int ticks)
 {
 	int index = ticks + 1;
@@ -29,6 +29,7 @@
 #include "timing_stm32.h"
 
 #define PLATFORM_HAS_TRACESWO
+#define PLATFORM_HAS_BATCH
 #define PLATFORM_HAS_POWER_SWITCH
 #ifdef ENABLE_DEBUG
 #define PLATFORM_HAS_DEBUG
@@ -130,6 +131,18 @@
 	GPIO_BSRR(SWDIO_DIR_PORT) = SWDIO_DIR_PIN; \
 	SWD_CR = cr; \
 } while(0)
+#ifdef SWD_SPI
+/* Hand SWCLK (PA5/SCK) and SWDIO (strapped to PA7/MOSI) to SPI1 for
+ * the multi-bit phases driven by swdptap_spi.c, and back to GPIO for
+ * turnarounds and short phases. */
+# define SWD_SPI_MODE_SPI() \
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, \
+	              GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO5 | GPIO7)
+# define SWD_SPI_MODE_GPIO() \
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, \
+	              GPIO_CNF_OUTPUT_PUSHPULL, GPIO5 | GPIO7)
+#endif
+
 #define UART_PIN_SETUP() do { \
 	gpio_set_mode(USBUSART_PORT, GPIO_MODE_OUTPUT_2_MHZ, \
 	              GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, USBUSART_TX_PIN); \
@@ -150,11 +163,21 @@
 
 #define USBUSART USART1
 #define USBUSART_CR1 USART1_CR1
+#define USBUSART_DR USART1_DR
 #define USBUSART_IRQ NVIC_USART1_IRQ
 #define USBUSART_CLK RCC_USART1
 #define USBUSART_PORT GPIOA
 #define USBUSART_TX_PIN GPIO9
 #define USBUSART_ISR usart1_isr
+/* USART1 DMA requests: RX on channel 5, TX on channel 4 */
+#define USBUSART_DMA_BUS DMA1
+#define USBUSART_DMA_CLK RCC_DMA1
+#define USBUSART_DMA_RX_CHAN DMA_CHANNEL5
+#define USBUSART_DMA_RX_IRQ NVIC_DMA1_CHANNEL5_IRQ
+#define USBUSART_DMA_RX_ISR dma1_channel5_isr
+#define USBUSART_DMA_TX_CHAN DMA_CHANNEL4
+#define USBUSART_DMA_TX_IRQ NVIC_DMA1_CHANNEL4_IRQ
+#define USBUSART_DMA_TX_ISR dma1_channel4_isr
 #define USBUSART_TIM TIM4
 #define USBUSART_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM4)
 #define USBUSART_TIM_IRQ NVIC_TIM4_IRQ
@@ -164,12 +187,34 @@
 #define TRACE_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM3)
 #define TRACE_IRQ   NVIC_TIM3_IRQ
 #define TRACE_ISR   tim3_isr
+/* DMA-fed capture: TIM3_CH1 requests map to DMA1 channel 6 */
+#define TRACE_DMA_BUS  DMA1
+#define TRACE_DMA_CLK  RCC_DMA1
+#define TRACE_DMA_CHAN DMA_CHANNEL6
+#define TRACE_DMA_IRQ  NVIC_DMA1_CHANNEL6_IRQ
+#define TRACE_DMA_ISR  dma1_channel6_isr
+
+/* NRZ mode SWO (TRACESWO_PROTOCOL=2): USART2 RX shares PA3 with TDI,
+ * which is free during SWD sessions.  USART2_RX is also DMA1 channel 6;
+ * only one capture protocol is ever built in. */
+#define IRQ_PRI_SWO_DMA         (1 << 4)
+#define NUM_TRACE_PACKETS       (64)		/* This is a 4K buffer */
+#define SWO_UART                USART2
+#define SWO_UART_DR             USART2_DR
+#define SWO_UART_CLK            RCC_USART2
+#define SWO_UART_PORT           GPIOA
+#define SWO_UART_RX_PIN         GPIO3
+#define SWO_DMA_BUS             DMA1
+#define SWO_DMA_CLK             RCC_DMA1
+#define SWO_DMA_CHAN            DMA_CHANNEL6
+#define SWO_DMA_IRQ             NVIC_DMA1_CHANNEL6_IRQ
+#define SWO_DMA_ISR(x)          dma1_channel6_isr(x)
 
 #ifdef ENABLE_DEBUG
 extern bool debug_bmp;
 int usbuart_debug_write(const char *buf, size_t len);
 
-#define DEBUG printf
+/* DEBUG goes to the trace ring; see general.h */
 #else
 #define DEBUG(...)
 #endif
@@ -69,6 +69,7 @@
 #define LED_UART	GPIO14
 
 #define PLATFORM_HAS_TRACESWO	1
+#define PLATFORM_HAS_BATCH	1
 #define NUM_TRACE_PACKETS		(128)		/* This is an 8K buffer */
 
 # define SWD_CR   GPIO_CRH(SWDIO_PORT)
@@ -120,7 +121,7 @@
 #ifdef ENABLE_DEBUG
 extern bool debug_bmp;
 int usbuart_debug_write(const char *buf, size_t len);
-# define DEBUG printf
+/* DEBUG goes to the trace ring; see general.h */
 #else
 # define DEBUG(...)
 #endif
@@ -56,10 +56,21 @@ void dfu_flash_program_buffer(uint32_t baseaddr, void *buf, int len)
 
 uint32_t dfu_poll_timeout(uint8_t cmd, uint32_t addr, uint16_t blocknum)
 {
-	(void)cmd;
 	(void)addr;
-	(void)blocknum;
-	return 100;
+
+	/* The host is paced by the hardware anyway: we execute from the
+	 * flash being operated on, so the CPU stalls on the first fetch
+	 * after kicking the operation and the following GETSTATUS is
+	 * NAKed until the flash is free again.  Report the typical times
+	 * from the datasheet rather than a pessimistic round number so
+	 * the host polls as soon as the operation is likely complete.
+	 */
+	if (blocknum == 0)
+		/* Page erase: 20ms typical */
+		return (cmd == CMD_ERASE) ? 25 : 1;
+
+	/* Programming a 1KiB block half-word at a time, ~52us each */
+	return 27;
 }
 
 void dfu_protect(dfu_mode_t mode)
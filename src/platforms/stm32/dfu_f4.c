@@ -32,10 +32,15 @@ static uint32_t sector_addr[] = {
 	0x8080000, 0x80a0000, 0x80c0000, 0x80e0000,
 	0x8100000, 0
 };
+/* Typical x32 erase times from the datasheet.  The worst case is up
+ * to 2x this, but the host is paced by the hardware anyway: we execute
+ * from the flash being erased, so the CPU stalls on the first fetch
+ * after kicking the operation and the following GETSTATUS is NAKed
+ * until the flash is free again. */
 static uint16_t sector_erase_time[12]= {
-	500, 500, 500, 500,
-	1100, 2600, 2600, 2600,
-	2600, 2600, 2600, 2600
+	250, 250, 250, 250,
+	1000, 2000, 2000, 2000,
+	2000, 2000, 2000, 2000
 };
 static uint8_t sector_num = 0xff;
 
@@ -71,14 +76,18 @@ uint32_t dfu_poll_timeout(uint8_t cmd, uint32_t addr, uint16_t blocknum)
 {
 	/* Erase for big pages on STM2/4 needs "long" time
 	   Try not to hit USB timeouts*/
-	if ((blocknum == 0) && (cmd == CMD_ERASE)) {
-		get_sector_num(addr);
-		if(addr == sector_addr[sector_num])
-			return sector_erase_time[sector_num];
+	if (blocknum == 0) {
+		if (cmd == CMD_ERASE) {
+			get_sector_num(addr);
+			if(addr == sector_addr[sector_num])
+				return sector_erase_time[sector_num];
+		}
+		/* Set-address and friends touch no flash */
+		return 1;
 	}
 
-	/* Programming 256 word with 100 us(max) per word*/
-	return 26;
+	/* Programming 256 words at ~16us typical per word */
+	return 5;
 }
 
 void dfu_protect_enable(void)
@@ -26,16 +26,39 @@
 #include "cdcacm.h"
 #include "gdb_if.h"
 
-static uint32_t count_out;
-static uint32_t count_in;
-static uint32_t out_ptr;
-static uint8_t buffer_out[CDCACM_PACKET_SIZE];
-static uint8_t buffer_in[CDCACM_PACKET_SIZE];
+/* Multi-packet RX buffering: OUT packets are stashed as they arrive
+ * and the endpoint is only NAKed when another full packet no longer
+ * fits, so the host can stream bursts without stalling.  Platforms may
+ * size it in platform.h. */
+#ifndef GDB_IF_FIFO_SIZE
+#define GDB_IF_FIFO_SIZE 1024
+#endif
+
 #ifdef STM32F4
-static volatile uint32_t count_new;
-static uint8_t double_buffer_out[CDCACM_PACKET_SIZE];
+/* Single-producer/single-consumer ring of whole packet slots.  The USB
+ * ISR's only copy is the mandatory endpoint FIFO drain, straight into
+ * the next free slot; it then just publishes the write index, so the
+ * time spent at interrupt priority stays off the cycle-timed SWD
+ * loops.  All byte-shuffling happens in the main loop consumers. */
+#define RX_SLOTS (GDB_IF_FIFO_SIZE / CDCACM_PACKET_SIZE)
+static uint8_t rx_slot[RX_SLOTS][CDCACM_PACKET_SIZE];
+static uint16_t rx_slot_len[RX_SLOTS];
+static volatile uint32_t rx_slot_w;
+static volatile uint32_t rx_slot_r;
+static uint32_t rx_slot_pos;	/* consumer offset into rx_slot[rx_slot_r] */
+static volatile bool rx_nak;
+#else
+/* Byte FIFO fed from the main loop: the ST USBFS core leaves the
+ * packet parked in its buffer memory until we read it, so nothing at
+ * all happens in interrupt context here. */
+static uint8_t fifo_out[GDB_IF_FIFO_SIZE];
+static volatile uint32_t fifo_out_w;
+static volatile uint32_t fifo_out_r;
 #endif
 
+static uint32_t count_in;
+static uint8_t buffer_in[CDCACM_PACKET_SIZE];
+
 void gdb_if_putchar(unsigned char c, int flush)
 {
 	buffer_in[count_in++] = c;
@@ -64,43 +87,118 @@ void gdb_if_putchar(unsigned char c, int flush)
 	}
 }
 
+void gdb_if_write(const char *data, int size)
+{
+	while (size) {
+		int n = CDCACM_PACKET_SIZE - count_in;
+		if (n > size)
+			n = size;
+		memcpy(buffer_in + count_in, data, n);
+		count_in += n;
+		data += n;
+		size -= n;
+		if (count_in == CDCACM_PACKET_SIZE) {
+			if ((cdcacm_get_config() != 1) || !cdcacm_get_dtr()) {
+				count_in = 0;
+				return;
+			}
+			while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT,
+				buffer_in, count_in) <= 0);
+			count_in = 0;
+		}
+	}
+}
+
 #ifdef STM32F4
+static bool rx_empty(void)
+{
+	return rx_slot_w == rx_slot_r;
+}
+
+static unsigned char rx_pop(void)
+{
+	uint32_t r = rx_slot_r;
+	unsigned char c = rx_slot[r][rx_slot_pos++];
+
+	if (rx_slot_pos >= rx_slot_len[r]) {
+		rx_slot_pos = 0;
+		rx_slot_r = (r + 1) % RX_SLOTS;
+	}
+	return c;
+}
+
 void gdb_usb_out_cb(usbd_device *dev, uint8_t ep)
 {
 	(void)ep;
-	usbd_ep_nak_set(dev, CDCACM_GDB_ENDPOINT, 1);
-	count_new = usbd_ep_read_packet(dev, CDCACM_GDB_ENDPOINT,
-	                                double_buffer_out, CDCACM_PACKET_SIZE);
-	if(!count_new) {
-		usbd_ep_nak_set(dev, CDCACM_GDB_ENDPOINT, 0);
+	uint32_t w = rx_slot_w;
+
+	rx_slot_len[w] = usbd_ep_read_packet(dev, CDCACM_GDB_ENDPOINT,
+	                                     rx_slot[w], CDCACM_PACKET_SIZE);
+	if (rx_slot_len[w] == 0)
+		return;	/* Terminating ZLP carries nothing to publish */
+	rx_slot_w = (w + 1) % RX_SLOTS;
+	/* Hold the host off while no free slot remains */
+	if (((rx_slot_w + 1) % RX_SLOTS) == rx_slot_r) {
+		usbd_ep_nak_set(dev, CDCACM_GDB_ENDPOINT, 1);
+		rx_nak = true;
 	}
 }
+#else
+static bool rx_empty(void)
+{
+	return fifo_out_w == fifo_out_r;
+}
+
+static unsigned char rx_pop(void)
+{
+	unsigned char c = fifo_out[fifo_out_r];
+
+	fifo_out_r = (fifo_out_r + 1) % GDB_IF_FIFO_SIZE;
+	return c;
+}
+
+static uint32_t fifo_out_level(void)
+{
+	return (fifo_out_w + GDB_IF_FIFO_SIZE - fifo_out_r) % GDB_IF_FIFO_SIZE;
+}
+
+static void fifo_out_push(const uint8_t *data, uint32_t len)
+{
+	uint32_t w = fifo_out_w;
+	while (len--) {
+		fifo_out[w] = *data++;
+		w = (w + 1) % GDB_IF_FIFO_SIZE;
+	}
+	fifo_out_w = w;
+}
 #endif
 
 static void gdb_if_update_buf(void)
 {
 	while (cdcacm_get_config() != 1);
+	/* Every blocking wait spins through here: a good moment to service
+	 * channel work that can't run from interrupt context */
+	platform_event_pump();
 #ifdef STM32F4
 	asm volatile ("cpsid i; isb");
-	if (count_new) {
-		memcpy(buffer_out, double_buffer_out, count_new);
-		count_out = count_new;
-		count_new = 0;
-		out_ptr = 0;
+	if (rx_nak && (((rx_slot_w + 1) % RX_SLOTS) != rx_slot_r)) {
 		usbd_ep_nak_set(usbdev, CDCACM_GDB_ENDPOINT, 0);
+		rx_nak = false;
 	}
 	asm volatile ("cpsie i; isb");
 #else
-	count_out = usbd_ep_read_packet(usbdev, CDCACM_GDB_ENDPOINT,
-	                                buffer_out, CDCACM_PACKET_SIZE);
-	out_ptr = 0;
+	if ((GDB_IF_FIFO_SIZE - 1 - fifo_out_level()) >= CDCACM_PACKET_SIZE) {
+		uint8_t packet[CDCACM_PACKET_SIZE];
+		uint32_t count = usbd_ep_read_packet(usbdev, CDCACM_GDB_ENDPOINT,
+		                                     packet, CDCACM_PACKET_SIZE);
+		fifo_out_push(packet, count);
+	}
 #endif
 }
 
 unsigned char gdb_if_getchar(void)
 {
-
-	while (!(out_ptr < count_out)) {
+	while (rx_empty()) {
 		/* Detach if port closed */
 		if (!cdcacm_get_dtr())
 			return 0x04;
@@ -108,7 +206,30 @@ unsigned char gdb_if_getchar(void)
 		gdb_if_update_buf();
 	}
 
-	return buffer_out[out_ptr++];
+	return rx_pop();
+}
+
+int gdb_if_getbuf(unsigned char *buf, int maxlen)
+{
+	int len = 0;
+
+	while (rx_empty()) {
+		/* Detach if port closed */
+		if (!cdcacm_get_dtr()) {
+			buf[0] = 0x04;
+			return 1;
+		}
+
+		gdb_if_update_buf();
+	}
+
+	while ((len < maxlen) && !rx_empty())
+		buf[len++] = rx_pop();
+	/* Release the endpoint (or poll for the next packet) now that
+	 * buffer space is free again */
+	gdb_if_update_buf();
+
+	return len;
 }
 
 unsigned char gdb_if_getchar_to(int timeout)
@@ -116,17 +237,16 @@ unsigned char gdb_if_getchar_to(int timeout)
 	platform_timeout t;
 	platform_timeout_set(&t, timeout);
 
-	if (!(out_ptr < count_out)) do {
+	if (rx_empty()) do {
 		/* Detach if port closed */
 		if (!cdcacm_get_dtr())
 			return 0x04;
 
 		gdb_if_update_buf();
-	} while (!platform_timeout_is_expired(&t) && !(out_ptr < count_out));
+	} while (!platform_timeout_is_expired(&t) && rx_empty());
 
-	if(out_ptr < count_out)
+	if (!rx_empty())
 		return gdb_if_getchar();
 
 	return -1;
 }
-
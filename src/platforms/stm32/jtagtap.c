@@ -26,10 +26,43 @@
 #include "jtagtap.h"
 #include "gdb_packet.h"
 
+/* Adaptive clocking: on pinouts that route RTCK the target echoes TCK
+ * back once its debug logic has sampled the bit, so holding each edge
+ * for the echo makes the shift rate track the target's debug clock
+ * even when it scales underneath us.  The spin bound covers the
+ * slowest clock a throttled core presents; if the echo disappears
+ * within it we latch back to open-loop clocking.  Compiles out unless
+ * the platform defines RTCK_PORT/RTCK_PIN. */
+#ifdef RTCK_PORT
+static bool rtck_active;
+
+static void PLATFORM_RAMFUNC rtck_sync(uint8_t level)
+{
+	if (!rtck_active)
+		return;
+	for (unsigned i = 0; i < 10000; i++)
+		if (!gpio_get(RTCK_PORT, RTCK_PIN) == !level)
+			return;
+	rtck_active = false;
+}
+#else
+#define rtck_sync(level) do {} while (0)
+#endif
+
 int jtagtap_init(void)
 {
 	TMS_SET_MODE();
 
+#ifdef RTCK_PORT
+	/* One probe pulse: an unrouted or silent RTCK pin never echoes
+	 * and rtck_sync() latches back to open-loop by itself */
+	rtck_active = true;
+	gpio_set(TCK_PORT, TCK_PIN);
+	rtck_sync(1);
+	gpio_clear(TCK_PORT, TCK_PIN);
+	rtck_sync(0);
+#endif
+
 	/* Go to JTAG mode for SWJ-DP */
 	for(int i = 0; i <= 50; i++) jtagtap_next(1, 0); /* Reset SW-DP */
 	jtagtap_tms_seq(0xE73C, 16);		/* SWD to JTAG sequence */
@@ -51,36 +84,40 @@ void jtagtap_reset(void)
 	jtagtap_soft_reset();
 }
 
-inline uint8_t jtagtap_next(uint8_t dTMS, uint8_t dTDI)
+uint8_t PLATFORM_RAMFUNC jtagtap_next(uint8_t dTMS, uint8_t dTDI)
 {
 	uint16_t ret;
 
 	gpio_set_val(TMS_PORT, TMS_PIN, dTMS);
 	gpio_set_val(TDI_PORT, TDI_PIN, dTDI);
 	gpio_set(TCK_PORT, TCK_PIN);
+	rtck_sync(1);
 	ret = gpio_get(TDO_PORT, TDO_PIN);
 	gpio_clear(TCK_PORT, TCK_PIN);
+	rtck_sync(0);
 
 	//DEBUG("jtagtap_next(TMS = %d, TDI = %d) = %d\n", dTMS, dTDI, ret);
 
 	return ret != 0;
 }
 
-void jtagtap_tms_seq(uint32_t MS, int ticks)
+void PLATFORM_RAMFUNC jtagtap_tms_seq(uint32_t MS, int ticks)
 {
 	gpio_set_val(TDI_PORT, TDI_PIN, 1);
 	int data = MS & 1;
 	while(ticks) {
 		gpio_set_val(TMS_PORT, TMS_PIN, data);
 		gpio_set(TCK_PORT, TCK_PIN);
+		rtck_sync(1);
 		MS >>= 1;
 		data = MS & 1;
 		ticks--;
 		gpio_clear(TCK_PORT, TCK_PIN);
+		rtck_sync(0);
 	}
 }
 
-void
+void PLATFORM_RAMFUNC
 jtagtap_tdi_tdo_seq(uint8_t *DO, const uint8_t final_tms, const uint8_t *DI, int ticks)
 {
 	uint8_t index = 1;
@@ -89,6 +126,7 @@ jtagtap_tdi_tdo_seq(uint8_t *DO, const uint8_t final_tms, const uint8_t *DI, int
 	while(ticks > 1) {
 		gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
 		gpio_set(TCK_PORT, TCK_PIN);
+		rtck_sync(1);
 		if (gpio_get(TDO_PORT, TDO_PIN)) {
 			res |= index;
 		}
@@ -100,18 +138,21 @@ jtagtap_tdi_tdo_seq(uint8_t *DO, const uint8_t final_tms, const uint8_t *DI, int
 		}
 		ticks--;
 		gpio_clear(TCK_PORT, TCK_PIN);
+		rtck_sync(0);
 	}
 	gpio_set_val(TMS_PORT, TMS_PIN, final_tms);
 	gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
 	gpio_set(TCK_PORT, TCK_PIN);
+	rtck_sync(1);
 	if (gpio_get(TDO_PORT, TDO_PIN)) {
 		res |= index;
 	}
 	*DO = res;
 	gpio_clear(TCK_PORT, TCK_PIN);
+	rtck_sync(0);
 }
 
-void
+void PLATFORM_RAMFUNC
 jtagtap_tdi_seq(const uint8_t final_tms, const uint8_t *DI, int ticks)
 {
 	uint8_t index = 1;
@@ -119,10 +160,53 @@ jtagtap_tdi_seq(const uint8_t final_tms, const uint8_t *DI, int ticks)
 		gpio_set_val(TMS_PORT, TMS_PIN, ticks? 0 : final_tms);
 		gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
 		gpio_set(TCK_PORT, TCK_PIN);
+		rtck_sync(1);
 		if(!(index <<= 1)) {
 			index = 1;
 			DI++;
 		}
 		gpio_clear(TCK_PORT, TCK_PIN);
+		rtck_sync(0);
+	}
+}
+
+void PLATFORM_RAMFUNC
+jtagtap_scan(uint8_t *DO, const uint8_t *DI, int prescan, int ticks, int postscan)
+{
+	uint8_t index = 1;
+	uint8_t res = 0;
+	int total = prescan + ticks + postscan;
+	int pos;
+
+	gpio_set_val(TMS_PORT, TMS_PIN, 0);
+	for(pos = 0; pos < total; pos++) {
+		if(pos == total - 1)
+			gpio_set_val(TMS_PORT, TMS_PIN, 1);
+		if((pos < prescan) || (pos >= prescan + ticks)) {
+			/* BYPASS padding: don't care, shift in ones */
+			gpio_set_val(TDI_PORT, TDI_PIN, 1);
+			gpio_set(TCK_PORT, TCK_PIN);
+			rtck_sync(1);
+			gpio_clear(TCK_PORT, TCK_PIN);
+			rtck_sync(0);
+			continue;
+		}
+		gpio_set_val(TDI_PORT, TDI_PIN, *DI & index);
+		gpio_set(TCK_PORT, TCK_PIN);
+		rtck_sync(1);
+		if (gpio_get(TDO_PORT, TDO_PIN)) {
+			res |= index;
+		}
+		if(!(index <<= 1)) {
+			if(DO)
+				*DO++ = res;
+			res = 0;
+			index = 1;
+			DI++;
+		}
+		gpio_clear(TCK_PORT, TCK_PIN);
+		rtck_sync(0);
 	}
+	if(DO && (ticks & 7))
+		*DO = res;
 }
@@ -0,0 +1,162 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Alternate SW-DP sequence backend clocking multi-bit phases from the
+ * SPI peripheral instead of bit-banging them.  Selected per platform by
+ * defining SWD_SPI and building this file in place of the common
+ * bit-banged sequence loops; requires SWCLK on the SPI SCK pin and
+ * SWDIO routed to MOSI/MISO (on the native pinout SWCLK already sits on
+ * PA5/SCK, SWDIO needs the PA4-PA7 strap).
+ *
+ * Turnarounds and the odd-length request/ack phases stay bit-banged;
+ * the 8-bit request and the 32-bit data phases go through the shifter
+ * so the CPU only feeds the data register once per byte.  SPI is run
+ * LSB-first to match the SWD bit order.
+ */
+#include "general.h"
+#include "swdptap.h"
+
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/rcc.h>
+
+enum {
+	SWDIO_STATUS_FLOAT = 0,
+	SWDIO_STATUS_DRIVE
+};
+
+static int olddir = SWDIO_STATUS_FLOAT;
+
+/* The wire layer's clock control sets this on the bit-banged tap; the
+ * SPI backend's rate comes from the SPI baud divisor, so the setting
+ * is accepted and ignored. */
+unsigned swdptap_clk_divider;
+
+int swdptap_init(void)
+{
+	rcc_periph_clock_enable(RCC_SPI1);
+	spi_reset(SPI1);
+	/* CPOL=0/CPHA=0: sample on rising SWCLK edge as SWD requires */
+	spi_init_master(SPI1, SPI_CR1_BAUDRATE_FPCLK_DIV_8,
+			SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+			SPI_CR1_CPHA_CLK_TRANSITION_1,
+			SPI_CR1_DFF_8BIT, SPI_CR1_LSBFIRST);
+	spi_enable_software_slave_management(SPI1);
+	spi_set_nss_high(SPI1);
+	return 0;
+}
+
+static void swdptap_turnaround(int dir)
+{
+	if (dir == olddir)
+		return;
+	olddir = dir;
+
+	/* One clock with SWDIO released, bit-banged: the SPI shifter
+	 * cannot produce a lone turnaround cycle. */
+	if (dir == SWDIO_STATUS_FLOAT)
+		SWDIO_MODE_FLOAT();
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	if (dir == SWDIO_STATUS_DRIVE)
+		SWDIO_MODE_DRIVE();
+}
+
+/* Hand the SWCLK/SWDIO pins to the SPI peripheral for a burst, then
+ * return them to GPIO so turnarounds and short phases keep working. */
+static uint8_t spi_shift_byte(uint8_t out)
+{
+	spi_send(SPI1, out);
+	return spi_read(SPI1);
+}
+
+bool swdptap_bit_in(void)
+{
+	uint16_t ret;
+
+	swdptap_turnaround(SWDIO_STATUS_FLOAT);
+
+	ret = gpio_get(SWDIO_PORT, SWDIO_PIN);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+
+	return ret != 0;
+}
+
+void swdptap_bit_out(bool val)
+{
+	swdptap_turnaround(SWDIO_STATUS_DRIVE);
+
+	gpio_set_val(SWDIO_PORT, SWDIO_PIN, val);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_set(SWCLK_PORT, SWCLK_PIN);
+	gpio_clear(SWCLK_PORT, SWCLK_PIN);
+}
+
+uint32_t swdptap_seq_in(int ticks)
+{
+	uint32_t ret = 0;
+	int i = 0;
+
+	swdptap_turnaround(SWDIO_STATUS_FLOAT);
+	/* Whole bytes through the shifter, leftover bits banged */
+	SWD_SPI_MODE_SPI();
+	for (; ticks - i >= 8; i += 8)
+		ret |= (uint32_t)spi_shift_byte(0) << i;
+	SWD_SPI_MODE_GPIO();
+	for (; i < ticks; i++)
+		if (swdptap_bit_in())
+			ret |= 1 << i;
+	return ret;
+}
+
+bool swdptap_seq_in_parity(uint32_t *ret, int ticks)
+{
+	uint32_t res = swdptap_seq_in(ticks);
+	uint8_t parity = __builtin_popcount(res) & 1;
+
+	if (swdptap_bit_in())
+		parity ^= 1;
+	*ret = res;
+	return parity;
+}
+
+void swdptap_seq_out(uint32_t MS, int ticks)
+{
+	int i = 0;
+
+	swdptap_turnaround(SWDIO_STATUS_DRIVE);
+	SWD_SPI_MODE_SPI();
+	for (; ticks - i >= 8; i += 8)
+		spi_shift_byte((MS >> i) & 0xFF);
+	SWD_SPI_MODE_GPIO();
+	for (; i < ticks; i++)
+		swdptap_bit_out((MS >> i) & 1);
+}
+
+void swdptap_seq_out_parity(uint32_t MS, int ticks)
+{
+	uint8_t parity = __builtin_popcount(MS) & 1;
+
+	swdptap_seq_out(MS, ticks);
+	swdptap_bit_out(parity);
+}
@@ -18,9 +18,16 @@
  */
 #include "general.h"
 #include "morse.h"
+#ifdef PLATFORM_HAS_TRACESWO
+#include "cdcacm.h"
+#include "traceswo.h"
+#endif
+#include "batch.h"
 
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
 
 uint8_t running_status;
 static volatile uint32_t time_ms;
@@ -34,6 +41,9 @@ void platform_timing_init(void)
 	SCB_SHPR(11) |= ((14 << 4) & 0xff);
 	systick_interrupt_enable();
 	systick_counter_enable();
+
+	/* Cycle counter for platform_time_us() */
+	dwt_enable_cycle_counter();
 }
 
 void platform_delay(uint32_t ms)
@@ -58,3 +68,36 @@ uint32_t platform_time_ms(void)
 	return time_ms;
 }
 
+/* Microsecond time base derived from DWT_CYCCNT.  The counter wraps in
+ * seconds at AHB speed, so the delta since the previous call is folded
+ * into a running total; profiling reads it often enough in practice. */
+uint32_t platform_time_us(void)
+{
+	static uint32_t last_cycles;
+	static uint32_t residue;
+	static uint32_t time_us;
+	uint32_t cycles_per_us = rcc_ahb_frequency / 1000000;
+	uint32_t cycles = dwt_read_cycle_counter();
+
+	residue += cycles - last_cycles;
+	last_cycles = cycles;
+	time_us += residue / cycles_per_us;
+	residue %= cycles_per_us;
+	return time_us;
+}
+
+/* GDB RX and the UART forwarder are interrupt-fed on this platform, so
+ * the only deferred work is the SWO spill-over: when the trace endpoint
+ * NAKed during capture, the leftover would otherwise sit buffered until
+ * the next capture interrupt.  Retry it here so a paused trace stream
+ * still flushes while we wait on GDB.  Batch records queued by the USB
+ * interrupt also execute from here, in main-loop context. */
+void platform_event_pump(void)
+{
+#ifdef PLATFORM_HAS_TRACESWO
+	if (cdcacm_get_config() == 1)
+		trace_buf_drain(usbdev, 0x85);
+#endif
+	batch_process();
+}
+
@@ -30,17 +30,43 @@
  * The idea is to use TIM3 input capture modes to capture pulse timings.
  * These can be capture directly to RAM by DMA.
  * The core can then process the buffer to extract the frame.
+ *
+ * When the platform provides TRACE_DMA_* definitions the capture values
+ * are in fact moved to RAM by DMA: each capture event bursts the
+ * (CCR1, CCR2) pair into a circular buffer through TIMx_DMAR and the
+ * decoder runs in bulk from the DMA half/full-transfer interrupts, so
+ * per-edge interrupt overhead no longer limits the trace rate.  Without
+ * the definitions the original capture-interrupt-per-edge mode is used.
  */
 #include "general.h"
 #include "cdcacm.h"
+#include "traceswo.h"
 
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/scs.h>
 #include <libopencm3/stm32/timer.h>
 #include <libopencm3/stm32/f1/rcc.h>
+#ifdef TRACE_DMA_BUS
+#include <libopencm3/stm32/dma.h>
+#endif
+
+#ifdef TRACE_DMA_BUS
+/* Circular capture buffer of (cycle, duty) pairs */
+#define TRACE_DMA_PAIRS 64
+static uint16_t trace_dma_buf[TRACE_DMA_PAIRS * 2];
+static unsigned trace_dma_tail;
+#endif
 
-void traceswo_init(void)
+void traceswo_init(uint32_t baudrate)
 {
+	/* Manchester coding is self-clocking; the rate is deduced */
+	(void)baudrate;
+
 	TRACE_TIM_CLK_EN();
+#ifdef TRACE_DMA_BUS
+	rcc_periph_clock_enable(TRACE_DMA_CLK);
+#endif
 
 	timer_reset(TRACE_TIM);
 
@@ -64,10 +90,40 @@ void traceswo_init(void)
 	/* Slave reset mode: reset counter on trigger */
 	timer_slave_set_mode(TRACE_TIM, TIM_SMCR_SMS_RM);
 
-	/* Enable capture interrupt */
 	nvic_set_priority(TRACE_IRQ, IRQ_PRI_TRACE);
 	nvic_enable_irq(TRACE_IRQ);
+
+#ifdef TRACE_DMA_BUS
+	/* Captures land in the circular buffer without interrupts and are
+	 * decoded in bulk; the timer interrupt only flushes frame tails */
+	dma_channel_reset(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+	dma_set_peripheral_address(TRACE_DMA_BUS, TRACE_DMA_CHAN,
+	                           (uint32_t)&TIM_DMAR(TRACE_TIM));
+	dma_set_read_from_peripheral(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+	dma_enable_memory_increment_mode(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+	dma_set_peripheral_size(TRACE_DMA_BUS, TRACE_DMA_CHAN,
+	                        DMA_CCR_PSIZE_16BIT);
+	dma_set_memory_size(TRACE_DMA_BUS, TRACE_DMA_CHAN, DMA_CCR_MSIZE_16BIT);
+	dma_set_priority(TRACE_DMA_BUS, TRACE_DMA_CHAN, DMA_CCR_PL_HIGH);
+	dma_set_memory_address(TRACE_DMA_BUS, TRACE_DMA_CHAN,
+	                       (uint32_t)trace_dma_buf);
+	dma_set_number_of_data(TRACE_DMA_BUS, TRACE_DMA_CHAN,
+	                       TRACE_DMA_PAIRS * 2);
+	dma_enable_circular_mode(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+	dma_enable_half_transfer_interrupt(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+	dma_enable_transfer_complete_interrupt(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+	nvic_set_priority(TRACE_DMA_IRQ, IRQ_PRI_TRACE);
+	nvic_enable_irq(TRACE_DMA_IRQ);
+	dma_enable_channel(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+
+	/* Burst the (CCR1, CCR2) pair through TIMx_DMAR on each CC1 event:
+	 * DBL = 2 transfers, DBA = offset of CCR1 */
+	TIM_DCR(TRACE_TIM) = (1 << 8) | (0x34 >> 2);
+	timer_enable_irq(TRACE_TIM, TIM_DIER_CC1DE);
+#else
+	/* Enable capture interrupt */
 	timer_enable_irq(TRACE_TIM, TIM_DIER_CC1IE);
+#endif
 
 	/* Enable the capture channels */
 	timer_ic_enable(TRACE_TIM, TIM_IC1);
@@ -79,8 +135,41 @@ void traceswo_init(void)
 static uint8_t trace_usb_buf[64];
 static uint8_t trace_usb_buf_size;
 
+static bool trace_ts_enable;
+
+void traceswo_timestamp(bool enable)
+{
+	if (enable) {
+		/* Free-run the core cycle counter as the capture clock */
+		SCS_DEMCR |= SCS_DEMCR_TRCENA;
+		DWT_CYCCNT = 0;
+		DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	}
+	trace_ts_enable = enable;
+}
+
 void trace_buf_push(uint8_t *buf, int len)
 {
+	uint8_t frame[64];
+
+	if (trace_ts_enable) {
+		/* Frames are pushed from the capture interrupt, so the
+		 * counter is read while the wire is still at the frame's
+		 * trailing edge */
+		uint32_t now = DWT_CYCCNT;
+		if (len > (int)sizeof(frame) - TRACE_TS_HDR)
+			len = sizeof(frame) - TRACE_TS_HDR;
+		frame[0] = TRACE_TS_MAGIC;
+		frame[1] = len;
+		frame[2] = now & 0xFF;
+		frame[3] = (now >> 8) & 0xFF;
+		frame[4] = (now >> 16) & 0xFF;
+		frame[5] = (now >> 24) & 0xFF;
+		memcpy(&frame[TRACE_TS_HDR], buf, len);
+		buf = frame;
+		len += TRACE_TS_HDR;
+	}
+
 	if (usbd_ep_write_packet(usbdev, 0x85, buf, len) != len) {
 		if (trace_usb_buf_size + len > 64) {
 			/* Stall if upstream to too slow. */
@@ -102,34 +191,49 @@ void trace_buf_drain(usbd_device *dev, uint8_t ep)
 	trace_usb_buf_size = 0;
 }
 
-#define ALLOWED_DUTY_ERROR 5
-
-void TRACE_ISR(void)
+bool trace_dump_write(const uint8_t *buf, unsigned len)
 {
-	uint16_t sr = TIM_SR(TRACE_TIM);
-	uint16_t duty, cycle;
-	static uint16_t bt;
-	static uint8_t lastbit;
-	static uint8_t decbuf[17];
-	static uint8_t decbuf_pos;
-	static uint8_t halfbit;
-	static uint8_t notstart;
-
-	/* Reset decoder state if capture overflowed */
-	if (sr & (TIM_SR_CC1OF | TIM_SR_UIF)) {
-		timer_clear_flag(TRACE_TIM, TIM_SR_CC1OF | TIM_SR_UIF);
-		if (!(sr & (TIM_SR_CC2IF | TIM_SR_CC1IF)))
-			goto flush_and_reset;
+	while (len) {
+		unsigned chunk = (len > 64) ? 64 : len;
+		uint32_t start = platform_time_ms();
+		/* Endpoint NAKs while the previous packet is in flight */
+		while (usbd_ep_write_packet(usbdev, 0x85, buf, chunk) != chunk)
+			if (platform_time_ms() - start > 1000)
+				return false;
+		buf += chunk;
+		len -= chunk;
 	}
+	return true;
+}
+
+#define ALLOWED_DUTY_ERROR 5
 
-	cycle = TIM_CCR1(TRACE_TIM);
-	duty = TIM_CCR2(TRACE_TIM);
+static uint16_t bt;
+static uint8_t lastbit;
+static uint8_t decbuf[17];
+static uint8_t decbuf_pos;
+static uint8_t halfbit;
+static uint8_t notstart;
+
+static void trace_flush(void)
+{
+	timer_set_period(TRACE_TIM, -1);
+	timer_disable_irq(TRACE_TIM, TIM_DIER_UIE);
+	trace_buf_push(decbuf, decbuf_pos >> 3);
+	bt = 0;
+	decbuf_pos = 0;
+	memset(decbuf, 0, sizeof(decbuf));
+}
 
+/* Decode one captured (cycle, duty) pair.  cycle_valid is clear when the
+ * rising edge closing the cycle was never captured (end of frame). */
+static void trace_decode(uint16_t cycle, uint16_t duty, bool cycle_valid)
+{
 	/* Reset decoder state if crazy shit happened */
 	if ((bt && (((duty / bt) > 2) || ((duty / bt) == 0))) || (duty == 0))
 		goto flush_and_reset;
 
-	if(!(sr & TIM_SR_CC1IF)) notstart = 1;
+	if (!cycle_valid) notstart = 1;
 
 	if (!bt) {
 		if (notstart) {
@@ -159,7 +263,7 @@ void TRACE_ISR(void)
 		decbuf_pos++;
 	}
 
-	if (!(sr & TIM_SR_CC1IF) || (((cycle - duty) / bt) > 2))
+	if (!cycle_valid || (((cycle - duty) / bt) > 2))
 		goto flush_and_reset;
 
 	if (((cycle - duty) / bt) > 1) {
@@ -176,10 +280,62 @@ void TRACE_ISR(void)
 		return;
 
 flush_and_reset:
-	timer_set_period(TRACE_TIM, -1);
-	timer_disable_irq(TRACE_TIM, TIM_DIER_UIE);
-	trace_buf_push(decbuf, decbuf_pos >> 3);
-	bt = 0;
-	decbuf_pos = 0;
-	memset(decbuf, 0, sizeof(decbuf));
+	trace_flush();
+}
+
+#ifdef TRACE_DMA_BUS
+
+/* Decode every pair the DMA controller delivered since the last call */
+static void trace_dma_drain(void)
+{
+	unsigned head = (TRACE_DMA_PAIRS * 2) -
+	        dma_get_number_of_data(TRACE_DMA_BUS, TRACE_DMA_CHAN);
+	head &= ~1U;
+	while (trace_dma_tail != head) {
+		uint16_t cycle = trace_dma_buf[trace_dma_tail++];
+		uint16_t duty = trace_dma_buf[trace_dma_tail++];
+		trace_dma_tail %= TRACE_DMA_PAIRS * 2;
+		trace_decode(cycle, duty, true);
+	}
 }
+
+void TRACE_DMA_ISR(void)
+{
+	DMA_IFCR(TRACE_DMA_BUS) |= DMA_ISR_HTIF(TRACE_DMA_CHAN) |
+	        DMA_ISR_TCIF(TRACE_DMA_CHAN);
+	trace_dma_drain();
+}
+
+/* Counter overflow: the line went idle.  Pick up any pairs still in the
+ * buffer plus a trailing half-cycle, then flush the frame. */
+void TRACE_ISR(void)
+{
+	uint16_t sr = TIM_SR(TRACE_TIM);
+	timer_clear_flag(TRACE_TIM, TIM_SR_UIF | TIM_SR_CC1OF);
+	trace_dma_drain();
+	if (sr & TIM_SR_CC2IF)
+		trace_decode(TIM_CCR1(TRACE_TIM), TIM_CCR2(TRACE_TIM), false);
+	else
+		trace_flush();
+}
+
+#else
+
+void TRACE_ISR(void)
+{
+	uint16_t sr = TIM_SR(TRACE_TIM);
+
+	/* Reset decoder state if capture overflowed */
+	if (sr & (TIM_SR_CC1OF | TIM_SR_UIF)) {
+		timer_clear_flag(TRACE_TIM, TIM_SR_CC1OF | TIM_SR_UIF);
+		if (!(sr & (TIM_SR_CC2IF | TIM_SR_CC1IF))) {
+			trace_flush();
+			return;
+		}
+	}
+
+	trace_decode(TIM_CCR1(TRACE_TIM), TIM_CCR2(TRACE_TIM),
+	             sr & TIM_SR_CC1IF);
+}
+
+#endif
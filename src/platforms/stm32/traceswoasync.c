@@ -31,9 +31,12 @@
 #include "general.h"
 #include "cdcacm.h"
 #include "platform.h"
+#include "traceswo.h"
 
 #include <libopencmsis/core_cm3.h>
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/scs.h>
 #include <libopencm3/stm32/timer.h>
 #include <libopencm3/stm32/f1/rcc.h>
 #include <libopencm3/stm32/usart.h>
@@ -44,13 +47,100 @@
 /* Default line rate....used as default for a request without baudrate */
 #define DEFAULTSPEED	(2250000)
 
-static volatile uint32_t w;	/* Packet currently received via UART */
-static volatile uint32_t r;	/* Packet currently waiting to transmit to USB */
-/* Packets arrived from the SWO interface */
+static volatile uint32_t w;	/* Write index into the trace byte ring */
+static volatile uint32_t r;	/* Read index waiting to transmit to USB */
+/* Byte ring holding data arrived from the SWO interface */
 static uint8_t trace_rx_buf[NUM_TRACE_PACKETS * FULL_SWO_PACKET];
 /* Packet pingpong buffer used for receiving packets */
 static uint8_t pingpong_buf[2 * FULL_SWO_PACKET];
 
+/* Stimulus ports forwarded to USB; all of them by default */
+static uint32_t itm_mask = 0xFFFFFFFF;
+/* ITM parser state: payload bytes still to copy/drop, and whether we
+ * are inside a continuation-encoded protocol packet */
+static uint8_t itm_copy;
+static uint8_t itm_skip;
+static bool itm_continuation;
+
+void traceswo_setmask(uint32_t mask)
+{
+	itm_mask = mask;
+	itm_copy = itm_skip = 0;
+	itm_continuation = false;
+}
+
+static bool trace_ts_enable;
+
+void traceswo_timestamp(bool enable)
+{
+	if (enable) {
+		/* Free-run the core cycle counter as the capture clock */
+		SCS_DEMCR |= SCS_DEMCR_TRCENA;
+		DWT_CYCCNT = 0;
+		DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	}
+	trace_ts_enable = enable;
+}
+
+static void trace_push_byte(uint8_t c)
+{
+	uint32_t next = (w + 1) % sizeof(trace_rx_buf);
+	if (next == r) /* Ring full, drop */
+		return;
+	trace_rx_buf[w] = c;
+	w = next;
+}
+
+/* Forward only software (SWIT) packets from wanted stimulus ports,
+ * passing sync bytes through so host decoders keep alignment */
+static void itm_filter(uint8_t c)
+{
+	static const uint8_t itm_len[] = {0, 1, 2, 4};
+
+	if (itm_copy) {
+		itm_copy--;
+		trace_push_byte(c);
+		return;
+	}
+	if (itm_skip) {
+		itm_skip--;
+		return;
+	}
+	if (itm_continuation) {
+		if (!(c & 0x80))
+			itm_continuation = false;
+		return;
+	}
+	if (c == 0) { /* Synchronisation */
+		trace_push_byte(c);
+		return;
+	}
+	if (c & 0x03) { /* SWIT: port in bits 7:3, size in bits 1:0 */
+		if (itm_mask & (1U << (c >> 3))) {
+			trace_push_byte(c);
+			itm_copy = itm_len[c & 0x03];
+		} else {
+			itm_skip = itm_len[c & 0x03];
+		}
+		return;
+	}
+	/* Timestamp/extension/overflow: drop, minding continuation bytes */
+	if (c & 0x80)
+		itm_continuation = true;
+}
+
+static void trace_enqueue(const uint8_t *buf, uint32_t len)
+{
+	if (itm_mask == 0xFFFFFFFF) {
+		/* No filtering requested: forward the stream wholesale */
+		while (len--)
+			trace_push_byte(*buf++);
+	} else {
+		while (len--)
+			itm_filter(*buf++);
+	}
+}
+
 void trace_buf_drain(usbd_device *dev, uint8_t ep)
 {
 	static volatile char inBufDrain;
@@ -58,14 +148,52 @@ void trace_buf_drain(usbd_device *dev, uint8_t ep)
 	/* If we are already in this routine then we don't need to come in again */
 	if (__atomic_test_and_set (&inBufDrain, __ATOMIC_RELAXED))
 		return;
-	/* Attempt to write everything we buffered */
-	if ((w != r) && (usbd_ep_write_packet(dev, ep,
-										  &trace_rx_buf[r * FULL_SWO_PACKET],
-										  FULL_SWO_PACKET)))
-		r =(r + 1) % NUM_TRACE_PACKETS;
+	/* Attempt to write everything we buffered, a packet at a time */
+	if (w != r) {
+		uint32_t len = (w > r) ? (w - r) : (sizeof(trace_rx_buf) - r);
+		if (!trace_ts_enable) {
+			if (len > FULL_SWO_PACKET)
+				len = FULL_SWO_PACKET;
+			if (usbd_ep_write_packet(dev, ep, &trace_rx_buf[r], len))
+				r = (r + len) % sizeof(trace_rx_buf);
+		} else {
+			/* Bytes are drained by the same DMA interrupt that
+			 * captured them, so this reads the counter within one
+			 * half-buffer period of the data hitting the wire */
+			uint8_t frame[FULL_SWO_PACKET];
+			uint32_t now = DWT_CYCCNT;
+			if (len > FULL_SWO_PACKET - TRACE_TS_HDR)
+				len = FULL_SWO_PACKET - TRACE_TS_HDR;
+			frame[0] = TRACE_TS_MAGIC;
+			frame[1] = len;
+			frame[2] = now & 0xFF;
+			frame[3] = (now >> 8) & 0xFF;
+			frame[4] = (now >> 16) & 0xFF;
+			frame[5] = (now >> 24) & 0xFF;
+			memcpy(&frame[TRACE_TS_HDR], &trace_rx_buf[r], len);
+			if (usbd_ep_write_packet(dev, ep, frame,
+			                         len + TRACE_TS_HDR))
+				r = (r + len) % sizeof(trace_rx_buf);
+		}
+	}
 	__atomic_clear (&inBufDrain, __ATOMIC_RELAXED);
 }
 
+bool trace_dump_write(const uint8_t *buf, unsigned len)
+{
+	while (len) {
+		unsigned chunk = (len > FULL_SWO_PACKET) ? FULL_SWO_PACKET : len;
+		uint32_t start = platform_time_ms();
+		/* Endpoint NAKs while the previous packet is in flight */
+		while (usbd_ep_write_packet(usbdev, 0x85, buf, chunk) != chunk)
+			if (platform_time_ms() - start > 1000)
+				return false;
+		buf += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
 void traceswo_setspeed(uint32_t baudrate)
 {
 	dma_disable_channel(SWO_DMA_BUS, SWO_DMA_CHAN);
@@ -103,15 +231,12 @@ void SWO_DMA_ISR(void)
 {
 	if (DMA_ISR(SWO_DMA_BUS) & DMA_ISR_HTIF(SWO_DMA_CHAN)) {
 		DMA_IFCR(SWO_DMA_BUS) |= DMA_ISR_HTIF(SWO_DMA_CHAN);
-		memcpy(&trace_rx_buf[w * FULL_SWO_PACKET], pingpong_buf,
-			   FULL_SWO_PACKET);
+		trace_enqueue(pingpong_buf, FULL_SWO_PACKET);
 	}
 	if (DMA_ISR(SWO_DMA_BUS) & DMA_ISR_TCIF(SWO_DMA_CHAN)) {
 		DMA_IFCR(SWO_DMA_BUS) |= DMA_ISR_TCIF(SWO_DMA_CHAN);
-		memcpy(&trace_rx_buf[w * FULL_SWO_PACKET],
-			   &pingpong_buf[FULL_SWO_PACKET], FULL_SWO_PACKET);
+		trace_enqueue(&pingpong_buf[FULL_SWO_PACKET], FULL_SWO_PACKET);
 	}
-	w = (w + 1) % NUM_TRACE_PACKETS;
 	trace_buf_drain(usbdev, 0x85);
 }
 
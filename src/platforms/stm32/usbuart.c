@@ -22,6 +22,7 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/dma.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/scs.h>
 #include <libopencm3/usb/usbd.h>
@@ -33,17 +34,50 @@
 #define USBUART_TIMER_FREQ_HZ 1000000U /* 1us per tick */
 #define USBUART_RUN_FREQ_HZ 5000U /* 200us (or 100 characters at 2Mbps) */
 
-#define FIFO_SIZE 128
+/* RX ring size; platforms may override in platform.h to run higher
+ * baud rates.  Must be a power of two. */
+#ifndef USBUART_FIFO_SIZE
+#define USBUART_FIFO_SIZE 128
+#endif
+#if USBUART_FIFO_SIZE & (USBUART_FIFO_SIZE - 1)
+#error "USBUART_FIFO_SIZE must be a power of two"
+#endif
+#define FIFO_SIZE USBUART_FIFO_SIZE
+/* Above this level the ring is pushed to USB immediately instead of
+ * waiting for the next timer tick */
+#define FIFO_HWM (FIFO_SIZE * 3 / 4)
+
+/* DMA mode moves the USART data by hardware and takes an interrupt per
+ * burst instead of per character.  It needs the platform's DMA wiring
+ * and is incompatible with the debug console sharing the RX FIFO. */
+#if defined(USBUSART_DMA_BUS) && !defined(USBUART_DEBUG)
+#define USBUART_USE_DMA
+#endif
 
 /* RX Fifo buffer */
 static uint8_t buf_rx[FIFO_SIZE];
 /* Fifo in pointer, writes assumed to be atomic, should be only incremented within RX ISR */
-static uint8_t buf_rx_in;
+static uint32_t buf_rx_in;
 /* Fifo out pointer, writes assumed to be atomic, should be only incremented outside RX ISR */
-static uint8_t buf_rx_out;
+static uint32_t buf_rx_out;
+
+/* TX double buffer: one packet draining into the UART (by DMA, or by
+ * the TXE interrupt a character at a time), one being received */
+static uint8_t buf_tx[2][CDCACM_PACKET_SIZE];
+static uint8_t buf_tx_len[2];
+static volatile uint8_t tx_act = 0xFF;	/* buffer draining, 0xFF = idle */
+static volatile bool tx_pending;
+#ifndef USBUART_USE_DMA
+static volatile uint8_t tx_pos;	/* next byte of buf_tx[tx_act] to send */
+#endif
 
 static void usbuart_run(void);
 
+static uint32_t usbuart_fifo_level(void)
+{
+	return (buf_rx_in + FIFO_SIZE - buf_rx_out) % FIFO_SIZE;
+}
+
 void usbuart_init(void)
 {
 	rcc_periph_clock_enable(USBUSART_CLK);
@@ -61,8 +95,57 @@ void usbuart_init(void)
 	/* Finally enable the USART. */
 	usart_enable(USBUSART);
 
+#ifdef USBUART_USE_DMA
+	rcc_periph_clock_enable(USBUSART_DMA_CLK);
+
+	/* RX: circular DMA into the FIFO, the in pointer follows CNDTR.
+	 * Half/full-transfer interrupts drain bursts; the USART idle
+	 * interrupt picks up the tail of a transmission. */
+	dma_channel_reset(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN);
+	dma_set_peripheral_address(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN,
+	                           (uint32_t)&USBUSART_DR);
+	dma_set_memory_address(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN,
+	                       (uint32_t)buf_rx);
+	dma_set_number_of_data(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN,
+	                       FIFO_SIZE);
+	dma_set_read_from_peripheral(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN);
+	dma_enable_memory_increment_mode(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN);
+	dma_set_peripheral_size(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN,
+	                        DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN,
+	                    DMA_CCR_MSIZE_8BIT);
+	dma_enable_circular_mode(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN);
+	dma_enable_half_transfer_interrupt(USBUSART_DMA_BUS,
+	                                   USBUSART_DMA_RX_CHAN);
+	dma_enable_transfer_complete_interrupt(USBUSART_DMA_BUS,
+	                                       USBUSART_DMA_RX_CHAN);
+	nvic_set_priority(USBUSART_DMA_RX_IRQ, IRQ_PRI_USBUSART);
+	nvic_enable_irq(USBUSART_DMA_RX_IRQ);
+	dma_enable_channel(USBUSART_DMA_BUS, USBUSART_DMA_RX_CHAN);
+	usart_enable_rx_dma(USBUSART);
+
+	/* TX: one USB packet per transfer out of the double buffer */
+	dma_channel_reset(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN);
+	dma_set_peripheral_address(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN,
+	                           (uint32_t)&USBUSART_DR);
+	dma_set_read_from_memory(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN);
+	dma_enable_memory_increment_mode(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN);
+	dma_set_peripheral_size(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN,
+	                        DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN,
+	                    DMA_CCR_MSIZE_8BIT);
+	dma_enable_transfer_complete_interrupt(USBUSART_DMA_BUS,
+	                                       USBUSART_DMA_TX_CHAN);
+	nvic_set_priority(USBUSART_DMA_TX_IRQ, IRQ_PRI_USBUSART);
+	nvic_enable_irq(USBUSART_DMA_TX_IRQ);
+	usart_enable_tx_dma(USBUSART);
+
+	/* Enable interrupts */
+	USBUSART_CR1 |= USART_CR1_IDLEIE;
+#else
 	/* Enable interrupts */
 	USBUSART_CR1 |= USART_CR1_RXNEIE;
+#endif
 	nvic_set_priority(USBUSART_IRQ, IRQ_PRI_USBUSART);
 	nvic_enable_irq(USBUSART_IRQ);
 
@@ -107,7 +190,7 @@ static void usbuart_run(void)
 	{
 		uint8_t packet_buf[CDCACM_PACKET_SIZE];
 		uint8_t packet_size = 0;
-		uint8_t buf_out = buf_rx_out;
+		uint32_t buf_out = buf_rx_out;
 
 		/* copy from uart FIFO into local usb packet buffer */
 		while (buf_rx_in != buf_out && packet_size < CDCACM_PACKET_SIZE)
@@ -163,27 +246,97 @@ void usbuart_set_line_coding(struct usb_cdc_line_coding *coding)
 	}
 }
 
+#ifdef USBUART_USE_DMA
+static void usbuart_tx_start(uint8_t idx)
+{
+	dma_disable_channel(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN);
+	dma_set_memory_address(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN,
+	                       (uint32_t)buf_tx[idx]);
+	dma_set_number_of_data(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN,
+	                       buf_tx_len[idx]);
+	dma_enable_channel(USBUSART_DMA_BUS, USBUSART_DMA_TX_CHAN);
+}
+
+void usbuart_usb_out_cb(usbd_device *dev, uint8_t ep)
+{
+	(void)ep;
+
+	nvic_disable_irq(USBUSART_DMA_TX_IRQ);
+	uint8_t idx = (tx_act == 0xFF) ? 0 : (tx_act ^ 1);
+	int len = usbd_ep_read_packet(dev, CDCACM_UART_ENDPOINT,
+					buf_tx[idx], CDCACM_PACKET_SIZE);
+
+#if defined(BLACKMAGIC)
+	/* Don't bother if uart is disabled.
+	 * This will be the case on mini while we're being debugged.
+	 */
+	if(!(RCC_APB2ENR & RCC_APB2ENR_USART1EN)) {
+		nvic_enable_irq(USBUSART_DMA_TX_IRQ);
+		return;
+	}
+#endif
+
+	gpio_set(LED_PORT_UART, LED_UART);
+	buf_tx_len[idx] = len;
+	if (tx_act == 0xFF) {
+		tx_act = idx;
+		usbuart_tx_start(idx);
+	} else {
+		/* Both buffers in use: hold the host off until DMA frees one */
+		tx_pending = true;
+		usbd_ep_nak_set(dev, CDCACM_UART_ENDPOINT, 1);
+	}
+	nvic_enable_irq(USBUSART_DMA_TX_IRQ);
+}
+
+void USBUSART_DMA_TX_ISR(void)
+{
+	DMA_IFCR(USBUSART_DMA_BUS) |= DMA_ISR_TCIF(USBUSART_DMA_TX_CHAN);
+	if (tx_pending) {
+		tx_pending = false;
+		tx_act ^= 1;
+		usbuart_tx_start(tx_act);
+		usbd_ep_nak_set(usbdev, CDCACM_UART_ENDPOINT, 0);
+	} else {
+		tx_act = 0xFF;
+		gpio_clear(LED_PORT_UART, LED_UART);
+	}
+}
+#else
 void usbuart_usb_out_cb(usbd_device *dev, uint8_t ep)
 {
 	(void)ep;
 
-	char buf[CDCACM_PACKET_SIZE];
+	nvic_disable_irq(USBUSART_IRQ);
+	uint8_t idx = (tx_act == 0xFF) ? 0 : (tx_act ^ 1);
 	int len = usbd_ep_read_packet(dev, CDCACM_UART_ENDPOINT,
-					buf, CDCACM_PACKET_SIZE);
+					buf_tx[idx], CDCACM_PACKET_SIZE);
 
 #if defined(BLACKMAGIC)
 	/* Don't bother if uart is disabled.
 	 * This will be the case on mini while we're being debugged.
 	 */
-	if(!(RCC_APB2ENR & RCC_APB2ENR_USART1EN))
+	if(!(RCC_APB2ENR & RCC_APB2ENR_USART1EN)) {
+		nvic_enable_irq(USBUSART_IRQ);
 		return;
+	}
 #endif
 
 	gpio_set(LED_PORT_UART, LED_UART);
-	for(int i = 0; i < len; i++)
-		usart_send_blocking(USBUSART, buf[i]);
-	gpio_clear(LED_PORT_UART, LED_UART);
+	buf_tx_len[idx] = len;
+	if (tx_act == 0xFF) {
+		tx_act = idx;
+		tx_pos = 0;
+		USBUSART_CR1 |= USART_CR1_TXEIE;
+	} else {
+		/* Both buffers in use: hold the host off until the UART
+		 * catches up */
+		tx_pending = true;
+		usbd_ep_nak_set(dev, CDCACM_UART_ENDPOINT, 1);
+	}
+	nvic_enable_irq(USBUSART_IRQ);
 }
+#endif
 
 #ifdef USBUART_DEBUG
 int usbuart_debug_write(const char *buf, size_t len)
@@ -208,14 +361,74 @@ void usbuart_usb_in_cb(usbd_device *dev, uint8_t ep)
 	(void) ep;
 }
 
+#ifdef USBUART_USE_DMA
+/*
+ * Advance the FIFO in pointer to wherever the DMA controller has got to
+ * and kick off deferred processing.  Called per burst rather than per
+ * character: from the DMA half/full-transfer interrupts and from the
+ * USART idle interrupt closing out a reception.
+ */
+static void usbuart_rx_advance(void)
+{
+	buf_rx_in = (FIFO_SIZE - dma_get_number_of_data(USBUSART_DMA_BUS,
+	                USBUSART_DMA_RX_CHAN)) % FIFO_SIZE;
+	if (buf_rx_in != buf_rx_out) {
+		gpio_set(LED_PORT_UART, LED_UART);
+		timer_enable_irq(USBUSART_TIM, TIM_DIER_UIE);
+		/* Past the high watermark, drain now: the next tick may
+		 * be too late at multi-megabaud rates */
+		if (usbuart_fifo_level() >= FIFO_HWM)
+			timer_generate_event(USBUSART_TIM, TIM_EGR_UG);
+	}
+}
+
+void USBUSART_ISR(void)
+{
+	/* Idle line: SR then DR read sequence clears the flag */
+	(void)USART_SR(USBUSART);
+	(void)usart_recv(USBUSART);
+	usbuart_rx_advance();
+}
+
+void USBUSART_DMA_RX_ISR(void)
+{
+	DMA_IFCR(USBUSART_DMA_BUS) |= DMA_ISR_HTIF(USBUSART_DMA_RX_CHAN) |
+	        DMA_ISR_TCIF(USBUSART_DMA_RX_CHAN);
+	usbuart_rx_advance();
+}
+#else
 /*
- * Read a character from the UART RX and stuff it in a software FIFO.
- * Allowed to read from FIFO out pointer, but not write to it.
- * Allowed to write to FIFO in pointer.
+ * Read a character from the UART RX and stuff it in a software FIFO,
+ * and trickle the TX double buffer into the UART one character per TXE
+ * interrupt.  Allowed to read from FIFO out pointer, but not write to
+ * it.  Allowed to write to FIFO in pointer.
  */
 void USBUSART_ISR(void)
 {
 	uint32_t err = USART_SR(USBUSART);
+
+	if ((USBUSART_CR1 & USART_CR1_TXEIE) && (err & USART_SR_TXE)) {
+		if (tx_pos < buf_tx_len[tx_act])
+			usart_send(USBUSART, buf_tx[tx_act][tx_pos++]);
+		if (tx_pos >= buf_tx_len[tx_act]) {
+			if (tx_pending) {
+				/* Swap in the queued packet and release
+				 * the endpoint */
+				tx_pending = false;
+				tx_act ^= 1;
+				tx_pos = 0;
+				usbd_ep_nak_set(usbdev, CDCACM_UART_ENDPOINT, 0);
+			} else {
+				tx_act = 0xFF;
+				USBUSART_CR1 &= ~USART_CR1_TXEIE;
+				gpio_clear(LED_PORT_UART, LED_UART);
+			}
+		}
+	}
+
+	if (!(err & USART_SR_RXNE))
+		return;
+
 	char c = usart_recv(USBUSART);
 	if (err & (USART_SR_ORE | USART_SR_FE | USART_SR_NE))
 		return;
@@ -239,8 +452,13 @@ void USBUSART_ISR(void)
 
 		/* enable deferred processing if we put data in the FIFO */
 		timer_enable_irq(USBUSART_TIM, TIM_DIER_UIE);
+		/* Past the high watermark, drain now: the next tick may
+		 * be too late at multi-megabaud rates */
+		if (usbuart_fifo_level() >= FIFO_HWM)
+			timer_generate_event(USBUSART_TIM, TIM_EGR_UG);
 	}
 }
+#endif
 
 void USBUSART_TIM_ISR(void)
 {
@@ -97,11 +97,21 @@
 
 #define USBUSART USART1
 #define USBUSART_CR1 USART1_CR1
+#define USBUSART_DR USART1_DR
 #define USBUSART_IRQ NVIC_USART1_IRQ
 #define USBUSART_CLK RCC_USART1
 #define USBUSART_PORT GPIOB
 #define USBUSART_TX_PIN GPIO6
 #define USBUSART_ISR usart1_isr
+/* USART1 DMA requests: RX on channel 5, TX on channel 4 */
+#define USBUSART_DMA_BUS DMA1
+#define USBUSART_DMA_CLK RCC_DMA1
+#define USBUSART_DMA_RX_CHAN DMA_CHANNEL5
+#define USBUSART_DMA_RX_IRQ NVIC_DMA1_CHANNEL5_IRQ
+#define USBUSART_DMA_RX_ISR dma1_channel5_isr
+#define USBUSART_DMA_TX_CHAN DMA_CHANNEL4
+#define USBUSART_DMA_TX_IRQ NVIC_DMA1_CHANNEL4_IRQ
+#define USBUSART_DMA_TX_ISR dma1_channel4_isr
 #define USBUSART_TIM TIM4
 #define USBUSART_TIM_CLK_EN() rcc_periph_clock_enable(RCC_TIM4)
 #define USBUSART_TIM_IRQ NVIC_TIM4_IRQ
@@ -114,12 +124,30 @@
 #define TRACE_IC_IN TIM_IC_IN_TI2
 #define TRACE_TRIG_IN TIM_SMCR_TS_IT1FP2
 
+/* NRZ mode SWO (TRACESWO_PROTOCOL=2): wire the target's SWO to PA3 */
+#if defined(TRACESWO_PROTOCOL) && (TRACESWO_PROTOCOL == 2)
+#define PLATFORM_HAS_TRACESWO
+#define PLATFORM_HAS_BATCH
+#endif
+#define IRQ_PRI_SWO_DMA		(1 << 4)
+#define NUM_TRACE_PACKETS	(64)		/* This is a 4K buffer */
+#define SWO_UART		USART2
+#define SWO_UART_DR		USART2_DR
+#define SWO_UART_CLK		RCC_USART2
+#define SWO_UART_PORT		GPIOA
+#define SWO_UART_RX_PIN		GPIO3
+#define SWO_DMA_BUS		DMA1
+#define SWO_DMA_CLK		RCC_DMA1
+#define SWO_DMA_CHAN		DMA_CHANNEL6
+#define SWO_DMA_IRQ		NVIC_DMA1_CHANNEL6_IRQ
+#define SWO_DMA_ISR(x)		dma1_channel6_isr(x)
+
 #ifdef ENABLE_DEBUG
 # define PLATFORM_HAS_DEBUG
 # define USBUART_DEBUG
 extern bool debug_bmp;
 int usbuart_debug_write(const char *buf, size_t len);
-# define DEBUG printf
+/* DEBUG goes to the trace ring; see general.h */
 #else
 # define DEBUG(...)
 #endif
@@ -50,6 +50,28 @@ void gdb_if_putchar(unsigned char c, int flush)
 	}
 }
 
+void gdb_if_write(const char *data, int size)
+{
+	while (size) {
+		int n = CDCACM_PACKET_SIZE - count_in;
+		if (n > size)
+			n = size;
+		memcpy((uint8_t *)buffer_in + count_in, data, n);
+		count_in += n;
+		data += n;
+		size -= n;
+		if (count_in == CDCACM_PACKET_SIZE) {
+			if ((cdcacm_get_config() != 1) || !cdcacm_get_dtr()) {
+				count_in = 0;
+				return;
+			}
+			while (usbd_ep_write_packet(usbdev, CDCACM_GDB_ENDPOINT,
+				(uint8_t *)buffer_in, count_in) <= 0);
+			count_in = 0;
+		}
+	}
+}
+
 void gdb_usb_out_cb(usbd_device *dev, uint8_t ep)
 {
 	(void)ep;
@@ -82,6 +104,26 @@ unsigned char gdb_if_getchar(void)
 	return buffer_out[tail_out++ % sizeof(buffer_out)];
 }
 
+int gdb_if_getbuf(unsigned char *buf, int maxlen)
+{
+	int len = 0;
+
+	while(tail_out == head_out) {
+		/* Detach if port closed */
+		if(!cdcacm_get_dtr()) {
+			buf[0] = 0x04;
+			return 1;
+		}
+
+		while(cdcacm_get_config() != 1);
+	}
+
+	while((tail_out != head_out) && (len < maxlen))
+		buf[len++] = buffer_out[tail_out++ % sizeof(buffer_out)];
+
+	return len;
+}
+
 unsigned char gdb_if_getchar_to(int timeout)
 {
 	platform_timeout t;
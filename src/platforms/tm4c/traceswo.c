@@ -21,6 +21,11 @@
  */
 
 /* This file implements capture of the TRACESWO output.
+ *
+ * The UART RX FIFO is serviced by the uDMA controller in ping-pong
+ * mode, so at full rate the CPU takes one interrupt per 64-byte
+ * buffer instead of one per character.  Bursts shorter than the FIFO
+ * trigger level are scooped up on the receive-timeout interrupt.
  *
  * ARM DDI 0403D - ARMv7M Architecture Reference Manual
  * ARM DDI 0337I - Cortex-M3 Technical Reference Manual
@@ -29,6 +34,7 @@
 
 #include "general.h"
 #include "cdcacm.h"
+#include "udma.h"
 
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/lm4f/rcc.h>
@@ -36,6 +42,27 @@
 #include <libopencm3/lm4f/uart.h>
 #include <libopencm3/usb/usbd.h>
 
+#define DMA_BUF_SIZE 64
+
+/* Ping-pong capture buffers; which half the DMA fills next */
+static uint8_t trace_dma_buf[2][DMA_BUF_SIZE];
+static int trace_dma_half;
+
+static void trace_dma_arm(int half)
+{
+	struct udma_channel_ctl *ctl =
+		&udma_ctl[UDMA_CH_UART2RX + (half ? 32 : 0)];
+
+	/* End pointers are inclusive */
+	ctl->src_end = TRACEUART + 0x000;	/* UARTDR */
+	ctl->dst_end = (uint32_t)&trace_dma_buf[half][DMA_BUF_SIZE - 1];
+	ctl->chctl = UDMA_CHCTL_DSTINC_8 | UDMA_CHCTL_DSTSIZE_8 |
+		UDMA_CHCTL_SRCINC_NONE | UDMA_CHCTL_SRCSIZE_8 |
+		UDMA_CHCTL_ARBSIZE_8 |
+		UDMA_CHCTL_XFERSIZE(DMA_BUF_SIZE) |
+		UDMA_CHCTL_XFERMODE_PINGPONG;
+}
+
 void traceswo_init(void)
 {
 	periph_clock_enable(RCC_GPIOD);
@@ -63,8 +90,23 @@ void traceswo_init(void)
 
 	uart_clear_interrupt_flag(TRACEUART, UART_INT_RX | UART_INT_RT);
 
-	/* Enable interrupts */
-	uart_enable_interrupts(TRACEUART, UART_INT_RX | UART_INT_RT);
+	/* The FIFO trigger raises uDMA burst requests instead of RX
+	 * interrupts; only the receive timeout still interrupts, to
+	 * scoop up tails shorter than a burst. */
+	uart_enable_interrupts(TRACEUART, UART_INT_RT);
+
+	/* uDMA: ping-pong channel 0 <- UART2 RX */
+	udma_init();
+	UDMA_CHMAP0 = (UDMA_CHMAP0 & ~0xF) | 1;
+	UDMA_PRIOSET = 1 << UDMA_CH_UART2RX;
+	/* Burst requests only; singles are left for the timeout path */
+	UDMA_USEBURSTSET = 1 << UDMA_CH_UART2RX;
+	UDMA_REQMASKCLR = 1 << UDMA_CH_UART2RX;
+	trace_dma_arm(0);
+	trace_dma_arm(1);
+	trace_dma_half = 0;
+	UDMA_ENASET = 1 << UDMA_CH_UART2RX;
+	uart_enable_rx_dma(TRACEUART);
 
 	/* Finally enable the USART. */
 	uart_enable(TRACEUART);
@@ -93,6 +135,18 @@ static volatile uint32_t buf_rx_in = 0;
 /* Fifo out pointer, writes assumed to be atomic, should be only incremented outside RX ISR */
 static volatile uint32_t buf_rx_out = 0;
 
+/* Stage captured bytes into the USB fifo; excess is dropped */
+static void trace_ring_put(const uint8_t *data, size_t len)
+{
+	while (len--) {
+		if (((buf_rx_in + 1) % FIFO_SIZE) == buf_rx_out)
+			return;
+		buf_rx[buf_rx_in++] = *data++;
+		if (buf_rx_in >= FIFO_SIZE)
+			buf_rx_in = 0;
+	}
+}
+
 void trace_buf_push(void)
 {
 	size_t len;
@@ -129,33 +183,53 @@ void trace_tick(void)
 
 void TRACEUART_ISR(void)
 {
+	struct udma_channel_ctl *ctl;
 	uint32_t flush = uart_is_interrupt_source(TRACEUART, UART_INT_RT);
 
-	while (!uart_is_rx_fifo_empty(TRACEUART)) {
-		uint32_t c = uart_recv(TRACEUART);
-
-		/* If the next increment of rx_in would put it at the same point
-		* as rx_out, the FIFO is considered full.
-		*/
-		if (((buf_rx_in + 1) % FIFO_SIZE) != buf_rx_out)
-		{
-			/* insert into FIFO */
-			buf_rx[buf_rx_in++] = c;
-
-			/* wrap out pointer */
-			if (buf_rx_in >= FIFO_SIZE)
-			{
-				buf_rx_in = 0;
-			}
-		} else {
-			flush = 1;
+	if (flush)
+		uart_clear_interrupt_flag(TRACEUART, UART_INT_RT);
+
+	/* Completed halves signal on this vector with no UART flag set;
+	 * the XFERMODE bits fall to STOP when a side finishes. */
+	for (;;) {
+		ctl = &udma_ctl[UDMA_CH_UART2RX + (trace_dma_half ? 32 : 0)];
+		if ((ctl->chctl & UDMA_CHCTL_XFERMODE_MASK) !=
+		    UDMA_CHCTL_XFERMODE_STOP)
 			break;
-		}
+		trace_ring_put(trace_dma_buf[trace_dma_half], DMA_BUF_SIZE);
+		trace_dma_arm(trace_dma_half);
+		trace_dma_half ^= 1;
 	}
 
 	if (flush) {
-		/* advance fifo out pointer by amount written */
+		/* Tail shorter than a burst: park the channel, take what
+		 * the DMA already moved plus what is left in the FIFO,
+		 * then restart the ping-pong from a clean slate so the
+		 * stream stays in order. */
+		size_t landed;
+
+		UDMA_ENACLR = 1 << UDMA_CH_UART2RX;
+		ctl = &udma_ctl[UDMA_CH_UART2RX + (trace_dma_half ? 32 : 0)];
+		if ((ctl->chctl & UDMA_CHCTL_XFERMODE_MASK) ==
+		    UDMA_CHCTL_XFERMODE_STOP)
+			landed = DMA_BUF_SIZE;
+		else
+			landed = DMA_BUF_SIZE -
+				UDMA_CHCTL_XFERSIZE_GET(ctl->chctl);
+		if (landed)
+			trace_ring_put(trace_dma_buf[trace_dma_half], landed);
+
+		while (!uart_is_rx_fifo_empty(TRACEUART)) {
+			uint8_t c = uart_recv(TRACEUART);
+			trace_ring_put(&c, 1);
+		}
+
+		trace_dma_arm(0);
+		trace_dma_arm(1);
+		trace_dma_half = 0;
+		UDMA_ALTCLR = 1 << UDMA_CH_UART2RX;
+		UDMA_ENASET = 1 << UDMA_CH_UART2RX;
+
 		trace_buf_push();
 	}
 }
-
@@ -0,0 +1,43 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Shared state for the TM4C uDMA controller.  The channel control
+ * table is one block for the whole controller, so the UART bridge and
+ * the SWO capture both arm their channels out of this table. */
+
+#include "general.h"
+#include "udma.h"
+
+#include <libopencm3/lm4f/rcc.h>
+
+/* The controller requires 1K alignment */
+struct udma_channel_ctl udma_ctl[64] __attribute__((aligned(1024)));
+
+void udma_init(void)
+{
+	static bool initialised = false;
+
+	if (initialised)
+		return;
+	initialised = true;
+
+	periph_clock_enable(RCC_UDMA);
+	__asm__("nop"); __asm__("nop"); __asm__("nop");
+
+	UDMA_CFG = UDMA_CFG_MASTEN;
+	UDMA_CTLBASE = (uint32_t)udma_ctl;
+}
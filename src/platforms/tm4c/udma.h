@@ -0,0 +1,70 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __UDMA_H
+#define __UDMA_H
+
+#include <libopencm3/cm3/common.h>
+
+/* TM4C uDMA controller; no libopencm3 driver, so raw registers here */
+#define UDMA_BASE		0x400FF000
+#define UDMA_CFG		MMIO32(UDMA_BASE + 0x004)
+#define UDMA_CTLBASE		MMIO32(UDMA_BASE + 0x008)
+#define UDMA_USEBURSTSET	MMIO32(UDMA_BASE + 0x018)
+#define UDMA_REQMASKCLR		MMIO32(UDMA_BASE + 0x024)
+#define UDMA_ENASET		MMIO32(UDMA_BASE + 0x028)
+#define UDMA_ENACLR		MMIO32(UDMA_BASE + 0x02C)
+#define UDMA_ALTCLR		MMIO32(UDMA_BASE + 0x034)
+#define UDMA_PRIOSET		MMIO32(UDMA_BASE + 0x038)
+#define UDMA_CHMAP0		MMIO32(UDMA_BASE + 0x510)
+#define UDMA_CHMAP1		MMIO32(UDMA_BASE + 0x514)
+
+#define UDMA_CFG_MASTEN		(1 << 0)
+
+/* TM4C123 channel assignments used by this firmware */
+#define UDMA_CH_UART2RX		0	/* map encoding 1 */
+#define UDMA_CH_UART0RX		8	/* map encoding 0 */
+#define UDMA_CH_UART0TX		9	/* map encoding 0 */
+
+/* Channel control word fields */
+#define UDMA_CHCTL_DSTINC_8	(0u << 30)
+#define UDMA_CHCTL_DSTINC_NONE	(3u << 30)
+#define UDMA_CHCTL_DSTSIZE_8	(0 << 28)
+#define UDMA_CHCTL_SRCINC_8	(0 << 26)
+#define UDMA_CHCTL_SRCINC_NONE	(3 << 26)
+#define UDMA_CHCTL_SRCSIZE_8	(0 << 24)
+#define UDMA_CHCTL_ARBSIZE_4	(2 << 14)
+#define UDMA_CHCTL_ARBSIZE_8	(3 << 14)
+#define UDMA_CHCTL_XFERSIZE(x)	(((x) - 1) << 4)
+#define UDMA_CHCTL_XFERSIZE_GET(ctl)	((((ctl) >> 4) & 0x3FF) + 1)
+#define UDMA_CHCTL_XFERMODE_MASK	7
+#define UDMA_CHCTL_XFERMODE_STOP	0
+#define UDMA_CHCTL_XFERMODE_BASIC	1
+#define UDMA_CHCTL_XFERMODE_PINGPONG	3
+
+struct udma_channel_ctl {
+	volatile uint32_t src_end;
+	volatile uint32_t dst_end;
+	volatile uint32_t chctl;
+	volatile uint32_t reserved;
+};
+
+/* Channel control table: primary entries then alternates at +0x200 */
+extern struct udma_channel_ctl udma_ctl[64];
+
+void udma_init(void);
+
+#endif
@@ -19,8 +19,16 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+
+/* USB to UART bridge.  Both directions ride the uDMA controller: RX
+ * ping-pongs into 64-byte buffers staged through a software ring, TX
+ * streams whole CDCACM packets out of a double buffer, so the bridge
+ * costs one interrupt per burst instead of one per character and
+ * leaves the CPU to the SWD path. */
+
 #include "general.h"
 #include "cdcacm.h"
+#include "udma.h"
 
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/scs.h>
@@ -29,22 +37,76 @@
 #include <libopencm3/lm4f/rcc.h>
 #include <libopencm3/lm4f/uart.h>
 
-#define FIFO_SIZE 128
+/* RX ring size; platforms may override in platform.h to run higher
+ * baud rates.  Must be a power of two. */
+#ifndef USBUART_FIFO_SIZE
+#define USBUART_FIFO_SIZE 128
+#endif
+#if USBUART_FIFO_SIZE & (USBUART_FIFO_SIZE - 1)
+#error "USBUART_FIFO_SIZE must be a power of two"
+#endif
+#define FIFO_SIZE USBUART_FIFO_SIZE
+
+#define DMA_RX_SIZE 64
 
 /* RX Fifo buffer */
 static uint8_t buf_rx[FIFO_SIZE];
 /* Fifo in pointer, writes assumed to be atomic, should be only incremented within RX ISR */
-static uint8_t buf_rx_in;
+static uint32_t buf_rx_in;
 /* Fifo out pointer, writes assumed to be atomic, should be only incremented outside RX ISR */
-static uint8_t buf_rx_out;
+static uint32_t buf_rx_out;
+
+/* Ping-pong capture buffers; which half the DMA fills next */
+static uint8_t buf_rx_dma[2][DMA_RX_SIZE];
+static int rx_dma_half;
+
+/* TX double buffer: one packet in flight on DMA, one being received */
+static uint8_t buf_tx[2][CDCACM_PACKET_SIZE];
+static uint8_t buf_tx_len[2];
+static volatile uint8_t tx_act = 0xFF;	/* buffer on DMA, 0xFF = idle */
+static volatile bool tx_pending;
+
+static uint32_t usbuart_fifo_level(void)
+{
+	return (buf_rx_in + FIFO_SIZE - buf_rx_out) % FIFO_SIZE;
+}
+
+static void usbuart_rx_dma_arm(int half)
+{
+	struct udma_channel_ctl *ctl =
+		&udma_ctl[UDMA_CH_UART0RX + (half ? 32 : 0)];
+
+	/* End pointers are inclusive */
+	ctl->src_end = USBUART + 0x000;		/* UARTDR */
+	ctl->dst_end = (uint32_t)&buf_rx_dma[half][DMA_RX_SIZE - 1];
+	ctl->chctl = UDMA_CHCTL_DSTINC_8 | UDMA_CHCTL_DSTSIZE_8 |
+		UDMA_CHCTL_SRCINC_NONE | UDMA_CHCTL_SRCSIZE_8 |
+		UDMA_CHCTL_ARBSIZE_8 |
+		UDMA_CHCTL_XFERSIZE(DMA_RX_SIZE) |
+		UDMA_CHCTL_XFERMODE_PINGPONG;
+}
+
+static void usbuart_tx_start(uint8_t idx)
+{
+	struct udma_channel_ctl *ctl = &udma_ctl[UDMA_CH_UART0TX];
+
+	ctl->src_end = (uint32_t)&buf_tx[idx][buf_tx_len[idx] - 1];
+	ctl->dst_end = USBUART + 0x000;		/* UARTDR */
+	ctl->chctl = UDMA_CHCTL_DSTINC_NONE | UDMA_CHCTL_DSTSIZE_8 |
+		UDMA_CHCTL_SRCINC_8 | UDMA_CHCTL_SRCSIZE_8 |
+		UDMA_CHCTL_ARBSIZE_4 |
+		UDMA_CHCTL_XFERSIZE(buf_tx_len[idx]) |
+		UDMA_CHCTL_XFERMODE_BASIC;
+	UDMA_ENASET = 1 << UDMA_CH_UART0TX;
+}
 
 void usbuart_init(void)
 {
 	UART_PIN_SETUP();
-	
+
 	periph_clock_enable(USBUART_CLK);
 	__asm__("nop"); __asm__("nop"); __asm__("nop");
-	
+
 	uart_disable(USBUART);
 
 	/* Setup UART parameters. */
@@ -57,19 +119,35 @@ void usbuart_init(void)
 	// Enable FIFO
 	uart_enable_fifo(USBUART);
 
-	// Set FIFO interrupt trigger levels to 1/8 full for RX buffer and
+	// Set FIFO interrupt trigger levels to 1/2 full for RX buffer and
 	// 7/8 empty (1/8 full) for TX buffer
-	uart_set_fifo_trigger_levels(USBUART, UART_FIFO_RX_TRIG_1_8, UART_FIFO_TX_TRIG_7_8);
+	uart_set_fifo_trigger_levels(USBUART, UART_FIFO_RX_TRIG_1_2, UART_FIFO_TX_TRIG_7_8);
 
 	uart_clear_interrupt_flag(USBUART, UART_INT_RX | UART_INT_RT);
 
-	/* Enable interrupts */
-	uart_enable_interrupts(UART0, UART_INT_RX| UART_INT_RT);
+	/* The FIFO triggers raise uDMA requests instead of interrupts;
+	 * only the receive timeout still interrupts, to scoop up tails
+	 * shorter than a burst. */
+	uart_enable_interrupts(USBUART, UART_INT_RT);
+
+	/* uDMA: ping-pong RX channel plus a basic-mode TX channel */
+	udma_init();
+	UDMA_CHMAP1 &= ~0xFF;	/* ch8/ch9 encoding 0: UART0 RX/TX */
+	UDMA_PRIOSET = 1 << UDMA_CH_UART0RX;
+	/* RX takes burst requests only; singles are left for the
+	 * timeout path.  TX takes both so short packets drain. */
+	UDMA_USEBURSTSET = 1 << UDMA_CH_UART0RX;
+	UDMA_REQMASKCLR = (1 << UDMA_CH_UART0RX) | (1 << UDMA_CH_UART0TX);
+	usbuart_rx_dma_arm(0);
+	usbuart_rx_dma_arm(1);
+	rx_dma_half = 0;
+	UDMA_ENASET = 1 << UDMA_CH_UART0RX;
+	uart_enable_rx_dma(USBUART);
+	uart_enable_tx_dma(USBUART);
 
 	/* Finally enable the USART. */
 	uart_enable(USBUART);
 
-	//nvic_set_priority(USBUSART_IRQ, IRQ_PRI_USBUSART);
 	nvic_enable_irq(USBUART_IRQ);
 }
 
@@ -103,12 +181,26 @@ void usbuart_usb_out_cb(usbd_device *dev, uint8_t ep)
 {
 	(void)ep;
 
-	char buf[CDCACM_PACKET_SIZE];
+	nvic_disable_irq(USBUART_IRQ);
+	uint8_t idx = (tx_act == 0xFF) ? 0 : (tx_act ^ 1);
 	int len = usbd_ep_read_packet(dev, CDCACM_UART_ENDPOINT,
-					buf, CDCACM_PACKET_SIZE);
+					buf_tx[idx], CDCACM_PACKET_SIZE);
+
+	if (len == 0) {
+		nvic_enable_irq(USBUART_IRQ);
+		return;
+	}
 
-	for(int i = 0; i < len; i++)
-		uart_send_blocking(USBUART, buf[i]);
+	buf_tx_len[idx] = len;
+	if (tx_act == 0xFF) {
+		tx_act = idx;
+		usbuart_tx_start(idx);
+	} else {
+		/* Both buffers in use: hold the host off until DMA frees one */
+		tx_pending = true;
+		usbd_ep_nak_set(dev, CDCACM_UART_ENDPOINT, 1);
+	}
+	nvic_enable_irq(USBUART_IRQ);
 }
 
 
@@ -118,65 +210,126 @@ void usbuart_usb_in_cb(usbd_device *dev, uint8_t ep)
 	(void) ep;
 }
 
+/* Stage captured bytes into the USB fifo; excess is dropped */
+static void usbuart_ring_put(const uint8_t *data, size_t len)
+{
+	while (len--) {
+		if (((buf_rx_in + 1) % FIFO_SIZE) == buf_rx_out)
+			return;
+		buf_rx[buf_rx_in++] = *data++;
+		if (buf_rx_in >= FIFO_SIZE)
+			buf_rx_in = 0;
+	}
+}
+
 /*
- * Read a character from the UART RX and stuff it in a software FIFO.
- * Allowed to read from FIFO out pointer, but not write to it.
- * Allowed to write to FIFO in pointer.
+ * Drain the RX ring to the host.  Allowed to read from FIFO in
+ * pointer, but not write to it.  Allowed to write to FIFO out pointer.
  */
-void USBUART_ISR(void)
+static void usbuart_run(void)
 {
-	int flush = uart_is_interrupt_source(USBUART, UART_INT_RT);
+	/* forcibly empty fifo if no USB endpoint */
+	if (cdcacm_get_config() != 1)
+	{
+		buf_rx_out = buf_rx_in;
+		return;
+	}
 
-	while (!uart_is_rx_fifo_empty(USBUART)) {
-		char c = uart_recv(USBUART);
+	if (buf_rx_in == buf_rx_out)
+		return;
 
-		/* If the next increment of rx_in would put it at the same point
-		* as rx_out, the FIFO is considered full.
-		*/
-		if (((buf_rx_in + 1) % FIFO_SIZE) != buf_rx_out)
-		{
-			/* insert into FIFO */
-			buf_rx[buf_rx_in++] = c;
+	uint8_t packet_buf[CDCACM_PACKET_SIZE];
+	uint8_t packet_size = 0;
+	uint32_t buf_out = buf_rx_out;
 
-			/* wrap out pointer */
-			if (buf_rx_in >= FIFO_SIZE)
-			{
-				buf_rx_in = 0;
-			}
-		} else {
-			flush = 1;
-		}
-	}
+	/* copy from uart FIFO into local usb packet buffer */
+	while (buf_rx_in != buf_out && packet_size < CDCACM_PACKET_SIZE)
+	{
+		packet_buf[packet_size++] = buf_rx[buf_out++];
 
-	if (flush) {
-		/* forcibly empty fifo if no USB endpoint */
-		if (cdcacm_get_config() != 1)
+		/* wrap out pointer */
+		if (buf_out >= FIFO_SIZE)
 		{
-			buf_rx_out = buf_rx_in;
-			return;
+			buf_out = 0;
 		}
 
-		uint8_t packet_buf[CDCACM_PACKET_SIZE];
-		uint8_t packet_size = 0;
-		uint8_t buf_out = buf_rx_out;
+	}
 
-		/* copy from uart FIFO into local usb packet buffer */
-		while (buf_rx_in != buf_out && packet_size < CDCACM_PACKET_SIZE)
-		{
-			packet_buf[packet_size++] = buf_rx[buf_out++];
+	/* advance fifo out pointer by amount written */
+	buf_rx_out += usbd_ep_write_packet(usbdev,
+			CDCACM_UART_ENDPOINT, packet_buf, packet_size);
+	buf_rx_out %= FIFO_SIZE;
+}
 
-			/* wrap out pointer */
-			if (buf_out >= FIFO_SIZE)
-			{
-				buf_out = 0;
-			}
+void USBUART_ISR(void)
+{
+	struct udma_channel_ctl *ctl;
+	int flush = uart_is_interrupt_source(USBUART, UART_INT_RT);
+
+	if (flush)
+		uart_clear_interrupt_flag(USBUART, UART_INT_RT);
+
+	/* Completed RX halves signal on this vector with no UART flag
+	 * set; the XFERMODE bits fall to STOP when a side finishes. */
+	for (;;) {
+		ctl = &udma_ctl[UDMA_CH_UART0RX + (rx_dma_half ? 32 : 0)];
+		if ((ctl->chctl & UDMA_CHCTL_XFERMODE_MASK) !=
+		    UDMA_CHCTL_XFERMODE_STOP)
+			break;
+		usbuart_ring_put(buf_rx_dma[rx_dma_half], DMA_RX_SIZE);
+		usbuart_rx_dma_arm(rx_dma_half);
+		rx_dma_half ^= 1;
+	}
+
+	if (flush) {
+		/* Tail shorter than a burst: park the channel, take what
+		 * the DMA already moved plus what is left in the FIFO,
+		 * then restart the ping-pong from a clean slate so the
+		 * stream stays in order. */
+		size_t landed;
 
+		UDMA_ENACLR = 1 << UDMA_CH_UART0RX;
+		ctl = &udma_ctl[UDMA_CH_UART0RX + (rx_dma_half ? 32 : 0)];
+		if ((ctl->chctl & UDMA_CHCTL_XFERMODE_MASK) ==
+		    UDMA_CHCTL_XFERMODE_STOP)
+			landed = DMA_RX_SIZE;
+		else
+			landed = DMA_RX_SIZE -
+				UDMA_CHCTL_XFERSIZE_GET(ctl->chctl);
+		if (landed)
+			usbuart_ring_put(buf_rx_dma[rx_dma_half], landed);
+
+		while (!uart_is_rx_fifo_empty(USBUART)) {
+			uint8_t c = uart_recv(USBUART);
+			usbuart_ring_put(&c, 1);
 		}
 
-		/* advance fifo out pointer by amount written */
-		buf_rx_out += usbd_ep_write_packet(usbdev,
-				CDCACM_UART_ENDPOINT, packet_buf, packet_size);
-		buf_rx_out %= FIFO_SIZE;
+		usbuart_rx_dma_arm(0);
+		usbuart_rx_dma_arm(1);
+		rx_dma_half = 0;
+		UDMA_ALTCLR = 1 << UDMA_CH_UART0RX;
+		UDMA_ENASET = 1 << UDMA_CH_UART0RX;
 	}
-}
 
+	/* TX completion: the basic-mode channel drops to STOP */
+	if (tx_act != 0xFF) {
+		ctl = &udma_ctl[UDMA_CH_UART0TX];
+		if ((ctl->chctl & UDMA_CHCTL_XFERMODE_MASK) ==
+		    UDMA_CHCTL_XFERMODE_STOP) {
+			if (tx_pending) {
+				tx_pending = false;
+				tx_act ^= 1;
+				usbuart_tx_start(tx_act);
+				usbd_ep_nak_set(usbdev,
+						CDCACM_UART_ENDPOINT, 0);
+			} else {
+				tx_act = 0xFF;
+			}
+		}
+	}
+
+	/* A completed half is a full USB packet; a timeout means the
+	 * line went quiet.  Either way, hand what we have to the host. */
+	if (flush || usbuart_fifo_level() >= DMA_RX_SIZE)
+		usbuart_run();
+}
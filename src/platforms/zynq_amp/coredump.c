@@ -5,39 +5,292 @@
 
 #include "elfcore.h"
 
-#define MAX_SEGMENTS 10
+/* Streaming ELF core writer: segment data is written to the file as it
+ * is produced, so only the growing program header table and the note
+ * are held in memory.  The program header table lands at the end of the
+ * file and the ELF header is patched to point at it on finish.
+ *
+ * Output can optionally go through a compressed container ("zcore"):
+ * a magic/version header followed by records of the ELF byte stream,
+ * each a 32-bit word with the type in the top two bits and the length
+ * below - zero runs are elided entirely, literals carry their data and
+ * a patch record rewrites earlier bytes (used for the final ELF
+ * header).  scripts/zcore.c reconstructs the ELF on the host.  On our
+ * mostly-zero RAM regions this shrinks dumps by orders of magnitude. */
+#define ZCORE_MAGIC      0x524F435A  /* "ZCOR" */
+#define ZCORE_VERSION    1
+#define ZCORE_CHUNK      4096
+#define ZCORE_ZEROS(n)   (n)
+#define ZCORE_LITERAL(n) ((1UL << 30) | (n))
+#define ZCORE_PATCH(n)   ((2UL << 30) | (n))
 
 struct corefile {
+    FILE *f;
     struct Elf32_Ehdr ehdr;
-    struct Elf32_Phdr phdr[MAX_SEGMENTS];
-    const void *segments[MAX_SEGMENTS];
-    void *note;
+    /* Fixed-size program header table and note arena: the metadata
+     * phase of a dump runs allocation-free, so a crash that has taken
+     * the heap with it can still be captured */
+    struct Elf32_Phdr phdr[CORE_PHDR_MAX];
+    uint8_t note[CORE_NOTE_ARENA_SIZE];
     size_t note_size;
+    int note_written;
+    int compress;
+    int started;
+    uint32_t zeros;     /* run of elided zero bytes not yet recorded */
+    uint32_t offset;
 };
 
-struct corefile *core_new(uint32_t machine)
+struct corefile *core_new(FILE *f, uint32_t machine)
 {
-    struct corefile *cf = calloc(1, sizeof(*cf));
+    /* One dump at a time; in-place assembly with no allocator calls */
+    static struct corefile corefile;
+    struct corefile *cf = &corefile;
+    memset(cf, 0, sizeof(*cf));
+    cf->f = f;
     memcpy(cf->ehdr.e_ident, E_IDENT_ELF32LSB, sizeof(cf->ehdr.e_ident));
     cf->ehdr.e_type = ET_CORE;
     cf->ehdr.e_version = 1;
     cf->ehdr.e_ehsize = sizeof(struct Elf32_Ehdr);
-    cf->ehdr.e_phoff = sizeof(struct Elf32_Ehdr);
     cf->ehdr.e_phentsize = sizeof(struct Elf32_Phdr);
     cf->ehdr.e_machine = machine;
+    cf->offset = sizeof(cf->ehdr);
     return cf;
 }
 
-void core_add_ph(struct corefile *cf, uint32_t p_type, uint32_t p_vaddr,
-                 const void *data, uint32_t p_filesz)
+/* Must be called before any note or segment is written */
+void core_compress(struct corefile *cf)
 {
-    struct Elf32_Phdr *phdr = &cf->phdr[cf->ehdr.e_phnum];
+    cf->compress = 1;
+}
+
+static void cw_flush_zeros(struct corefile *cf)
+{
+    if (cf->zeros) {
+        uint32_t rec = ZCORE_ZEROS(cf->zeros);
+        fwrite(&rec, sizeof(rec), 1, cf->f);
+        cf->zeros = 0;
+    }
+}
+
+/* Bulk copy tuned for the A9: 64-byte NEON blocks with the preloads
+ * running several lines ahead, so the loads land in lines the PLD
+ * engine (and the PL310, where prefetch hinting is enabled) has
+ * already started fetching.  The DDR segments arrive through an
+ * uncached /dev/mem mapping, where the wide loads matter most. */
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+static void core_bulk_copy(void *dst, const void *src, size_t len)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    while (((uintptr_t)s & 15) && len) {
+        *d++ = *s++;
+        len--;
+    }
+    while (len >= 64) {
+        __builtin_prefetch(s + 256);
+        __builtin_prefetch(s + 288);
+        uint8x16_t q0 = vld1q_u8(s);
+        uint8x16_t q1 = vld1q_u8(s + 16);
+        uint8x16_t q2 = vld1q_u8(s + 32);
+        uint8x16_t q3 = vld1q_u8(s + 48);
+        vst1q_u8(d, q0);
+        vst1q_u8(d + 16, q1);
+        vst1q_u8(d + 32, q2);
+        vst1q_u8(d + 48, q3);
+        s += 64;
+        d += 64;
+        len -= 64;
+    }
+    if (len)
+        memcpy(d, s, len);
+}
+#else
+static void core_bulk_copy(void *dst, const void *src, size_t len)
+{
+    memcpy(dst, src, len);
+}
+#endif
+
+/* Bounce buffer shared by the write paths: one dump at a time, and
+ * the sparse writer wants the zero scan to run against the same
+ * cached copy the output is taken from */
+static uint32_t bounce[ZCORE_CHUNK / 4];
+
+/* Emit bytes that are already in cached memory (padded to a word
+ * boundary when compressing) */
+static void cw_emit(struct corefile *cf, const uint32_t *data, size_t len)
+{
+    if (!cf->compress) {
+        fwrite(data, len, 1, cf->f);
+        return;
+    }
+    size_t words = (len + 3) / 4;
+    size_t i;
+    for (i = 0; i < words; i++)
+        if (data[i])
+            break;
+    if (i == words) {
+        cf->zeros += len;
+    } else {
+        cw_flush_zeros(cf);
+        uint32_t rec = ZCORE_LITERAL(len);
+        fwrite(&rec, sizeof(rec), 1, cf->f);
+        fwrite(data, len, 1, cf->f);
+    }
+}
+
+/* All output funnels through here so the container sees one stream.
+ * Data is pulled chunk-wise into a bounce buffer with the fast copy -
+ * both the plain fwrite and the zero scan then run against cached
+ * memory instead of the device mapping. */
+static void cw_write(struct corefile *cf, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    while (len) {
+        size_t chunk = (len > ZCORE_CHUNK) ? ZCORE_CHUNK : len;
+        core_bulk_copy(bounce, p, chunk);
+        if (cf->compress && (chunk & 3))
+            memset((uint8_t *)bounce + chunk, 0, 4 - (chunk & 3));
+        cw_emit(cf, bounce, chunk);
+        p += chunk;
+        len -= chunk;
+    }
+}
+
+static void cw_start(struct corefile *cf)
+{
+    if (cf->started)
+        return;
+    cf->started = 1;
+    if (cf->compress) {
+        uint32_t magic[2] = {ZCORE_MAGIC, ZCORE_VERSION};
+        fwrite(magic, sizeof(magic), 1, cf->f);
+    }
+    /* Placeholder header; rewritten by core_finish() */
+    cw_write(cf, &cf->ehdr, sizeof(cf->ehdr));
+}
+
+static struct Elf32_Phdr *core_push_phdr(struct corefile *cf, uint32_t p_type,
+                                         uint32_t p_vaddr, uint32_t p_filesz)
+{
+    if (cf->ehdr.e_phnum == CORE_PHDR_MAX)
+        /* Table full; drop the previous entry rather than overrun.
+         * CORE_PHDR_MAX is sized so this cannot happen. */
+        cf->ehdr.e_phnum--;
+    struct Elf32_Phdr *phdr = &cf->phdr[cf->ehdr.e_phnum++];
+    memset(phdr, 0, sizeof(*phdr));
     phdr->p_type = p_type;
     phdr->p_vaddr = p_vaddr;
     phdr->p_memsz = p_filesz;
     phdr->p_filesz = p_filesz;
-    cf->segments[cf->ehdr.e_phnum] = data;
-    cf->ehdr.e_phnum++;
+    phdr->p_offset = cf->offset;
+    cf->offset += p_filesz;
+    return phdr;
+}
+
+/* The note segment goes out ahead of the first memory segment so the
+ * interesting registers are on disk as early as possible */
+static void core_write_note(struct corefile *cf)
+{
+    if (cf->note_written || (cf->note_size == 0))
+        return;
+    cf->note_written = 1;
+    cw_start(cf);
+    core_push_phdr(cf, PT_NOTE, 0, cf->note_size);
+    cw_write(cf, cf->note, cf->note_size);
+}
+
+void core_write_segment(struct corefile *cf, uint32_t p_type, uint32_t p_vaddr,
+                        const void *data, uint32_t p_filesz)
+{
+    cw_start(cf);
+    core_write_note(cf);
+    core_push_phdr(cf, p_type, p_vaddr, p_filesz);
+    cw_write(cf, data, p_filesz);
+}
+
+/* Zero run below which a hole isn't worth its own program header;
+ * shorter runs are cheaper written out as literal zeros */
+#define CORE_SPARSE_MIN_HOLE (16 * ZCORE_CHUNK)
+
+/* Sparse variant: crash-time DDR is overwhelmingly zero-filled, so
+ * the copy pass scans each bounced chunk word-wise (the same words
+ * the container scan reads) and elides zero runs from the file.  A
+ * run inside a segment becomes the sparse tail of the data before it
+ * (p_memsz > p_filesz) with the data after it opening a fresh
+ * segment; debuggers read the elided addresses back as zero.  Runs
+ * too short to justify a header, and any once the header table nears
+ * capacity, are written as literal zeros instead. */
+void core_write_segment_sparse(struct corefile *cf, uint32_t p_type,
+                               uint32_t p_vaddr, const void *data,
+                               uint32_t p_memsz)
+{
+    static const uint32_t zero_chunk[ZCORE_CHUNK / 4];
+    const uint8_t *p = data;
+    struct Elf32_Phdr *phdr = NULL;
+    uint32_t pos = 0, zrun = 0;
+
+    cw_start(cf);
+    core_write_note(cf);
+
+    while (pos < p_memsz) {
+        size_t chunk = p_memsz - pos;
+        if (chunk > ZCORE_CHUNK)
+            chunk = ZCORE_CHUNK;
+        core_bulk_copy(bounce, p + pos, chunk);
+        if (chunk & 3)
+            memset((uint8_t *)bounce + chunk, 0, 4 - (chunk & 3));
+        size_t words = (chunk + 3) / 4;
+        size_t i;
+        for (i = 0; i < words; i++)
+            if (bounce[i])
+                break;
+        if (i == words) {
+            zrun += chunk;
+            pos += chunk;
+            continue;
+        }
+
+        /* Non-zero chunk: resolve the pending zero run first */
+        if ((zrun >= CORE_SPARSE_MIN_HOLE) &&
+            (cf->ehdr.e_phnum < CORE_PHDR_MAX - 1)) {
+            if (phdr)
+                phdr->p_memsz = phdr->p_filesz + zrun;
+            else {
+                /* Leading zeros: an empty segment keeps the
+                 * addresses mapped */
+                struct Elf32_Phdr *zh = core_push_phdr(cf, p_type,
+                        p_vaddr + pos - zrun, 0);
+                zh->p_memsz = zrun;
+            }
+            phdr = NULL;
+            zrun = 0;
+        }
+        if (!phdr)
+            phdr = core_push_phdr(cf, p_type, p_vaddr + pos - zrun, 0);
+        while (zrun) {
+            size_t zc = (zrun > ZCORE_CHUNK) ? ZCORE_CHUNK : zrun;
+            cw_emit(cf, zero_chunk, zc);
+            phdr->p_filesz += zc;
+            cf->offset += zc;
+            zrun -= zc;
+        }
+        cw_emit(cf, bounce, chunk);
+        phdr->p_filesz += chunk;
+        cf->offset += chunk;
+        pos += chunk;
+    }
+
+    /* Trailing zeros ride on the size difference alone */
+    if (phdr) {
+        phdr->p_memsz = phdr->p_filesz + zrun;
+    } else {
+        phdr = core_push_phdr(cf, p_type, p_vaddr, 0);
+        phdr->p_memsz = zrun;
+    }
 }
 
 static inline size_t pad(size_t x) { return ((x + 3) / 4)*4; }
@@ -51,7 +304,9 @@ void core_note_add(struct corefile *cf,
         .type = type,
     };
     size_t this_size = sizeof(note) + pad(strlen(name) + 1) + pad(len);
-    cf->note = realloc(cf->note, cf->note_size + this_size);
+    if (cf->note_size + this_size > sizeof(cf->note))
+        /* Arena full; CORE_NOTE_ARENA_SIZE needs bumping for new notes */
+        return;
     void *p = cf->note + cf->note_size;
     memset(p, 0, this_size);
     memcpy(p, &note, sizeof(note)); p += sizeof(note);
@@ -61,7 +316,7 @@ void core_note_add(struct corefile *cf,
 }
 
 void core_note_add_prstatus(struct corefile *cf,
-                            uint16_t signal, const uint32_t regs[18])
+                            uint16_t signal, const uint32_t regs[19])
 {
     struct ARM_prstatus prstatus = {
         .pr_cursig = signal,
@@ -75,30 +330,32 @@ void core_note_add_arm_vfp(struct corefile *cf, const struct ARM_vfp *regs)
     core_note_add(cf, "LINUX", NT_ARM_VFP, regs, sizeof(*regs));
 }
 
-void core_dump(FILE *f, struct corefile *cf)
+void core_finish(struct corefile *cf)
 {
-    core_add_ph(cf, PT_NOTE, 0, cf->note, cf->note_size);
+    cw_start(cf);
+    core_write_note(cf);
 
-    /* Write the ELF header */
-    fwrite(&cf->ehdr, sizeof(cf->ehdr), 1, f);
-    uint32_t offset = cf->ehdr.e_ehsize + cf->ehdr.e_phentsize * cf->ehdr.e_phnum;
-    for (int i = 0; i < cf->ehdr.e_phnum; i++) {
-        /* Update program header and write to file */
-        cf->phdr[i].p_offset = offset;
-        offset += cf->phdr[i].p_filesz;
-        fwrite(&cf->phdr[i], sizeof(cf->phdr[i]), 1, f);
-    }
-    for (int i = 0; i < cf->ehdr.e_phnum; i++) {
-        /* Write actual segment data to file */
-        fwrite(cf->segments[i], cf->phdr[i].p_filesz, 1, f);
+    /* Program header table at the end, then patch the ELF header */
+    cf->ehdr.e_phoff = cf->offset;
+    cw_write(cf, cf->phdr, sizeof(*cf->phdr) * cf->ehdr.e_phnum);
+    if (cf->compress) {
+        cw_flush_zeros(cf);
+        uint32_t rec = ZCORE_PATCH(sizeof(cf->ehdr));
+        uint32_t at = 0;
+        fwrite(&rec, sizeof(rec), 1, cf->f);
+        fwrite(&at, sizeof(at), 1, cf->f);
+        fwrite(&cf->ehdr, sizeof(cf->ehdr), 1, cf->f);
+    } else {
+        fseek(cf->f, 0, SEEK_SET);
+        fwrite(&cf->ehdr, sizeof(cf->ehdr), 1, cf->f);
     }
+    fflush(cf->f);
 }
 
 void core_free(struct corefile *cf)
 {
-    if (cf->note != NULL)
-        free(cf->note);
-    free(cf);
+    /* Static storage; just scrub for the next dump */
+    memset(cf, 0, sizeof(*cf));
 }
 
 #include <sys/types.h>
@@ -129,31 +386,43 @@ void zynq_amp_core_dump(target *t)
         {0, 0}
     };
     uint8_t treg[target_regs_size(t)];
-    uint32_t regs[18] = {0};
+    uint32_t regs[19] = {0};
     uint32_t auxv[2] = {AT_HWCAP, HWCAP_VFP | HWCAP_NEON};
     struct ARM_vfp fregs;
+    memset(&fregs, 0, sizeof(fregs));
     target_regs_read(t, treg);
+    /* Register cache layout: r0-r15, CPSR, FPSCR, d0-d15 */
     memcpy(regs, treg, 17 * sizeof(uint32_t));
-    memcpy(&fregs.sr, regs + 18 * sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(&fregs.d, regs + 19 * sizeof(uint32_t), 32 * sizeof(uint64_t));
-    struct corefile *cf = core_new(0x28); /* ARM */
+    memcpy(&fregs.sr, treg + 17 * sizeof(uint32_t), sizeof(uint32_t));
+    memcpy(&fregs.d, treg + 18 * sizeof(uint32_t), 16 * sizeof(uint64_t));
+
+    time_t tim;
+    char fn[80];
+    time(&tim);
+    strftime(fn, sizeof(fn), "/tmp/cores/zynq_amp_core-%Y%m%d-%H%M%S", gmtime(&tim));
+    /* Opt-in compressed container; unpack with scripts/zcore.c */
+    int compress = (getenv("BMP_CORE_COMPRESS") != NULL);
+    if (compress)
+        strncat(fn, ".zcore", sizeof(fn) - strlen(fn) - 1);
+    FILE *f = fopen(fn, "w");
+
+    struct corefile *cf = core_new(f, 0x28); /* ARM */
+    if (compress)
+        core_compress(cf);
     core_note_add_prstatus(cf, SIGSEGV, regs);
     core_note_add(cf, "CORE", NT_AUXV, auxv, sizeof(auxv));
     core_note_add_arm_vfp(cf, &fregs);
     int pmem = open("/dev/mem", O_RDWR | O_SYNC);
     for (const struct section *s = sections; s->size; s++) {
+        /* Stream each section out as it is captured */
         cortexa_cache_clean(t, s->base, s->size);
         volatile void *ptr = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED,
                                   pmem, s->base);
-        core_add_ph(cf, PT_LOAD, s->base, (void*)ptr, s->size);
+        core_write_segment_sparse(cf, PT_LOAD, s->base, (void*)ptr, s->size);
+        munmap((void*)ptr, s->size);
     }
-
-    time_t tim;
-    char fn[80];
-    time(&tim);
-    strftime(fn, sizeof(fn), "/tmp/cores/zynq_amp_core-%Y%m%d-%H%M%S", gmtime(&tim));
-    FILE *f = fopen(fn, "w");
-    core_dump(f, cf);
+    core_finish(cf);
+    core_free(cf);
     fclose(f);
     close(pmem);
 
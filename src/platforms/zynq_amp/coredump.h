@@ -5,15 +5,27 @@
 #include <stdio.h>
 #include "elfcore.h"
 
-struct corefile *core_new(uint32_t machine);
-void core_add_ph(struct corefile *cf, uint32_t p_type, uint32_t p_vaddr,
-                 const void *data, uint32_t p_filesz);
+/* Streaming writer: core_new() starts the file, notes are buffered and
+ * flushed before the first segment, core_write_segment() emits data
+ * immediately and core_finish() appends the program header table. */
+struct corefile *core_new(FILE *f, uint32_t machine);
+/* Switch the output to the "zcore" compressed container (see
+ * coredump.c for the format); call before the first note/segment. */
+void core_compress(struct corefile *cf);
+void core_write_segment(struct corefile *cf, uint32_t p_type, uint32_t p_vaddr,
+                        const void *data, uint32_t p_filesz);
+/* As above, but zero runs found during the copy pass are elided from
+ * the file: segments split around large holes with p_memsz covering
+ * the gap, so mostly-zero RAM costs almost nothing on disk */
+void core_write_segment_sparse(struct corefile *cf, uint32_t p_type,
+                               uint32_t p_vaddr, const void *data,
+                               uint32_t p_memsz);
 void core_note_add(struct corefile *cf,
                    char *name, uint32_t type, const void *data, size_t len);
 void core_note_add_prstatus(struct corefile *cf,
-                            uint16_t signal, const uint32_t regs[18]);
+                            uint16_t signal, const uint32_t regs[19]);
 void core_note_add_arm_vfp(struct corefile *cf, const struct ARM_vfp *regs);
-void core_dump(FILE *f, struct corefile *cf);
+void core_finish(struct corefile *cf);
 void core_free(struct corefile *cf);
 
 #include "general.h"
@@ -2,6 +2,39 @@
 #include "target.h"
 #include "coredump.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* The CPU1 private watchdog's reset request latches in SLCR
+ * REBOOT_STATUS, so a firmware that stops kicking its dead-man shows
+ * up here even though it never takes a fault.  Faults themselves are
+ * caught in hardware: vector catch halts the core in the faulting
+ * state, so the poll below only delays the start of capture, never
+ * the freshness of the state captured. */
+#define SLCR_UNLOCK		(0x008 / 4)
+#define SLCR_UNLOCK_KEY		0xDF0D
+#define SLCR_REBOOT_STATUS	(0x258 / 4)
+#define REBOOT_STATUS_AWDT1_RST	(1 << 18)
+
+static volatile uint32_t *slcr;
+
+static void crash_watchdog_slcr_init(void)
+{
+	int pmem;
+
+	if (slcr)
+		return;
+	pmem = open("/dev/mem", O_RDWR | O_SYNC);
+	if (pmem < 0)
+		return;
+	slcr = mmap(NULL, 0x1000, PROT_READ | PROT_WRITE, MAP_SHARED,
+	            pmem, 0xf8000000);
+	if (slcr == MAP_FAILED)
+		slcr = NULL;
+	close(pmem);
+}
+
 static target *crash_watchdog_target;
 
 static void crash_watchdog_destroy(struct target_controller *tc, target *t)
@@ -18,11 +51,21 @@ static struct target_controller crash_watchdog_controller = {
 void crash_watchdog_poll(void)
 {
 	if (crash_watchdog_target == NULL) {
+		crash_watchdog_slcr_init();
 		crash_watchdog_target =
 			target_attach_n(1, &crash_watchdog_controller);
 		target_halt_resume(crash_watchdog_target, false);
 		printf("Crash watchdog connected\n");
 	}
+	/* Event-latched dead-man: halt the core the moment the watchdog
+	 * reset request appears, before the crash state churns */
+	if (slcr && (slcr[SLCR_REBOOT_STATUS] & REBOOT_STATUS_AWDT1_RST)) {
+		slcr[SLCR_UNLOCK] = SLCR_UNLOCK_KEY;
+		slcr[SLCR_REBOOT_STATUS] &= ~REBOOT_STATUS_AWDT1_RST;
+		piksi_log("Firmware watchdog expired! Halting for dump...");
+		printf("Watchdog expiry detected, halting for dump\n");
+		target_halt_request(crash_watchdog_target);
+	}
 	enum target_halt_reason reason = target_halt_poll(crash_watchdog_target, NULL);
 	switch (reason) {
 	case TARGET_HALT_RUNNING:
@@ -84,4 +84,17 @@ struct ARM_vfp { /* Note name 'LINUX' */
     uint32_t sr;
 } __attribute__((packed));
 
+/* Upper bound on the note segment this writer assembles: one header
+ * plus an 8-byte padded name per note, data sized by the register-set
+ * descriptors above and the two-word auxv.  Bump when adding notes. */
+#define CORE_NOTE_ARENA_SIZE \
+    (3 * (sizeof(struct Elf32_Note) + 8) + \
+     sizeof(struct ARM_prstatus) + sizeof(struct ARM_vfp) + \
+     2 * sizeof(uint32_t))
+
+/* Program header table bound: the three firmware sections plus the
+ * note, with headroom for the segments the sparse writer splits
+ * around large zero holes */
+#define CORE_PHDR_MAX 64
+
 #endif
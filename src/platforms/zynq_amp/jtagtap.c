@@ -18,12 +18,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Low level JTAG implementation using FT2232 with libftdi.
+/* JTAG bit-bang over the Zynq PS GPIO EMIO bank.
  *
- * Issues:
- * This code is old, rotten and unsupported.
- * Magic numbers everywhere.
- * Should share interface with swdptap.c or at least clean up...
+ * TCK, TMS and TDI change together in one MASK_DATA store per clock
+ * phase, and the weak generic sequence layer is overridden so whole
+ * scans run without per-bit call overhead.  TCK/TMS share the EMIO
+ * pins the SW-DP tap drives as SWCLK/SWDIO.
  */
 
 #include <stdio.h>
@@ -35,18 +35,148 @@
 #include "general.h"
 #include "jtagtap.h"
 
+/* EMIO pin allocation within bank 2 */
+#define TCK_BIT		(1 << 0)
+#define TMS_BIT		(1 << 1)
+#define TDI_BIT		(1 << 2)
+#define TDO_BIT		(1 << 3)
+#define RTCK_BIT	(1 << 4)
+
+static volatile uint32_t *gpio;
+
+#define gpio_reg(off)	gpio[(off) / 4]
+
+static inline void gpio_masked(uint16_t data)
+{
+	gpio_reg(ZYNQ_GPIO_MASK_DATA_2_LSW) =
+		((uint32_t)(uint16_t)~(TCK_BIT | TMS_BIT | TDI_BIT) << 16) |
+		data;
+}
+
+/* Adaptive clocking: when the target returns RTCK, every TCK edge
+ * holds until the echo comes back, so the shift rate tracks the
+ * target's debug clock even when it scales under us.  The spin bound
+ * covers the slowest clock we expect from a thermally throttled core;
+ * a pin that stops echoing within it drops us back to open-loop. */
+#define RTCK_SPIN	10000
+
+static bool rtck_active;
+
+static inline void rtck_sync(bool level)
+{
+	if (!rtck_active)
+		return;
+	for (unsigned i = 0; i < RTCK_SPIN; i++)
+		if (!!(gpio_reg(ZYNQ_GPIO_DATA_2_RO) & RTCK_BIT) == level)
+			return;
+	rtck_active = false;
+}
+
 int jtagtap_init(void)
 {
+	if (gpio)
+		return 0;
+
+	gpio = zynq_gpio_init();
+	if (!gpio)
+		return -1;
+
+	gpio_reg(ZYNQ_GPIO_DIRM_2) |= TCK_BIT | TMS_BIT | TDI_BIT;
+	gpio_reg(ZYNQ_GPIO_OEN_2) |= TCK_BIT | TMS_BIT | TDI_BIT;
+	gpio_reg(ZYNQ_GPIO_DIRM_2) &= ~(TDO_BIT | RTCK_BIT);
+	gpio_masked(0);
+
+	/* Probe for RTCK with a single pulse: an unrouted pin never
+	 * echoes and rtck_sync() latches back to open-loop by itself */
+	rtck_active = true;
+	gpio_masked(TCK_BIT);
+	rtck_sync(true);
+	gpio_masked(0);
+	rtck_sync(false);
+
+	jtagtap_soft_reset();
 	return 0;
 }
 
 void jtagtap_reset(void)
 {
+	jtagtap_soft_reset();
 }
 
-uint8_t jtagtap_next(uint8_t dTMS, uint8_t dTDO)
+uint8_t jtagtap_next(uint8_t dTMS, uint8_t dTDI)
 {
-	(void)dTMS; (void)dTDO;
-	return 0;
+	uint16_t d = (dTMS ? TMS_BIT : 0) | (dTDI ? TDI_BIT : 0);
+	uint8_t ret;
+
+	gpio_masked(d);
+	gpio_masked(d | TCK_BIT);
+	rtck_sync(true);
+	ret = !!(gpio_reg(ZYNQ_GPIO_DATA_2_RO) & TDO_BIT);
+	gpio_masked(d);
+	rtck_sync(false);
+	return ret;
+}
+
+/* Batched shifts overriding the weak generic layer */
+void jtagtap_tms_seq(uint32_t MS, int ticks)
+{
+	uint16_t d = TDI_BIT;
+
+	while (ticks--) {
+		d = TDI_BIT | ((MS & 1) ? TMS_BIT : 0);
+		gpio_masked(d);
+		rtck_sync(false);
+		gpio_masked(d | TCK_BIT);
+		rtck_sync(true);
+		MS >>= 1;
+	}
+	gpio_masked(d);
+	rtck_sync(false);
 }
 
+void jtagtap_tdi_tdo_seq(uint8_t *DO, const uint8_t final_tms,
+                         const uint8_t *DI, int ticks)
+{
+	uint8_t index = 1;
+	uint16_t d = 0;
+
+	while (ticks--) {
+		d = (*DI & index ? TDI_BIT : 0) |
+			((!ticks && final_tms) ? TMS_BIT : 0);
+		gpio_masked(d);
+		rtck_sync(false);
+		gpio_masked(d | TCK_BIT);
+		rtck_sync(true);
+		if (gpio_reg(ZYNQ_GPIO_DATA_2_RO) & TDO_BIT)
+			*DO |= index;
+		else
+			*DO &= ~index;
+		if (!(index <<= 1)) {
+			index = 1;
+			DI++; DO++;
+		}
+	}
+	gpio_masked(d);
+	rtck_sync(false);
+}
+
+void jtagtap_tdi_seq(const uint8_t final_tms, const uint8_t *DI, int ticks)
+{
+	uint8_t index = 1;
+	uint16_t d = 0;
+
+	while (ticks--) {
+		d = (*DI & index ? TDI_BIT : 0) |
+			((!ticks && final_tms) ? TMS_BIT : 0);
+		gpio_masked(d);
+		rtck_sync(false);
+		gpio_masked(d | TCK_BIT);
+		rtck_sync(true);
+		if (!(index <<= 1)) {
+			index = 1;
+			DI++;
+		}
+	}
+	gpio_masked(d);
+	rtck_sync(false);
+}
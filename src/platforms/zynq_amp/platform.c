@@ -55,6 +55,26 @@ CTI (connected to CPU1, PTM1) 0xF889_9000
 PTM0 (for CPU0) 0xF889_C000
 PTM1 (for CPU1) 0xF889_D000
  */
+/* PS GPIO controller, shared by the EMIO SWD and JTAG bit-bang */
+volatile uint32_t *zynq_gpio_init(void)
+{
+	static volatile uint32_t *gpio;
+
+	if (gpio)
+		return gpio;
+
+	int pmem = open("/dev/mem", O_RDWR | O_SYNC);
+	if (pmem < 0)
+		return NULL;
+	gpio = mmap(NULL, 0x1000, PROT_READ | PROT_WRITE, MAP_SHARED,
+	            pmem, 0xe000a000);
+	if (gpio == MAP_FAILED) {
+		close(pmem);
+		gpio = NULL;
+	}
+	return gpio;
+}
+
 void platform_init(void)
 {
 	printf("\nBlack Magic Probe (" FIRMWARE_VERSION ")\n");
@@ -65,10 +85,16 @@ void platform_init(void)
 	int pmem = open("/dev/mem", O_RDWR | O_SYNC);
 	volatile uint32_t *dbg = mmap(NULL, 0x1000, PROT_READ | PROT_WRITE, MAP_SHARED,
 	                            pmem, 0xf8892000);
+	/* CPU1's Cross Trigger Interface, for synchronized halt/restart */
+	volatile uint32_t *cti = mmap(NULL, 0x1000, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                            pmem, 0xf8899000);
+	if (cti == MAP_FAILED)
+		cti = NULL;	/* Fall back to plain DBGDRCR requests */
 	volatile uint32_t *slcr = mmap(NULL, 0x1000, PROT_READ | PROT_WRITE, MAP_SHARED,
 	                            pmem, 0xf8000000);
-    extern bool cortexa_probe(volatile uint32_t *dbg, volatile uint32_t *slcr);
-    cortexa_probe(dbg, slcr);
+    extern bool cortexa_probe(volatile uint32_t *dbg, volatile uint32_t *cti,
+                              volatile uint32_t *slcr, int pmem);
+    cortexa_probe(dbg, cti, slcr, pmem);
 
 	assert(gdb_if_init() == 0);
 }
@@ -97,6 +123,20 @@ uint32_t platform_time_ms(void)
 	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
 }
 
+uint32_t platform_time_us(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+/* Host RAM is plentiful: let the target layer buffer whole flash
+ * images and hand the driver maximal runs */
+size_t platform_flash_buf_limit(void)
+{
+	return 0x100000;
+}
+
 void piksi_log(char *fmt, ...)
 {
 	FILE *piksi_log = popen("/usr/bin/sbp_log --error", "w");
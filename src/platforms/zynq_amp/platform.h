@@ -25,6 +25,12 @@
 
 #define PLATFORM_HAS_DEBUG
 
+/* Hosted build: take large packets so a firmware load needs an order of
+ * magnitude fewer round trips than the 1K default allows. */
+#define GDB_PACKET_BUFFER_SIZE	(64*1024)
+/* CRC verification reads in packet-buffer sized chunks */
+#define CRC32_BUFFER_SIZE	(64*1024)
+
 #define SET_RUN_STATE(state)
 #define SET_IDLE_STATE(state)
 #define SET_ERROR_STATE(state)
@@ -36,4 +42,13 @@ static inline int platform_hwversion(void)
 
 void piksi_log(char *fmt, ...);
 
+/* Memory-mapped PS GPIO controller for the EMIO bit-bang taps */
+volatile uint32_t *zynq_gpio_init(void);
+
+/* Register offsets for EMIO bank 2 (GPIO 54..85, routed to the PL) */
+#define ZYNQ_GPIO_MASK_DATA_2_LSW	0x010
+#define ZYNQ_GPIO_DATA_2_RO		0x068
+#define ZYNQ_GPIO_DIRM_2		0x284
+#define ZYNQ_GPIO_OEN_2			0x288
+
 #endif
@@ -18,8 +18,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Quick hack for bit-banging SW-DP interface over FT2232.
- * Intended as proof of concept, not for production.
+/* SW-DP bit-bang over the Zynq PS GPIO EMIO bank.
+ *
+ * The MASK_DATA registers update SWCLK and SWDIO together in one
+ * store, and the weak generic sequence layer is overridden so a whole
+ * 32-bit+parity shift costs two APB crossings per bit with no call
+ * overhead, instead of several per bit through the bit primitives.
  */
 
 #include <stdio.h>
@@ -28,19 +32,124 @@
 #include "general.h"
 #include "swdptap.h"
 
+/* EMIO pin allocation within bank 2 */
+#define SWCLK_BIT	(1 << 0)
+#define SWDIO_BIT	(1 << 1)
+
+static volatile uint32_t *gpio;
+
+#define gpio_reg(off)	gpio[(off) / 4]
+
+/* One store updates both lines: the upper halfword masks off every
+ * bank bit the write should not touch */
+static inline void gpio_masked(uint16_t data)
+{
+	gpio_reg(ZYNQ_GPIO_MASK_DATA_2_LSW) =
+		((uint32_t)(uint16_t)~(SWCLK_BIT | SWDIO_BIT) << 16) | data;
+}
+
+static void swdio_drive(bool drive)
+{
+	static bool driving = true;
+
+	if (drive == driving)
+		return;
+	driving = drive;
+
+	if (drive) {
+		gpio_reg(ZYNQ_GPIO_DIRM_2) |= SWDIO_BIT;
+		gpio_reg(ZYNQ_GPIO_OEN_2) |= SWDIO_BIT;
+	} else {
+		gpio_reg(ZYNQ_GPIO_OEN_2) &= ~SWDIO_BIT;
+		gpio_reg(ZYNQ_GPIO_DIRM_2) &= ~SWDIO_BIT;
+	}
+}
 
 int swdptap_init(void)
 {
+	if (gpio)
+		return 0;
+
+	gpio = zynq_gpio_init();
+	if (!gpio)
+		return -1;
+
+	gpio_reg(ZYNQ_GPIO_DIRM_2) |= SWCLK_BIT | SWDIO_BIT;
+	gpio_reg(ZYNQ_GPIO_OEN_2) |= SWCLK_BIT | SWDIO_BIT;
+	gpio_masked(0);
 	return 0;
 }
 
 bool swdptap_bit_in(void)
 {
-	return 0;
+	bool val;
+
+	swdio_drive(false);
+	val = gpio_reg(ZYNQ_GPIO_DATA_2_RO) & SWDIO_BIT;
+	gpio_masked(SWCLK_BIT);
+	gpio_masked(0);
+	return val;
 }
 
 void swdptap_bit_out(bool val)
 {
-	(void)val;
+	uint16_t d = val ? SWDIO_BIT : 0;
+
+	swdio_drive(true);
+	gpio_masked(d);
+	gpio_masked(d | SWCLK_BIT);
+	gpio_masked(d);
+}
+
+/* Batched shifts overriding the weak generic layer */
+uint32_t swdptap_seq_in(int ticks)
+{
+	uint32_t index = 1;
+	uint32_t ret = 0;
+
+	swdio_drive(false);
+	while (ticks--) {
+		if (gpio_reg(ZYNQ_GPIO_DATA_2_RO) & SWDIO_BIT)
+			ret |= index;
+		index <<= 1;
+		gpio_masked(SWCLK_BIT);
+		gpio_masked(0);
+	}
+	return ret;
+}
+
+bool swdptap_seq_in_parity(uint32_t *ret, int ticks)
+{
+	uint32_t data = swdptap_seq_in(ticks);
+	int parity = __builtin_parity(data);
+
+	if (gpio_reg(ZYNQ_GPIO_DATA_2_RO) & SWDIO_BIT)
+		parity ^= 1;
+	gpio_masked(SWCLK_BIT);
+	gpio_masked(0);
+
+	*ret = data;
+	return parity;
+}
+
+void swdptap_seq_out(uint32_t MS, int ticks)
+{
+	uint16_t d = 0;
+
+	swdio_drive(true);
+	while (ticks--) {
+		d = (MS & 1) ? SWDIO_BIT : 0;
+		gpio_masked(d);
+		gpio_masked(d | SWCLK_BIT);
+		MS >>= 1;
+	}
+	gpio_masked(d);
 }
 
+void swdptap_seq_out_parity(uint32_t MS, int ticks)
+{
+	int parity = __builtin_parity(MS);
+
+	swdptap_seq_out(MS, ticks);
+	swdptap_bit_out(parity);
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Statistical PC-sampling profiler.  While the target runs, the
+ * halt-poll loops call profile_poll() which reads the Cortex-M DWT
+ * PCSR register -- a non-intrusive snapshot of the program counter --
+ * at the requested rate and streams the raw samples over the trace
+ * endpoint as little-endian 32-bit words.  scripts/pcsamp.py folds a
+ * capture into a hot-spot histogram.
+ */
+
+#include "general.h"
+#include "profile.h"
+
+#ifdef PLATFORM_HAS_TRACESWO
+
+#include "traceswo.h"
+
+/* DWT Program Counter Sample Register.  Reads 0xFFFFFFFF while the
+ * core is halted or sleeping; the decoder drops those. */
+#define DWT_PCSR	0xE000101C
+
+/* Batch samples into trace-endpoint writes */
+#define SAMPLE_BATCH	64
+
+static uint32_t sample_interval_ms;	/* 0 = profiler off */
+static uint32_t sample_due_ms;
+static uint32_t sample_buf[SAMPLE_BATCH];
+static unsigned sample_fill;
+static uint32_t sample_count;
+
+bool profile_start(uint32_t hz)
+{
+	if ((hz == 0) || (hz > 1000))
+		return false;
+	sample_interval_ms = 1000 / hz;
+	sample_due_ms = platform_time_ms() + sample_interval_ms;
+	sample_fill = 0;
+	sample_count = 0;
+	return true;
+}
+
+void profile_stop(void)
+{
+	if (sample_fill)
+		trace_dump_write((uint8_t *)sample_buf, sample_fill * 4);
+	sample_fill = 0;
+	sample_interval_ms = 0;
+}
+
+bool profile_active(void)
+{
+	return sample_interval_ms != 0;
+}
+
+uint32_t profile_sample_count(void)
+{
+	return sample_count;
+}
+
+void profile_poll(target *t)
+{
+	uint32_t pc;
+
+	if (!sample_interval_ms || !t)
+		return;
+	if ((int32_t)(platform_time_ms() - sample_due_ms) < 0)
+		return;
+	sample_due_ms += sample_interval_ms;
+	/* If polling fell behind by more than a period, resync rather
+	 * than burst-sampling to catch up */
+	if ((int32_t)(platform_time_ms() - sample_due_ms) > 0)
+		sample_due_ms = platform_time_ms() + sample_interval_ms;
+
+	if (target_mem_read(t, &pc, DWT_PCSR, 4))
+		return;
+	sample_buf[sample_fill++] = pc;
+	sample_count++;
+	if (sample_fill == SAMPLE_BATCH) {
+		/* Host stopped draining: shut the profiler down rather
+		 * than stall the poll loop */
+		if (!trace_dump_write((uint8_t *)sample_buf,
+		                      sizeof(sample_buf)))
+			sample_interval_ms = 0;
+		sample_fill = 0;
+	}
+}
+
+#endif
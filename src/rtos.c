@@ -0,0 +1,229 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2019  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* FreeRTOS thread awareness.
+ *
+ * Without this, gdb walks the scheduler's task lists itself with
+ * dozens of 4-byte `m' packets per stop.  Here the walk runs on the
+ * probe over the normal bulk memory read path and the result is one
+ * XML annex.  Symbol addresses come from gdb's qSymbol exchange once
+ * per session.
+ *
+ * The TCB and list offsets below are the stock 32-bit FreeRTOS layout
+ * (no MPU wrappers): ports that reorder the TCB will misreport names
+ * and priorities but cannot fault the probe, since every pointer is
+ * fetched with checked reads.
+ */
+
+#include "general.h"
+#include "rtos.h"
+
+/* struct tskTCB */
+#define TCB_TOP_OF_STACK	0  /* pxTopOfStack, always first */
+#define TCB_STATE_LIST_ITEM	4  /* xStateListItem */
+#define TCB_PRIORITY		44 /* uxPriority */
+#define TCB_NAME		52 /* pcTaskName */
+#define TCB_NAME_LEN		16 /* configMAX_TASK_NAME_LEN default */
+#define TCB_READ_LEN		(TCB_NAME + TCB_NAME_LEN)
+
+/* struct xLIST */
+#define LIST_NUM_ITEMS		0  /* uxNumberOfItems */
+#define LIST_END_NEXT		12 /* xListEnd.pxNext */
+#define LIST_SIZE		20
+
+/* struct xLIST_ITEM */
+#define LIST_ITEM_NEXT		4  /* pxNext */
+#define LIST_ITEM_OWNER		12 /* pvOwner */
+#define LIST_ITEM_SIZE		20
+
+/* Ready lists are an array indexed by priority; walk no further than
+ * this many in case uxCurrentNumberOfTasks is garbage */
+#define MAX_PRIORITIES		32
+#define MAX_THREADS		16
+
+enum rtos_symbol {
+	SYM_CURRENT_TCB = 0,
+	SYM_READY_LISTS,
+	SYM_NUM_TASKS,
+	SYM_DELAYED_LIST1,
+	SYM_DELAYED_LIST2,
+	SYM_SUSPENDED_LIST,
+	SYM_COUNT,
+	/* Symbols below this point may be absent (config-dependent) */
+	SYM_OPTIONAL = SYM_DELAYED_LIST1,
+};
+
+static const char *const symbol_names[SYM_COUNT] = {
+	"pxCurrentTCB",
+	"pxReadyTasksLists",
+	"uxCurrentNumberOfTasks",
+	"xDelayedTaskList1",
+	"xDelayedTaskList2",
+	"xSuspendedTaskList",
+};
+
+static uint32_t symbol_addr[SYM_COUNT];
+static bool symbol_answered[SYM_COUNT];
+
+static char threads_xml[1024];
+
+void rtos_reset(void)
+{
+	memset(symbol_addr, 0, sizeof(symbol_addr));
+	memset(symbol_answered, 0, sizeof(symbol_answered));
+	threads_xml[0] = 0;
+}
+
+void rtos_symbol_set(const char *name, uint32_t addr)
+{
+	for (int i = 0; i < SYM_COUNT; i++)
+		if (!strcmp(name, symbol_names[i])) {
+			symbol_addr[i] = addr;
+			symbol_answered[i] = true;
+			return;
+		}
+}
+
+const char *rtos_symbol_wanted(void)
+{
+	for (int i = 0; i < SYM_COUNT; i++)
+		if (!symbol_answered[i])
+			return symbol_names[i];
+	return NULL;
+}
+
+bool rtos_available(void)
+{
+	for (int i = 0; i < SYM_OPTIONAL; i++)
+		if (!symbol_addr[i])
+			return false;
+	return true;
+}
+
+uint32_t rtos_current_thread(target *t)
+{
+	uint32_t tcb;
+	if (!symbol_addr[SYM_CURRENT_TCB] ||
+	    target_mem_read(t, &tcb, symbol_addr[SYM_CURRENT_TCB],
+	                    sizeof(tcb)))
+		return 0;
+	return tcb;
+}
+
+/* Reconstruct the register file of a switched-out task from the
+ * context frame its port layer pushed: the Cortex-M ports stack r4-r11
+ * below the hardware exception frame (r0-r3, r12, lr, pc, xpsr) and
+ * leave pxTopOfStack pointing at the bottom of it.  Registers the
+ * frame does not hold (msp, the packed special word, any FP state)
+ * read as zero. */
+bool rtos_thread_regs(target *t, uint32_t tcb, uint32_t *regs, size_t count)
+{
+	uint32_t sp, frame[16];
+
+	if (count < 19)	/* through psp in the g-packet layout */
+		return false;
+	if (target_mem_read(t, &sp, tcb + TCB_TOP_OF_STACK, sizeof(sp)))
+		return false;
+	if (target_mem_read(t, frame, sp, sizeof(frame)))
+		return false;
+	memset(regs, 0, count * 4);
+	memcpy(&regs[4], &frame[0], 8 * 4);	/* r4-r11 */
+	regs[0] = frame[8];			/* r0 */
+	regs[1] = frame[9];
+	regs[2] = frame[10];
+	regs[3] = frame[11];
+	regs[12] = frame[12];
+	regs[14] = frame[13];			/* lr */
+	regs[15] = frame[14];			/* pc */
+	regs[16] = frame[15];			/* xpsr */
+	/* sp as the exception return will leave it once the hardware
+	 * frame is un-stacked, honouring the alignment-pad bit; tasks
+	 * run on the process stack, so psp mirrors it */
+	sp += 16 * 4;
+	if (regs[16] & (1 << 9))
+		sp += 4;
+	regs[13] = sp;
+	regs[18] = sp;
+	return true;
+}
+
+/* Append the tasks on one scheduler list to the XML render.  Each task
+ * costs two bulk reads: its list item and the head of its TCB. */
+static size_t walk_list(target *t, uint32_t list, char *buf, size_t len,
+                        size_t pos, uint32_t cur_tcb, unsigned *remaining)
+{
+	uint8_t node[LIST_SIZE];
+	uint8_t tcb[TCB_READ_LEN];
+	uint32_t count, item;
+
+	if (target_mem_read(t, node, list, LIST_SIZE))
+		return pos;
+	memcpy(&count, &node[LIST_NUM_ITEMS], 4);
+	memcpy(&item, &node[LIST_END_NEXT], 4);
+
+	while (count-- && *remaining) {
+		if (target_mem_read(t, node, item, LIST_ITEM_SIZE))
+			break;
+		uint32_t owner, prio;
+		memcpy(&owner, &node[LIST_ITEM_OWNER], 4);
+		memcpy(&item, &node[LIST_ITEM_NEXT], 4);
+		if (target_mem_read(t, tcb, owner, TCB_READ_LEN))
+			break;
+		memcpy(&prio, &tcb[TCB_PRIORITY], 4);
+		tcb[TCB_NAME + TCB_NAME_LEN - 1] = 0;
+		pos += snprintf(buf + pos, (len > pos) ? len - pos : 0,
+		                "<thread id=\"%" PRIx32 "\">%s%s [prio %"
+		                PRIu32 "]</thread>",
+		                owner, (owner == cur_tcb) ? "* " : "",
+		                (char *)&tcb[TCB_NAME], prio);
+		(*remaining)--;
+	}
+	return pos;
+}
+
+const char *rtos_threads_xml(target *t, bool refresh)
+{
+	if (!refresh && threads_xml[0])
+		return threads_xml;
+
+	size_t pos = snprintf(threads_xml, sizeof(threads_xml),
+	                      "<?xml version=\"1.0\"?><threads>");
+
+	if (rtos_available()) {
+		uint32_t num_tasks = 0, cur_tcb = rtos_current_thread(t);
+		target_mem_read(t, &num_tasks, symbol_addr[SYM_NUM_TASKS],
+		                sizeof(num_tasks));
+		unsigned remaining = MIN(num_tasks, MAX_THREADS);
+
+		for (unsigned i = 0; (i < MAX_PRIORITIES) && remaining; i++)
+			pos = walk_list(t, symbol_addr[SYM_READY_LISTS] +
+			                i * LIST_SIZE, threads_xml,
+			                sizeof(threads_xml), pos, cur_tcb,
+			                &remaining);
+		for (int s = SYM_OPTIONAL; s < SYM_COUNT; s++)
+			if (symbol_addr[s] && remaining)
+				pos = walk_list(t, symbol_addr[s], threads_xml,
+				                sizeof(threads_xml), pos,
+				                cur_tcb, &remaining);
+	}
+
+	snprintf(threads_xml + MIN(pos, sizeof(threads_xml) - 11),
+	         sizeof(threads_xml), "</threads>");
+	return threads_xml;
+}
@@ -0,0 +1,455 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2011  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements the SW-DP specific functions of the
+ * ARM Debug Interface v5 Architecure Specification, ARM doc IHI0031A.
+ */
+
+#include "general.h"
+#include "exception.h"
+#include "adiv5.h"
+#include "swdptap.h"
+#include "target.h"
+#include "target_internal.h"
+
+#define SWDP_ACK_OK    0x01
+#define SWDP_ACK_WAIT  0x02
+#define SWDP_ACK_FAULT 0x04
+
+static uint32_t adiv5_swdp_read(ADIv5_DP_t *dp, uint16_t addr);
+
+static uint32_t adiv5_swdp_error(ADIv5_DP_t *dp);
+
+static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
+				      uint16_t addr, uint32_t value);
+
+static void adiv5_swdp_low_read_block(ADIv5_DP_t *dp, uint16_t addr,
+				      uint32_t *dest, size_t words);
+
+static uint32_t adiv5_swdp_low_write_block(ADIv5_DP_t *dp, uint16_t addr,
+					   const uint32_t *src, size_t words);
+
+static void adiv5_swdp_abort(ADIv5_DP_t *dp, uint32_t abort);
+
+/* Build the 8-bit request for a DP/AP register access:
+ * start, APnDP, RnW, A[3:2], parity, stop, park. */
+static uint32_t swdp_make_request(uint8_t RnW, uint16_t addr)
+{
+	bool APnDP = addr & ADIV5_APnDP;
+	uint32_t request = 0x81;
+
+	if(APnDP) request ^= 0x22;
+	if(RnW)   request ^= 0x24;
+
+	addr &= 0xC;
+	request |= (addr << 1) & 0x18;
+	if((addr == 4) || (addr == 8))
+		request ^= 0x20;
+
+	return request;
+}
+
+/* TARGETSEL value currently selected on the wire; 0 on single-drop */
+static uint32_t swdp_wire_selected;
+
+/* 50+ clocks with SWDIO high then a few idle cycles; on SWDv2 this
+ * leaves every DP on the wire deselected and listening for TARGETSEL */
+static void swdp_line_reset(void)
+{
+	swdptap_seq_out(0xFFFFFFFF, 32);
+	swdptap_seq_out(0xFFFFFFFF, 18);
+	swdptap_seq_out(0, 4);
+}
+
+/* Write TARGETSEL in the selection window after a line reset.  No DP
+ * drives the ack turnaround of this request, so the three ack bits are
+ * clocked out and ignored. */
+static void swdp_targetsel(uint32_t id)
+{
+	swdptap_seq_out(swdp_make_request(ADIV5_LOW_WRITE,
+	                                  ADIV5_DP_TARGETSEL), 8);
+	(void)swdptap_seq_in(3);
+	swdptap_seq_out_parity(id, 32);
+}
+
+/* Reselect the wire for this DP if another one owns it.  Called on the
+ * low access paths, so halt polls and memory accesses can interleave
+ * across the targets of one multi-drop wire without the callers
+ * managing selection. */
+static void swdp_select(ADIv5_DP_t *dp)
+{
+	uint32_t idcode;
+
+	if ((dp->targetsel == 0) || (dp->targetsel == swdp_wire_selected))
+		return;
+	swdp_line_reset();
+	swdp_targetsel(dp->targetsel);
+	/* The part wants its IDCODE read before any other access */
+	swdptap_seq_out(0xA5, 8);
+	if (swdptap_seq_in(3) == SWDP_ACK_OK)
+		swdptap_seq_in_parity(&idcode, 32);
+	/* The SELECT shadow no longer reflects the hardware */
+	dp->select_valid = false;
+	swdp_wire_selected = dp->targetsel;
+}
+
+/* Read the SW-DP IDCODE register to synchronise.
+ * This could be done with adiv_swdp_low_access(), but this doesn't
+ * allow the ack to be checked here. */
+static bool swdp_sync_idcode(ADIv5_DP_t *dp)
+{
+	swdptap_seq_out(0xA5, 8);
+	if (swdptap_seq_in(3) != SWDP_ACK_OK)
+		return false;
+	return !swdptap_seq_in_parity(&dp->idcode, 32);
+}
+
+/* The DP of the last successful scan.  Valid only while target_list
+ * still holds the targets probed from it: the structures are freed as
+ * a unit when the list goes. */
+static ADIv5_DP_t *swdp_last_dp;
+
+int adiv5_swdp_scan(void)
+{
+	bool synced = false;
+
+	if (keep_powered && swdp_last_dp && target_list) {
+		/* Debug power was never released, so the previous DP, AP
+		 * and target structures are still good if the same part is
+		 * still on the wire.  A line reset and one DPIDR read
+		 * establish that; the AP discovery and ROM table walk are
+		 * skipped entirely. */
+		ADIv5_DP_t check = {0};
+
+		if (swdptap_init())
+			return -1;
+		swdp_line_reset();
+		if (swdp_sync_idcode(&check) &&
+		    (check.idcode == swdp_last_dp->idcode)) {
+			/* The line reset invalidated the SELECT shadow */
+			swdp_last_dp->select_valid = false;
+			adiv5_swdp_error(swdp_last_dp);
+			return 1;
+		}
+		/* Silent wire or a different part: full scan */
+		swdp_last_dp = NULL;
+	}
+
+	swdp_last_dp = NULL;
+	target_list_free();
+	ADIv5_DP_t *dp = (void*)calloc(1, sizeof(*dp));
+
+	if (swdptap_init())
+		return -1;
+
+	if (attach_fast) {
+		/* The wire is expected to be in SWD mode already, so the
+		 * JTAG escape sequence is dead time: try the minimum line
+		 * reset the spec requires and fall through to the full
+		 * switch sequence only if the DP stays silent. */
+		swdp_line_reset();
+		synced = swdp_sync_idcode(dp);
+	}
+
+	if (!synced) {
+		/* Switch from JTAG to SWD mode */
+		swdptap_seq_out(0xFFFFFFFF, 16);
+		swdptap_seq_out(0xFFFFFFFF, 32);
+		swdptap_seq_out(0xFFFFFFFF, 18);
+		swdptap_seq_out(0xE79E, 16); /* 0b0111100111100111 */
+		swdptap_seq_out(0xFFFFFFFF, 32);
+		swdptap_seq_out(0xFFFFFFFF, 18);
+		swdptap_seq_out(0, 16);
+
+		synced = swdp_sync_idcode(dp);
+	}
+
+	if (!synced) {
+		DEBUG("\n");
+		free(dp);
+		return -1;
+	}
+
+	dp->dp_read = adiv5_swdp_read;
+	dp->error = adiv5_swdp_error;
+	dp->low_access = adiv5_swdp_low_access;
+	dp->low_read_block = adiv5_swdp_low_read_block;
+	dp->low_write_block = adiv5_swdp_low_write_block;
+	dp->abort = adiv5_swdp_abort;
+
+	adiv5_swdp_error(dp);
+	adiv5_dp_init(dp);
+
+	if (target_list)
+		swdp_last_dp = dp;
+	return target_list?1:0;
+}
+
+/* One-handshake autodetecting scan: bring the wire up once and try SWD
+ * first -- failure is cheap, a line reset and an unanswered IDCODE
+ * read.  On silence the wire is already in a known state from the SWJ
+ * switch sequence, so it is steered straight back to JTAG and the
+ * chain is scanned on the same electrical session, instead of a
+ * second full reset/ID/timeout round trip. */
+int swj_scan(void)
+{
+	int devs = adiv5_swdp_scan();
+	if (devs > 0)
+		return devs;
+
+	/* SWD-to-JTAG select: line reset then 0xE73C, LSB first */
+	swdptap_seq_out(0xFFFFFFFF, 32);
+	swdptap_seq_out(0xFFFFFFFF, 18);
+	swdptap_seq_out(0xE73C, 16);
+
+	return jtag_scan(NULL);
+}
+
+/* Scan a multi-drop (SWDv2) wire.  Each entry of targetsel addresses
+ * one DP, in the DLPIDR/TARGETID instance format.  Single-drop
+ * scanning is untouched; after the scan reselection is automatic on
+ * every access, so one probe serves all the MCUs sharing the wire. */
+int adiv5_swdp_scan_multidrop(const uint32_t *targetsel, size_t count)
+{
+	swdp_last_dp = NULL;
+	target_list_free();
+
+	if (swdptap_init())
+		return -1;
+
+	/* Switch from JTAG to SWD mode */
+	swdptap_seq_out(0xFFFFFFFF, 16);
+	swdptap_seq_out(0xFFFFFFFF, 32);
+	swdptap_seq_out(0xFFFFFFFF, 18);
+	swdptap_seq_out(0xE79E, 16); /* 0b0111100111100111 */
+
+	for (size_t i = 0; i < count; i++) {
+		ADIv5_DP_t *dp = (void*)calloc(1, sizeof(*dp));
+
+		dp->targetsel = targetsel[i];
+		swdp_line_reset();
+		swdp_targetsel(dp->targetsel);
+		swdp_wire_selected = dp->targetsel;
+
+		if (!swdp_sync_idcode(dp)) {
+			DEBUG("No DP answers TARGETSEL %08X\n",
+			      (unsigned)targetsel[i]);
+			free(dp);
+			continue;
+		}
+
+		dp->dp_read = adiv5_swdp_read;
+		dp->error = adiv5_swdp_error;
+		dp->low_access = adiv5_swdp_low_access;
+		dp->low_read_block = adiv5_swdp_low_read_block;
+		dp->low_write_block = adiv5_swdp_low_write_block;
+		dp->abort = adiv5_swdp_abort;
+
+		adiv5_swdp_error(dp);
+		adiv5_dp_init(dp);
+	}
+
+	return target_list?1:0;
+}
+
+static uint32_t adiv5_swdp_read(ADIv5_DP_t *dp, uint16_t addr)
+{
+	if (addr & ADIV5_APnDP) {
+		adiv5_dp_low_access(dp, ADIV5_LOW_READ, addr, 0);
+		return adiv5_dp_low_access(dp, ADIV5_LOW_READ,
+		                           ADIV5_DP_RDBUFF, 0);
+	} else {
+		return adiv5_swdp_low_access(dp, ADIV5_LOW_READ, addr, 0);
+	}
+}
+
+static uint32_t adiv5_swdp_error(ADIv5_DP_t *dp)
+{
+	uint32_t err, clr = 0;
+
+	err = adiv5_swdp_read(dp, ADIV5_DP_CTRLSTAT) &
+		(ADIV5_DP_CTRLSTAT_STICKYORUN | ADIV5_DP_CTRLSTAT_STICKYCMP |
+		ADIV5_DP_CTRLSTAT_STICKYERR | ADIV5_DP_CTRLSTAT_WDATAERR);
+
+	if(err & ADIV5_DP_CTRLSTAT_STICKYORUN)
+		clr |= ADIV5_DP_ABORT_ORUNERRCLR;
+	if(err & ADIV5_DP_CTRLSTAT_STICKYCMP)
+		clr |= ADIV5_DP_ABORT_STKCMPCLR;
+	if(err & ADIV5_DP_CTRLSTAT_STICKYERR)
+		clr |= ADIV5_DP_ABORT_STKERRCLR;
+	if(err & ADIV5_DP_CTRLSTAT_WDATAERR)
+		clr |= ADIV5_DP_ABORT_WDERRCLR;
+
+	adiv5_dp_write(dp, ADIV5_DP_ABORT, clr);
+	dp->fault = 0;
+
+	return err;
+}
+
+static uint32_t adiv5_swdp_low_access(ADIv5_DP_t *dp, uint8_t RnW,
+				      uint16_t addr, uint32_t value)
+{
+	bool APnDP = addr & ADIV5_APnDP;
+	uint32_t request = swdp_make_request(RnW, addr);
+	uint32_t response = 0;
+	bool parity_err = false;
+	uint32_t ack;
+	platform_timeout timeout;
+
+	if(APnDP && dp->fault) return 0;
+
+	swdp_select(dp);
+
+	platform_timeout_set(&timeout, 2000);
+	do {
+		dp->stats_xfers++;
+		if(RnW)
+			ack = swdptap_transaction_read(request, &response,
+			                               &parity_err);
+		else
+			ack = swdptap_transaction_write(request, value);
+		if (ack == SWDP_ACK_WAIT)
+			dp->stats_waits++;
+	} while (ack == SWDP_ACK_WAIT && !platform_timeout_is_expired(&timeout));
+
+	if (ack == SWDP_ACK_WAIT)
+		raise_exception(EXCEPTION_TIMEOUT, "SWDP ACK timeout");
+
+	if(ack == SWDP_ACK_FAULT) {
+		dp->fault = 1;
+		return 0;
+	}
+
+	if(ack != SWDP_ACK_OK)
+		raise_exception(EXCEPTION_ERROR, "SWDP invalid ACK");
+
+	if(RnW && parity_err) {
+		/* A parity error usually means SWCLK is faster than this
+		 * target can manage; back the clock off and retry once
+		 * before giving up. */
+		swdptap_clk_divider += 4;
+		ack = swdptap_transaction_read(request, &response, &parity_err);
+		if ((ack != SWDP_ACK_OK) || parity_err)
+			raise_exception(EXCEPTION_ERROR, "SWDP Parity error");
+	}
+
+	return response;
+}
+
+/* Stream 'words' posted reads of an AP register.  On SW-DP an AP read
+ * returns the data of the previous access in its data phase, so the
+ * request/ack/data cadence never breaks: the first data phase is
+ * clocked and discarded, and the final word is drained from RDBUFF.
+ * The request bytes and the timeout are set up once for the whole run
+ * rather than per word as in low_access. */
+static void adiv5_swdp_low_read_block(ADIv5_DP_t *dp, uint16_t addr,
+				      uint32_t *dest, size_t words)
+{
+	uint32_t request = swdp_make_request(ADIV5_LOW_READ, addr);
+	uint32_t rdbuff = swdp_make_request(ADIV5_LOW_READ, ADIV5_DP_RDBUFF);
+	uint32_t data;
+	bool parity_err = false;
+	uint32_t ack;
+	platform_timeout timeout;
+
+	if(dp->fault) return;
+
+	swdp_select(dp);
+
+	platform_timeout_set(&timeout, 2000);
+	for (size_t i = 0; i <= words; i++) {
+		do {
+			dp->stats_xfers++;
+			ack = swdptap_transaction_read(
+				(i < words) ? request : rdbuff,
+				&data, &parity_err);
+			if (ack == SWDP_ACK_WAIT)
+				dp->stats_waits++;
+		} while (ack == SWDP_ACK_WAIT &&
+		         !platform_timeout_is_expired(&timeout));
+
+		if (ack == SWDP_ACK_WAIT)
+			raise_exception(EXCEPTION_TIMEOUT, "SWDP ACK timeout");
+
+		if(ack == SWDP_ACK_FAULT) {
+			dp->fault = 1;
+			return;
+		}
+
+		if(ack != SWDP_ACK_OK)
+			raise_exception(EXCEPTION_ERROR, "SWDP invalid ACK");
+
+		if(parity_err)
+			raise_exception(EXCEPTION_ERROR, "SWDP Parity error");
+
+		if (i)
+			dest[i - 1] = data;
+	}
+}
+
+/* Stream 'words' writes of an AP register back-to-back with overrun
+ * detection enabled.  The per-transaction WAIT handshake is skipped:
+ * with ORUNDETECT set the DP drops whatever it cannot accept and
+ * latches STICKYORUN, and the data phase is driven regardless so the
+ * stream stays framed.  Sticky errors are swept once at the end via
+ * CTRLSTAT/ABORT; on a dirty burst the write count is unknowable, so
+ * the swept mask is returned for the caller to replay the run through
+ * the handshaked path. */
+static uint32_t adiv5_swdp_low_write_block(ADIv5_DP_t *dp, uint16_t addr,
+					   const uint32_t *src, size_t words)
+{
+	uint32_t request = swdp_make_request(ADIV5_LOW_WRITE, addr);
+	uint32_t ctrlstat, err;
+	bool acked = true;
+
+	if(dp->fault) return dp->fault;
+
+	swdp_select(dp);
+
+	ctrlstat = adiv5_swdp_read(dp, ADIV5_DP_CTRLSTAT);
+	adiv5_swdp_low_access(dp, ADIV5_LOW_WRITE, ADIV5_DP_CTRLSTAT,
+	                      ctrlstat | ADIV5_DP_CTRLSTAT_ORUNDETECT);
+
+	for (size_t i = 0; i < words; i++) {
+		dp->stats_xfers++;
+		swdptap_seq_out(request, 8);
+		if (swdptap_seq_in(3) != SWDP_ACK_OK)
+			acked = false;
+		swdptap_seq_out_parity(src[i], 32);
+	}
+
+	err = adiv5_swdp_error(dp);
+	/* Overrun detection changes the WAIT semantics of every access,
+	 * so it must not leak past the burst */
+	adiv5_swdp_low_access(dp, ADIV5_LOW_WRITE, ADIV5_DP_CTRLSTAT,
+	                      ctrlstat & ~ADIV5_DP_CTRLSTAT_ORUNDETECT);
+
+	/* A non-OK ack with clean sticky flags still means dropped
+	 * writes; make sure the caller sees it */
+	if (!acked && !err)
+		err = ADIV5_DP_CTRLSTAT_STICKYORUN;
+	return err;
+}
+
+static void adiv5_swdp_abort(ADIv5_DP_t *dp, uint32_t abort)
+{
+	adiv5_dp_write(dp, ADIV5_DP_ABORT, abort);
+}
+
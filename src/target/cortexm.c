@@ -0,0 +1,1778 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2012  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This file implements debugging functionality specific to ARM
+ * the Cortex-M3 core.  This should be generic to ARMv7-M as it is
+ * implemented according to the "ARMv7-M Architectue Reference Manual",
+ * ARM doc DDI0403C.
+ *
+ * Also supports Cortex-M0 / ARMv6-M
+ */
+#include "general.h"
+#include "exception.h"
+#include "adiv5.h"
+#include "target.h"
+#include "target_internal.h"
+#include "cortexm.h"
+#include "swdptap.h"
+#include "flashstub/ring.h"
+
+#include <stddef.h>
+#include <unistd.h>
+
+static const char cortexm_driver_str[] = "ARM Cortex-M";
+
+static bool cortexm_vector_catch(target *t, int argc, char *argv[]);
+static bool cortexm_dp_stats(target *t, int argc, char *argv[]);
+static bool cortexm_swd_divider(target *t, int argc, char *argv[]);
+static bool cortexm_perf(target *t, int argc, char *argv[]);
+
+const struct command_s cortexm_cmd_list[] = {
+	{"vector_catch", (cmd_handler)cortexm_vector_catch, "Catch exception vectors"},
+	{"dp_stats", (cmd_handler)cortexm_dp_stats, "Display and reset DP transaction statistics"},
+	{"swd_divider", (cmd_handler)cortexm_swd_divider, "Set SWCLK pacing: (0 = flat out)"},
+	{"perf", (cmd_handler)cortexm_perf, "DWT performance counters: (start|stop|show)"},
+	{NULL, NULL, NULL}
+};
+
+/* target options recognised by the Cortex-M target */
+#define	TOPT_FLAVOUR_V6M	(1<<0)	/* if not set, target is assumed to be v7m */
+#define	TOPT_FLAVOUR_V7MF	(1<<1)	/* if set, floating-point enabled. */
+
+static void cortexm_regs_read(target *t, void *data);
+static void cortexm_regs_write(target *t, const void *data);
+static void cortexm_regs_read_hw(target *t, void *data);
+static void cortexm_regs_write_hw(target *t, const void *data);
+static ssize_t cortexm_reg_read(target *t, int reg, void *data, size_t max);
+static ssize_t cortexm_reg_write(target *t, int reg, const void *data,
+                                 size_t size);
+static uint32_t cortexm_pc_read(target *t);
+
+static void cortexm_reset(target *t);
+static enum target_halt_reason cortexm_halt_poll(target *t, target_addr *watch);
+static enum target_halt_reason cortexm_halt_step(target *t, target_addr *watch);
+static void cortexm_halt_range_resume(target *t, target_addr start,
+                                      target_addr end);
+static void cortexm_halt_request(target *t);
+static int cortexm_fault_unwind(target *t);
+
+static int cortexm_breakwatch_set(target *t, struct breakwatch *);
+static int cortexm_breakwatch_clear(target *t, struct breakwatch *);
+static target_addr cortexm_check_watch(target *t);
+
+#define CORTEXM_MAX_WATCHPOINTS	4	/* architecture says up to 15, no implementation has > 4 */
+#define CORTEXM_MAX_BREAKPOINTS	6	/* architecture says up to 127, no implementation has > 6 */
+#define CORTEXM_MAX_SW_BREAKPOINTS	16	/* cached BKPT patch slots */
+#define CORTEXM_MAX_REGS	53	/* r0-r15, xpsr, msp, psp, special, fpscr, s0-s31 */
+
+static int cortexm_hostio_request(target *t);
+static void cortexm_hostio_console_flush(target *t);
+
+struct cortexm_priv {
+	ADIv5_AP_t *ap;
+	bool stepping;
+	bool on_bkpt;
+	/* Watchpoint unit status */
+	bool hw_watchpoint[CORTEXM_MAX_WATCHPOINTS];
+	unsigned flash_patch_revision;
+	unsigned hw_watchpoint_max;
+	/* Breakpoint unit status */
+	bool hw_breakpoint[CORTEXM_MAX_BREAKPOINTS];
+	unsigned hw_breakpoint_max;
+	/* Shadow of the comparators as programmed.  Clears are deferred to
+	 * resume, so gdb tearing down and re-setting the same breakpoints
+	 * on every stop costs no wire transactions. */
+	uint32_t fpb_comp[CORTEXM_MAX_BREAKPOINTS];
+	uint32_t dwt_comp[CORTEXM_MAX_WATCHPOINTS];
+	uint32_t dwt_mask[CORTEXM_MAX_WATCHPOINTS];
+	uint32_t dwt_func[CORTEXM_MAX_WATCHPOINTS];
+	/* Software breakpoint opcode cache.  A cleared breakpoint keeps
+	 * its BKPT patch in target memory until resume, so gdb's
+	 * remove-all/insert-all cycling around every continue re-arms
+	 * the slot without touching the target at all. */
+	target_addr sw_break_addr[CORTEXM_MAX_SW_BREAKPOINTS];
+	uint16_t sw_break_insn[CORTEXM_MAX_SW_BREAKPOINTS];
+	bool sw_break_patched[CORTEXM_MAX_SW_BREAKPOINTS];
+	bool sw_break_armed[CORTEXM_MAX_SW_BREAKPOINTS];
+	/* Per-stop register cache: filled from the target on the first
+	 * read after a halt, then serving gdb's repeated 'g' packets from
+	 * probe memory.  Writes land in the cache and are flushed to the
+	 * core at resume. */
+	uint32_t reg_cache[CORTEXM_MAX_REGS];
+	bool reg_cache_valid;
+	bool reg_cache_dirty;
+	/* Copy of DEMCR for vector-catch */
+	uint32_t demcr;
+	/* Cache parameters */
+	bool has_cache;
+	uint32_t dcache_minline;
+	/* Halt-poll back-off state */
+	platform_timeout poll_timeout;
+	uint32_t poll_interval;
+	/* Active vCont range step: re-step while PC stays within
+	 * [step_range_start, step_range_end).  Equal bounds mean idle. */
+	target_addr step_range_start;
+	target_addr step_range_end;
+	/* Resident flash stub: identity of the loader image last uploaded
+	 * by cortexm_stub_load(), so per-chunk re-uploads are skipped
+	 * while nothing can have clobbered it.  stub_len == 0 means none;
+	 * stub_exec marks the stub's own run so it does not evict itself. */
+	target_addr stub_loadaddr;
+	const void *stub_src;
+	size_t stub_len;
+	bool stub_exec;
+	/* Batched semihosting console output: fd 1/2 writes land here and
+	 * go out on the console packet path once per poll interval. */
+	char hostio_out[128];
+	unsigned hostio_out_len;
+};
+
+/* Register number tables */
+static const uint32_t regnum_cortex_m[] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,	/* standard r0-r15 */
+	0x10,	/* xpsr */
+	0x11,	/* msp */
+	0x12,	/* psp */
+	0x14	/* special */
+};
+
+static const uint32_t regnum_cortex_mf[] = {
+	0x21,	/* fpscr */
+	0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,	/* s0-s7 */
+	0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,	/* s8-s15 */
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,	/* s16-s23 */
+	0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,	/* s24-s31 */
+};
+
+static const char tdesc_cortex_m[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target>"
+	"  <architecture>arm</architecture>"
+	"  <feature name=\"org.gnu.gdb.arm.m-profile\">"
+	"    <reg name=\"r0\" bitsize=\"32\"/>"
+	"    <reg name=\"r1\" bitsize=\"32\"/>"
+	"    <reg name=\"r2\" bitsize=\"32\"/>"
+	"    <reg name=\"r3\" bitsize=\"32\"/>"
+	"    <reg name=\"r4\" bitsize=\"32\"/>"
+	"    <reg name=\"r5\" bitsize=\"32\"/>"
+	"    <reg name=\"r6\" bitsize=\"32\"/>"
+	"    <reg name=\"r7\" bitsize=\"32\"/>"
+	"    <reg name=\"r8\" bitsize=\"32\"/>"
+	"    <reg name=\"r9\" bitsize=\"32\"/>"
+	"    <reg name=\"r10\" bitsize=\"32\"/>"
+	"    <reg name=\"r11\" bitsize=\"32\"/>"
+	"    <reg name=\"r12\" bitsize=\"32\"/>"
+	"    <reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+	"    <reg name=\"lr\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"xpsr\" bitsize=\"32\"/>"
+	"    <reg name=\"msp\" bitsize=\"32\" save-restore=\"no\" type=\"data_ptr\"/>"
+	"    <reg name=\"psp\" bitsize=\"32\" save-restore=\"no\" type=\"data_ptr\"/>"
+	"    <reg name=\"primask\" bitsize=\"8\" save-restore=\"no\"/>"
+	"    <reg name=\"basepri\" bitsize=\"8\" save-restore=\"no\"/>"
+	"    <reg name=\"faultmask\" bitsize=\"8\" save-restore=\"no\"/>"
+	"    <reg name=\"control\" bitsize=\"8\" save-restore=\"no\"/>"
+	"  </feature>"
+	"</target>";
+
+static const char tdesc_cortex_mf[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target>"
+	"  <architecture>arm</architecture>"
+	"  <feature name=\"org.gnu.gdb.arm.m-profile\">"
+	"    <reg name=\"r0\" bitsize=\"32\"/>"
+	"    <reg name=\"r1\" bitsize=\"32\"/>"
+	"    <reg name=\"r2\" bitsize=\"32\"/>"
+	"    <reg name=\"r3\" bitsize=\"32\"/>"
+	"    <reg name=\"r4\" bitsize=\"32\"/>"
+	"    <reg name=\"r5\" bitsize=\"32\"/>"
+	"    <reg name=\"r6\" bitsize=\"32\"/>"
+	"    <reg name=\"r7\" bitsize=\"32\"/>"
+	"    <reg name=\"r8\" bitsize=\"32\"/>"
+	"    <reg name=\"r9\" bitsize=\"32\"/>"
+	"    <reg name=\"r10\" bitsize=\"32\"/>"
+	"    <reg name=\"r11\" bitsize=\"32\"/>"
+	"    <reg name=\"r12\" bitsize=\"32\"/>"
+	"    <reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+	"    <reg name=\"lr\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"    <reg name=\"xpsr\" bitsize=\"32\"/>"
+	"    <reg name=\"msp\" bitsize=\"32\" save-restore=\"no\" type=\"data_ptr\"/>"
+	"    <reg name=\"psp\" bitsize=\"32\" save-restore=\"no\" type=\"data_ptr\"/>"
+	"    <reg name=\"primask\" bitsize=\"8\" save-restore=\"no\"/>"
+	"    <reg name=\"basepri\" bitsize=\"8\" save-restore=\"no\"/>"
+	"    <reg name=\"faultmask\" bitsize=\"8\" save-restore=\"no\"/>"
+	"    <reg name=\"control\" bitsize=\"8\" save-restore=\"no\"/>"
+	"  </feature>"
+	"  <feature name=\"org.gnu.gdb.arm.vfp\">"
+	"    <reg name=\"fpscr\" bitsize=\"32\"/>"
+	"    <reg name=\"d0\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d1\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d2\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d3\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d4\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d5\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d6\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d7\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d8\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d9\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d10\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d11\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d12\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d13\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d14\" bitsize=\"64\" type=\"float\"/>"
+	"    <reg name=\"d15\" bitsize=\"64\" type=\"float\"/>"
+	"  </feature>"
+	"</target>";
+
+ADIv5_AP_t *cortexm_ap(target *t)
+{
+	return ((struct cortexm_priv *)t->priv)->ap;
+}
+
+static void cortexm_cache_clean(target *t, target_addr addr, size_t len, bool invalidate)
+{
+	struct cortexm_priv *priv = t->priv;
+	if (!priv->has_cache || (priv->dcache_minline == 0))
+		return;
+	uint32_t cache_reg = invalidate ? CORTEXM_DCCIMVAC : CORTEXM_DCCMVAC;
+	size_t minline = priv->dcache_minline;
+
+	/* flush data cache for RAM regions that intersect requested region */
+	target_addr mem_end = addr + len; /* following code is NOP if wraparound */
+	/* requested region is [src, src_end) */
+	for (struct target_ram *r = t->ram; r; r = r->next) {
+		target_addr ram = r->start;
+		target_addr ram_end = r->start + r->length;
+		/* RAM region is [ram, ram_end) */
+		if (addr > ram)
+			ram = addr;
+		if (mem_end < ram_end)
+			ram_end = mem_end;
+		/* intersection is [ram, ram_end) */
+		for (ram &= ~(minline-1); ram < ram_end; ram += minline)
+			adiv5_mem_write(cortexm_ap(t), cache_reg, &ram, 4);
+	}
+}
+
+static void cortexm_mem_read(target *t, void *dest, target_addr src, size_t len)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	cortexm_cache_clean(t, src, len, false);
+	adiv5_mem_read(cortexm_ap(t), dest, src, len);
+
+	/* A removed software breakpoint keeps its BKPT patch in memory
+	 * until the next resume, but gdb already believes the original
+	 * instruction is back and no longer masks the address: serve the
+	 * saved opcode over the read. */
+	for (unsigned i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++) {
+		if (!priv->sw_break_patched[i] || priv->sw_break_armed[i])
+			continue;
+		for (unsigned b = 0; b < 2; b++) {
+			target_addr byte = priv->sw_break_addr[i] + b;
+			if ((byte >= src) && (byte - src < len))
+				((uint8_t *)dest)[byte - src] =
+					priv->sw_break_insn[i] >> (8 * b);
+		}
+	}
+}
+
+static void cortexm_mem_write(target *t, target_addr dest, const void *src, size_t len)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	/* A write over the loaded flash stub evicts it */
+	if (priv->stub_len && (dest < priv->stub_loadaddr + priv->stub_len) &&
+	    (dest + len > priv->stub_loadaddr))
+		priv->stub_len = 0;
+	/* A write overlapping the patch of a removed software breakpoint
+	 * must land on the real instruction and must not be undone by the
+	 * deferred restore at resume: put the opcode back first and
+	 * retire the slot (before the write16 recurses through here). */
+	for (unsigned i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++) {
+		if (priv->sw_break_patched[i] && !priv->sw_break_armed[i] &&
+		    (priv->sw_break_addr[i] < dest + len) &&
+		    (priv->sw_break_addr[i] + 2 > dest)) {
+			priv->sw_break_patched[i] = false;
+			target_mem_write16(t, priv->sw_break_addr[i],
+			                   priv->sw_break_insn[i]);
+		}
+	}
+	cortexm_cache_clean(t, dest, len, true);
+	adiv5_mem_write(cortexm_ap(t), dest, src, len);
+}
+
+static bool cortexm_check_error(target *t)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+
+	if (adiv5_dp_error(ap->dp)) {
+		/* Writes may have been dropped: the CSW/TAR shadows no
+		 * longer reflect what the AP holds. */
+		ap->csw_cache = 0;
+		ap->tar_valid = false;
+		return true;
+	}
+	return false;
+}
+
+static void cortexm_priv_free(void *priv)
+{
+	/* priv itself is arena memory reclaimed by target_list_free() */
+	adiv5_ap_unref(((struct cortexm_priv *)priv)->ap);
+}
+
+static bool cortexm_forced_halt(target *t)
+{
+	uint32_t start_time = platform_time_ms();
+	platform_srst_set_val(false);
+	/* Wait until SRST is released.*/
+	while (platform_time_ms() < start_time + 2000) {
+		if (!platform_srst_get_val())
+			break;
+	}
+	if (platform_srst_get_val())
+		return false;
+	uint32_t dhcsr = 0;
+	start_time = platform_time_ms();
+	/* Try hard to halt the target. STM32F7 in  WFI
+	   needs multiple writes!*/
+	while (platform_time_ms() < start_time + cortexm_wait_timeout) {
+		dhcsr = target_mem_read32(t, CORTEXM_DHCSR);
+		if (dhcsr == (CORTEXM_DHCSR_S_HALT | CORTEXM_DHCSR_S_REGRDY |
+					  CORTEXM_DHCSR_C_HALT | CORTEXM_DHCSR_C_DEBUGEN))
+			break;
+		target_halt_request(t);
+	}
+	if (dhcsr != 0x00030003)
+		return false;
+	return true;
+}
+
+bool cortexm_probe(ADIv5_AP_t *ap)
+{
+	target *t;
+
+	t = target_new();
+	adiv5_ap_ref(ap);
+	struct cortexm_priv *priv = target_mem_alloc(sizeof(*priv));
+	t->priv = priv;
+	t->priv_free = cortexm_priv_free;
+	priv->ap = ap;
+
+	t->check_error = cortexm_check_error;
+	t->mem_read = cortexm_mem_read;
+	t->mem_write = cortexm_mem_write;
+
+	t->driver = cortexm_driver_str;
+
+	t->attach = cortexm_attach;
+	t->detach = cortexm_detach;
+
+	/* Should probe here to make sure it's Cortex-M3 */
+	t->tdesc = tdesc_cortex_m;
+	t->regs_read = cortexm_regs_read;
+	t->regs_write = cortexm_regs_write;
+	t->reg_read = cortexm_reg_read;
+	t->reg_write = cortexm_reg_write;
+
+	t->reset = cortexm_reset;
+	t->halt_request = cortexm_halt_request;
+	t->halt_poll = cortexm_halt_poll;
+	t->halt_resume = cortexm_halt_resume;
+	t->halt_step = cortexm_halt_step;
+	t->halt_range_resume = cortexm_halt_range_resume;
+	t->regs_size = sizeof(regnum_cortex_m);
+
+	t->breakwatch_set = cortexm_breakwatch_set;
+	t->breakwatch_clear = cortexm_breakwatch_clear;
+
+	target_add_commands(t, cortexm_cmd_list, cortexm_driver_str);
+
+	/* Probe for FP extension */
+	uint32_t cpacr = target_mem_read32(t, CORTEXM_CPACR);
+	cpacr |= 0x00F00000; /* CP10 = 0b11, CP11 = 0b11 */
+	target_mem_write32(t, CORTEXM_CPACR, cpacr);
+	if (target_mem_read32(t, CORTEXM_CPACR) == cpacr) {
+		t->target_options |= TOPT_FLAVOUR_V7MF;
+		t->regs_size += sizeof(regnum_cortex_mf);
+		t->tdesc = tdesc_cortex_mf;
+	}
+
+	/* Default vectors to catch */
+	priv->demcr = CORTEXM_DEMCR_TRCENA | CORTEXM_DEMCR_VC_HARDERR |
+			CORTEXM_DEMCR_VC_CORERESET;
+
+	/* Check cache type */
+	uint32_t ctr = target_mem_read32(t, CORTEXM_CTR);
+	if ((ctr >> 29) == 4) {
+		priv->has_cache = true;
+		priv->dcache_minline = 4 << (ctr & 0xf);
+	} else {
+		target_check_error(t);
+	}
+
+	if (!cortexm_forced_halt(t))
+		return false;
+#define PROBE(x) \
+	do { if ((x)(t)) {target_halt_resume(t, 0); return true;} else target_check_error(t); } while (0)
+
+	PROBE(stm32f1_probe);
+	PROBE(stm32f4_probe);
+	PROBE(stm32h7_probe);
+	PROBE(stm32l0_probe);   /* STM32L0xx & STM32L1xx */
+	PROBE(stm32l4_probe);
+	PROBE(lpc11xx_probe);
+	PROBE(lpc15xx_probe);
+	PROBE(lpc43xx_probe);
+	PROBE(sam3x_probe);
+	PROBE(sam4l_probe);
+	PROBE(nrf51_probe);
+	PROBE(samd_probe);
+	PROBE(lmi_probe);
+	PROBE(kinetis_probe);
+	PROBE(efm32_probe);
+	PROBE(msp432_probe);
+	PROBE(lpc17xx_probe);
+#undef PROBE
+
+	return true;
+}
+
+bool cortexm_attach(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+	uint32_t r;
+
+	/* Clear any pending fault condition */
+	target_check_error(t);
+
+	priv->reg_cache_valid = false;
+	priv->reg_cache_dirty = false;
+
+	target_halt_request(t);
+	if (!cortexm_forced_halt(t))
+		return false;
+
+	/* Request halt on reset */
+	target_mem_write32(t, CORTEXM_DEMCR, priv->demcr);
+
+	/* Reset DFSR flags */
+	target_mem_write32(t, CORTEXM_DFSR, CORTEXM_DFSR_RESETALL);
+
+	/* size the break/watchpoint units */
+	priv->hw_breakpoint_max = CORTEXM_MAX_BREAKPOINTS;
+	r = target_mem_read32(t, CORTEXM_FPB_CTRL);
+	if (((r >> 4) & 0xf) < priv->hw_breakpoint_max)	/* only look at NUM_COMP1 */
+		priv->hw_breakpoint_max = (r >> 4) & 0xf;
+	priv->flash_patch_revision = (r >> 28);
+	priv->hw_watchpoint_max = CORTEXM_MAX_WATCHPOINTS;
+	r = target_mem_read32(t, CORTEXM_DWT_CTRL);
+	if ((r >> 28) > priv->hw_watchpoint_max)
+		priv->hw_watchpoint_max = r >> 28;
+
+	/* Clear any stale breakpoints */
+	for(i = 0; i < priv->hw_breakpoint_max; i++) {
+		target_mem_write32(t, CORTEXM_FPB_COMP(i), 0);
+		priv->hw_breakpoint[i] = 0;
+		priv->fpb_comp[i] = 0;
+	}
+
+	/* Clear any stale watchpoints */
+	for(i = 0; i < priv->hw_watchpoint_max; i++) {
+		target_mem_write32(t, CORTEXM_DWT_FUNC(i), 0);
+		priv->hw_watchpoint[i] = 0;
+		priv->dwt_func[i] = 0;
+	}
+
+	/* Flash Patch Control Register: set ENABLE */
+	target_mem_write32(t, CORTEXM_FPB_CTRL,
+			CORTEXM_FPB_CTRL_KEY | CORTEXM_FPB_CTRL_ENABLE);
+
+	return true;
+}
+
+void cortexm_detach(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+
+	/* Clear any stale breakpoints */
+	for(i = 0; i < priv->hw_breakpoint_max; i++)
+		target_mem_write32(t, CORTEXM_FPB_COMP(i), 0);
+
+	/* Unpatch any software breakpoints still in target memory */
+	for(i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++) {
+		if (priv->sw_break_patched[i]) {
+			target_mem_write16(t, priv->sw_break_addr[i],
+			                   priv->sw_break_insn[i]);
+			priv->sw_break_patched[i] = false;
+			priv->sw_break_armed[i] = false;
+		}
+	}
+
+	/* Clear any stale watchpoints */
+	for(i = 0; i < priv->hw_watchpoint_max; i++)
+		target_mem_write32(t, CORTEXM_DWT_FUNC(i), 0);
+
+	/* Any resident flash stub dies with the session */
+	priv->stub_len = 0;
+
+	/* Disable debug */
+	target_mem_write32(t, CORTEXM_DHCSR, CORTEXM_DHCSR_DBGKEY);
+}
+
+enum { DB_DHCSR, DB_DCRSR, DB_DCRDR, DB_DEMCR };
+
+static void cortexm_regs_read_hw(target *t, void *data)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	uint32_t *regs = data;
+	unsigned i;
+
+	/* FIXME: Describe what's really going on here */
+	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+
+	/* Map the banked data registers (0x10-0x1c) to the
+	 * debug registers DHCSR, DCRSR, DCRDR and DEMCR respectively */
+	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR);
+	ap->tar_valid = false;
+
+	/* Walk the regnum_cortex_m array, reading the registers it
+	 * calls out.  AP reads are posted, so each DCRDR access returns
+	 * the previous register's value while the next DCRSR transfer is
+	 * already in flight: two accesses per register instead of the
+	 * three a DCRSR write plus drained DCRDR read would cost.  The
+	 * first DCRDR read primes the pipeline and its result is
+	 * discarded; the last register is drained from RDBUFF. */
+	adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRSR), regnum_cortex_m[0]); /* Required to switch banks */
+	adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ, ADIV5_AP_DB(DB_DCRDR), 0);
+	for(i = 1; i < sizeof(regnum_cortex_m) / 4; i++) {
+		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
+		                    regnum_cortex_m[i]);
+		*regs++ = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ,
+		                              ADIV5_AP_DB(DB_DCRDR), 0);
+	}
+	if (t->target_options & TOPT_FLAVOUR_V7MF)
+		for(i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
+			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
+			                    ADIV5_AP_DB(DB_DCRSR),
+			                    regnum_cortex_mf[i]);
+			*regs++ = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ,
+			                              ADIV5_AP_DB(DB_DCRDR), 0);
+		}
+	*regs++ = adiv5_dp_low_access(ap->dp, ADIV5_LOW_READ,
+	                              ADIV5_DP_RDBUFF, 0);
+}
+
+static void cortexm_regs_write_hw(target *t, const void *data)
+{
+	ADIv5_AP_t *ap = cortexm_ap(t);
+	const uint32_t *regs = data;
+	unsigned i;
+
+	/* FIXME: Describe what's really going on here */
+	adiv5_ap_write(ap, ADIV5_AP_CSW, ap->csw | ADIV5_AP_CSW_SIZE_WORD);
+
+	/* Map the banked data registers (0x10-0x1c) to the
+	 * debug registers DHCSR, DCRSR, DCRDR and DEMCR respectively */
+	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_TAR, CORTEXM_DHCSR);
+	ap->tar_valid = false;
+
+	/* Walk the regnum_cortex_m array, writing the registers it
+	 * calls out. */
+	adiv5_ap_write(ap, ADIV5_AP_DB(DB_DCRDR), *regs++); /* Required to switch banks */
+	adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
+	                    0x10000 | regnum_cortex_m[0]);
+	for(i = 1; i < sizeof(regnum_cortex_m) / 4; i++) {
+		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
+		                    ADIV5_AP_DB(DB_DCRDR), *regs++);
+		adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE, ADIV5_AP_DB(DB_DCRSR),
+		                    0x10000 | regnum_cortex_m[i]);
+	}
+	if (t->target_options & TOPT_FLAVOUR_V7MF)
+		for(i = 0; i < sizeof(regnum_cortex_mf) / 4; i++) {
+			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
+			                    ADIV5_AP_DB(DB_DCRDR), *regs++);
+			adiv5_dp_low_access(ap->dp, ADIV5_LOW_WRITE,
+			                    ADIV5_AP_DB(DB_DCRSR),
+			                    0x10000 | regnum_cortex_mf[i]);
+		}
+}
+
+/* Cache layer over the register file.  gdb re-reads the registers
+ * several times within one stop; only the first goes to the target.
+ * Writes are held in the cache and flushed by cortexm_halt_resume(). */
+static void cortexm_regs_fill(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if (!priv->reg_cache_valid) {
+		cortexm_regs_read_hw(t, priv->reg_cache);
+		priv->reg_cache_valid = true;
+	}
+}
+
+static void cortexm_regs_read(target *t, void *data)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	cortexm_regs_fill(t);
+	memcpy(data, priv->reg_cache, t->regs_size);
+}
+
+static void cortexm_regs_write(target *t, const void *data)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	memcpy(priv->reg_cache, data, t->regs_size);
+	priv->reg_cache_valid = true;
+	priv->reg_cache_dirty = true;
+}
+
+static void cortexm_regs_flush(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if (priv->reg_cache_dirty) {
+		cortexm_regs_write_hw(t, priv->reg_cache);
+		priv->reg_cache_dirty = false;
+	}
+	/* The core is about to run; whatever we cached goes stale */
+	priv->reg_cache_valid = false;
+}
+
+int cortexm_mem_write_sized(
+	target *t, target_addr dest, const void *src, size_t len, enum align align)
+{
+	cortexm_cache_clean(t, dest, len, true);
+	adiv5_mem_write_sized(cortexm_ap(t), dest, src, len, align);
+	return target_check_error(t);
+}
+
+/* Map a target description register index to its slot in the packed
+ * register cache and the access width gdb expects for it.  The tdesc
+ * numbering does not match either space directly: primask, basepri,
+ * faultmask and control (indices 19-22) are advertised as separate
+ * 8-bit registers but the core packs all four into the one "special"
+ * selector, and on VFP parts fpscr (23) and the 64-bit d0-d15 (24-39)
+ * follow, each d spanning two single-precision cache words.  Returns
+ * the cache word index, or -1 for an index the core doesn't have. */
+static int cortexm_reg_slot(target *t, int reg, size_t *size)
+{
+	bool vfp = t->target_options & TOPT_FLAVOUR_V7MF;
+
+	if ((reg >= 0) && (reg <= REG_PSP)) {
+		*size = 4;
+		return reg;
+	}
+	if ((reg >= REG_SPECIAL) && (reg < REG_SPECIAL + 4)) {
+		*size = 1;
+		return REG_SPECIAL;
+	}
+	if (vfp && (reg == 23)) {	/* fpscr */
+		*size = 4;
+		return 20;
+	}
+	if (vfp && (reg >= 24) && (reg <= 39)) {	/* d0-d15 */
+		*size = 8;
+		return 21 + 2 * (reg - 24);
+	}
+	return -1;
+}
+
+/* Selector for a register cache word */
+static uint32_t cortexm_slot_regnum(int word)
+{
+	unsigned num_m = sizeof(regnum_cortex_m) / 4;
+
+	if ((unsigned)word < num_m)
+		return regnum_cortex_m[word];
+	return regnum_cortex_mf[word - num_m];
+}
+
+/* Single-register access: one DCRSR handshake per word instead of
+ * walking the whole register file */
+static uint32_t cortexm_reg_fetch(target *t, int word)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if (priv->reg_cache_valid)
+		return priv->reg_cache[word];
+	target_mem_write32(t, CORTEXM_DCRSR, cortexm_slot_regnum(word));
+	return target_mem_read32(t, CORTEXM_DCRDR);
+}
+
+static void cortexm_reg_store(target *t, int word, uint32_t val)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if (priv->reg_cache_valid) {
+		/* Held in the cache until resume flushes it */
+		priv->reg_cache[word] = val;
+		priv->reg_cache_dirty = true;
+		return;
+	}
+	target_mem_write32(t, CORTEXM_DCRDR, val);
+	target_mem_write32(t, CORTEXM_DCRSR,
+	                   CORTEXM_DCRSR_REGWnR | cortexm_slot_regnum(word));
+}
+
+static ssize_t cortexm_reg_read(target *t, int reg, void *data, size_t max)
+{
+	size_t size;
+	int word = cortexm_reg_slot(t, reg, &size);
+
+	if ((word < 0) || (max < size))
+		return -1;
+	uint32_t val = cortexm_reg_fetch(t, word);
+	switch (size) {
+	case 1:
+		*(uint8_t *)data = val >> (8 * (reg - REG_SPECIAL));
+		break;
+	case 8: {
+		uint32_t hi = cortexm_reg_fetch(t, word + 1);
+		memcpy(data, &val, 4);
+		memcpy((uint8_t *)data + 4, &hi, 4);
+		break;
+	}
+	default:
+		memcpy(data, &val, 4);
+	}
+	return size;
+}
+
+static ssize_t cortexm_reg_write(target *t, int reg, const void *data,
+                                 size_t size)
+{
+	size_t regsize;
+	int word = cortexm_reg_slot(t, reg, &regsize);
+	uint32_t val;
+
+	if ((word < 0) || (size < regsize))
+		return -1;
+	switch (regsize) {
+	case 1: {
+		/* Read-modify-write the byte into the packed special word */
+		unsigned shift = 8 * (reg - REG_SPECIAL);
+		val = cortexm_reg_fetch(t, word);
+		val &= ~(0xffu << shift);
+		val |= (uint32_t)*(const uint8_t *)data << shift;
+		cortexm_reg_store(t, word, val);
+		break;
+	}
+	case 8:
+		memcpy(&val, data, 4);
+		cortexm_reg_store(t, word, val);
+		memcpy(&val, (const uint8_t *)data + 4, 4);
+		cortexm_reg_store(t, word + 1, val);
+		break;
+	default:
+		memcpy(&val, data, 4);
+		cortexm_reg_store(t, word, val);
+	}
+	return regsize;
+}
+
+static uint32_t cortexm_pc_read(target *t)
+{
+	target_mem_write32(t, CORTEXM_DCRSR, 0x0F);
+	return target_mem_read32(t, CORTEXM_DCRDR);
+}
+
+static void cortexm_pc_write(target *t, const uint32_t val)
+{
+	target_mem_write32(t, CORTEXM_DCRDR, val);
+	target_mem_write32(t, CORTEXM_DCRSR, CORTEXM_DCRSR_REGWnR | 0x0F);
+}
+
+/* The following three routines implement target halt/resume
+ * using the core debug registers in the NVIC. */
+/* Minimum SRST assertion time, microseconds.  Deasserted as soon as
+ * this has elapsed -- the S_RESET_ST poll below does the real
+ * sequencing -- so boards whose reset line carries an RC filter or a
+ * supervisor can lengthen it from platform.h without taxing everyone
+ * else's restart time. */
+#ifndef PLATFORM_SRST_PULSE_US
+#define PLATFORM_SRST_PULSE_US 20
+#endif
+
+static void cortexm_reset(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	platform_timeout reset_timeout;
+
+	/* The register cache describes the pre-reset state */
+	priv->reg_cache_valid = false;
+	priv->reg_cache_dirty = false;
+	/* SRAM contents are not guaranteed across reset */
+	priv->stub_len = 0;
+
+	if ((t->target_options & CORTEXM_TOPT_INHIBIT_SRST) == 0) {
+		uint32_t start_us = platform_time_us();
+		platform_srst_set_val(true);
+		while (platform_time_us() - start_us < PLATFORM_SRST_PULSE_US);
+		platform_srst_set_val(false);
+	}
+
+	/* Read DHCSR here to clear S_RESET_ST bit before reset */
+	target_mem_read32(t, CORTEXM_DHCSR);
+
+	/* Request system reset from NVIC: SRST doesn't work correctly */
+	/* This could be VECTRESET: 0x05FA0001 (reset only core)
+	 *          or SYSRESETREQ: 0x05FA0004 (system reset)
+	 */
+	target_mem_write32(t, CORTEXM_AIRCR,
+	                   CORTEXM_AIRCR_VECTKEY | CORTEXM_AIRCR_SYSRESETREQ);
+
+	/* If target needs to do something extra (see Atmel SAM4L for example) */
+	if (t->extended_reset != NULL) {
+		t->extended_reset(t);
+	}
+
+	/* Poll for release from reset at full wire rate, bounded so a
+	 * target held in reset externally can't wedge the session */
+	platform_timeout_set(&reset_timeout, 1000);
+	while ((target_mem_read32(t, CORTEXM_DHCSR) & CORTEXM_DHCSR_S_RESET_ST) &&
+	       !platform_timeout_is_expired(&reset_timeout))
+		target_op_progress();
+
+	/* Reset DFSR flags */
+	target_mem_write32(t, CORTEXM_DFSR, CORTEXM_DFSR_RESETALL);
+}
+
+static void cortexm_halt_request(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	volatile struct exception e;
+
+	priv->poll_interval = 0;
+	/* An interrupt cancels a range step in flight */
+	priv->step_range_start = priv->step_range_end = 0;
+	TRY_CATCH (e, EXCEPTION_TIMEOUT) {
+		target_mem_write32(t, CORTEXM_DHCSR, CORTEXM_DHCSR_DBGKEY |
+		                                          CORTEXM_DHCSR_C_HALT |
+		                                          CORTEXM_DHCSR_C_DEBUGEN);
+	}
+	if (e.type) {
+		tc_printf(t, "Timeout sending interrupt, is target in WFI?\n");
+	}
+}
+
+/* Back off the poll interval while the target stays running, so a
+ * long-running target costs the debug link almost nothing.  Reset by
+ * halt_resume() and halt_request() so a fresh run or a pending
+ * interrupt is noticed promptly. */
+static enum target_halt_reason cortexm_poll_backoff(struct cortexm_priv *priv)
+{
+	uint32_t max = platform_poll_interval();
+
+	priv->poll_interval = MIN(priv->poll_interval ?
+	                          priv->poll_interval * 2 : 1, max);
+	platform_timeout_set(&priv->poll_timeout, priv->poll_interval);
+	return TARGET_HALT_RUNNING;
+}
+
+static enum target_halt_reason cortexm_halt_poll(target *t, target_addr *watch)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	/* Push out semihosting console output batched since the last
+	 * poll: one console packet per poll interval instead of one
+	 * per SYS_WRITE. */
+	if (priv->hostio_out_len)
+		cortexm_hostio_console_flush(t);
+
+	/* Skip the DHCSR read entirely until the back-off interval from
+	 * the last poll that found the target running has elapsed. */
+	if (priv->poll_interval &&
+	    !platform_timeout_is_expired(&priv->poll_timeout))
+		return TARGET_HALT_RUNNING;
+
+	volatile uint32_t dhcsr = 0;
+	volatile struct exception e;
+	TRY_CATCH (e, EXCEPTION_ALL) {
+		/* If this times out because the target is in WFI then
+		 * the target is still running. */
+		dhcsr = target_mem_read32(t, CORTEXM_DHCSR);
+	}
+	switch (e.type) {
+	case EXCEPTION_ERROR:
+		/* Oh crap, there's no recovery from this... */
+		target_list_free();
+		return TARGET_HALT_ERROR;
+	case EXCEPTION_TIMEOUT:
+		/* Timeout isn't a problem, target could be in WFI */
+		return cortexm_poll_backoff(priv);
+	}
+
+	if (!(dhcsr & CORTEXM_DHCSR_S_HALT))
+		return cortexm_poll_backoff(priv);
+
+	priv->poll_interval = 0;
+
+	/* Range step: while the halt is a plain completed step and PC is
+	 * still inside the requested range, re-step on the probe.  Each
+	 * iteration costs a few debug register accesses instead of a
+	 * stop-reply/step round trip over the GDB link. */
+	target_addr range_start = priv->step_range_start;
+	target_addr range_end = priv->step_range_end;
+	if (priv->stepping && (range_start != range_end)) {
+		priv->step_range_start = priv->step_range_end = 0;
+		uint32_t dfsr = target_mem_read32(t, CORTEXM_DFSR);
+		uint32_t pc;
+		while (!(dfsr & (CORTEXM_DFSR_BKPT | CORTEXM_DFSR_DWTTRAP |
+		                 CORTEXM_DFSR_VCATCH)) &&
+		       ((pc = cortexm_pc_read(t)) >= range_start) &&
+		       (pc < range_end)) {
+			cortexm_halt_resume(t, true);
+			unsigned spin = 0;
+			while (!(target_mem_read32(t, CORTEXM_DHCSR) &
+			         CORTEXM_DHCSR_S_HALT)) {
+				if (++spin == 64) {
+					/* Slow to retire (WFI?): hand back to
+					 * the poll loop, range still armed */
+					priv->step_range_start = range_start;
+					priv->step_range_end = range_end;
+					return TARGET_HALT_RUNNING;
+				}
+			}
+			dfsr = target_mem_read32(t, CORTEXM_DFSR);
+		}
+	}
+
+	/* We've halted.  Let's find out why. */
+	uint32_t dfsr = target_mem_read32(t, CORTEXM_DFSR);
+	target_mem_write32(t, CORTEXM_DFSR, dfsr); /* write back to reset */
+
+	if ((dfsr & CORTEXM_DFSR_VCATCH) && cortexm_fault_unwind(t))
+		return TARGET_HALT_FAULT;
+
+	/* Remember if we stopped on a breakpoint */
+	priv->on_bkpt = dfsr & (CORTEXM_DFSR_BKPT);
+	if (priv->on_bkpt) {
+		/* If we've hit a programmed breakpoint, check for semihosting
+		 * call. */
+		uint32_t pc = cortexm_pc_read(t);
+		uint16_t bkpt_instr;
+		bkpt_instr = target_mem_read16(t, pc);
+		if (bkpt_instr == 0xBEAB) {
+			if (cortexm_hostio_request(t)) {
+				return TARGET_HALT_REQUEST;
+			} else {
+				target_halt_resume(t, priv->stepping);
+				return 0;
+			}
+		}
+	}
+
+	if (dfsr & CORTEXM_DFSR_DWTTRAP) {
+		if (watch != NULL)
+			*watch = cortexm_check_watch(t);
+		return TARGET_HALT_WATCHPOINT;
+	}
+	if (dfsr & CORTEXM_DFSR_BKPT)
+		return TARGET_HALT_BREAKPOINT;
+
+	if (dfsr & CORTEXM_DFSR_HALTED)
+		return priv->stepping ? TARGET_HALT_STEPPING : TARGET_HALT_REQUEST;
+
+	return TARGET_HALT_BREAKPOINT;
+}
+
+void cortexm_halt_resume(target *t, bool step)
+{
+	struct cortexm_priv *priv = t->priv;
+	uint32_t dhcsr = CORTEXM_DHCSR_DBGKEY | CORTEXM_DHCSR_C_DEBUGEN;
+	unsigned i;
+
+	/* Flush register writes held in the cache */
+	cortexm_regs_flush(t);
+
+	/* Flush deferred comparator clears: a slot freed since the last
+	 * resume may still be enabled in hardware */
+	for (i = 0; i < priv->hw_breakpoint_max; i++) {
+		if ((priv->fpb_comp[i] & 1) && !priv->hw_breakpoint[i]) {
+			target_mem_write32(t, CORTEXM_FPB_COMP(i), 0);
+			priv->fpb_comp[i] = 0;
+		}
+	}
+	for (i = 0; i < priv->hw_watchpoint_max; i++) {
+		if (priv->dwt_func[i] && !priv->hw_watchpoint[i]) {
+			target_mem_write32(t, CORTEXM_DWT_FUNC(i), 0);
+			priv->dwt_func[i] = 0;
+		}
+	}
+	/* ... and deferred software breakpoint removals: put the saved
+	 * opcode back where the slot hasn't been re-armed */
+	for (i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++) {
+		if (priv->sw_break_patched[i] && !priv->sw_break_armed[i]) {
+			target_mem_write16(t, priv->sw_break_addr[i],
+			                   priv->sw_break_insn[i]);
+			priv->sw_break_patched[i] = false;
+		}
+	}
+
+	/* A free run of the core can execute anything, including code
+	 * that scribbles over the loader RAM; only the stub's own run
+	 * leaves it resident */
+	if (!step && !priv->stub_exec)
+		priv->stub_len = 0;
+
+	if (step)
+		dhcsr |= CORTEXM_DHCSR_C_STEP | CORTEXM_DHCSR_C_MASKINTS;
+
+	/* Disable interrupts while single stepping... */
+	if(step != priv->stepping) {
+		target_mem_write32(t, CORTEXM_DHCSR, dhcsr | CORTEXM_DHCSR_C_HALT);
+		priv->stepping = step;
+	}
+
+	if (priv->on_bkpt) {
+		uint32_t pc = cortexm_pc_read(t);
+		if ((target_mem_read16(t, pc) & 0xFF00) == 0xBE00)
+			cortexm_pc_write(t, pc + 2);
+	}
+
+	if (priv->has_cache)
+		target_mem_write32(t, CORTEXM_ICIALLU, 0);
+
+	priv->poll_interval = 0;
+	target_mem_write32(t, CORTEXM_DHCSR, dhcsr);
+}
+
+/* Fused single-step: issue the step, spin on S_HALT and hand straight
+ * to the normal poll decode.  Single instructions retire within a few
+ * DHCSR reads, so this skips the poll back-off machinery and the
+ * per-iteration trip back through the gdb loop. */
+static enum target_halt_reason cortexm_halt_step(target *t, target_addr *watch)
+{
+	cortexm_halt_resume(t, true);
+	for (unsigned i = 0; i < 16; i++) {
+		if (target_mem_read32(t, CORTEXM_DHCSR) & CORTEXM_DHCSR_S_HALT)
+			break;
+	}
+	/* Decodes the halt if it landed, or reports still-running and the
+	 * regular poll loop takes over */
+	return cortexm_halt_poll(t, watch);
+}
+
+/* vCont range step: arm the range and issue the first step.  The poll
+ * decode keeps re-stepping while PC stays inside [start, end), so only
+ * the final stop is reported to the host. */
+static void cortexm_halt_range_resume(target *t, target_addr start,
+                                      target_addr end)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	cortexm_halt_resume(t, true);
+	priv->step_range_start = start;
+	priv->step_range_end = end;
+}
+
+static int cortexm_fault_unwind(target *t)
+{
+	uint32_t hfsr = target_mem_read32(t, CORTEXM_HFSR);
+	uint32_t cfsr = target_mem_read32(t, CORTEXM_CFSR);
+	target_mem_write32(t, CORTEXM_HFSR, hfsr);/* write back to reset */
+	target_mem_write32(t, CORTEXM_CFSR, cfsr);/* write back to reset */
+	/* We check for FORCED in the HardFault Status Register or
+	 * for a configurable fault to avoid catching core resets */
+	if((hfsr & CORTEXM_HFSR_FORCED) || cfsr) {
+		/* Unwind exception */
+		uint32_t regs[t->regs_size / 4];
+		uint32_t stack[8];
+		uint32_t retcode, framesize;
+		/* Read registers for post-exception stack pointer */
+		target_regs_read(t, regs);
+		/* save retcode currently in lr */
+		retcode = regs[REG_LR];
+		bool spsel = retcode & (1<<2);
+		bool fpca = !(retcode & (1<<4));
+		/* Read stack for pre-exception registers */
+		uint32_t sp = spsel ? regs[REG_PSP] : regs[REG_MSP];
+		target_mem_read(t, stack, sp, sizeof(stack));
+		if (target_check_error(t))
+			return 0;
+		regs[REG_LR] = stack[5];	/* restore LR to pre-exception state */
+		regs[REG_PC] = stack[6];	/* restore PC to pre-exception state */
+
+		/* adjust stack to pop exception state */
+		framesize = fpca ? 0x68 : 0x20;	/* check for basic vs. extended frame */
+		if (stack[7] & (1<<9))				/* check for stack alignment fixup */
+			framesize += 4;
+
+		if (spsel) {
+			regs[REG_SPECIAL] |= 0x4000000;
+			regs[REG_SP] = regs[REG_PSP] += framesize;
+		} else {
+			regs[REG_SP] = regs[REG_MSP] += framesize;
+		}
+
+		if (fpca)
+			regs[REG_SPECIAL] |= 0x2000000;
+
+		/* FIXME: stack[7] contains xPSR when this is supported */
+		/* although, if we caught the exception it will be unchanged */
+
+		/* Reset exception state to allow resuming from restored
+		 * state.
+		 */
+		target_mem_write32(t, CORTEXM_AIRCR,
+				CORTEXM_AIRCR_VECTKEY | CORTEXM_AIRCR_VECTCLRACTIVE);
+
+		/* Write pre-exception registers back to core */
+		target_regs_write(t, regs);
+
+		return 1;
+	}
+	return 0;
+}
+
+/* Upload a flash stub unless the very same image is already resident.
+ * Drivers call this once per chunk; after the first chunk only the
+ * data buffer and the registers travel on the wire.  Residency is
+ * dropped whenever the image can have been clobbered: reset, detach,
+ * a free run of the core, or a memory write overlapping the stub. */
+void cortexm_stub_load(target *t, uint32_t loadaddr,
+                       const void *stub, size_t len)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if ((priv->stub_len == len) && (priv->stub_loadaddr == loadaddr) &&
+	    (priv->stub_src == stub))
+		return;
+
+	priv->stub_len = 0;
+	target_mem_write(t, loadaddr, stub, len);
+	if (target_check_error(t))
+		return;
+	priv->stub_loadaddr = loadaddr;
+	priv->stub_src = stub;
+	priv->stub_len = len;
+}
+
+int cortexm_run_stub(target *t, uint32_t loadaddr,
+                     uint32_t r0, uint32_t r1, uint32_t r2, uint32_t r3)
+{
+	uint32_t regs[t->regs_size / 4];
+
+	memset(regs, 0, sizeof(regs));
+	regs[0] = r0;
+	regs[1] = r1;
+	regs[2] = r2;
+	regs[3] = r3;
+	regs[15] = loadaddr;
+	regs[16] = 0x1000000;
+	regs[19] = 0;
+
+	cortexm_regs_write(t, regs);
+
+	if (target_check_error(t))
+		return -1;
+
+	/* Execute the stub */
+	enum target_halt_reason reason;
+	struct cortexm_priv *priv = t->priv;
+	priv->stub_exec = true;
+	cortexm_halt_resume(t, 0);
+	do {
+		/* Stubs complete in microseconds: keep every poll on the
+		 * wire rather than letting the run-state back-off kick in. */
+		priv->poll_interval = 0;
+	} while ((reason = cortexm_halt_poll(t, NULL)) == TARGET_HALT_RUNNING);
+	priv->stub_exec = false;
+
+	if (reason == TARGET_HALT_ERROR)
+		raise_exception(EXCEPTION_ERROR, "Target lost in stub");
+
+	if (reason != TARGET_HALT_BREAKPOINT)
+		return -2;
+
+	uint32_t pc = cortexm_pc_read(t);
+	uint16_t bkpt_instr = target_mem_read16(t, pc);
+	if (bkpt_instr >> 8 != 0xbe)
+		return -2;
+
+	return bkpt_instr & 0xff;
+}
+
+/* Run a streaming stub against a RAM ring buffer (flashstub/ring.h).
+ * Where cortexm_run_stub is lockstep - fill buffer, run, wait, repeat -
+ * this keeps the stub running: it spins draining the ring while the
+ * probe refills it over the wire, so programming and transfer overlap
+ * and no halt/restart cycle separates the chunks.  The whole image
+ * travels through one invocation; the stub parks in stub_exit() once
+ * done is raised and the ring is empty. */
+int cortexm_stub_stream(target *t, uint32_t loadaddr, uint32_t ring,
+                        uint32_t buf, uint32_t buf_size,
+                        uint32_t dest, const void *src, size_t len)
+{
+	uint32_t regs[t->regs_size / 4];
+	uint32_t head = 0, tail = 0;
+	platform_timeout timeout;
+
+	target_mem_write32(t, ring + offsetof(struct stub_ring, head), 0);
+	target_mem_write32(t, ring + offsetof(struct stub_ring, tail), 0);
+	target_mem_write32(t, ring + offsetof(struct stub_ring, done), 0);
+
+	memset(regs, 0, sizeof(regs));
+	regs[0] = dest;
+	regs[1] = ring;
+	regs[2] = buf;
+	regs[3] = buf_size;
+	regs[15] = loadaddr;
+	regs[16] = 0x1000000;
+	regs[19] = 0;
+
+	cortexm_regs_write(t, regs);
+
+	if (target_check_error(t))
+		return -1;
+
+	enum target_halt_reason reason;
+	struct cortexm_priv *priv = t->priv;
+	priv->stub_exec = true;
+	cortexm_halt_resume(t, 0);
+
+	platform_timeout_set(&timeout, 5000);
+	while (len) {
+		uint32_t space = buf_size - (head - tail);
+		if (space == 0) {
+			/* Ring full: re-sample the stub's consumption.  No
+			 * progress within the timeout means the stub wedged
+			 * (or faulted without reaching a breakpoint). */
+			tail = target_mem_read32(t,
+				ring + offsetof(struct stub_ring, tail));
+			if (buf_size - (head - tail))
+				platform_timeout_set(&timeout, 5000);
+			else if (platform_timeout_is_expired(&timeout)) {
+				cortexm_halt_request(t);
+				while (cortexm_halt_poll(t, NULL) ==
+				       TARGET_HALT_RUNNING)
+					priv->poll_interval = 0;
+				priv->stub_exec = false;
+				return -2;
+			}
+			continue;
+		}
+		/* Fill up to the end of the buffer; the wrap restarts the
+		 * copy at offset zero next time around */
+		uint32_t off = head % buf_size;
+		size_t n = MIN(space, len);
+		if (n > buf_size - off)
+			n = buf_size - off;
+		target_mem_write(t, buf + off, src, n);
+		src = (const uint8_t *)src + n;
+		head += n;
+		len -= n;
+		target_mem_write32(t, ring + offsetof(struct stub_ring, head),
+		                   head);
+	}
+	target_mem_write32(t, ring + offsetof(struct stub_ring, done), 1);
+
+	do {
+		priv->poll_interval = 0;
+	} while ((reason = cortexm_halt_poll(t, NULL)) == TARGET_HALT_RUNNING);
+	priv->stub_exec = false;
+
+	if (reason == TARGET_HALT_ERROR)
+		raise_exception(EXCEPTION_ERROR, "Target lost in stub");
+
+	if (reason != TARGET_HALT_BREAKPOINT)
+		return -2;
+
+	uint32_t pc = cortexm_pc_read(t);
+	uint16_t bkpt_instr = target_mem_read16(t, pc);
+	if (bkpt_instr >> 8 != 0xbe)
+		return -2;
+
+	return bkpt_instr & 0xff;
+}
+
+/* The following routines implement hardware breakpoints and watchpoints.
+ * The Flash Patch and Breakpoint (FPB) and Data Watch and Trace (DWT)
+ * systems are used. */
+
+static uint32_t dwt_mask(size_t len)
+{
+	switch (len) {
+	case 1:
+		return CORTEXM_DWT_MASK_BYTE;
+	case 2:
+		return CORTEXM_DWT_MASK_HALFWORD;
+	case 4:
+		return CORTEXM_DWT_MASK_WORD;
+	default:
+		return -1;
+	}
+}
+
+static uint32_t dwt_func(target *t, enum target_breakwatch type)
+{
+	uint32_t x = 0;
+
+	if ((t->target_options & TOPT_FLAVOUR_V6M) == 0)
+		x = CORTEXM_DWT_FUNC_DATAVSIZE_WORD;
+
+	switch (type) {
+	case TARGET_WATCH_WRITE:
+		return CORTEXM_DWT_FUNC_FUNC_WRITE | x;
+	case TARGET_WATCH_READ:
+		return CORTEXM_DWT_FUNC_FUNC_READ | x;
+	case TARGET_WATCH_ACCESS:
+		return CORTEXM_DWT_FUNC_FUNC_ACCESS | x;
+	default:
+		return -1;
+	}
+}
+
+static int cortexm_breakwatch_set(target *t, struct breakwatch *bw)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i;
+	uint32_t val = bw->addr;
+
+	switch (bw->type) {
+	case TARGET_BREAK_SOFT:
+		/* A slot still carrying this address has its BKPT patch in
+		 * place (restores are deferred to resume): re-arm for free */
+		for (i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++) {
+			if (priv->sw_break_patched[i] &&
+			    (priv->sw_break_addr[i] == bw->addr)) {
+				priv->sw_break_armed[i] = true;
+				bw->reserved[0] = i;
+				return 0;
+			}
+		}
+
+		for (i = 0; i < CORTEXM_MAX_SW_BREAKPOINTS; i++)
+			if (!priv->sw_break_patched[i])
+				break;
+
+		if (i == CORTEXM_MAX_SW_BREAKPOINTS)
+			return -1;
+
+		priv->sw_break_insn[i] = target_mem_read16(t, bw->addr);
+		target_mem_write16(t, bw->addr, 0xBE00); /* BKPT #0 */
+		if (target_check_error(t))
+			return -1;
+
+		priv->sw_break_addr[i] = bw->addr;
+		priv->sw_break_patched[i] = true;
+		priv->sw_break_armed[i] = true;
+		bw->reserved[0] = i;
+		return 0;
+
+	case TARGET_BREAK_HARD:
+		if (priv->flash_patch_revision == 0) {
+			val &= 0x1FFFFFFC;
+			val |= (bw->addr & 2)?0x80000000:0x40000000;
+		}
+		val |= 1;
+
+		for(i = 0; i < priv->hw_breakpoint_max; i++)
+			if (!priv->hw_breakpoint[i])
+				break;
+
+		if (i == priv->hw_breakpoint_max)
+			return -1;
+
+		priv->hw_breakpoint[i] = true;
+		if (priv->fpb_comp[i] != val) {
+			target_mem_write32(t, CORTEXM_FPB_COMP(i), val);
+			priv->fpb_comp[i] = val;
+		}
+		bw->reserved[0] = i;
+		return 0;
+
+	case TARGET_WATCH_WRITE:
+	case TARGET_WATCH_READ:
+	case TARGET_WATCH_ACCESS:
+		for(i = 0; i < priv->hw_watchpoint_max; i++)
+			if (!priv->hw_watchpoint[i])
+				break;
+
+		if (i == priv->hw_watchpoint_max)
+			return -1;
+
+		priv->hw_watchpoint[i] = true;
+
+		if (priv->dwt_comp[i] != val) {
+			target_mem_write32(t, CORTEXM_DWT_COMP(i), val);
+			priv->dwt_comp[i] = val;
+		}
+		if (priv->dwt_mask[i] != dwt_mask(bw->size)) {
+			target_mem_write32(t, CORTEXM_DWT_MASK(i), dwt_mask(bw->size));
+			priv->dwt_mask[i] = dwt_mask(bw->size);
+		}
+		if (priv->dwt_func[i] != dwt_func(t, bw->type)) {
+			target_mem_write32(t, CORTEXM_DWT_FUNC(i), dwt_func(t, bw->type));
+			priv->dwt_func[i] = dwt_func(t, bw->type);
+		}
+
+		bw->reserved[0] = i;
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static int cortexm_breakwatch_clear(target *t, struct breakwatch *bw)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned i = bw->reserved[0];
+	switch (bw->type) {
+	case TARGET_BREAK_SOFT:
+		/* Deferred like the comparators: the saved opcode goes back
+		 * on resume unless the slot is re-armed by then */
+		priv->sw_break_armed[i] = false;
+		return 0;
+	case TARGET_BREAK_HARD:
+		/* Deferred: the comparator is disabled on resume unless the
+		 * slot has been re-armed with the same breakpoint by then */
+		priv->hw_breakpoint[i] = false;
+		return 0;
+	case TARGET_WATCH_WRITE:
+	case TARGET_WATCH_READ:
+	case TARGET_WATCH_ACCESS:
+		priv->hw_watchpoint[i] = false;
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static target_addr cortexm_check_watch(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+	unsigned armed = 0, last = 0, i;
+
+	for (i = 0; i < priv->hw_watchpoint_max; i++)
+		if (priv->hw_watchpoint[i]) {
+			armed++;
+			last = i;
+		}
+	if (armed == 0)
+		return 0;
+
+	/* DFSR already said this stop was a watchpoint trap.  The address
+	 * comes from the comparator shadow rather than a COMP readback,
+	 * and with a single comparator armed there is nothing to
+	 * disambiguate at all. */
+	if (armed == 1)
+		return priv->dwt_comp[last];
+
+	/* Several armed: poll FUNC for MATCHED, but the final candidate
+	 * needs no readback -- it is implied by the others not having
+	 * matched. */
+	for (i = 0; i < priv->hw_watchpoint_max; i++) {
+		if (!priv->hw_watchpoint[i])
+			continue;
+		if ((i == last) ||
+		    (target_mem_read32(t, CORTEXM_DWT_FUNC(i)) &
+					CORTEXM_DWT_FUNC_MATCHED))
+			return priv->dwt_comp[i];
+	}
+	return 0;
+}
+
+static bool cortexm_vector_catch(target *t, int argc, char *argv[])
+{
+	struct cortexm_priv *priv = t->priv;
+	const char *vectors[] = {"reset", NULL, NULL, NULL, "mm", "nocp",
+				"chk", "stat", "bus", "int", "hard"};
+	uint32_t tmp = 0;
+	unsigned i;
+
+	if ((argc < 3) || ((argv[1][0] != 'e') && (argv[1][0] != 'd'))) {
+		tc_printf(t, "usage: monitor vector_catch (enable|disable) "
+			     "(hard|int|bus|stat|chk|nocp|mm|reset)\n");
+	} else {
+		for (int j = 0; j < argc; j++)
+			for (i = 0; i < sizeof(vectors) / sizeof(char*); i++) {
+				if (vectors[i] && !strcmp(vectors[i], argv[j]))
+					tmp |= 1 << i;
+			}
+
+		if (argv[1][0] == 'e')
+			priv->demcr |= tmp;
+		else
+			priv->demcr &= ~tmp;
+
+		target_mem_write32(t, CORTEXM_DEMCR, priv->demcr);
+	}
+
+	tc_printf(t, "Catching vectors: ");
+	for (i = 0; i < sizeof(vectors) / sizeof(char*); i++) {
+		if (!vectors[i])
+			continue;
+		if (priv->demcr & (1 << i))
+			tc_printf(t, "%s ", vectors[i]);
+	}
+	tc_printf(t, "\n");
+	return true;
+}
+
+static bool cortexm_dp_stats(target *t, int argc, char *argv[])
+{
+	(void)argc;
+	(void)argv;
+	ADIv5_DP_t *dp = cortexm_ap(t)->dp;
+
+	tc_printf(t, "DP: %u transactions, %u WAIT acks\n",
+	          dp->stats_xfers, dp->stats_waits);
+	dp->stats_xfers = 0;
+	dp->stats_waits = 0;
+	return true;
+}
+
+/* DWT profiling counters.  `perf start' zeroes and enables the set so
+ * a run region can be bracketed with start/stop from the gdb console;
+ * CYCCNT counts the full 32 bits, the event counters are 8 bits and
+ * wrap, so keep regions short or lean on the cycle count. */
+static bool cortexm_perf(target *t, int argc, char *argv[])
+{
+	const uint32_t enables = CORTEXM_DWT_CTRL_CYCCNTENA |
+			CORTEXM_DWT_CTRL_CPIEVTENA |
+			CORTEXM_DWT_CTRL_EXCEVTENA |
+			CORTEXM_DWT_CTRL_SLEEPEVTENA |
+			CORTEXM_DWT_CTRL_LSUEVTENA |
+			CORTEXM_DWT_CTRL_FOLDEVTENA;
+	uint32_t ctrl = target_mem_read32(t, CORTEXM_DWT_CTRL);
+
+	if (ctrl & CORTEXM_DWT_CTRL_NOPRFCNT) {
+		tc_printf(t, "Profiling counters not implemented on this core\n");
+		return false;
+	}
+	if ((argc > 1) && !strcmp(argv[1], "start")) {
+		/* TRCENA is already set in DEMCR from attach */
+		target_mem_write32(t, CORTEXM_DWT_CYCCNT, 0);
+		target_mem_write32(t, CORTEXM_DWT_CPICNT, 0);
+		target_mem_write32(t, CORTEXM_DWT_EXCCNT, 0);
+		target_mem_write32(t, CORTEXM_DWT_SLEEPCNT, 0);
+		target_mem_write32(t, CORTEXM_DWT_LSUCNT, 0);
+		target_mem_write32(t, CORTEXM_DWT_FOLDCNT, 0);
+		target_mem_write32(t, CORTEXM_DWT_CTRL, ctrl | enables);
+		tc_printf(t, "Performance counters zeroed and running\n");
+		return true;
+	}
+	if ((argc > 1) && !strcmp(argv[1], "stop"))
+		target_mem_write32(t, CORTEXM_DWT_CTRL, ctrl & ~enables);
+
+	tc_printf(t, "cyccnt:   %u\n", target_mem_read32(t, CORTEXM_DWT_CYCCNT));
+	tc_printf(t, "cpicnt:   %u\n",
+	          target_mem_read32(t, CORTEXM_DWT_CPICNT) & 0xFF);
+	tc_printf(t, "exccnt:   %u\n",
+	          target_mem_read32(t, CORTEXM_DWT_EXCCNT) & 0xFF);
+	tc_printf(t, "sleepcnt: %u\n",
+	          target_mem_read32(t, CORTEXM_DWT_SLEEPCNT) & 0xFF);
+	tc_printf(t, "lsucnt:   %u\n",
+	          target_mem_read32(t, CORTEXM_DWT_LSUCNT) & 0xFF);
+	tc_printf(t, "foldcnt:  %u\n",
+	          target_mem_read32(t, CORTEXM_DWT_FOLDCNT) & 0xFF);
+	return true;
+}
+
+static bool cortexm_swd_divider(target *t, int argc, char *argv[])
+{
+	if (argc > 1)
+		swdptap_clk_divider = strtoul(argv[1], NULL, 0);
+	tc_printf(t, "SWCLK divider: %u\n", swdptap_clk_divider);
+	return true;
+}
+
+/* Windows defines this with some other meaning... */
+#ifdef SYS_OPEN
+#	undef SYS_OPEN
+#endif
+
+/* Semihosting support */
+/* ARM Semihosting syscall numbers, from ARM doc DUI0471C, Chapter 8 */
+#define SYS_CLOSE	0x02
+#define SYS_CLOCK	0x10
+#define SYS_ELAPSED	0x30
+#define SYS_ERRNO	0x13
+#define SYS_FLEN	0x0C
+#define SYS_GET_CMDLINE	0x15
+#define SYS_HEAPINFO	0x16
+#define SYS_ISERROR	0x08
+#define SYS_ISTTY	0x09
+#define SYS_OPEN	0x01
+#define SYS_READ	0x06
+#define SYS_READC	0x07
+#define SYS_REMOVE	0x0E
+#define SYS_RENAME	0x0F
+#define SYS_SEEK	0x0A
+#define SYS_SYSTEM	0x12
+#define SYS_TICKFREQ	0x31
+#define SYS_TIME	0x11
+#define SYS_TMPNAM	0x0D
+#define SYS_WRITE	0x05
+#define SYS_WRITEC	0x03
+#define SYS_WRITE0	0x04
+
+static void cortexm_hostio_console_flush(target *t)
+{
+	struct cortexm_priv *priv = t->priv;
+
+	if (!priv->hostio_out_len)
+		return;
+	priv->hostio_out[priv->hostio_out_len] = 0;
+	priv->hostio_out_len = 0;
+	tc_printf(t, "%s", priv->hostio_out);
+}
+
+/* Batch a semihosting console (fd 1/2) write probe-side.  The data
+ * goes out on the console output path, which needs no host reply, so
+ * the target resumes immediately instead of blocking on a gdb file-io
+ * exchange per call.  The buffer drains from the halt poll loop. */
+static int32_t cortexm_hostio_console_write(target *t,
+                                            target_addr buf, uint32_t count)
+{
+	struct cortexm_priv *priv = t->priv;
+	uint32_t remain = count;
+
+	while (remain) {
+		uint32_t n = MIN(remain,
+		            sizeof(priv->hostio_out) - 1 - priv->hostio_out_len);
+		if (n == 0) {
+			cortexm_hostio_console_flush(t);
+			continue;
+		}
+		target_mem_read(t, priv->hostio_out + priv->hostio_out_len,
+		                buf, n);
+		if (target_check_error(t))
+			return -1;
+		priv->hostio_out_len += n;
+		buf += n;
+		remain -= n;
+	}
+	t->tc->errno_ = 0;
+	return count;
+}
+
+static int cortexm_hostio_request(target *t)
+{
+	uint32_t arm_regs[t->regs_size];
+	uint32_t params[4];
+
+	t->tc->interrupted = false;
+	target_regs_read(t, arm_regs);
+	target_mem_read(t, params, arm_regs[1], sizeof(params));
+	uint32_t syscall = arm_regs[0];
+	int32_t ret = 0;
+
+	DEBUG("syscall 0"PRIx32"%"PRIx32" (%"PRIx32" %"PRIx32" %"PRIx32" %"PRIx32")\n",
+              syscall, params[0], params[1], params[2], params[3]);
+	switch (syscall) {
+	case SYS_OPEN:{	/* open */
+		/* Translate stupid fopen modes to open flags.
+		 * See DUI0471C, Table 8-3 */
+		const uint32_t flags[] = {
+			TARGET_O_RDONLY,	/* r, rb */
+			TARGET_O_RDWR,		/* r+, r+b */
+			TARGET_O_WRONLY | TARGET_O_CREAT | TARGET_O_TRUNC,/*w*/
+			TARGET_O_RDWR | TARGET_O_CREAT | TARGET_O_TRUNC,/*w+*/
+			TARGET_O_WRONLY | TARGET_O_CREAT | TARGET_O_APPEND,/*a*/
+			TARGET_O_RDWR | TARGET_O_CREAT | TARGET_O_APPEND,/*a+*/
+		};
+		uint32_t pflag = flags[params[1] >> 1];
+		char filename[4];
+
+		target_mem_read(t, filename, params[0], sizeof(filename));
+		/* handle requests for console i/o */
+		if (!strcmp(filename, ":tt")) {
+			if (pflag == TARGET_O_RDONLY)
+				ret = STDIN_FILENO;
+			else if (pflag & TARGET_O_TRUNC)
+				ret = STDOUT_FILENO;
+			else
+				ret = STDERR_FILENO;
+			ret++;
+			break;
+		}
+
+		ret = tc_open(t, params[0], params[2] + 1, pflag, 0644);
+		if (ret != -1)
+			ret++;
+		break;
+		}
+	case SYS_CLOSE:	/* close */
+		ret = tc_close(t, params[0] - 1);
+		break;
+	case SYS_READ:	/* read */
+		ret = tc_read(t, params[0] - 1, params[1], params[2]);
+		if (ret > 0)
+			ret = params[2] - ret;
+		break;
+	case SYS_WRITE:	/* write */
+		if ((params[0] - 1 == STDOUT_FILENO) ||
+		    (params[0] - 1 == STDERR_FILENO))
+			ret = cortexm_hostio_console_write(t, params[1],
+			                                   params[2]);
+		else
+			ret = tc_write(t, params[0] - 1, params[1], params[2]);
+		if (ret > 0)
+			ret = params[2] - ret;
+		break;
+	case SYS_WRITEC: /* writec */
+		ret = cortexm_hostio_console_write(t, arm_regs[1], 1);
+		break;
+	case SYS_ISTTY:	/* isatty */
+		ret = tc_isatty(t, params[0] - 1);
+		break;
+	case SYS_SEEK:	/* lseek */
+		ret = tc_lseek(t, params[0] - 1, params[1], TARGET_SEEK_SET);
+		break;
+	case SYS_RENAME:/* rename */
+		ret = tc_rename(t, params[0] - 1, params[1] + 1,
+				params[2], params[3] + 1);
+		break;
+	case SYS_REMOVE:/* unlink */
+		ret = tc_unlink(t, params[0] - 1, params[1] + 1);
+		break;
+	case SYS_SYSTEM:/* system */
+		ret = tc_system(t, params[0] - 1, params[1] + 1);
+		break;
+
+	case SYS_FLEN:	/* Not supported, fake success */
+		t->tc->errno_ = 0;
+		break;
+
+	case SYS_ERRNO: /* Return last errno from GDB */
+		ret = t->tc->errno_;
+		break;
+
+	case SYS_TIME:	/* gettimeofday */
+		/* FIXME How do we use gdb's gettimeofday? */
+		break;
+	}
+
+	arm_regs[0] = ret;
+	target_regs_write(t, arm_regs);
+
+	return t->tc->interrupted;
+}
+
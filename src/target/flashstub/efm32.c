@@ -0,0 +1,90 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Richard Meadows
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include "stub.h"
+#include "ring.h"
+
+#define EFM32_MSC_WRITECTRL(msc)		*((volatile uint32_t *)(msc+0x008))
+#define EFM32_MSC_WRITECMD(msc)	    	*((volatile uint32_t *)(msc+0x00c))
+#define EFM32_MSC_ADDRB(msc)			*((volatile uint32_t *)(msc+0x010))
+#define EFM32_MSC_WDATA(msc)			*((volatile uint32_t *)(msc+0x018))
+#define EFM32_MSC_STATUS(msc)			*((volatile uint32_t *)(msc+0x01c))
+#define EFM32_MSC_LOCK(msc)				*((volatile uint32_t *)(msc+(msc == 0x400e0000?0x40:0x3c)))
+#define EFM32_MSC_MASSLOCK(msc)	    	*((volatile uint32_t *)(msc+0x054))
+
+#define EFM32_MSC_LOCK_LOCKKEY          0x1b71
+
+#define EFM32_MSC_WRITECMD_LADDRIM      (1<<0)
+#define EFM32_MSC_WRITECMD_ERASEPAGE    (1<<1)
+#define EFM32_MSC_WRITECMD_WRITEEND     (1<<2)
+#define EFM32_MSC_WRITECMD_WRITEONCE    (1<<3)
+#define EFM32_MSC_WRITECMD_WRITETRIG    (1<<4)
+#define EFM32_MSC_WRITECMD_ERASEABORT   (1<<5)
+
+#define EFM32_MSC_STATUS_BUSY           (1<<0)
+#define EFM32_MSC_STATUS_LOCKED         (1<<1)
+#define EFM32_MSC_STATUS_INVADDR        (1<<2)
+#define EFM32_MSC_STATUS_WDATAREADY     (1<<3)
+#define EFM32_MSC_STATUS_WORDTIMEOUT	(1<<4)
+
+/* Streaming write stub (see ../flashstub/README.md).  Drains the ring
+ * buffer into the MSC, one word per WRITETRIG: ADDRB is loaded once
+ * and the MSC auto-increments the write address afterwards, so the
+ * words stream without per-word address setup.  The driver parks the
+ * MSC base address in the word following the control block, since all
+ * four stub parameters are taken by the ring protocol.
+ * buf_size must be a power of two (it is: a flash page). */
+void __attribute__((naked))
+efm32_flash_write_stub(volatile uint32_t *dest, struct stub_ring *ring,
+                       uint32_t *buf, uint32_t buf_size)
+{
+	uint32_t msc = *(volatile uint32_t *)(ring + 1);
+	uint32_t tail = 0;
+
+	EFM32_MSC_LOCK(msc) = EFM32_MSC_LOCK_LOCKKEY;
+	EFM32_MSC_WRITECTRL(msc) = 1;
+
+	EFM32_MSC_ADDRB(msc) = (uint32_t)dest;
+	EFM32_MSC_WRITECMD(msc) = EFM32_MSC_WRITECMD_LADDRIM;
+
+	for (;;) {
+		uint32_t head = ring->head;
+		if (head == tail) {
+			if (ring->done && (ring->head == tail))
+				stub_exit(0);
+			continue;
+		}
+
+		/* One head snapshot covers the whole run that has arrived;
+		 * only the MSC handshake remains in the per-word path. */
+		while (tail != head) {
+			/* Wait for WDATAREADY */
+			while ((EFM32_MSC_STATUS(msc) & EFM32_MSC_STATUS_WDATAREADY) == 0);
+
+			EFM32_MSC_WDATA(msc) = buf[(tail & (buf_size - 1)) / 4];
+			EFM32_MSC_WRITECMD(msc) = EFM32_MSC_WRITECMD_WRITETRIG;
+
+			/* Wait for BUSY */
+			while ((EFM32_MSC_STATUS(msc) & EFM32_MSC_STATUS_BUSY));
+
+			tail += 4;
+		}
+		ring->tail = tail;
+	}
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include "stub.h"
+
+#define LMI_FLASH_BASE       ((volatile uint32_t *)0x400FD000)
+#define LMI_FLASH_FMA        LMI_FLASH_BASE[0]
+#define LMI_FLASH_FMC2       LMI_FLASH_BASE[8]
+#define LMI_FLASH_FWB        ((volatile uint32_t *)0x400FD100)
+
+#define LMI_FLASH_FMC2_WRBUF (1 << 0)
+#define LMI_FLASH_FMC_WRKEY  0xA4420000
+
+/* Write buffer variant for LM4F/TM4C parts: fill the 32-word FWB and
+ * commit 128 bytes per FMC2 operation.  Writing an FWB word sets its
+ * FWBVAL bit, so a partial final buffer programs only the words
+ * supplied.  dest must be 128-byte aligned. */
+void __attribute__((naked))
+lmi_flash_write_fwb_stub(uint32_t *dest, uint32_t *src, uint32_t size)
+{
+	while (size) {
+		LMI_FLASH_FMA = (uint32_t)dest;
+		for (int j = 0; j < 32; j++) {
+			LMI_FLASH_FWB[j] = *src++;
+			dest++;
+			size -= 4;
+			if (size == 0)
+				break;
+		}
+		LMI_FLASH_FMC2 = LMI_FLASH_FMC_WRKEY | LMI_FLASH_FMC2_WRBUF;
+		while (LMI_FLASH_FMC2 & LMI_FLASH_FMC2_WRBUF)
+			;
+	}
+
+	stub_exit(0);
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2017  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include "stub.h"
+#include "ring.h"
+
+/* Non-Volatile Memory Controller (NVMC) Registers */
+#define NVMC_READY     (*(volatile uint32_t *)0x4001E400)
+#define NVMC_CONFIG    (*(volatile uint32_t *)0x4001E504)
+
+#define NVMC_CONFIG_REN 0
+#define NVMC_CONFIG_WEN 1
+
+/* Streaming write stub (see ../flashstub/README.md).  Drains the ring
+ * buffer into flash one word at a time, pacing itself against
+ * NVMC_READY, and owns the CONFIG write-enable window, so the probe
+ * side issues no NVMC traffic at all.  Works for the UICR as well as
+ * code flash.  buf_size must be a power of two (it is: a flash page
+ * or the UICR size). */
+void __attribute__((naked))
+nrf51_flash_write_stub(volatile uint32_t *dest, struct stub_ring *ring,
+                       uint32_t *buf, uint32_t buf_size)
+{
+	uint32_t tail = 0;
+
+	NVMC_CONFIG = NVMC_CONFIG_WEN;
+	while (!(NVMC_READY & 1));
+
+	for (;;) {
+		uint32_t head = ring->head;
+		if (head == tail) {
+			if (ring->done && (ring->head == tail)) {
+				NVMC_CONFIG = NVMC_CONFIG_REN;
+				while (!(NVMC_READY & 1));
+				stub_exit(0);
+			}
+			continue;
+		}
+
+		/* Program the whole run that has arrived on one head
+		 * snapshot: the ring bookkeeping is paid per burst, not
+		 * per word.  The READY poll stays per word; the NVMC
+		 * demands it between data writes. */
+		while (tail != head) {
+			*dest++ = buf[(tail & (buf_size - 1)) / 4];
+			while (!(NVMC_READY & 1));
+			tail += 4;
+		}
+		ring->tail = tail;
+	}
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdint.h>
+
+/* Streaming ring protocol between the probe and a flash stub.
+ *
+ * This control block lives in target RAM alongside a data buffer.
+ * head counts bytes produced by the probe, tail counts bytes consumed
+ * by the stub; both free-run and are reduced modulo the buffer size
+ * for addressing, so head == tail means empty and head - tail is the
+ * fill level.  The probe raises done once the final byte is in the
+ * buffer; the stub drains the remainder and leaves via stub_exit().
+ *
+ * A streaming stub is started with
+ *   r0 = flash destination address
+ *   r1 = address of this control block
+ *   r2 = data buffer address
+ *   r3 = data buffer size in bytes
+ * and is driven from the probe side by cortexm_stub_stream().
+ */
+struct stub_ring {
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t done;
+};
+
+#endif
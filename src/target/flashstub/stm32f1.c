@@ -0,0 +1,69 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include "stub.h"
+#include "ring.h"
+
+#define FLASH_SR       (*(volatile uint32_t *)0x4002200C)
+#define FLASH_CR       (*(volatile uint32_t *)0x40022010)
+
+#define FLASH_CR_PG    (1 << 0)
+#define FLASH_SR_BSY   (1 << 0)
+#define FLASH_SR_EOP   (1 << 5)
+#define SR_ERROR_MASK  0x14
+
+/* Streaming write stub (see ../flashstub/README.md).  The F1 FPEC
+ * programs one halfword per data write, so the stub drains the ring
+ * two bytes at a time, polling BSY after each program.  The error
+ * flags are sticky, so they are cleared on entry and checked once
+ * when the ring drains.  buf_size must be a power of two (it is: a
+ * flash page). */
+void __attribute__((naked))
+stm32f1_flash_write_stub(volatile uint16_t *dest, struct stub_ring *ring,
+                         uint8_t *buf, uint32_t buf_size)
+{
+	uint32_t tail = 0;
+
+	FLASH_SR = SR_ERROR_MASK | FLASH_SR_EOP;
+	FLASH_CR = FLASH_CR_PG;
+
+	for (;;) {
+		uint32_t head = ring->head;
+		if (head == tail) {
+			if (ring->done && (ring->head == tail)) {
+				if (FLASH_SR & SR_ERROR_MASK)
+					stub_exit(1);
+				stub_exit(0);
+			}
+			continue;
+		}
+
+		/* Drain everything that has arrived against a single head
+		 * snapshot, touching the control block again only at the
+		 * end of the run.  The BSY poll stays per halfword; the
+		 * FPEC requires it before the next data write. */
+		while (tail != head) {
+			*dest++ = *(uint16_t *)(buf + (tail & (buf_size - 1)));
+			while (FLASH_SR & FLASH_SR_BSY);
+			tail += 2;
+		}
+		ring->tail = tail;
+	}
+}
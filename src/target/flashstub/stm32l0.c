@@ -0,0 +1,54 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2019  Black Sphere Technologies Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include "stub.h"
+
+/* STM32L0x NVM interface */
+#define STM32L0_NVM_PECR (*(volatile uint32_t *)0x40022004)
+#define STM32L0_NVM_SR   (*(volatile uint32_t *)0x40022018)
+
+#define STM32L0_NVM_PECR_FPRG  (1 << 10)
+#define STM32L0_NVM_PECR_PROG  (1 << 3)
+#define STM32L0_NVM_SR_BSY     (1 << 0)
+#define STM32L0_NVM_SR_ERR_M   0x00010700
+
+#define HALF_PAGE_WORDS 16
+
+/* Program consecutive 64-byte half-pages.  Half-page mode requires the
+ * writing code to run from RAM, which is why this lives in a stub.
+ * dest and size must be half-page aligned and the NVM unlocked by the
+ * caller. */
+void __attribute__((naked))
+stm32l0_flash_write_stub(volatile uint32_t *dest, uint32_t *src,
+                         uint32_t size)
+{
+	STM32L0_NVM_PECR = STM32L0_NVM_PECR_PROG | STM32L0_NVM_PECR_FPRG;
+
+	while (size) {
+		for (int i = 0; i < HALF_PAGE_WORDS; i++)
+			*dest++ = *src++;
+		while (STM32L0_NVM_SR & STM32L0_NVM_SR_BSY)
+			;
+		if (STM32L0_NVM_SR & STM32L0_NVM_SR_ERR_M)
+			stub_exit(1);
+		size -= 4 * HALF_PAGE_WORDS;
+	}
+
+	stub_exit(0);
+}
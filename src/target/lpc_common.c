@@ -0,0 +1,230 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2015 Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "general.h"
+#include "target.h"
+#include "target_internal.h"
+#include "cortexm.h"
+#include "lpc_common.h"
+
+#include <stdarg.h>
+
+struct flash_param {
+	uint16_t opcode;
+	uint16_t pad0;
+	uint32_t command;
+	uint32_t words[4];
+	uint32_t result;
+} __attribute__((aligned(4)));
+
+/* RAM-resident IAP dispatcher.  Walks an array of flash_param frames
+ * (r0 = first frame, r1 = count, r2 = IAP entry), calling the ROM for
+ * each and stopping at the first failing result, then hits a
+ * breakpoint.  A prepare/program pair or a prepare/erase/blankcheck
+ * triple thus costs one halt/restart cycle instead of one per call.
+ *
+ *   cmp r1, #0; beq done
+ *   movs r4, r0; movs r5, r1; movs r6, r2
+ * loop:
+ *   adds r0, r4, #4          ; &frame->command
+ *   movs r1, r4; adds r1, #24 ; &frame->result
+ *   blx r6
+ *   ldr r0, [r4, #24]; cmp r0, #0; bne fail
+ *   adds r4, #28; subs r5, #1; bne loop
+ * done: bkpt 0
+ * fail: bkpt 1
+ */
+static const uint16_t lpc_iap_dispatch[] = {
+	0x2900, 0xD00C, 0x0004, 0x000D, 0x0016, 0x1D20, 0x0021, 0x3118,
+	0x47B0, 0x69A0, 0x2800, 0xD103, 0x341C, 0x3D01, 0xD1F5, 0xBE00,
+	0xBE01,
+};
+
+#define IAP_QUEUE_DEPTH 3
+
+struct lpc_iap_queue {
+	unsigned count;
+	struct flash_param params[IAP_QUEUE_DEPTH];
+};
+
+#define IAP_QUEUE_BASE(f) ALIGN((f)->iap_ram + sizeof(lpc_iap_dispatch), 4)
+#define IAP_PGM_BUFFER(f) ALIGN(IAP_QUEUE_BASE(f) + \
+			IAP_QUEUE_DEPTH * sizeof(struct flash_param), 4)
+
+
+struct lpc_flash *lpc_add_flash(target *t, target_addr addr, size_t length)
+{
+	struct lpc_flash *lf = target_mem_alloc(sizeof(*lf));
+	struct target_flash *f = &lf->f;
+	f->start = addr;
+	f->length = length;
+	f->erase = lpc_flash_erase;
+	f->write = lpc_flash_write;
+	f->erased = 0xff;
+	target_add_flash(t, f);
+	return lf;
+}
+
+enum iap_status lpc_iap_call(struct lpc_flash *f, enum iap_cmd cmd, ...)
+{
+	target *t = f->f.t;
+	struct flash_param param = {
+		.opcode = ARM_THUMB_BREAKPOINT,
+		.command = cmd,
+	};
+
+	/* Pet WDT before each IAP call, if it is on */
+	if (f->wdt_kick)
+		f->wdt_kick(t);
+
+	/* fill out the remainder of the parameters */
+	va_list ap;
+	va_start(ap, cmd);
+	for (int i = 0; i < 4; i++)
+		param.words[i] = va_arg(ap, uint32_t);
+	va_end(ap);
+
+	/* copy the structure to RAM */
+	target_mem_write(t, f->iap_ram, &param, sizeof(param));
+
+	/* set up for the call to the IAP ROM */
+	uint32_t regs[t->regs_size / sizeof(uint32_t)];
+	target_regs_read(t, regs);
+	regs[0] = f->iap_ram + offsetof(struct flash_param, command);
+	regs[1] = f->iap_ram + offsetof(struct flash_param, result);
+	regs[REG_MSP] = f->iap_msp;
+	regs[REG_LR] = f->iap_ram | 1;
+	regs[REG_PC] = f->iap_entry;
+	target_regs_write(t, regs);
+
+	/* start the target and wait for it to halt again */
+	target_halt_resume(t, false);
+	while (!target_halt_poll(t, NULL));
+
+	/* copy back just the parameters structure */
+	target_mem_read(t, &param, f->iap_ram, sizeof(param));
+	return param.result;
+}
+
+static void lpc_iap_enqueue(struct lpc_iap_queue *q, enum iap_cmd cmd, ...)
+{
+	struct flash_param *p = &q->params[q->count++];
+
+	p->opcode = ARM_THUMB_BREAKPOINT;
+	p->pad0 = 0;
+	p->command = cmd;
+	p->result = 0;
+
+	va_list ap;
+	va_start(ap, cmd);
+	for (int i = 0; i < 4; i++)
+		p->words[i] = va_arg(ap, uint32_t);
+	va_end(ap);
+}
+
+/* Execute all queued commands in one target run.  Returns the index
+ * of the first failing command negated (-1 for the first, and so on)
+ * or 0 when the whole queue succeeded. */
+static int lpc_iap_run_queue(struct lpc_flash *f, struct lpc_iap_queue *q)
+{
+	target *t = f->f.t;
+	uint32_t queue_base = IAP_QUEUE_BASE(f);
+
+	/* Pet WDT before each IAP run, if it is on */
+	if (f->wdt_kick)
+		f->wdt_kick(t);
+
+	target_mem_write(t, f->iap_ram, lpc_iap_dispatch,
+	                 sizeof(lpc_iap_dispatch));
+	target_mem_write(t, queue_base, q->params,
+	                 q->count * sizeof(struct flash_param));
+
+	/* set up for the call to the dispatcher */
+	uint32_t regs[t->regs_size / sizeof(uint32_t)];
+	target_regs_read(t, regs);
+	regs[0] = queue_base;
+	regs[1] = q->count;
+	regs[2] = f->iap_entry;
+	regs[REG_MSP] = f->iap_msp;
+	regs[REG_LR] = f->iap_ram | 1;
+	regs[REG_PC] = f->iap_ram;
+	target_regs_write(t, regs);
+
+	/* start the target and wait for it to halt again */
+	target_halt_resume(t, false);
+	while (!target_halt_poll(t, NULL));
+
+	/* copy back the queue for the per-command results */
+	target_mem_read(t, q->params, queue_base,
+	                q->count * sizeof(struct flash_param));
+	for (unsigned i = 0; i < q->count; i++)
+		if (q->params[i].result)
+			return -(int)(i + 1);
+	return 0;
+}
+
+static uint8_t lpc_sector_for_addr(struct lpc_flash *f, uint32_t addr)
+{
+	return f->base_sector + (addr - f->f.start) / f->f.blocksize;
+}
+
+int lpc_flash_erase(struct target_flash *tf, target_addr addr, size_t len)
+{
+	struct lpc_flash *f = (struct lpc_flash *)tf;
+	uint32_t start = lpc_sector_for_addr(f, addr);
+	uint32_t end = lpc_sector_for_addr(f, addr + len - 1);
+	struct lpc_iap_queue q = { 0 };
+
+	/* prepare, erase and blank-check in a single dispatcher run */
+	lpc_iap_enqueue(&q, IAP_CMD_PREPARE, start, end, f->bank);
+	lpc_iap_enqueue(&q, IAP_CMD_ERASE, start, end, CPU_CLK_KHZ, f->bank);
+	lpc_iap_enqueue(&q, IAP_CMD_BLANKCHECK, start, end, f->bank);
+	return lpc_iap_run_queue(f, &q);
+}
+
+int lpc_flash_write(struct target_flash *tf,
+                    target_addr dest, const void *src, size_t len)
+{
+	struct lpc_flash *f = (struct lpc_flash *)tf;
+	uint32_t sector = lpc_sector_for_addr(f, dest);
+	struct lpc_iap_queue q = { 0 };
+
+	/* Stream the payload to target ram with one bulk write */
+	uint32_t bufaddr = IAP_PGM_BUFFER(f);
+	target_mem_write(f->f.t, bufaddr, src, len);
+
+	/* prepare and program in a single dispatcher run */
+	lpc_iap_enqueue(&q, IAP_CMD_PREPARE, sector, sector, f->bank);
+	lpc_iap_enqueue(&q, IAP_CMD_PROGRAM, dest, bufaddr, len, CPU_CLK_KHZ);
+	return lpc_iap_run_queue(f, &q);
+}
+
+int lpc_flash_write_magic_vect(struct target_flash *f,
+                               target_addr dest, const void *src, size_t len)
+{
+	if (dest == 0) {
+		/* Fill in the magic vector to allow booting the flash */
+		uint32_t *w = (uint32_t *)src;
+		uint32_t sum = 0;
+
+		for (unsigned i = 0; i < 7; i++)
+			sum += w[i];
+		w[7] = ~sum + 1;
+	}
+	return lpc_flash_write(f, dest, src, len);
+}
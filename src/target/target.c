@@ -0,0 +1,941 @@
+/*
+ * This file is part of the Black Magic Debug project.
+ *
+ * Copyright (C) 2016  Black Sphere Technologies Ltd.
+ * Written by Gareth McMullin <gareth@blacksphere.co.nz>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "general.h"
+#include "target.h"
+#include "target_internal.h"
+#include "crc32.h"
+
+#include <stdarg.h>
+
+target *target_list = NULL;
+
+struct flash_timing flash_timing;
+
+/* Flash diff mode (`flash_diff' monitor command): erases are deferred
+ * to programming time and a sector whose current contents already
+ * match the incoming image is neither erased nor programmed.  Turns a
+ * full-image reflash into work proportional to what changed. */
+bool flash_diff;
+
+/* Fast attach mode (`attach_fast' monitor command): scanning assumes
+ * the wire is already in SWD mode and skips the JTAG-to-SWD escape
+ * sequence, keeping it as a fallback.  For attach farms that scan the
+ * same board thousands of times a day. */
+bool attach_fast;
+
+/* Keep-powered mode (`keep_powered' monitor command): CDBGPWRUPREQ is
+ * left asserted across detach and the scan keeps the previous DP, AP
+ * and target structures when the part still answers with the same
+ * DPIDR.  For flash-test cycles that detach and re-attach the same
+ * target every iteration. */
+bool keep_powered;
+
+static int target_flash_write_buffered(struct target_flash *f,
+                                       target_addr dest, const void *src, size_t len);
+static int target_flash_done_buffered(struct target_flash *f);
+static int target_flash_drain(struct target_flash *f);
+static int target_flash_program(struct target_flash *f);
+
+/* The target object graph -- the targets themselves, their RAM/flash/
+ * command list nodes, breakwatch entries, driver private state and the
+ * rendered memory map -- is built up during a scan and discarded
+ * wholesale by the next one.  Allocating it piecemeal fragments the
+ * heap until larger allocations (the flash sector buffers) start
+ * failing, so all of it comes from a chunked arena that
+ * target_list_free() returns in one sweep. */
+struct target_arena_chunk {
+	struct target_arena_chunk *next;
+	size_t size;
+	size_t used;
+};
+
+#define TARGET_ARENA_CHUNK_SIZE 1024
+
+static struct target_arena_chunk *target_arena;
+
+/* Cleared breakwatch entries are recycled through a free list: the
+ * arena cannot free individually and gdb sets and clears breakpoints
+ * around every stop. */
+static struct breakwatch *bw_free_list;
+
+void *target_mem_alloc(size_t size)
+{
+	/* Keep returned blocks pointer-aligned */
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	struct target_arena_chunk *c = target_arena;
+	if ((c == NULL) || (c->size - c->used < size)) {
+		size_t chunk_size = MAX(TARGET_ARENA_CHUNK_SIZE, size);
+		c = malloc(sizeof(*c) + chunk_size);
+		c->size = chunk_size;
+		c->used = 0;
+		c->next = target_arena;
+		target_arena = c;
+	}
+	void *ret = (uint8_t *)(c + 1) + c->used;
+	c->used += size;
+	memset(ret, 0, size);
+	return ret;
+}
+
+static void target_arena_free(void)
+{
+	while (target_arena) {
+		struct target_arena_chunk *next = target_arena->next;
+		free(target_arena);
+		target_arena = next;
+	}
+	bw_free_list = NULL;
+}
+
+target *target_new(void)
+{
+	target *t = target_mem_alloc(sizeof(*t));
+	if (target_list) {
+		target *c = target_list;
+		while (c->next)
+			c = c->next;
+		c->next = t;
+	} else {
+		target_list = t;
+	}
+
+	return t;
+}
+
+bool target_foreach(void (*cb)(int, target *t, void *context), void *context)
+{
+	int i = 1;
+	target *t = target_list;
+	for (; t; t = t->next, i++)
+		cb(i, t, context);
+	return target_list != NULL;
+}
+
+void target_mem_map_free(target *t)
+{
+	/* Arena memory is reclaimed wholesale at the next re-scan; here
+	 * the lists are just unlinked so the probe can rebuild them. */
+	t->mem_map = NULL;
+	t->ram = NULL;
+	t->flash = NULL;
+	t->flash_index = NULL;
+	t->flash_index_count = 0;
+	t->flash_cursor = NULL;
+}
+
+void target_list_free(void)
+{
+	while(target_list) {
+		target *t = target_list->next;
+		if (target_list->tc)
+			target_list->tc->destroy_callback(target_list->tc, target_list);
+		if (target_list->priv_free)
+			target_list->priv_free(target_list->priv);
+		target_list = t;
+	}
+	target_arena_free();
+}
+
+void target_add_commands(target *t, const struct command_s *cmds, const char *name)
+{
+	struct target_command_s *tc;
+	if (t->commands) {
+		for (tc = t->commands; tc->next; tc = tc->next);
+		tc = tc->next = target_mem_alloc(sizeof(*tc));
+	} else {
+		t->commands = tc = target_mem_alloc(sizeof(*tc));
+	}
+	tc->specific_name = name;
+	tc->cmds = cmds;
+	tc->next = NULL;
+}
+
+target *target_attach_n(int n, struct target_controller *tc)
+{
+	target *t;
+	int i;
+	for(t = target_list, i = 1; t; t = t->next, i++)
+		if(i == n)
+			return target_attach(t, tc);
+	return NULL;
+}
+
+target *target_attach(target *t, struct target_controller *tc)
+{
+	if (t->tc)
+		t->tc->destroy_callback(t->tc, t);
+
+	t->tc = tc;
+
+	if (!t->attach(t))
+		return NULL;
+
+	t->attached = true;
+	return t;
+}
+
+void target_add_ram(target *t, target_addr start, uint32_t len)
+{
+	struct target_ram *ram = target_mem_alloc(sizeof(*ram));
+	ram->start = start;
+	ram->length = len;
+	ram->next = t->ram;
+	t->ram = ram;
+	/* Invalidate any rendered memory map */
+	t->mem_map = NULL;
+}
+
+void target_add_flash(target *t, struct target_flash *f)
+{
+	if (f->buf_size == 0) {
+		/* Driver left sizing to us: start at one erase block (or the
+		 * budget, whichever is smaller) and double up through whole
+		 * multiples of the block while the platform's memory budget
+		 * and the region allow.  A hosted probe with megabytes spare
+		 * then buffers whole images and hands the driver maximal
+		 * runs; a RAM-constrained one keeps the old sub-block buffer. */
+		size_t limit = platform_flash_buf_limit();
+		if (limit == 0)
+			limit = 0x400;
+		f->buf_size = MIN(f->blocksize, limit);
+		while ((f->buf_size * 2 <= limit) &&
+		       (f->buf_size * 2 <= f->length) &&
+		       ((f->buf_size % f->blocksize) == 0))
+			f->buf_size *= 2;
+	}
+	f->t = t;
+	f->next = t->flash;
+	t->flash = f;
+	/* Invalidate any rendered memory map and region index */
+	t->mem_map = NULL;
+	t->flash_index = NULL;
+	t->flash_index_count = 0;
+	t->flash_cursor = NULL;
+}
+
+static ssize_t map_ram(char *buf, size_t len, struct target_ram *ram)
+{
+	return snprintf(buf, len, "<memory type=\"ram\" start=\"0x%08"PRIx32
+	                          "\" length=\"0x%"PRIx32"\"/>",
+	                          ram->start, (uint32_t)ram->length);
+}
+
+static ssize_t map_flash(char *buf, size_t len, struct target_flash *f)
+{
+	int i = 0;
+	i += snprintf(buf, len, "<memory type=\"flash\" start=\"0x%08"PRIx32
+	                        "\" length=\"0x%"PRIx32"\">",
+	                        f->start, (uint32_t)f->length);
+	i += snprintf(buf ? &buf[i] : NULL, len > (size_t)i ? len - i : 0,
+	                        "<property name=\"blocksize\">0x%"PRIx32
+	                        "</property></memory>",
+	                        (uint32_t)f->blocksize);
+	return i;
+}
+
+static size_t mem_map_generate(target *t, char *buf, size_t len)
+{
+	/* buf == NULL sizes the map without rendering it */
+	size_t i = 0;
+	i = snprintf(buf, len, "<memory-map>");
+	/* Map each defined RAM */
+	for (struct target_ram *r = t->ram; r; r = r->next)
+		i += map_ram(buf ? &buf[i] : NULL, len > i ? len - i : 0, r);
+	/* Map each defined Flash */
+	for (struct target_flash *f = t->flash; f; f = f->next)
+		i += map_flash(buf ? &buf[i] : NULL, len > i ? len - i : 0, f);
+	i += snprintf(buf ? &buf[i] : NULL, len > i ? len - i : 0,
+	              "</memory-map>");
+	return i;
+}
+
+const char *target_mem_map(target *t)
+{
+	/* gdb fetches the map in offset windows and refetches it freely,
+	 * so it is rendered once and kept on the target until the memory
+	 * map itself changes */
+	if (t->mem_map == NULL) {
+		size_t len = mem_map_generate(t, NULL, 0) + 1;
+		t->mem_map = target_mem_alloc(len);
+		mem_map_generate(t, t->mem_map, len);
+	}
+	return t->mem_map;
+}
+
+/* Build the sorted region index over the flash list.  Probing is done
+ * by the time the first lookup arrives, so like the rendered memory map
+ * the index is built once and kept until the region list changes. */
+static void flash_index_build(target *t)
+{
+	unsigned n = 0;
+	for (struct target_flash *f = t->flash; f; f = f->next)
+		n++;
+	t->flash_index = target_mem_alloc(n * sizeof(*t->flash_index));
+	t->flash_index_count = n;
+	n = 0;
+	for (struct target_flash *f = t->flash; f; f = f->next) {
+		/* Insertion sort by start address; region counts are small */
+		unsigned i = n++;
+		while (i && (t->flash_index[i - 1]->start > f->start)) {
+			t->flash_index[i] = t->flash_index[i - 1];
+			i--;
+		}
+		t->flash_index[i] = f;
+	}
+}
+
+static struct target_flash *flash_for_addr(target *t, uint32_t addr)
+{
+	/* Sequential chunks of a load nearly always stay in the region
+	 * the previous chunk ended in; check the cursor before searching */
+	struct target_flash *f = t->flash_cursor;
+	if (f && (f->start <= addr) && (addr < (f->start + f->length)))
+		return f;
+
+	if (t->flash_index == NULL) {
+		if (t->flash == NULL)
+			return NULL;
+		flash_index_build(t);
+	}
+
+	unsigned lo = 0, hi = t->flash_index_count;
+	while (lo < hi) {
+		unsigned mid = (lo + hi) / 2;
+		if (t->flash_index[mid]->start <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	/* lo is now one past the last region starting at or below addr */
+	if (lo == 0)
+		return NULL;
+	f = t->flash_index[lo - 1];
+	if (addr >= f->start + f->length)
+		return NULL;
+	t->flash_cursor = f;
+	return f;
+}
+
+/* Check a range for the erased pattern with bulk reads */
+static bool flash_blank_check(struct target_flash *f,
+                              target_addr addr, size_t len)
+{
+	static uint8_t bytes[256];
+	if (f->blank_check)
+		return f->blank_check(f, addr, len);
+	while (len) {
+		size_t tmplen = MIN(sizeof(bytes), len);
+		if (target_mem_read(f->t, bytes, addr, tmplen))
+			return false;
+		for (size_t i = 0; i < tmplen; i++)
+			if (bytes[i] != f->erased)
+				return false;
+		addr += tmplen;
+		len -= tmplen;
+	}
+	return true;
+}
+
+/* Finish any asynchronous flash completion left by
+ * target_flash_done_async() and collect its status.  Callers that
+ * cannot return an error stash the result back in flash_done_ret so
+ * the next operation that can return picks it up. */
+static int target_flash_sync(target *t)
+{
+	int ret = t->flash_done_ret;
+	t->flash_done_ret = 0;
+	if (t->flash_done_pending) {
+		t->flash_done_pending = false;
+		for (struct target_flash *f = t->flash; f; f = f->next) {
+			ret |= target_flash_drain(f);
+			if (f->done)
+				ret |= f->done(f);
+		}
+	}
+	return ret;
+}
+
+/* Overridden by the GDB layer with a rate-limited keep-alive; the weak
+ * default keeps the target layer free-standing. */
+void __attribute__((weak)) target_op_progress(void)
+{
+}
+
+/* Diff mode compares and erases at write-buffer granularity, which is
+ * only sound when the buffer covers whole erase blocks: with a
+ * sub-block buffer a changed chunk would erase its containing sector
+ * and wipe the chunks the compare had just skipped as unchanged.
+ * Regions whose driver keeps a small buffer stay on the up-front
+ * erase path instead. */
+static bool flash_diff_capable(struct target_flash *f)
+{
+	return (f->buf_size >= f->blocksize) &&
+	       ((f->buf_size % f->blocksize) == 0);
+}
+
+int target_flash_erase(target *t, target_addr addr, size_t len)
+{
+	int ret = target_flash_sync(t);
+	uint32_t start_us = platform_time_us();
+	while (len) {
+		struct target_flash *f = flash_for_addr(t, addr);
+		size_t tmptarget = MIN(addr + len, f->start + f->length);
+		size_t tmplen = tmptarget - addr;
+		/* Diff mode defers erase to block programming time, where
+		 * the incoming data is in hand to compare against */
+		if (flash_diff && flash_diff_capable(f)) {
+			addr += tmplen;
+			len -= tmplen;
+			continue;
+		}
+		/* Erase sector-by-sector, skipping sectors already blank:
+		 * incremental updates touch a minority of pages */
+		while (tmplen) {
+			size_t sectlen = MIN(f->blocksize - (addr % f->blocksize),
+			                     tmplen);
+			if (!flash_blank_check(f, addr, sectlen))
+				ret |= f->erase(f, addr, sectlen);
+			addr += sectlen;
+			tmplen -= sectlen;
+			len -= sectlen;
+			target_op_progress();
+		}
+	}
+	flash_timing.erase_us += platform_time_us() - start_us;
+	return ret;
+}
+
+int target_flash_write(target *t,
+                       target_addr dest, const void *src, size_t len)
+{
+	int ret = target_flash_sync(t);
+	while (len) {
+		struct target_flash *f = flash_for_addr(t, dest);
+		size_t tmptarget = MIN(dest + len, f->start + f->length);
+		size_t tmplen = tmptarget - dest;
+		ret |= target_flash_write_buffered(f, dest, src, tmplen);
+		dest += tmplen;
+		src += tmplen;
+		len -= tmplen;
+	}
+	return ret;
+}
+
+int target_flash_done(target *t)
+{
+	int ret = target_flash_sync(t);
+	if (ret)
+		return ret;
+	for (struct target_flash *f = t->flash; f; f = f->next) {
+		int tmp = target_flash_done_buffered(f);
+		if (tmp)
+			return tmp;
+		if (f->done) {
+			int tmp = f->done(f);
+			if (tmp)
+				return tmp;
+		}
+	}
+	return 0;
+}
+
+/* Asynchronous variant for the vFlashDone early ack: start programming
+ * any sector still buffered and return, deferring the final drain and
+ * the driver done hooks to the next operation against the target.  The
+ * host's reply round trip and reset preparation then overlap the tail
+ * of the programming. */
+int target_flash_done_async(target *t)
+{
+	int ret = target_flash_sync(t);
+	for (struct target_flash *f = t->flash; f; f = f->next) {
+		if ((f->buf != NULL) && (f->buf_addr != (uint32_t)-1)) {
+			ret |= target_flash_program(f);
+			f->buf_addr = -1;
+		}
+	}
+	t->flash_done_pending = true;
+	return ret;
+}
+
+/* Complete any sector write still in flight in the driver */
+static int target_flash_drain(struct target_flash *f)
+{
+	int ret = 0;
+	if (f->write_inflight) {
+		uint32_t start_us = platform_time_us();
+		ret = f->write_poll(f);
+		f->write_inflight = false;
+		flash_timing.program_us += platform_time_us() - start_us;
+	}
+	return ret;
+}
+
+/* Program the filled sector buffer.  With a split-phase driver the
+ * write call returns once the operation is started and the buffers
+ * swap, so the freed buffer refills from the wire while the driver's
+ * busy-poll is deferred to the next drain point. */
+static int target_flash_program(struct target_flash *f)
+{
+	int ret;
+
+	if (flash_diff && flash_diff_capable(f)) {
+		/* Unchanged block: no erase, no program.  The compare is
+		 * one local CRC against one target CRC, which the driver's
+		 * on-chip verify engine serves without read traffic. */
+		if (crc32_buf(f->buf, f->buf_size) ==
+		    target_crc32(f->t, f->buf_addr, f->buf_size))
+			return target_flash_drain(f);
+
+		ret = target_flash_drain(f);
+		uint32_t erase_start_us = platform_time_us();
+		if (!flash_blank_check(f, f->buf_addr, f->buf_size))
+			ret |= f->erase(f, f->buf_addr, f->buf_size);
+		flash_timing.erase_us += platform_time_us() - erase_start_us;
+		if (ret)
+			return ret;
+	} else {
+		/* Programming the erased pattern is a no-op; skip the
+		 * driver call */
+		size_t i;
+		for (i = 0; i < f->buf_size; i++)
+			if (((uint8_t *)f->buf)[i] != f->erased)
+				break;
+		if (i == f->buf_size)
+			return target_flash_drain(f);
+
+		ret = target_flash_drain(f);
+	}
+	uint32_t start_us = platform_time_us();
+	ret |= f->write(f, f->buf_addr, f->buf, f->buf_size);
+	flash_timing.program_us += platform_time_us() - start_us;
+	if (f->write_poll) {
+		void *tmp = f->buf;
+		f->buf = f->inflight_buf;
+		f->inflight_buf = tmp;
+		f->write_inflight = (ret == 0);
+	}
+	return ret;
+}
+
+int target_flash_write_buffered(struct target_flash *f,
+                                target_addr dest, const void *src, size_t len)
+{
+	int ret = 0;
+
+	if (f->buf == NULL) {
+		/* Allocate flash sector buffer.  Arena-backed and kept for
+		 * the life of the target, so repeated flash sessions cost no
+		 * further allocation. */
+		f->buf = target_mem_alloc(f->buf_size);
+		/* Second buffer for the write pipeline */
+		if (f->write_poll)
+			f->inflight_buf = target_mem_alloc(f->buf_size);
+		f->buf_addr = -1;
+	}
+	while (len) {
+		uint32_t offset = dest % f->buf_size;
+		uint32_t base = dest - offset;
+		if (base != f->buf_addr) {
+			if (f->buf_addr != (uint32_t)-1) {
+				/* Write sector to flash if valid */
+				ret |= target_flash_program(f);
+			}
+			/* Setup buffer for a new sector */
+			f->buf_addr = base;
+			memset(f->buf, f->erased, f->buf_size);
+		}
+		/* Copy chunk into sector buffer */
+		size_t sectlen = MIN(f->buf_size - offset, len);
+		memcpy(f->buf + offset, src, sectlen);
+		dest += sectlen;
+		src += sectlen;
+		len -= sectlen;
+	}
+	return ret;
+}
+
+uint32_t target_crc32(target *t, target_addr addr, size_t len)
+{
+	struct target_flash *f = flash_for_addr(t, addr);
+	uint32_t crc;
+
+	/* A verify must see the final sector's programming finished */
+	t->flash_done_ret |= target_flash_sync(t);
+	uint32_t start_us = platform_time_us();
+
+	/* Use the driver's on-chip verify engine when the whole range
+	 * falls inside one flash region providing it: the CRC then costs
+	 * no memory read traffic at all.  The engines work in whole
+	 * words, so a range that is unaligned or has a byte tail must
+	 * take the byte-exact generic path or the result differs from
+	 * gdb's. */
+	if (f && f->verify && (addr + len <= f->start + f->length) &&
+	    ((addr & 3) == 0) && ((len & 3) == 0) && (len >= 4) &&
+	    (f->verify(f, addr, len, &crc) == 0)) {
+		flash_timing.verify_us += platform_time_us() - start_us;
+		return crc;
+	}
+	crc = generic_crc32(t, addr, len);
+	flash_timing.verify_us += platform_time_us() - start_us;
+	return crc;
+}
+
+int target_flash_done_buffered(struct target_flash *f)
+{
+	int ret = 0;
+	if ((f->buf != NULL) &&(f->buf_addr != (uint32_t)-1)) {
+		/* Write sector to flash if valid */
+		ret = target_flash_program(f);
+		f->buf_addr = -1;
+	}
+	ret |= target_flash_drain(f);
+
+	return ret;
+}
+
+/* Wrapper functions */
+void target_detach(target *t)
+{
+	t->flash_done_ret |= target_flash_sync(t);
+	t->detach(t);
+	t->attached = false;
+#if defined(LIBFTDI)
+# include "platform.h"
+	platform_buffer_flush();
+#endif
+}
+
+bool target_check_error(target *t) { return t->check_error(t); }
+bool target_attached(target *t) { return t->attached; }
+
+/* Memory access functions */
+int target_mem_read(target *t, void *dest, target_addr src, size_t len)
+{
+	int ret = target_flash_sync(t);
+	t->mem_read(t, dest, src, len);
+	return target_check_error(t) | ret;
+}
+
+int target_mem_write(target *t, target_addr dest, const void *src, size_t len)
+{
+	int ret = target_flash_sync(t);
+	t->mem_write(t, dest, src, len);
+	return target_check_error(t) | ret;
+}
+
+/* Register access functions */
+void target_regs_read(target *t, void *data) { t->regs_read(t, data); }
+void target_regs_write(target *t, const void *data) { t->regs_write(t, data); }
+
+ssize_t target_reg_read(target *t, int reg, void *data, size_t max)
+{
+	if (!t->reg_read)
+		return 0;
+	return t->reg_read(t, reg, data, max);
+}
+
+ssize_t target_reg_write(target *t, int reg, const void *data, size_t size)
+{
+	if (!t->reg_write)
+		return 0;
+	return t->reg_write(t, reg, data, size);
+}
+
+/* Halt/resume functions */
+void target_reset(target *t)
+{
+	t->flash_done_ret |= target_flash_sync(t);
+	t->reset(t);
+}
+void target_halt_request(target *t) { t->halt_request(t); }
+enum target_halt_reason target_halt_poll(target *t, target_addr *watch)
+{
+	if (t->step_pending) {
+		/* Deferred fused step: resume, spin and decode in one go */
+		t->step_pending = false;
+		return t->halt_step(t, watch);
+	}
+	return t->halt_poll(t, watch);
+}
+
+void target_halt_resume(target *t, bool step)
+{
+	t->flash_done_ret |= target_flash_sync(t);
+	/* A step on a driver with a fused primitive is deferred to the
+	 * first poll, where the halt reason and watch address land */
+	t->step_pending = step && t->halt_step;
+	if (!t->step_pending)
+		t->halt_resume(t, step);
+}
+
+bool target_halt_range_resume(target *t, target_addr start, target_addr end)
+{
+	if (!t->halt_range_resume)
+		return false;
+	t->halt_range_resume(t, start, end);
+	return true;
+}
+
+/* Break-/watchpoint functions */
+int target_breakwatch_set(target *t,
+                          enum target_breakwatch type, target_addr addr, size_t len)
+{
+	struct breakwatch bw = {
+		.type = type,
+		.addr = addr,
+		.size = len,
+	};
+	int ret = 1;
+
+	if (t->breakwatch_set)
+		ret = t->breakwatch_set(t, &bw);
+
+	if (ret == 0) {
+		/* Success, make a durable copy and add to list */
+		struct breakwatch *bwm;
+		if (bw_free_list) {
+			bwm = bw_free_list;
+			bw_free_list = bwm->next;
+		} else {
+			bwm = target_mem_alloc(sizeof(bw));
+		}
+		memcpy(bwm, &bw, sizeof(bw));
+		bwm->next = t->bw_list;
+		t->bw_list = bwm;
+	}
+
+	return ret;
+}
+
+int target_breakwatch_clear(target *t,
+                            enum target_breakwatch type, target_addr addr, size_t len)
+{
+	struct breakwatch *bwp = NULL, *bw;
+	int ret = 1;
+	for (bw = t->bw_list; bw; bwp = bw, bw = bw->next)
+		if ((bw->type == type) &&
+		    (bw->addr == addr) &&
+		    (bw->size == len))
+			break;
+
+	if (bw == NULL)
+		return -1;
+
+	if (t->breakwatch_clear)
+		ret = t->breakwatch_clear(t, bw);
+
+	if (ret == 0) {
+		if (bwp == NULL) {
+			t->bw_list = bw->next;
+		} else {
+			bwp->next = bw->next;
+		}
+		bw->next = bw_free_list;
+		bw_free_list = bw;
+	}
+	return ret;
+}
+
+/* Accessor functions */
+size_t target_regs_size(target *t)
+{
+	return t->regs_size;
+}
+
+const char *target_tdesc(target *t)
+{
+	return t->tdesc ? t->tdesc : "";
+}
+
+const char *target_driver_name(target *t)
+{
+	return t->driver;
+}
+
+uint32_t target_mem_read32(target *t, uint32_t addr)
+{
+	uint32_t ret;
+	t->mem_read(t, &ret, addr, sizeof(ret));
+	return ret;
+}
+
+void target_mem_write32(target *t, uint32_t addr, uint32_t value)
+{
+	t->mem_write(t, addr, &value, sizeof(value));
+}
+
+uint16_t target_mem_read16(target *t, uint32_t addr)
+{
+	uint16_t ret;
+	t->mem_read(t, &ret, addr, sizeof(ret));
+	return ret;
+}
+
+void target_mem_write16(target *t, uint32_t addr, uint16_t value)
+{
+	t->mem_write(t, addr, &value, sizeof(value));
+}
+
+uint8_t target_mem_read8(target *t, uint32_t addr)
+{
+	uint8_t ret;
+	t->mem_read(t, &ret, addr, sizeof(ret));
+	return ret;
+}
+
+void target_mem_write8(target *t, uint32_t addr, uint8_t value)
+{
+	t->mem_write(t, addr, &value, sizeof(value));
+}
+
+void target_command_help(target *t)
+{
+	for (struct target_command_s *tc = t->commands; tc; tc = tc->next) {
+		tc_printf(t, "%s specific commands:\n", tc->specific_name);
+		for(const struct command_s *c = tc->cmds; c->cmd; c++)
+			tc_printf(t, "\t%s -- %s\n", c->cmd, c->help);
+	}
+}
+
+int target_command(target *t, int argc, const char *argv[])
+{
+	size_t cmdlen = strlen(argv[0]);
+	for (struct target_command_s *tc = t->commands; tc; tc = tc->next)
+		for(const struct command_s *c = tc->cmds; c->cmd; c++)
+			if((argv[0][0] == c->cmd[0]) &&
+			   !strncmp(argv[0], c->cmd, cmdlen))
+				return !c->handler(t, argc, argv);
+	return -1;
+}
+
+void tc_printf(target *t, const char *fmt, ...)
+{
+	(void)t;
+	va_list ap;
+
+	if (t->tc == NULL)
+		return;
+
+	va_start(ap, fmt);
+	t->tc->printf(t->tc, fmt, ap);
+	va_end(ap);
+}
+
+/* Interface to host system calls */
+int tc_open(target *t, target_addr path, size_t plen,
+            enum target_open_flags flags, mode_t mode)
+{
+	if (t->tc->open == NULL) {
+		t->tc->errno_ = TARGET_ENFILE;
+		return -1;
+	}
+	return t->tc->open(t->tc, path, plen, flags, mode);
+}
+
+int tc_close(target *t, int fd)
+{
+	if (t->tc->close == NULL) {
+		t->tc->errno_ = TARGET_EBADF;
+		return -1;
+	}
+	return t->tc->close(t->tc, fd);
+}
+
+int tc_read(target *t, int fd, target_addr buf, unsigned int count)
+{
+	if (t->tc->read == NULL)
+		return 0;
+	return t->tc->read(t->tc, fd, buf, count);
+}
+
+int tc_write(target *t, int fd, target_addr buf, unsigned int count)
+{
+	if (t->tc->write == NULL)
+		return 0;
+	return t->tc->write(t->tc, fd, buf, count);
+}
+
+long tc_lseek(target *t, int fd, long offset, enum target_seek_flag flag)
+{
+	if (t->tc->lseek == NULL)
+		return 0;
+	return t->tc->lseek(t->tc, fd, offset, flag);
+}
+
+int tc_rename(target *t, target_addr oldpath, size_t oldlen,
+                         target_addr newpath, size_t newlen)
+{
+	if (t->tc->rename == NULL) {
+		t->tc->errno_ = TARGET_ENOENT;
+		return -1;
+	}
+	return t->tc->rename(t->tc, oldpath, oldlen, newpath, newlen);
+}
+
+int tc_unlink(target *t, target_addr path, size_t plen)
+{
+	if (t->tc->unlink == NULL) {
+		t->tc->errno_ = TARGET_ENOENT;
+		return -1;
+	}
+	return t->tc->unlink(t->tc, path, plen);
+}
+
+int tc_stat(target *t, target_addr path, size_t plen, target_addr buf)
+{
+	if (t->tc->stat == NULL) {
+		t->tc->errno_ = TARGET_ENOENT;
+		return -1;
+	}
+	return t->tc->stat(t->tc, path, plen, buf);
+}
+
+int tc_fstat(target *t, int fd, target_addr buf)
+{
+	if (t->tc->fstat == NULL) {
+		return 0;
+	}
+	return t->tc->fstat(t->tc, fd, buf);
+}
+
+int tc_gettimeofday(target *t, target_addr tv, target_addr tz)
+{
+	if (t->tc->gettimeofday == NULL) {
+		return -1;
+	}
+	return t->tc->gettimeofday(t->tc, tv, tz);
+}
+
+int tc_isatty(target *t, int fd)
+{
+	if (t->tc->isatty == NULL) {
+		return 1;
+	}
+	return t->tc->isatty(t->tc, fd);
+}
+
+int tc_system(target *t, target_addr cmd, size_t cmdlen)
+{
+	if (t->tc->system == NULL) {
+		return -1;
+	}
+	return t->tc->system(t->tc, cmd, cmdlen);
+}
@@ -26,6 +26,10 @@
 #endif
 
 #include <assert.h>
+#ifndef WIN32
+#   include <unistd.h>
+#   include <sys/wait.h>
+#endif
 
 #include "dfu.h"
 #include "stm32mem.h"
@@ -35,6 +39,9 @@
 
 #define LOAD_ADDRESS 0x8002000
 
+/* Manufacturing stations hang a hub full of probes off one port */
+#define MAX_DEVS 64
+
 void banner(void)
 {
 	puts("\nBlack Magic Probe -- Firmware Upgrade Utility -- Version " VERSION);
@@ -43,13 +50,14 @@ void banner(void)
 }
 
 
-struct usb_device * find_dev(void)
+int find_all_devs(struct usb_device **devs, int max)
 {
 	struct usb_bus *bus;
 	struct usb_device *dev;
 	struct usb_dev_handle *handle;
 	char man[40];
 	char prod[40];
+	int n = 0;
 
 	usb_find_busses();
 	usb_find_devices();
@@ -73,17 +81,17 @@ struct usb_device * find_dev(void)
 			usb_close(handle);
 
 			if (((dev->descriptor.idProduct == 0x5740) ||
-			     (dev->descriptor.idProduct == 0x6018)) &&
-			   !strcmp(man, "Black Sphere Technologies"))
-				return dev;
-
-			if (((dev->descriptor.idProduct == 0xDF11) ||
+			     (dev->descriptor.idProduct == 0x6018) ||
+			     (dev->descriptor.idProduct == 0xDF11) ||
 			     (dev->descriptor.idProduct == 0x6017)) &&
-			   !strcmp(man, "Black Sphere Technologies"))
-				return dev;
+			   !strcmp(man, "Black Sphere Technologies")) {
+				devs[n++] = dev;
+				if (n == max)
+					return n;
+			}
 		}
 	}
-	return NULL;
+	return n;
 }
 
 usb_dev_handle * get_dfu_interface(struct usb_device *dev, uint16_t *interface)
@@ -116,19 +124,49 @@ usb_dev_handle * get_dfu_interface(struct usb_device *dev, uint16_t *interface)
 	return NULL;
 }
 
-int main(void)
+int upgrade_device(struct usb_device *dev, int show_progress)
 {
-	struct usb_device *dev;
 	usb_dev_handle *handle;
 	uint16_t iface;
-	int state;
 	uint32_t offset;
 
+	if(!(handle = get_dfu_interface(dev, &iface)))
+		return -1;
+
+	dfu_makeidle(handle, iface);
+
+	for(offset = 0; offset < bindatalen; offset += 1024) {
+		if(show_progress) {
+			printf("Progress: %d%%\r", (offset*100)/bindatalen);
+			fflush(stdout);
+		}
+		assert(stm32_mem_erase(handle, iface, LOAD_ADDRESS + offset) == 0);
+		stm32_mem_write(handle, iface, (void*)&bindata[offset], 1024);
+	}
+	stm32_mem_manifest(handle, iface);
+
+	usb_release_interface(handle, iface);
+	usb_close(handle);
+
+	printf("Device %s:%s upgrade complete\n",
+		dev->bus->dirname, dev->filename);
+
+	return 0;
+}
+
+int main(void)
+{
+	struct usb_device *devs[MAX_DEVS];
+	usb_dev_handle *handle;
+	uint16_t iface;
+	int n, i, detached;
+
 	banner();
 	usb_init();
 
 retry:
-	if(!(dev = find_dev()) || !(handle = get_dfu_interface(dev, &iface))) {
+	n = find_all_devs(devs, MAX_DEVS);
+	if(n == 0) {
 		puts("FATAL: No compatible device found!\n");
 #ifdef WIN32
 		system("pause");
@@ -136,12 +174,24 @@ retry:
 		return -1;
 	}
 
-	state = dfu_getstate(handle, iface);
-	if((state < 0) || (state == STATE_APP_IDLE)) {
-		puts("Resetting device in firmware upgrade mode...");
-		dfu_detach(handle, iface, 1000);
+	/* Kick any device still running the application into the
+	 * bootloader, then rescan once they have re-enumerated */
+	detached = 0;
+	for(i = 0; i < n; i++) {
+		int state;
+		if(!(handle = get_dfu_interface(devs[i], &iface)))
+			continue;
+		state = dfu_getstate(handle, iface);
+		if((state < 0) || (state == STATE_APP_IDLE)) {
+			dfu_detach(handle, iface, 1000);
+			detached++;
+		}
 		usb_release_interface(handle, iface);
 		usb_close(handle);
+	}
+	if(detached) {
+		printf("Resetting %d device(s) in firmware upgrade mode...\n",
+			detached);
 #ifdef WIN32
 		Sleep(5000);
 #else
@@ -149,20 +199,36 @@ retry:
 #endif
 		goto retry;
 	}
-	printf("Found device at %s:%s\n", dev->bus->dirname, dev->filename);
 
-	dfu_makeidle(handle, iface);
-
-	for(offset = 0; offset < bindatalen; offset += 1024) {
-		printf("Progress: %d%%\r", (offset*100)/bindatalen);
-		fflush(stdout);
-		assert(stm32_mem_erase(handle, iface, LOAD_ADDRESS + offset) == 0);
-		stm32_mem_write(handle, iface, (void*)&bindata[offset], 1024);
+	for(i = 0; i < n; i++)
+		printf("Found device at %s:%s\n",
+			devs[i]->bus->dirname, devs[i]->filename);
+
+#ifndef WIN32
+	if(n > 1) {
+		int status, failed = 0;
+		/* Each probe is an independent pipe with its own DNLOAD
+		 * state machine: drive them all at once, one child per
+		 * device, and gather the verdicts */
+		for(i = 0; i < n; i++)
+			if(fork() == 0)
+				return upgrade_device(devs[i], 0);
+		while(wait(&status) > 0)
+			if(!WIFEXITED(status) || WEXITSTATUS(status))
+				failed++;
+		if(failed) {
+			printf("FATAL: %d device(s) failed to upgrade!\n",
+				failed);
+			return -1;
+		}
+		puts("All operations complete!\n");
+		return 0;
 	}
-	stm32_mem_manifest(handle, iface);
+#endif
 
-	usb_release_interface(handle, iface);
-	usb_close(handle);
+	for(i = 0; i < n; i++)
+		if(upgrade_device(devs[i], n == 1))
+			return -1;
 
 	puts("All operations complete!\n");
 
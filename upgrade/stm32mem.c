@@ -34,28 +34,30 @@
 #define STM32_CMD_SETADDRESSPOINTER	0x21
 #define STM32_CMD_ERASE			0x41
 
-static int stm32_download(usb_dev_handle *dev, uint16_t iface, 
+static int stm32_download(usb_dev_handle *dev, uint16_t iface,
 			  uint16_t wBlockNum, void *data, int size)
 {
 	dfu_status status;
 	int i;
 
 	if((i = dfu_dnload(dev, iface, wBlockNum, data, size)) < 0) return i;
-	while(1) {
-		if((i = dfu_getstatus(dev, iface, &status)) < 0) return i;
-		switch(status.bState) {
-		case STATE_DFU_DOWNLOAD_BUSY:
-#ifdef WIN32
-			Sleep(status.bwPollTimeout);
-#else
-			usleep(status.bwPollTimeout * 1000);
-#endif
-			break;
-		case STATE_DFU_DOWNLOAD_IDLE:
-			return 0;
-		default:	
-			return -1;
-		}
+	/* This GETSTATUS moves the device into dfuDNBUSY and its
+	 * completion handler runs the flash operation, after which the
+	 * device sits in dfuDNLOAD-IDLE ready for the next block.  There
+	 * is no need to sleep out bwPollTimeout and poll for that state:
+	 * the default pipe carries one transfer at a time and the device
+	 * NAKs the next request until the operation completes, so
+	 * submitting the next block immediately lets the hardware do the
+	 * pacing.  An operation that errors is reported by the next
+	 * GETSTATUS to come through. */
+	if((i = dfu_getstatus(dev, iface, &status)) < 0) return i;
+	if(status.bStatus != DFU_STATUS_OK) return -1;
+	switch(status.bState) {
+	case STATE_DFU_DOWNLOAD_BUSY:
+	case STATE_DFU_DOWNLOAD_IDLE:
+		return 0;
+	default:
+		return -1;
 	}
 }
 